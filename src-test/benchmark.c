@@ -0,0 +1,843 @@
+/*
+  Quite-Alright JSON for C - https://github.com/USESystemEngineeringBV/qajson4c
+
+  Licensed under the MIT License <http://opensource.org/licenses/MIT>.
+
+  Copyright (c) 2016 Pascal Proksch - USE System Engineering BV
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in
+  all copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+  THE SOFTWARE.
+*/
+
+
+/*
+ * Micro benchmarks for the lookup and parse hot paths. Each benchmark prints the time per
+ * operation, the benchmarks to run can be selected by name on the command line (all are
+ * executed in case no name is given).
+ *
+ * The numbers are only meaningful with an optimized build (-DCMAKE_BUILD_TYPE=Release).
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <qajson4c/qajson4c.h>
+
+#define ARRAY_COUNT(a)  (sizeof(a) / sizeof(a[0]))
+
+#ifndef QAJ4C_BENCHMARK_DATA_DIR
+#define QAJ4C_BENCHMARK_DATA_DIR "data"
+#endif
+
+typedef struct benchmark {
+    const char* name;
+    void (*run)( void );
+} benchmark;
+
+/* Prevents the compiler from optimizing the measured lookups away */
+static volatile uintptr_t g_sink;
+
+static const char* g_field_names[] = {
+    "id", "name", "type", "created", "modified", "owner", "group", "size", "checksum",
+    "version", "status", "priority", "tags", "parent", "children", "path", "mime_type",
+    "encoding", "language", "title", "description", "author", "license", "url", "hash",
+    "flags", "score", "rank", "region", "timezone"
+};
+
+static double elapsed_ns( clock_t start, size_t operations ) {
+    return (double)(clock() - start) * 1e9 / CLOCKS_PER_SEC / (double)operations;
+}
+
+/*
+ * Writes the name of the n-th field (g_field_names with a numeric suffix for n beyond them).
+ */
+static void field_name( char* buffer, size_t n ) {
+    size_t names = ARRAY_COUNT(g_field_names);
+    if (n < names) {
+        strcpy(buffer, g_field_names[n]);
+    } else {
+        sprintf(buffer, "%s_%u", g_field_names[n % names], (unsigned)(n / names));
+    }
+}
+
+/*
+ * Creates an array with the given amount of objects that all share the same members (the
+ * first members named by field_name).
+ */
+static char* create_same_shape_array( size_t objects, size_t members ) {
+    size_t buffer_size = objects * members * 32 + objects * 4 + 16;
+    char* json = malloc(buffer_size);
+    char name[32];
+    size_t pos = 0;
+    size_t i;
+    size_t j;
+
+    json[pos++] = '[';
+    for (i = 0; i < objects; ++i) {
+        json[pos++] = i > 0 ? ',' : ' ';
+        json[pos++] = '{';
+        for (j = 0; j < members; ++j) {
+            field_name(name, j);
+            pos += sprintf(json + pos, "%s\"%s\":%u", j > 0 ? "," : "", name, (unsigned)(i + j));
+        }
+        json[pos++] = '}';
+    }
+    json[pos++] = ']';
+    json[pos] = '\0';
+    return json;
+}
+
+static void benchmark_key_lookup_opts( const char* title, int opts, size_t objects, size_t rounds ) {
+    const size_t lookups = objects * rounds * ARRAY_COUNT(g_field_names);
+    char* json = create_same_shape_array(objects, ARRAY_COUNT(g_field_names));
+    const QAJ4C_Value* document = QAJ4C_parse_opt_dynamic(json, strlen(json), opts, realloc);
+    QAJ4C_Key keys[ARRAY_COUNT(g_field_names)];
+    const QAJ4C_Value* results[ARRAY_COUNT(g_field_names)];
+    clock_t start;
+    size_t r;
+    size_t i;
+    size_t j;
+
+    for (j = 0; j < ARRAY_COUNT(g_field_names); ++j) {
+        QAJ4C_key_init(&keys[j], g_field_names[j]);
+    }
+
+    start = clock();
+    for (r = 0; r < rounds; ++r) {
+        for (i = 0; i < objects; ++i) {
+            const QAJ4C_Value* object = QAJ4C_array_get(document, i);
+            for (j = 0; j < ARRAY_COUNT(g_field_names); ++j) {
+                g_sink += (uintptr_t)QAJ4C_object_get(object, g_field_names[j]);
+            }
+        }
+    }
+    printf("%-28s QAJ4C_object_get:     %6.1f ns/lookup\n", title, elapsed_ns(start, lookups));
+
+    start = clock();
+    for (r = 0; r < rounds; ++r) {
+        for (i = 0; i < objects; ++i) {
+            const QAJ4C_Value* object = QAJ4C_array_get(document, i);
+            for (j = 0; j < ARRAY_COUNT(g_field_names); ++j) {
+                g_sink += (uintptr_t)QAJ4C_object_get_key(object, &keys[j]);
+            }
+        }
+    }
+    printf("%-28s QAJ4C_object_get_key: %6.1f ns/lookup\n", title, elapsed_ns(start, lookups));
+
+    start = clock();
+    for (r = 0; r < rounds; ++r) {
+        for (i = 0; i < objects; ++i) {
+            QAJ4C_object_get_many(QAJ4C_array_get(document, i), g_field_names, ARRAY_COUNT(g_field_names), results);
+            g_sink += (uintptr_t)results[0];
+        }
+    }
+    printf("%-28s QAJ4C_object_get_many:%6.1f ns/lookup\n", title, elapsed_ns(start, lookups));
+
+    free((void*)document);
+    free(json);
+}
+
+static void benchmark_key_lookup( void ) {
+    /* small document (fits into the cache) and large document (memory bound) */
+    benchmark_key_lookup_opts("key-lookup 1k (sorted)", 0, 1000, 200);
+    benchmark_key_lookup_opts("key-lookup 1k (unsorted)", QAJ4C_PARSE_OPTS_DONT_SORT_OBJECT_MEMBERS, 1000, 200);
+    benchmark_key_lookup_opts("key-lookup 1k (keep order)", QAJ4C_PARSE_OPTS_KEEP_ORDER, 1000, 200);
+    benchmark_key_lookup_opts("key-lookup 50k (sorted)", 0, 50000, 4);
+    benchmark_key_lookup_opts("key-lookup 50k (unsorted)", QAJ4C_PARSE_OPTS_DONT_SORT_OBJECT_MEMBERS, 50000, 4);
+}
+
+static void benchmark_small_objects_opts( size_t members, bool sorted, const char* title ) {
+    const size_t objects = 1000;
+    const size_t lookups = 4000000;
+    const size_t rounds = lookups / (objects * members);
+    char* json = create_same_shape_array(objects, members);
+    const QAJ4C_Value* document = QAJ4C_parse_opt_dynamic(json, strlen(json), QAJ4C_PARSE_OPTS_DONT_SORT_OBJECT_MEMBERS, realloc);
+    char names[64][32];
+    clock_t start;
+    size_t r;
+    size_t i;
+    size_t j;
+
+    /* sort explicitly, the parser leaves objects below QAJ4C_SORT_MIN_MEMBERS unsorted */
+    for (i = 0; sorted && i < objects; ++i) {
+        QAJ4C_object_optimize((QAJ4C_Value*)QAJ4C_array_get(document, i));
+    }
+    for (j = 0; j < members; ++j) {
+        field_name(names[j], j);
+    }
+
+    start = clock();
+    for (r = 0; r < rounds; ++r) {
+        for (i = 0; i < objects; ++i) {
+            const QAJ4C_Value* object = QAJ4C_array_get(document, i);
+            for (j = 0; j < members; ++j) {
+                g_sink += (uintptr_t)QAJ4C_object_get(object, names[j]);
+            }
+        }
+    }
+    printf("small-objects %2u members %-10s %6.1f ns/lookup\n", (unsigned)members, title, elapsed_ns(start, rounds * objects * members));
+
+    free((void*)document);
+    free(json);
+}
+
+/*
+ * Lookups in small objects, used to find the member count up to which scanning the unsorted
+ * members is faster than the binary search (see QAJ4C_SORT_MIN_MEMBERS).
+ */
+static void benchmark_small_objects( void ) {
+    const size_t members[] = {2, 3, 4, 6, 8, 12, 16, 24, 32, 48, 64};
+    size_t i;
+    for (i = 0; i < ARRAY_COUNT(members); ++i) {
+        benchmark_small_objects_opts(members[i], true, "(sorted)");
+        benchmark_small_objects_opts(members[i], false, "(unsorted)");
+    }
+}
+
+/*
+ * Creates an array of objects with the given amount of members. The keys have different
+ * lengths and are not in sorted order.
+ */
+static char* create_object_array( size_t objects, size_t members ) {
+    char* json = malloc(objects * members * 40 + objects * 4 + 16);
+    size_t pos = 0;
+    uint32_t seed = 12345;
+    size_t i;
+    size_t j;
+
+    json[pos++] = '[';
+    for (i = 0; i < objects; ++i) {
+        json[pos++] = i > 0 ? ',' : ' ';
+        json[pos++] = '{';
+        for (j = 0; j < members; ++j) {
+            seed = seed * 1103515245u + 12345u;
+            pos += sprintf(json + pos, "%s\"%.*s_%u\":%u", j > 0 ? "," : "", (int)(seed >> 28), "attribute_name", (unsigned)j, (unsigned)j);
+        }
+        json[pos++] = '}';
+    }
+    json[pos++] = ']';
+    json[pos] = '\0';
+    return json;
+}
+
+static void benchmark_parse_objects_opts( size_t members, int opts, const char* title ) {
+    const size_t total_members = 2000000;
+    size_t objects = total_members / members;
+    size_t rounds = 5;
+    char* json = create_object_array(objects, members);
+    size_t json_len = strlen(json);
+    size_t buffer_size = QAJ4C_calculate_max_buffer_size_opt(json, json_len, opts);
+    void* buffer = malloc(buffer_size);
+    const QAJ4C_Value* document = NULL;
+    clock_t start;
+    size_t r;
+
+    start = clock();
+    for (r = 0; r < rounds; ++r) {
+        QAJ4C_parse_opt(json, json_len, opts, buffer, buffer_size, &document);
+        g_sink += (uintptr_t)document;
+    }
+    printf("parse-objects %4u members %-10s %6.1f ns/member\n", (unsigned)members, title, elapsed_ns(start, objects * members * rounds));
+
+    free(buffer);
+    free(json);
+}
+
+static void benchmark_parse_objects( void ) {
+    const size_t members[] = {10, 30, 100, 300, 1000};
+    size_t i;
+    for (i = 0; i < ARRAY_COUNT(members); ++i) {
+        benchmark_parse_objects_opts(members[i], 0, "(sorted)");
+        benchmark_parse_objects_opts(members[i], QAJ4C_PARSE_OPTS_DONT_SORT_OBJECT_MEMBERS, "(unsorted)");
+    }
+}
+
+static void benchmark_shared_shapes_opts( size_t members, int opts, const char* title ) {
+    const size_t objects = 100000;
+    const size_t rounds = 5;
+    char* json = create_same_shape_array(objects, members);
+    size_t json_len = strlen(json);
+    size_t buffer_size = QAJ4C_calculate_max_buffer_size_opt(json, json_len, opts);
+    void* buffer = malloc(buffer_size);
+    const QAJ4C_Value* document = NULL;
+    char name[32];
+    clock_t start;
+    double parse_ns;
+    size_t r;
+    size_t i;
+
+    start = clock();
+    for (r = 0; r < rounds; ++r) {
+        QAJ4C_parse_opt(json, json_len, opts, buffer, buffer_size, &document);
+    }
+    parse_ns = elapsed_ns(start, objects * members * rounds);
+
+    field_name(name, members - 1);
+    start = clock();
+    for (r = 0; r < rounds; ++r) {
+        for (i = 0; i < objects; ++i) {
+            g_sink += (uintptr_t)QAJ4C_object_get(QAJ4C_array_get(document, i), name);
+        }
+    }
+    printf("shared-shapes %2u members %-10s %9u bytes %6.1f ns/member (parse) %6.1f ns/lookup\n", (unsigned)members, title, (unsigned)buffer_size, parse_ns, elapsed_ns(start, objects * rounds));
+
+    free(buffer);
+    free(json);
+}
+
+/*
+ * DOM size, parse time and lookups of arrays of records with and without shared keys.
+ */
+static void benchmark_shared_shapes( void ) {
+    const size_t members[] = {2, 4, 8, 16, 31};
+    size_t i;
+    for (i = 0; i < ARRAY_COUNT(members); ++i) {
+        benchmark_shared_shapes_opts(members[i], 0, "(plain)");
+        benchmark_shared_shapes_opts(members[i], QAJ4C_PARSE_OPTS_SHARE_SHAPES, "(shared)");
+    }
+}
+
+static void benchmark_learned_shapes_opts( size_t members, int opts, const char* title ) {
+    const size_t objects = 2000000 / members;
+    const size_t rounds = 5;
+    char* json = create_same_shape_array(objects, members);
+    size_t json_len = strlen(json);
+    QAJ4C_Parser parser;
+    clock_t start;
+    size_t r;
+
+    QAJ4C_parser_init(&parser, realloc, free);
+    g_sink += (uintptr_t)QAJ4C_parser_parse(&parser, json, json_len, opts);
+
+    start = clock();
+    for (r = 0; r < rounds; ++r) {
+        g_sink += (uintptr_t)QAJ4C_parser_parse(&parser, json, json_len, opts);
+    }
+    printf("learned-shapes %4u members %-10s %6.1f ns/member\n", (unsigned)members, title, elapsed_ns(start, objects * members * rounds));
+
+    QAJ4C_parser_release(&parser);
+    free(json);
+}
+
+/*
+ * Repeated parsing of the same message layout with a parser context.
+ */
+static void benchmark_learned_shapes( void ) {
+    const size_t members[] = {8, 16, 32, 64, 128};
+    size_t i;
+    for (i = 0; i < ARRAY_COUNT(members); ++i) {
+        benchmark_learned_shapes_opts(members[i], 0, "(plain)");
+        benchmark_learned_shapes_opts(members[i], QAJ4C_PARSE_OPTS_LEARN_SHAPES, "(learned)");
+    }
+}
+
+/*
+ * Creates a document with the given amount of values of one kind: integers, doubles,
+ * coordinate pairs, short strings or records (objects with 8 members).
+ */
+static char* create_value_document( const char* kind, size_t values ) {
+    char* json = malloc(values * 32 + 16);
+    size_t pos = 0;
+    size_t i;
+
+    if (strcmp(kind, "records") == 0) {
+        free(json);
+        return create_same_shape_array(values / 9, 8);
+    }
+
+    json[pos++] = '[';
+    for (i = 0; i < values; ++i) {
+        const char* separator = i > 0 ? "," : "";
+        if (strcmp(kind, "integers") == 0) {
+            pos += sprintf(json + pos, "%s%u", separator, (unsigned)(i * 7919 % 1000003));
+        } else if (strcmp(kind, "doubles") == 0) {
+            pos += sprintf(json + pos, "%s%.6f", separator, (double)(i % 36000) / 100.0 - 180.0);
+        } else if (strcmp(kind, "coordinates") == 0 && i % 2 == 0) {
+            pos += sprintf(json + pos, "%s[%.6f,%.6f]", separator, (double)(i % 36000) / 100.0 - 180.0, (double)(i % 18000) / 100.0 - 90.0);
+        } else if (strcmp(kind, "strings") == 0) {
+            pos += sprintf(json + pos, "%s\"s%u\"", separator, (unsigned)i);
+        }
+    }
+    json[pos++] = ']';
+    json[pos] = '\0';
+    return json;
+}
+
+/*
+ * Visits all values of the document (reads numbers, strings and keys), returns the amount of
+ * values.
+ */
+static size_t visit_values( const QAJ4C_Value* value_ptr ) {
+    size_t result = 1;
+    size_t i;
+
+    if (QAJ4C_is_array(value_ptr)) {
+        for (i = 0; i < QAJ4C_array_size(value_ptr); ++i) {
+            result += visit_values(QAJ4C_array_get(value_ptr, i));
+        }
+    } else if (QAJ4C_is_object(value_ptr)) {
+        for (i = 0; i < QAJ4C_object_size(value_ptr); ++i) {
+            const QAJ4C_Member* member = QAJ4C_object_get_member(value_ptr, i);
+            g_sink += QAJ4C_get_string_length(QAJ4C_member_get_key(member));
+            result += visit_values(QAJ4C_member_get_value(member));
+        }
+    } else if (QAJ4C_is_double(value_ptr)) {
+        g_sink += (uintptr_t)QAJ4C_get_double(value_ptr);
+    } else if (QAJ4C_is_string(value_ptr)) {
+        g_sink += (uintptr_t)QAJ4C_get_string(value_ptr)[0] + QAJ4C_get_string_length(value_ptr);
+    }
+    return result;
+}
+
+static void benchmark_value_layout_json( const char* title, const char* json, size_t rounds ) {
+    size_t json_len = strlen(json);
+    size_t buffer_size = QAJ4C_calculate_max_buffer_size(json);
+    void* buffer = malloc(buffer_size);
+    const QAJ4C_Value* document = NULL;
+    size_t dom_size = 0;
+    size_t values = 0;
+    double parse_ns;
+    clock_t start;
+    size_t r;
+
+    start = clock();
+    for (r = 0; r < rounds; ++r) {
+        dom_size = QAJ4C_parse(json, buffer, buffer_size, &document);
+    }
+    parse_ns = elapsed_ns(start, rounds);
+    start = clock();
+    for (r = 0; r < rounds; ++r) {
+        values = visit_values(document);
+    }
+    printf("value-layout %-22s %9u json bytes %9u dom bytes %5.1f bytes/value %7.1f ns/value parse %5.1f ns/value access\n", title, (unsigned)json_len, (unsigned)dom_size, (double)dom_size / (double)values, parse_ns / (double)values, elapsed_ns(start, values * rounds));
+    free(buffer);
+}
+
+static char* read_file( const char* path ) {
+    FILE* fp = fopen(path, "rb");
+    char* json;
+    long size;
+
+    if (fp == NULL) {
+        return NULL;
+    }
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    json = malloc(size + 1);
+    json[fread(json, 1, size, fp)] = '\0';
+    fclose(fp);
+    return json;
+}
+
+/*
+ * Size of the DOM, parse and access time per value of the value layout the library has been
+ * compiled with (compare a build with QAJ4C_COMPACT_VALUES to one without), for the example
+ * messages in data/ and for large documents that consist of one kind of value.
+ */
+static void benchmark_value_layout( void ) {
+    const char* files[] = {"ref-example-1.json", "ref-example-2.json", "ref-example-3.json", "ref-example-4.json", "ref-example-5.json", "t-long-string-1.json"};
+    const char* kinds[] = {"integers", "doubles", "coordinates", "strings", "records"};
+    char path[512];
+    size_t i;
+
+#ifdef QAJ4C_COMPACT_VALUES
+    printf("value-layout compact\n");
+#else
+    printf("value-layout default\n");
+#endif
+    for (i = 0; i < ARRAY_COUNT(files); ++i) {
+        char* json;
+        sprintf(path, "%s/%s", QAJ4C_BENCHMARK_DATA_DIR, files[i]);
+        json = read_file(path);
+        if (json == NULL) {
+            printf("value-layout %-22s missing\n", files[i]);
+            continue;
+        }
+        benchmark_value_layout_json(files[i], json, 100000);
+        free(json);
+    }
+    for (i = 0; i < ARRAY_COUNT(kinds); ++i) {
+        char* json = create_value_document(kinds[i], 1000000);
+        benchmark_value_layout_json(kinds[i], json, 5);
+        free(json);
+    }
+}
+
+/*
+ * Creates a GeoJSON like feature collection, each feature is a polygon with the given amount
+ * of coordinate pairs.
+ */
+static char* create_feature_collection( size_t features, size_t points ) {
+    char* json = malloc(features * (points * 26 + 160) + 64);
+    size_t pos = 0;
+    size_t i;
+    size_t j;
+
+    pos += sprintf(json + pos, "{\"type\":\"FeatureCollection\",\"features\":[");
+    for (i = 0; i < features; ++i) {
+        pos += sprintf(json + pos, "%s{\"type\":\"Feature\",\"properties\":{\"name\":\"feature %u\"},", i > 0 ? "," : "", (unsigned)i);
+        pos += sprintf(json + pos, "\"geometry\":{\"type\":\"Polygon\",\"coordinates\":[[");
+        for (j = 0; j < points; ++j) {
+            size_t n = i * points + j;
+            pos += sprintf(json + pos, "%s[%.6f,%.6f]", j > 0 ? "," : "", (double)(n % 36000) / 100.0 - 180.0, (double)(n % 18000) / 100.0 - 90.0);
+        }
+        pos += sprintf(json + pos, "]]}}");
+    }
+    pos += sprintf(json + pos, "]}");
+    return json;
+}
+
+static void benchmark_coordinates_opts( const char* json, size_t json_len, int opts, const char* label ) {
+    const size_t rounds = 10;
+    size_t buffer_size = QAJ4C_calculate_max_buffer_size_opt(json, json_len, opts);
+    void* buffer = malloc(buffer_size);
+    const QAJ4C_Value* document = NULL;
+    clock_t start;
+    size_t r;
+
+    start = clock();
+    for (r = 0; r < rounds; ++r) {
+        QAJ4C_parse_opt(json, json_len, opts, buffer, buffer_size, &document);
+    }
+    g_sink += (uintptr_t)document;
+    printf("coordinates %-9s %9u json bytes %7.1f MB/s\n", label, (unsigned)json_len, (double)json_len * rounds / 1e6 / ((double)(clock() - start) / CLOCKS_PER_SEC));
+
+    free(buffer);
+}
+
+/*
+ * Parse throughput of a coordinates heavy document (mostly arrays of numbers).
+ */
+static void benchmark_coordinates( void ) {
+    char* json = create_feature_collection(2000, 256);
+    size_t json_len = strlen(json);
+
+    benchmark_coordinates_opts(json, json_len, 0, "(plain)");
+    benchmark_coordinates_opts(json, json_len, QAJ4C_PARSE_OPTS_PACK_ARRAYS, "(packed)");
+    free(json);
+}
+
+static void benchmark_array_copy_opts( const char* kind, int opts ) {
+    const size_t rounds = 20;
+    char* json = create_value_document(kind, 1000000);
+    size_t json_len = strlen(json);
+    const QAJ4C_Value* document = QAJ4C_parse_opt_dynamic(json, json_len, opts, realloc);
+    size_t count = QAJ4C_array_size(document);
+    double* out = malloc(count * sizeof(double));
+    double sum = 0.0;
+    clock_t start;
+    size_t r;
+    size_t i;
+
+    start = clock();
+    for (r = 0; r < rounds; ++r) {
+        for (i = 0; i < count; ++i) {
+            out[i] = QAJ4C_get_double(QAJ4C_array_get(document, i));
+        }
+        sum += out[r];
+    }
+    printf("array-copy %-9s %-6s get_double loop    %6.2f ns/value\n", kind, opts != 0 ? "packed" : "", elapsed_ns(start, count * rounds));
+
+    start = clock();
+    for (r = 0; r < rounds; ++r) {
+        count = QAJ4C_array_copy_doubles(document, out, count);
+        sum += out[r];
+    }
+    printf("array-copy %-9s %-6s array_copy_doubles %6.2f ns/value\n", kind, opts != 0 ? "packed" : "", elapsed_ns(start, count * rounds));
+
+    g_sink += (uintptr_t)sum;
+    free(out);
+    free((void*)document);
+    free(json);
+}
+
+/*
+ * Exporting a numeric array element by element compared to QAJ4C_array_copy_doubles.
+ */
+static void benchmark_array_copy( void ) {
+    benchmark_array_copy_opts("integers", 0);
+    benchmark_array_copy_opts("integers", QAJ4C_PARSE_OPTS_PACK_ARRAYS);
+    benchmark_array_copy_opts("doubles", 0);
+    benchmark_array_copy_opts("doubles", QAJ4C_PARSE_OPTS_PACK_ARRAYS);
+}
+
+static void benchmark_columns_opts( const char* json, size_t json_len, int opts, const char* label ) {
+    const size_t rounds = 20;
+    const QAJ4C_Value* document = QAJ4C_parse_opt_dynamic(json, json_len, opts, realloc);
+    size_t count = QAJ4C_array_size(document);
+    int64_t* out = malloc(count * sizeof(int64_t));
+    uint8_t* nulls = malloc(count / 8 + 1);
+    QAJ4C_Key key;
+    int64_t sum = 0;
+    clock_t start;
+    size_t r;
+    size_t i;
+
+    start = clock();
+    for (r = 0; r < rounds; ++r) {
+        for (i = 0; i < count; ++i) {
+            out[i] = QAJ4C_get_int64(QAJ4C_object_get(QAJ4C_array_get(document, i), "rank"));
+        }
+        sum += out[r];
+    }
+    printf("columns %-9s object_get loop      %6.2f ns/record\n", label, elapsed_ns(start, count * rounds));
+
+    QAJ4C_key_init(&key, "rank");
+    start = clock();
+    for (r = 0; r < rounds; ++r) {
+        sum += QAJ4C_array_column_int64s(document, &key, out, count, nulls);
+    }
+    printf("columns %-9s array_column_int64s  %6.2f ns/record\n", label, elapsed_ns(start, count * rounds));
+
+    g_sink += (uintptr_t)sum;
+    free(nulls);
+    free(out);
+    free((void*)document);
+}
+
+/*
+ * Extracting one field of all records element by element compared to the column functions.
+ */
+static void benchmark_columns( void ) {
+    char* json = create_same_shape_array(100000, 30);
+    size_t json_len = strlen(json);
+
+    benchmark_columns_opts(json, json_len, 0, "(sorted)");
+    benchmark_columns_opts(json, json_len, QAJ4C_PARSE_OPTS_SHARE_SHAPES, "(shapes)");
+    free(json);
+}
+
+/*
+ * Building a numeric array element by element compared to the bulk setters.
+ */
+static void benchmark_build_array( void ) {
+    const size_t count = 100000;
+    const size_t rounds = 200;
+    size_t buffer_size = 32 * (count + 1); /* more than sizeof(QAJ4C_Value) */
+    void* buffer = malloc(buffer_size);
+    double* values = malloc(count * sizeof(double));
+    QAJ4C_Builder builder;
+    QAJ4C_Value* root = NULL;
+    clock_t start;
+    size_t r;
+    size_t i;
+
+    for (i = 0; i < count; ++i) {
+        values[i] = (double)(i % 36000) / 100.0 - 180.0;
+    }
+
+    start = clock();
+    for (r = 0; r < rounds; ++r) {
+        QAJ4C_builder_init(&builder, buffer, buffer_size);
+        root = QAJ4C_builder_get_document(&builder);
+        QAJ4C_set_array(root, count, &builder);
+        for (i = 0; i < count; ++i) {
+            QAJ4C_set_double(QAJ4C_array_get_rw(root, i), values[i]);
+        }
+    }
+    printf("build-array set_double loop                   %6.2f ns/value\n", elapsed_ns(start, count * rounds));
+
+    start = clock();
+    for (r = 0; r < rounds; ++r) {
+        QAJ4C_builder_init(&builder, buffer, buffer_size);
+        root = QAJ4C_builder_get_document(&builder);
+        QAJ4C_set_array_from_doubles(root, values, count, false, &builder);
+    }
+    printf("build-array set_array_from_doubles            %6.2f ns/value\n", elapsed_ns(start, count * rounds));
+
+    start = clock();
+    for (r = 0; r < rounds; ++r) {
+        QAJ4C_builder_init(&builder, buffer, buffer_size);
+        root = QAJ4C_builder_get_document(&builder);
+        QAJ4C_set_array_from_doubles(root, values, count, true, &builder);
+    }
+    printf("build-array set_array_from_doubles (packed)   %6.2f ns/value\n", elapsed_ns(start, count * rounds));
+
+    g_sink += (uintptr_t)QAJ4C_array_size(root);
+    free(values);
+    free(buffer);
+}
+
+static void benchmark_build_object_members( size_t members ) {
+    const size_t rounds = members < 1000 ? 200000 / members : 20;
+    size_t buffer_size = 96 * (members + 1); /* more than the members and the values */
+    void* buffer = malloc(buffer_size);
+    char* names = malloc(members * 8);
+    const char** keys = malloc(members * sizeof(char*));
+    const QAJ4C_Value** values = malloc(members * sizeof(QAJ4C_Value*));
+    QAJ4C_Builder builder;
+    QAJ4C_Value* root = NULL;
+    QAJ4C_Value* numbers;
+    clock_t start;
+    size_t r;
+    size_t i;
+
+    /* same length keys, so the numeric order is the sorted order */
+    for (i = 0; i < members; ++i) {
+        sprintf(names + i * 8, "k%06u", (unsigned)i);
+        keys[i] = names + i * 8;
+    }
+
+    start = clock();
+    for (r = 0; r < rounds; ++r) {
+        QAJ4C_builder_init(&builder, buffer, buffer_size);
+        root = QAJ4C_builder_get_document(&builder);
+        QAJ4C_set_object(root, members, &builder);
+        for (i = 0; i < members; ++i) {
+            QAJ4C_set_uint(QAJ4C_object_create_member_by_ref(root, keys[i]), (uint32_t)i);
+        }
+        QAJ4C_object_optimize(root);
+    }
+    printf("build-object %5u members create_member + optimize %9.1f ns/member\n", (unsigned)members, elapsed_ns(start, members * rounds));
+
+    start = clock();
+    for (r = 0; r < rounds; ++r) {
+        QAJ4C_builder_init(&builder, buffer, buffer_size);
+        root = QAJ4C_builder_get_document(&builder);
+        /* the values to be referenced by the members */
+        QAJ4C_set_array(root, 1, &builder);
+        numbers = QAJ4C_array_get_rw(root, 0);
+        QAJ4C_set_array(numbers, members, &builder);
+        for (i = 0; i < members; ++i) {
+            QAJ4C_Value* number = QAJ4C_array_get_rw(numbers, i);
+            QAJ4C_set_uint(number, (uint32_t)i);
+            values[i] = number;
+        }
+        QAJ4C_set_object_from_arrays(root, keys, NULL, values, members, true, &builder);
+    }
+    printf("build-object %5u members set_object_from_arrays   %9.1f ns/member\n", (unsigned)members, elapsed_ns(start, members * rounds));
+
+    g_sink += (uintptr_t)QAJ4C_object_size(root);
+    free(values);
+    free(keys);
+    free(names);
+    free(buffer);
+}
+
+/*
+ * Building objects member by member compared to QAJ4C_set_object_from_arrays with presorted keys.
+ */
+static void benchmark_build_object( void ) {
+    benchmark_build_object_members(16);
+    benchmark_build_object_members(256);
+    benchmark_build_object_members(4096);
+}
+
+/*
+ * Appending to a growable array compared to a fixed size array with a known count (and appending
+ * with a growing builder instead of a worst case buffer).
+ */
+static void benchmark_build_growable( void ) {
+    const size_t count = 100000;
+    const size_t rounds = 200;
+    size_t buffer_size = 64 * (count + 1); /* room for the doubled capacities */
+    void* buffer = malloc(buffer_size);
+    QAJ4C_Builder builder;
+    QAJ4C_Value* root = NULL;
+    QAJ4C_Value* rows;
+    clock_t start;
+    size_t r;
+    size_t i;
+
+    start = clock();
+    for (r = 0; r < rounds; ++r) {
+        QAJ4C_builder_init(&builder, buffer, buffer_size);
+        root = QAJ4C_builder_get_document(&builder);
+        QAJ4C_set_array(root, count, &builder);
+        for (i = 0; i < count; ++i) {
+            QAJ4C_set_uint(QAJ4C_array_get_rw(root, i), (uint32_t)i);
+        }
+    }
+    printf("build-growable set_array (known count)        %6.2f ns/value\n", elapsed_ns(start, count * rounds));
+
+    start = clock();
+    for (r = 0; r < rounds; ++r) {
+        QAJ4C_builder_init(&builder, buffer, buffer_size);
+        root = QAJ4C_builder_get_document(&builder);
+        QAJ4C_set_array_growable(root, 0, &builder);
+        for (i = 0; i < count; ++i) {
+            QAJ4C_set_uint(QAJ4C_array_append(root, &builder), (uint32_t)i);
+        }
+    }
+    printf("build-growable array_append (in place)        %6.2f ns/value\n", elapsed_ns(start, count * rounds));
+
+    /* every row is allocated behind the outer array, so each growth of it relocates */
+    start = clock();
+    for (r = 0; r < rounds; ++r) {
+        QAJ4C_builder_init(&builder, buffer, buffer_size);
+        root = QAJ4C_builder_get_document(&builder);
+        QAJ4C_set_array_growable(root, 0, &builder);
+        for (i = 0; i < count / 4; ++i) {
+            rows = QAJ4C_array_append(root, &builder);
+            QAJ4C_set_array(rows, 3, &builder);
+        }
+    }
+    printf("build-growable array_append (relocating)      %6.2f ns/value\n", elapsed_ns(start, count / 4 * rounds));
+
+    /* the builder allocates 4 KiB chunks (doubling) instead of using a worst case buffer */
+    start = clock();
+    for (r = 0; r < rounds; ++r) {
+        QAJ4C_builder_init_allocator(&builder, 4096, QAJ4C_std_allocator());
+        root = QAJ4C_builder_get_document(&builder);
+        QAJ4C_set_array_growable(root, 0, &builder);
+        for (i = 0; i < count; ++i) {
+            QAJ4C_set_uint(QAJ4C_array_append(root, &builder), (uint32_t)i);
+        }
+        g_sink += (uintptr_t)QAJ4C_array_size(root);
+        QAJ4C_builder_release(&builder);
+    }
+    printf("build-growable array_append (growing builder) %6.2f ns/value\n", elapsed_ns(start, count * rounds));
+
+    free(buffer);
+}
+
+static const benchmark g_benchmarks[] = {
+    {"key-lookup", benchmark_key_lookup},
+    {"parse-objects", benchmark_parse_objects},
+    {"small-objects", benchmark_small_objects},
+    {"shared-shapes", benchmark_shared_shapes},
+    {"learned-shapes", benchmark_learned_shapes},
+    {"value-layout", benchmark_value_layout},
+    {"coordinates", benchmark_coordinates},
+    {"array-copy", benchmark_array_copy},
+    {"columns", benchmark_columns},
+    {"build-array", benchmark_build_array},
+    {"build-object", benchmark_build_object},
+    {"build-growable", benchmark_build_growable}
+};
+
+int main( int argc, char **argv ) {
+    size_t i;
+    int j;
+
+    for (i = 0; i < ARRAY_COUNT(g_benchmarks); ++i) {
+        bool selected = argc <= 1;
+        for (j = 1; j < argc; ++j) {
+            selected = selected || strcmp(argv[j], g_benchmarks[i].name) == 0;
+        }
+        if (selected) {
+            g_benchmarks[i].run();
+        }
+    }
+    return 0;
+}
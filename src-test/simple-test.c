@@ -190,7 +190,7 @@ int main(int argc, char **argv) {
     char* buffer = NULL;
     const QAJ4C_Value* document = NULL;
     if ( arguments.dynamic_parsing ) {
-        document = QAJ4C_parse_opt_dynamic(input_string, input_string_size, QAJ4C_PARSE_OPTS_STRICT, realloc);
+        document = QAJ4C_parse_opt_dynamic_allocator(input_string, input_string_size, QAJ4C_PARSE_OPTS_STRICT, NULL, QAJ4C_std_allocator());
     } else {
         size_t buffer_size = 0;
         if (arguments.insitu_parsing) {
@@ -232,7 +232,7 @@ int main(int argc, char **argv) {
     }
 
 	if (buffer == NULL) {
-		free((void*)document);
+		QAJ4C_document_free(document, QAJ4C_std_allocator());
 	} else {
 		free(buffer);
 	}
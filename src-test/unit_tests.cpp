@@ -34,6 +34,7 @@
 #include <unistd.h>
 #include <assert.h>
 #include <signal.h>
+#include <pthread.h>
 #include <string.h>
 #include <time.h>
 #include <tuple>
@@ -290,6 +291,27 @@ int main( int argc, char **argv ) {
    void a## _## b## _test()
 
 
+static void create_same_length_keys_json( char* json, size_t json_size, size_t count ) {
+    size_t pos = snprintf(json, json_size, "{");
+    for (size_t i = 0; i < count; ++i) {
+        pos += snprintf(json + pos, json_size - pos, "%s\"common_prefix_key_%03u\":%u", i > 0 ? "," : "", (unsigned)i, (unsigned)i);
+    }
+    snprintf(json + pos, json_size - pos, "}");
+}
+
+static void check_same_length_keys( const QAJ4C_Value* value, size_t count ) {
+    char key[64];
+    for (size_t i = 0; i < count; ++i) {
+        snprintf(key, sizeof(key), "common_prefix_key_%03u", (unsigned)i);
+        const QAJ4C_Value* member = QAJ4C_object_get(value, key);
+        assert(member != NULL);
+        assert(QAJ4C_get_uint(member) == i);
+    }
+    assert(QAJ4C_object_get(value, "common_prefix_key_999") == NULL);
+    assert(QAJ4C_object_get(value, "common_prefix_key_") == NULL);
+}
+
+
 TEST(BufferSizeTests, ParseObjectWithOneNumericMember) {
     const char json[] = R"({"id":1})";
 
@@ -298,7 +320,7 @@ TEST(BufferSizeTests, ParseObjectWithOneNumericMember) {
     assert(normal_required_buffer_size == insitu_required_buffer_size);
 
     // one object + one member
-    assert(normal_required_buffer_size == (sizeof(QAJ4C_Value) + sizeof(QAJ4C_Member)));
+    assert(normal_required_buffer_size == (sizeof(QAJ4C_Value) + sizeof(QAJ4C_Member) + QAJ4C_CONTAINER_HEADER_SIZE));
 }
 
 
@@ -353,7 +375,7 @@ TEST(BufferSizeTests, ParseObjectWithOneStringVeryLongMember) {
     assert(normal_required_buffer_size > insitu_required_buffer_size);
 
     // one object + one member
-    assert(insitu_required_buffer_size == (sizeof(QAJ4C_Value) + sizeof(QAJ4C_Member)));
+    assert(insitu_required_buffer_size == (sizeof(QAJ4C_Value) + sizeof(QAJ4C_Member) + QAJ4C_CONTAINER_HEADER_SIZE));
 }
 
 TEST(SimpleParsingTests, ParseObjectWithOneStringMember) {
@@ -382,7 +404,7 @@ TEST(SimpleParsingTests, ParseObjectWithOneStringVeryLongMember) {
 
 TEST(SimpleParsingTests, ParseObjectWithOneStringVeryLongMemberInsitu) {
     char json[] = R"({"name":"blahblubbhubbeldipup"})";
-    char buffer[64];
+    char buffer[4 * sizeof(QAJ4C_Value)];
     const QAJ4C_Value* value;
 
     size_t required = ARRAY_COUNT(buffer);
@@ -390,7 +412,7 @@ TEST(SimpleParsingTests, ParseObjectWithOneStringVeryLongMemberInsitu) {
     required = QAJ4C_parse_insitu(json, (void*)buffer, required, &value);
     assert(QAJ4C_is_object(value));
     assert(QAJ4C_object_size(value) == 1);
-    assert(required == sizeof(QAJ4C_Value) + sizeof(QAJ4C_Member));
+    assert(required == sizeof(QAJ4C_Value) + sizeof(QAJ4C_Member) + QAJ4C_CONTAINER_HEADER_SIZE);
 
     const QAJ4C_Value* object_entry = QAJ4C_object_get(value, "name");
     assert(QAJ4C_is_string(object_entry));
@@ -700,11 +722,27 @@ TEST(SimpleParsingTests, ParseObjectTrailingComma) {
 }
 
 TEST(SimpleParsingTests, ParseObjectCheckOptimized) {
+    char json[4096];
+    create_same_length_keys_json(json, sizeof(json), QAJ4C_SORT_MIN_MEMBERS);
+    const QAJ4C_Value* value = QAJ4C_parse_opt_dynamic(json, strlen(json), 0, realloc);
+    assert(QAJ4C_is_object(value));
+    assert(QAJ4C_object_size(value) == QAJ4C_SORT_MIN_MEMBERS);
+    assert(QAJ4C_get_internal_type(value) == QAJ4C_OBJECT_SORTED);
+
+    free((void*)value);
+}
+
+/**
+ * Scanning small objects is faster than the binary search, so these are not sorted.
+ */
+TEST(SimpleParsingTests, ParseSmallObjectNotOptimized) {
     const char json[] = R"({"id":1,"name":"foo","age":39,"job":null,"role":"admin"})";
     const QAJ4C_Value* value = QAJ4C_parse_opt_dynamic(json, ARRAY_COUNT(json), 0, realloc);
     assert(QAJ4C_is_object(value));
     assert(QAJ4C_object_size(value) == 5);
-    assert(QAJ4C_get_internal_type(value) == QAJ4C_OBJECT_SORTED);
+    assert(QAJ4C_get_internal_type(value) == QAJ4C_OBJECT);
+    assert(QAJ4C_get_uint(QAJ4C_object_get(value, "age")) == 39);
+    assert(QAJ4C_object_get(value, "ag") == NULL);
 
     free((void*)value);
 }
@@ -714,9 +752,10 @@ TEST(SimpleParsingTests, ParseObjectCheckOptimized) {
  * alter the binary.
  */
 TEST(SimpleParsingTests, ParseObjectCheckOptimizedNoChangeLater) {
-    const char json[] = R"({"id":1,"name":"foo","age":39,"job":null,"role":"admin"})";
+    char json[4096];
+    create_same_length_keys_json(json, sizeof(json), QAJ4C_SORT_MIN_MEMBERS);
 
-    static const size_t SIZE = 256;
+    static const size_t SIZE = 4096;
     uint8_t buff1[SIZE];
     uint8_t buff2[SIZE];
 
@@ -733,7 +772,7 @@ TEST(SimpleParsingTests, ParseObjectCheckOptimizedNoChangeLater) {
     }
 
     assert(QAJ4C_is_object(value));
-    assert(QAJ4C_object_size(value) == 5);
+    assert(QAJ4C_object_size(value) == QAJ4C_SORT_MIN_MEMBERS);
     assert(QAJ4C_get_internal_type(value) == QAJ4C_OBJECT_SORTED);
 
     QAJ4C_object_optimize((QAJ4C_Value*) value);
@@ -810,6 +849,25 @@ TEST(SimpleParsingTests, ParseNumericEValues) {
     free((void*)value);
 }
 
+TEST(SimpleParsingTests, ParseMixedArrayValues) {
+    const char json[] = R"([0.1, "a", -2.5e-3, {"x": 1}, 7, 1234567890.12345678901, 1e300, [], -0.0])";
+    const QAJ4C_Value* value = QAJ4C_parse_opt_dynamic(json, ARRAY_COUNT(json), 0, realloc);
+    assert(QAJ4C_is_array(value));
+    assert(QAJ4C_array_size(value) == 9);
+
+    assert(0.1 == QAJ4C_get_double(QAJ4C_array_get(value, 0)));
+    assert(QAJ4C_is_string(QAJ4C_array_get(value, 1)));
+    assert(-2.5e-3 == QAJ4C_get_double(QAJ4C_array_get(value, 2)));
+    assert(1 == QAJ4C_get_uint(QAJ4C_object_get(QAJ4C_array_get(value, 3), "x")));
+    assert(7 == QAJ4C_get_uint(QAJ4C_array_get(value, 4)));
+    assert(1234567890.12345678901 == QAJ4C_get_double(QAJ4C_array_get(value, 5)));
+    assert(1e300 == QAJ4C_get_double(QAJ4C_array_get(value, 6)));
+    assert(QAJ4C_is_array(QAJ4C_array_get(value, 7)));
+    assert(1.0 / QAJ4C_get_double(QAJ4C_array_get(value, 8)) < 0);
+
+    free((void*)value);
+}
+
 TEST(SimpleParsingTests, ParseUint64Max) {
     const char json[] = R"([18446744073709551615])";
     const QAJ4C_Value* value = QAJ4C_parse_opt_dynamic(json, ARRAY_COUNT(json), 0, realloc);
@@ -1454,6 +1512,12 @@ TEST(ErrorHandlingTests, ParseMultipleLongStrings) {
     free((void*)value);
 }
 
+/*
+ * The following tests rely on the type checks of the read accessors, which are compiled away
+ * in case the library is built with QAJ4C_UNCHECKED.
+ */
+#ifndef QAJ4C_UNCHECKED
+
 /**
  * This test will verify that in case an object is accessed incorrectly (with methods of a string or uint)
  * the default value will be returned in case a custom fatal function is set.
@@ -1586,6 +1650,7 @@ TEST(DomObjectAccessTests, IncorrectArrayAccess) {
     assert(++expected == called);
 }
 
+#ifndef QAJ4C_COMPACT_VALUES /* 64 bit integers need storage on a builder */
 TEST(DomObjectAccessTests, Uint64Access) {
     QAJ4C_Value value;
     QAJ4C_set_uint64(&value, UINT64_MAX);
@@ -1617,6 +1682,7 @@ TEST(DomObjectAccessTests, Uint64Access) {
     assert(NULL == QAJ4C_array_get(&value, 0));
     assert(9 == called);
 }
+#endif
 
 TEST(DomObjectAccessTests, Uint32Access) {
     QAJ4C_Value value;
@@ -1650,6 +1716,7 @@ TEST(DomObjectAccessTests, Uint32Access) {
     assert(7 == called);
 }
 
+#ifndef QAJ4C_COMPACT_VALUES /* 64 bit integers need storage on a builder */
 TEST(DomObjectAccessTests, Int64Access) {
     QAJ4C_Value value;
     QAJ4C_set_int64(&value, INT64_MIN);
@@ -1681,8 +1748,10 @@ TEST(DomObjectAccessTests, Int64Access) {
     assert(NULL == QAJ4C_array_get(&value, 0));
     assert(9 == called);
 }
+#endif
 
 
+#ifndef QAJ4C_COMPACT_VALUES /* 64 bit integers need storage on a builder */
 TEST(DomObjectAccessTests, Int64AccessMax) {
     QAJ4C_Value value;
     QAJ4C_set_int64(&value, INT64_MAX);
@@ -1714,6 +1783,7 @@ TEST(DomObjectAccessTests, Int64AccessMax) {
     assert(NULL == QAJ4C_array_get(&value, 0));
     assert(8 == called);
 }
+#endif
 
 TEST(DomObjectAccessTests, Int32Access) {
     QAJ4C_Value value;
@@ -1968,6 +2038,50 @@ TEST(DomObjectAccessTests, IncorrectErrorAccess) {
     assert(++expected == called);
 }
 
+#endif /* QAJ4C_UNCHECKED */
+
+/**
+ * Valid accesses through the read accessors (this is what the QAJ4C_UNCHECKED build relies on)
+ * and invalid accesses on the mutation paths, which are checked in all builds.
+ */
+TEST(DomObjectAccessTests, AccessorsWithAndWithoutChecks) {
+    const char json[] = R"({"array":[1,-2,3000000000,2.5,true,"a long string value",null],"object":{"id":7}})";
+    const QAJ4C_Value* value = QAJ4C_parse_opt_dynamic(json, ARRAY_COUNT(json), 0, realloc);
+    const QAJ4C_Value* array = QAJ4C_object_get(value, "array");
+    const QAJ4C_Value* object = QAJ4C_object_get(value, "object");
+
+    assert(QAJ4C_array_size(array) == 7);
+    assert(QAJ4C_get_int(QAJ4C_array_get(array, 0)) == 1);
+    assert(QAJ4C_get_uint(QAJ4C_array_get(array, 0)) == 1);
+    assert(QAJ4C_get_int64(QAJ4C_array_get(array, 1)) == -2);
+    assert(QAJ4C_get_uint64(QAJ4C_array_get(array, 2)) == 3000000000ULL);
+    assert(QAJ4C_get_double(QAJ4C_array_get(array, 3)) == 2.5);
+    assert(QAJ4C_get_bool(QAJ4C_array_get(array, 4)));
+    assert(QAJ4C_get_string_length(QAJ4C_array_get(array, 5)) == 19);
+    assert(strcmp(QAJ4C_get_string(QAJ4C_array_get(array, 5)), "a long string value") == 0);
+    assert(QAJ4C_string_cmp(QAJ4C_array_get(array, 5), "a long string value") == 0);
+    assert(QAJ4C_is_null(QAJ4C_array_get(array, 6)));
+    assert(QAJ4C_object_size(object) == 1);
+    assert(QAJ4C_get_int(QAJ4C_member_get_value(QAJ4C_object_get_member(object, 0))) == 7);
+    assert(strcmp(QAJ4C_get_string(QAJ4C_member_get_key(QAJ4C_object_get_member(object, 0))), "id") == 0);
+
+    static int called = 0;
+    auto lambda = [](){
+        ++called;
+    };
+    QAJ4C_register_fatal_error_function(lambda);
+
+    QAJ4C_Value* rw_array = (QAJ4C_Value*)array;
+    assert(QAJ4C_array_get_rw(rw_array, 7) == NULL);
+    assert(called == 1);
+    assert(QAJ4C_array_get_rw((QAJ4C_Value*)object, 0) == NULL);
+    assert(called == 2);
+    QAJ4C_set_int(QAJ4C_array_get_rw(rw_array, 6), 5);
+    assert(QAJ4C_get_int(QAJ4C_array_get(array, 6)) == 5);
+    assert(called == 2);
+    free((void*)value);
+}
+
 /**
  * In this test it is verified that even in case one sets a uint with the int64 function
  * it will still be uint compatible!
@@ -2009,184 +2123,1015 @@ TEST(DomObjectAccessTests, StringCopy) {
     assert(QAJ4C_string_cmp(&value, str) == 0);
 }
 
+#ifndef QAJ4C_COMPACT_VALUES /* packed arrays are not supported */
+TEST(DomObjectAccessTests, ArrayFromCArrays) {
+    const double doubles[] = {0.5, -1.0, 3.25};
+    const int64_t int64s[] = {1, -2, 3000000000LL, -5000000000LL};
+    const char* strings[] = {"a", "a somewhat longer string", ""};
+    char buff[1024];
+    char output[256];
+    QAJ4C_Builder builder = QAJ4C_builder_create(buff, ARRAY_COUNT(buff));
+    QAJ4C_Value* root = QAJ4C_builder_get_document(&builder);
+
+    QAJ4C_set_array(root, 5, &builder);
+    QAJ4C_set_array_from_doubles(QAJ4C_array_get_rw(root, 0), doubles, ARRAY_COUNT(doubles), false, &builder);
+    QAJ4C_set_array_from_int64s(QAJ4C_array_get_rw(root, 1), int64s, ARRAY_COUNT(int64s), false, &builder);
+    QAJ4C_set_array_from_strings(QAJ4C_array_get_rw(root, 2), strings, NULL, ARRAY_COUNT(strings), &builder);
+    QAJ4C_set_array_from_doubles(QAJ4C_array_get_rw(root, 3), doubles, ARRAY_COUNT(doubles), true, &builder);
+    QAJ4C_set_array_from_int64s(QAJ4C_array_get_rw(root, 4), int64s, ARRAY_COUNT(int64s), true, &builder);
+
+    assert(QAJ4C_get_double(QAJ4C_array_get(QAJ4C_array_get(root, 0), 2)) == 3.25);
+    assert(QAJ4C_get_int(QAJ4C_array_get(QAJ4C_array_get(root, 1), 1)) == -2);
+    assert(QAJ4C_is_uint(QAJ4C_array_get(QAJ4C_array_get(root, 1), 2)) && !QAJ4C_is_int(QAJ4C_array_get(QAJ4C_array_get(root, 1), 2)));
+    assert(QAJ4C_string_equals(QAJ4C_array_get(QAJ4C_array_get(root, 2), 1), strings[1]));
+    assert(QAJ4C_get_string_length(QAJ4C_array_get(QAJ4C_array_get(root, 2), 2)) == 0);
+    assert(QAJ4C_array_get_doubles(QAJ4C_array_get(root, 3))[1] == -1.0);
+    assert(QAJ4C_array_get_int64s(QAJ4C_array_get(root, 4))[3] == -5000000000LL);
+    assert(QAJ4C_equals(QAJ4C_array_get(root, 0), QAJ4C_array_get(root, 3)));
+    assert(QAJ4C_equals(QAJ4C_array_get(root, 1), QAJ4C_array_get(root, 4)));
+
+    QAJ4C_sprint(root, output, ARRAY_COUNT(output));
+    assert(strcmp(R"([[0.5,-1,3.25],[1,-2,3000000000,-5000000000],["a","a somewhat longer string",""],[0.5,-1,3.25],[1,-2,3000000000,-5000000000]])", output) == 0);
+}
+#endif
 
-TEST(ErrorHandlingTests, TooSmallDomBuffer) {
-    char json[] = "[0.123456,9,12,3,5,7,2,3]";
-    // just reduce the buffer size by one single byte
-    size_t buff_size = QAJ4C_calculate_max_buffer_size(json) - 1;
-    char buff[buff_size];
-    const QAJ4C_Value* value = NULL;
-
-    size_t actual_size = QAJ4C_parse(json, buff, buff_size, &value);
-    assert(QAJ4C_is_error(value));
+TEST(DomObjectAccessTests, GrowableArray) {
+    char buff[4096];
+    char output[512];
+    QAJ4C_Builder builder = QAJ4C_builder_create(buff, ARRAY_COUNT(buff));
+    QAJ4C_Value* root = QAJ4C_builder_get_document(&builder);
 
-    assert(QAJ4C_error_get_errno(value) == QAJ4C_ERROR_STORAGE_BUFFER_TO_SMALL);
+    QAJ4C_set_array_growable(root, 0, &builder);
+    for (int i = 0; i < 10; ++i) {
+        QAJ4C_set_int(QAJ4C_array_append(root, &builder), i);
+    }
+    /* the elements grow in place (one header, 16 elements) */
+    assert(builder.cur_obj_pos == sizeof(QAJ4C_Value) * 18);
+    assert(QAJ4C_array_size(root) == 10);
+
+    /* the nested arrays are allocated behind the elements, so the outer array has to move */
+    for (int i = 0; i < 10; ++i) {
+        QAJ4C_Value* nested = QAJ4C_array_append(root, &builder);
+        QAJ4C_set_array_growable(nested, 1, &builder);
+        for (int j = 0; j <= i % 3; ++j) {
+            QAJ4C_set_int(QAJ4C_array_append(nested, &builder), j);
+        }
+    }
+    assert(QAJ4C_array_size(root) == 20);
+    assert(QAJ4C_get_int(QAJ4C_array_get(root, 9)) == 9);
+    assert(QAJ4C_array_size(QAJ4C_array_get(root, 12)) == 3);
+    QAJ4C_sprint(root, output, ARRAY_COUNT(output));
+    assert(strcmp("[0,1,2,3,4,5,6,7,8,9,[0],[0,1],[0,1,2],[0],[0,1],[0,1,2],[0],[0,1],[0,1,2],[0]]", output) == 0);
 }
 
-TEST(ErrorHandlingTests, ReallocFailsBegin) {
-    char json[] = "[0.123456,9,12,3,5,7,2,3]";
-    auto lambda = []( void *ptr, size_t size ) {return (void*)NULL;};
-    // just reduce the buffer size by one single byte
-    const QAJ4C_Value* value = QAJ4C_parse_dynamic(json, lambda);
-    assert(QAJ4C_is_not_set(value));
-    free((void*)value);
+TEST(DomObjectAccessTests, GrowableObject) {
+    char buff[4096];
+    char key[32];
+    QAJ4C_Builder builder = QAJ4C_builder_create(buff, ARRAY_COUNT(buff));
+    QAJ4C_Value* root = QAJ4C_builder_get_document(&builder);
+
+    QAJ4C_set_object_growable(root, 2, &builder);
+    for (unsigned i = 0; i < 40; ++i) {
+        snprintf(key, sizeof(key), "key_%u", 39 - i);
+        QAJ4C_set_uint(QAJ4C_object_append_member_by_copy(root, key, &builder), 39 - i);
+        if (i == 20) {
+            QAJ4C_object_optimize(root);
+            assert(QAJ4C_get_internal_type(root) == QAJ4C_OBJECT_SORTED);
+        }
+    }
+    assert(QAJ4C_get_internal_type(root) == QAJ4C_OBJECT);
+    assert(QAJ4C_object_size(root) == 40);
+    assert(QAJ4C_get_uint(QAJ4C_object_get(root, "key_0")) == 0);
+    QAJ4C_object_optimize(root);
+    assert(QAJ4C_get_internal_type(root) == QAJ4C_OBJECT_SORTED);
+    for (unsigned i = 0; i < 40; ++i) {
+        snprintf(key, sizeof(key), "key_%u", i);
+        assert(QAJ4C_get_uint(QAJ4C_object_get(root, key)) == i);
+    }
+    QAJ4C_set_null(QAJ4C_object_append_member_by_ref(root, "extra", &builder));
+    assert(QAJ4C_is_null(QAJ4C_object_get(root, "extra")));
 }
 
-TEST(ErrorHandlingTests, ReallocFailsLater) {
-    char json[] = "[0.123456,9,12,3,5,7,2,3]";
-    static bool first = true;
-    auto lambda = []( void *ptr, size_t size ) {
-        if ( first ) {
-            first = false;
-            return realloc(ptr, size);
-        }
-        return (void*)NULL;
+TEST(ErrorHandlingTests, BuilderOverflowGrowableArray) {
+    char buff[sizeof(QAJ4C_Value) * 6];
+    QAJ4C_Builder builder = QAJ4C_builder_create(buff, ARRAY_COUNT(buff));
+    QAJ4C_Value* root = QAJ4C_builder_get_document(&builder);
+
+    static bool called = false;
+    auto lambda = [](){
+        called = true;
     };
-    // just reduce the buffer size by one single byte
-    const QAJ4C_Value* value = QAJ4C_parse_dynamic(json, lambda);
-    assert(QAJ4C_is_error(value));
+    QAJ4C_register_fatal_error_function(lambda);
 
-    assert(QAJ4C_error_get_errno(value) == QAJ4C_ERROR_ALLOCATION_ERROR);
-    free((void*)value);
+    QAJ4C_set_array_growable(root, 0, &builder);
+    for (int i = 0; i < 4; ++i) {
+        assert(QAJ4C_array_append(root, &builder) != NULL);
+    }
+    assert(called == false);
+    assert(QAJ4C_array_append(root, &builder) == NULL);
+    assert(called == true);
+    assert(QAJ4C_array_size(root) == 4);
+    assert(QAJ4C_array_append(QAJ4C_array_get_rw(root, 0), &builder) == NULL);
 }
 
-TEST(ErrorHandlingTests, DoubleSmallPrintBuffer) {
-    char json[] = "[0.123456]";
-    char out[ARRAY_COUNT(json) + 1];
-    memset(out, '\n', ARRAY_COUNT(out));
+TEST(ErrorHandlingTests, BuilderOverflowPackedArray) {
+    const double doubles[] = {0.5, -1.0, 3.25};
+    QAJ4C_Builder builder = QAJ4C_builder_create(NULL, 0);
 
-    size_t buff_size = QAJ4C_calculate_max_buffer_size(json);
-    char buff[buff_size];
-    const QAJ4C_Value* value = NULL;
+    static bool called = false;
+    auto lambda = [](){
+        called = true;
+    };
+    QAJ4C_register_fatal_error_function(lambda);
 
-    size_t actual_size = QAJ4C_parse(json, buff, buff_size, &value);
-    assert(!QAJ4C_is_error(value));
+    QAJ4C_Value value;
+    QAJ4C_set_array_from_doubles(&value, doubles, ARRAY_COUNT(doubles), true, &builder);
 
-    assert(actual_size == buff_size);
+    assert(called == true);
+    assert(QAJ4C_is_array(&value));
+    assert(0 == QAJ4C_array_size(&value));
+}
 
-    for (size_t i = 0, n = ARRAY_COUNT(json); i <= n; i++) {
-        assert(i == QAJ4C_sprint(value, out, i));
-        assert('\n' == out[i]); // check that nothing has been written over the bounds!
-        if (i > 0) {
-            assert(i - 1 == strlen(out));
-        }
+
+TEST(DomObjectAccessTests, LookupSameLengthKeysSorted) {
+    const size_t counts[] = {3, 8, 9, 100};
+    char json[4096];
+    for (size_t i = 0; i < ARRAY_COUNT(counts); ++i) {
+        create_same_length_keys_json(json, sizeof(json), counts[i]);
+        const QAJ4C_Value* value = QAJ4C_parse_dynamic(json, realloc);
+        assert(QAJ4C_get_internal_type(value) == (counts[i] >= QAJ4C_SORT_MIN_MEMBERS ? QAJ4C_OBJECT_SORTED : QAJ4C_OBJECT));
+        check_same_length_keys(value, counts[i]);
+        free((void*)value);
     }
 }
 
-TEST(ErrorHandlingTests, MultipleDoublesSmallPrintBuffer) {
-    char json[] = "[0.123456,6.9]";
-    char out[ARRAY_COUNT(json) + 1];
-    memset(out, '\n', ARRAY_COUNT(out));
-
-    size_t buff_size = QAJ4C_calculate_max_buffer_size(json);
-    char buff[buff_size];
-    const QAJ4C_Value* value = NULL;
+TEST(DomObjectAccessTests, LookupSameLengthKeysUnsorted) {
+    char json[4096];
+    create_same_length_keys_json(json, sizeof(json), 100);
+    const QAJ4C_Value* value = QAJ4C_parse_opt_dynamic(json, strlen(json), QAJ4C_PARSE_OPTS_DONT_SORT_OBJECT_MEMBERS, realloc);
+    assert(QAJ4C_get_internal_type(value) == QAJ4C_OBJECT);
+    check_same_length_keys(value, 100);
+    free((void*)value);
+}
 
-    size_t actual_size = QAJ4C_parse(json, buff, buff_size, &value);
-    assert(!QAJ4C_is_error(value));
+#ifndef QAJ4C_COMPACT_VALUES /* key hashes are not stored */
+/**
+ * Keys without a hash (e.g. created by older code paths) have to be found, nevertheless.
+ */
+TEST(DomObjectAccessTests, LookupKeysWithoutHash) {
+    char json[1024];
+    create_same_length_keys_json(json, sizeof(json), 20);
+    QAJ4C_Value* value = (QAJ4C_Value*)QAJ4C_parse_dynamic(json, realloc);
+    for (size_t i = 0; i < QAJ4C_object_size(value); ++i) {
+        QAJ4C_Member* member = (QAJ4C_Member*)QAJ4C_object_get_member(value, i);
+        assert(QAJ4C_get_key_hash(&member->key) != 0);
+        member->key.type &= 0xFFFF;
+    }
+    check_same_length_keys(value, 20);
+    free((void*)value);
+}
+#endif
 
-    assert(actual_size == buff_size);
+TEST(DomObjectAccessTests, LookupBuiltObject) {
+    uint8_t buff[4096];
+    QAJ4C_Builder builder = QAJ4C_builder_create(buff, sizeof(buff));
+    QAJ4C_Value* value = QAJ4C_builder_get_document(&builder);
+    char key[64];
 
-    for (size_t i = 0, n = ARRAY_COUNT(json); i <= n; i++) {
-        assert(i == QAJ4C_sprint(value, out, i));
-        assert('\n' == out[i]); // check that nothing has been written over the bounds!
-        if (i > 0) {
-            assert(i - 1 == strlen(out));
-        }
+    QAJ4C_set_object(value, 20, &builder);
+    for (unsigned i = 0; i < 20; ++i) {
+        snprintf(key, sizeof(key), "common_prefix_key_%03u", i);
+        QAJ4C_set_uint(QAJ4C_object_create_member_by_copy(value, key, &builder), i);
+    }
+    check_same_length_keys(value, 20);
+    QAJ4C_object_optimize(value);
+    check_same_length_keys(value, 20);
+}
+
+TEST(DomObjectAccessTests, ObjectFromArrays) {
+    uint8_t buff[1024];
+    QAJ4C_Builder builder = QAJ4C_builder_create(buff, sizeof(buff));
+    QAJ4C_Value* value = QAJ4C_builder_get_document(&builder);
+    const char* sorted_keys[] = {"b", "id", "name", "value"};
+    const char* unsorted_keys[] = {"value", "b", "name", "id"};
+    QAJ4C_Value numbers[3];
+    const QAJ4C_Value* values[4] = {&numbers[0], &numbers[1], &numbers[2], NULL};
+    char output[128];
+
+    for (unsigned i = 0; i < 3; ++i) {
+        QAJ4C_set_uint(&numbers[i], i);
     }
+    QAJ4C_set_object_from_arrays(value, sorted_keys, NULL, values, 4, true, &builder);
+    assert(QAJ4C_get_internal_type(value) == QAJ4C_OBJECT_SORTED);
+    assert(QAJ4C_get_uint(QAJ4C_object_get(value, "name")) == 2);
+    assert(QAJ4C_get_uint(QAJ4C_object_get(value, "b")) == 0);
+    assert(QAJ4C_object_get(value, "c") == NULL);
+
+    QAJ4C_set_object_from_arrays(value, unsorted_keys, NULL, values, 4, false, &builder);
+    assert(QAJ4C_get_internal_type(value) == QAJ4C_OBJECT);
+    assert(QAJ4C_is_null(QAJ4C_object_get(value, "id")));
+    QAJ4C_sprint(value, output, ARRAY_COUNT(output));
+    assert(strcmp(R"({"value":0,"b":1,"name":2,"id":null})", output) == 0);
 }
 
-TEST(ErrorHandlingTests, PrintStringPartially) {
-    char json[] = R"(["so ka?","ey chummer!"])";
-    char out[ARRAY_COUNT(json) + 1];
-    memset(out, '\n', ARRAY_COUNT(out));
+TEST(DomObjectAccessTests, ObjectFromArraysParsedValues) {
+    const char json[] = R"([[1.5, 2.5], "some string value", {"x": 1}])";
+    const QAJ4C_Value* document = QAJ4C_parse_opt_dynamic(json, ARRAY_COUNT(json), QAJ4C_PARSE_OPTS_PACK_ARRAYS, realloc);
+    uint8_t buff[256];
+    QAJ4C_Builder builder = QAJ4C_builder_create(buff, sizeof(buff));
+    QAJ4C_Value* value = QAJ4C_builder_get_document(&builder);
+    const char* keys[] = {"a", "b", "c", "d"};
+    const QAJ4C_Value* values[] = {QAJ4C_array_get(QAJ4C_array_get(document, 0), 1), QAJ4C_array_get(document, 0), QAJ4C_array_get(document, 1), QAJ4C_array_get(document, 2)};
+    char output[128];
 
-    size_t buff_size = QAJ4C_calculate_max_buffer_size(json);
-    char buff[buff_size];
-    const QAJ4C_Value* value = NULL;
+    QAJ4C_set_object_from_arrays(value, keys, NULL, values, 4, true, &builder);
+    QAJ4C_sprint(value, output, ARRAY_COUNT(output));
+    assert(strcmp(R"({"a":2.5,"b":[1.5,2.5],"c":"some string value","d":{"x":1}})", output) == 0);
+    free((void*)document);
+}
 
-    size_t actual_size = QAJ4C_parse(json, buff, buff_size, &value);
-    assert(!QAJ4C_is_error(value));
+#ifndef QAJ4C_COMPACT_VALUES /* packed arrays are not supported */
+TEST(ErrorHandlingTests, PackedArrayGetRw) {
+    const char json[] = R"([1,2,3,4])";
+    const QAJ4C_Value* value = QAJ4C_parse_opt_dynamic(json, ARRAY_COUNT(json), QAJ4C_PARSE_OPTS_PACK_ARRAYS, realloc);
+    assert(QAJ4C_get_internal_type(value) == QAJ4C_ARRAY_PACKED);
 
-    assert(actual_size == buff_size);
+    static bool called = false;
+    auto lambda = [](){
+        called = true;
+    };
+    QAJ4C_register_fatal_error_function(lambda);
 
-    for (size_t i = 0, n = ARRAY_COUNT(json); i <= n; i++) {
-        assert(i == QAJ4C_sprint(value, out, i));
-        assert('\n' == out[i]); // check that nothing has been written over the bounds!
-        if (i > 0) {
-            assert(i - 1 == strlen(out));
-        }
-    }
+    assert(QAJ4C_array_get_rw((QAJ4C_Value*)value, 3) == NULL);
+    assert(called == true);
+    assert(QAJ4C_get_int(QAJ4C_array_get(value, 3)) == 4);
+    free((void*)value);
 }
+#endif
 
-TEST(ErrorHandlingTests, PrintCompositionOfObjectsAndArraysPartially) {
-    char json[] = R"({"id":5,"values":[{},[],{"key":"val","key2":"val2"},[12,34],5.4]})";
-    char out[ARRAY_COUNT(json) + 1];
-    memset(out, '\n', ARRAY_COUNT(out));
+TEST(ErrorHandlingTests, ObjectFromArraysNotPresorted) {
+    uint8_t buff[1024];
+    QAJ4C_Builder builder = QAJ4C_builder_create(buff, sizeof(buff));
+    QAJ4C_Value* value = QAJ4C_builder_get_document(&builder);
+    const char* unsorted_keys[] = {"id", "b"};
+    const char* duplicate_keys[] = {"a", "id", "id"};
+    QAJ4C_Value numbers[3];
+    const QAJ4C_Value* values[3] = {&numbers[0], &numbers[1], &numbers[2]};
 
-    size_t buff_size = QAJ4C_calculate_max_buffer_size(json);
-    char buff[buff_size];
-    const QAJ4C_Value* value = NULL;
+    static int called = 0;
+    auto lambda = [](){
+        ++called;
+    };
+    QAJ4C_register_fatal_error_function(lambda);
 
-    size_t actual_size = QAJ4C_parse(json, buff, buff_size, &value);
-    assert(!QAJ4C_is_error(value));
+    for (unsigned i = 0; i < 3; ++i) {
+        QAJ4C_set_uint(&numbers[i], i);
+    }
+    QAJ4C_set_object_from_arrays(value, unsorted_keys, NULL, values, 2, true, &builder);
+    assert(called == 1);
+    assert(QAJ4C_get_internal_type(value) == QAJ4C_OBJECT);
+    assert(QAJ4C_get_uint(QAJ4C_object_get(value, "b")) == 1);
 
-    assert(actual_size == buff_size);
+    QAJ4C_set_object_from_arrays(value, duplicate_keys, NULL, values, 3, true, &builder);
+    assert(called == 2);
+    assert(QAJ4C_get_internal_type(value) == QAJ4C_OBJECT);
+}
 
-    for (size_t i = 0, n = ARRAY_COUNT(json); i <= n; i++) {
-        assert(i == QAJ4C_sprint(value, out, i));
-        assert('\n' == out[i]); // check that nothing has been written over the bounds!
-        if (i > 0) {
-            assert(i - 1 == strlen(out));
-        }
+
+#ifndef QAJ4C_COMPACT_VALUES /* lookup indices are not supported */
+TEST(DomObjectAccessTests, LookupHashIndex) {
+    const int opts[] = {QAJ4C_PARSE_OPTS_HASH_INDEX, QAJ4C_PARSE_OPTS_HASH_INDEX | QAJ4C_PARSE_OPTS_DONT_SORT_OBJECT_MEMBERS};
+    static char json[16384];
+    static uint8_t buff[65536];
+    create_same_length_keys_json(json, sizeof(json), 500);
+
+    for (size_t i = 0; i < ARRAY_COUNT(opts); ++i) {
+        const QAJ4C_Value* value = NULL;
+        size_t required_size = QAJ4C_calculate_max_buffer_size_opt(json, strlen(json), opts[i]);
+        assert(required_size <= sizeof(buff));
+        assert(QAJ4C_parse_opt(json, strlen(json), opts[i], buff, required_size, &value) == required_size);
+        assert((value->type & QAJ4C_OBJECT_FLAG_HASH_INDEX) != 0);
+        check_same_length_keys(value, 500);
     }
 }
+#endif
 
-TEST(ErrorHandlingTests, PrintConstantsPartially) {
-    char json[] = R"([null,true,false])";
-    char out[ARRAY_COUNT(json) + 1];
-    memset(out, '\n', ARRAY_COUNT(out));
+#ifndef QAJ4C_COMPACT_VALUES /* lookup indices are not supported */
+TEST(DomObjectAccessTests, HashIndexBufferSize) {
+    static char json[16384];
+    create_same_length_keys_json(json, sizeof(json), QAJ4C_HASH_INDEX_THRESHOLD);
+    size_t plain_size = QAJ4C_calculate_max_buffer_size_opt(json, strlen(json), 0);
+    size_t indexed_size = QAJ4C_calculate_max_buffer_size_opt(json, strlen(json), QAJ4C_PARSE_OPTS_HASH_INDEX);
+    assert(plain_size == QAJ4C_calculate_max_buffer_size(json));
+    assert(indexed_size == plain_size + QAJ4C_object_index_size(QAJ4C_OBJECT_FLAG_HASH_INDEX, QAJ4C_HASH_INDEX_THRESHOLD));
+
+    /* smaller objects do not get an index */
+    create_same_length_keys_json(json, sizeof(json), QAJ4C_HASH_INDEX_THRESHOLD - 1);
+    plain_size = QAJ4C_calculate_max_buffer_size_opt(json, strlen(json), 0);
+    indexed_size = QAJ4C_calculate_max_buffer_size_opt(json, strlen(json), QAJ4C_PARSE_OPTS_HASH_INDEX);
+    assert(indexed_size == plain_size);
+
+    const QAJ4C_Value* value = QAJ4C_parse_opt_dynamic(json, strlen(json), QAJ4C_PARSE_OPTS_HASH_INDEX, realloc);
+    assert((value->type & QAJ4C_OBJECT_FLAG_HASH_INDEX) == 0);
+    check_same_length_keys(value, QAJ4C_HASH_INDEX_THRESHOLD - 1);
+    free((void*)value);
+}
+#endif
 
-    size_t buff_size = QAJ4C_calculate_max_buffer_size(json);
-    char buff[buff_size];
-    const QAJ4C_Value* value = NULL;
+/**
+ * Nested large objects in an array require the index space to be reserved for each of them.
+ */
+TEST(DomObjectAccessTests, NestedHashIndex) {
+    static char object_json[8192];
+    static char json[65536];
+    create_same_length_keys_json(object_json, sizeof(object_json), 100);
+    snprintf(json, sizeof(json), "[%s,{\"a\":[%s]},%s]", object_json, object_json, object_json);
 
-    size_t actual_size = QAJ4C_parse(json, buff, buff_size, &value);
-    assert(!QAJ4C_is_error(value));
+    const QAJ4C_Value* value = QAJ4C_parse_opt_dynamic(json, strlen(json), QAJ4C_PARSE_OPTS_HASH_INDEX, realloc);
+    assert(QAJ4C_is_array(value));
+    check_same_length_keys(QAJ4C_array_get(value, 0), 100);
+    check_same_length_keys(QAJ4C_array_get(QAJ4C_object_get(QAJ4C_array_get(value, 1), "a"), 0), 100);
+    check_same_length_keys(QAJ4C_array_get(value, 2), 100);
+    free((void*)value);
+}
 
-    assert(actual_size == buff_size);
 
-    for (size_t i = 0, n = ARRAY_COUNT(json); i <= n; i++) {
-        assert(i == QAJ4C_sprint(value, out, i));
-        assert('\n' == out[i]); // check that nothing has been written over the bounds!
-        if (i > 0) {
-            assert(i - 1 == strlen(out));
-        }
-    }
+TEST(DomObjectAccessTests, LookupByKey) {
+    const char json[] = R"([{"id":1,"name":"foo","age":39},{"id":2,"name":"bar","age":40},{"name":"baz","id":3},{"age":41}])";
+    const QAJ4C_Value* value = QAJ4C_parse_opt_dynamic(json, ARRAY_COUNT(json), QAJ4C_PARSE_OPTS_DONT_SORT_OBJECT_MEMBERS, realloc);
+    QAJ4C_Key id_key;
+    QAJ4C_Key age_key;
+    QAJ4C_key_init(&id_key, "id");
+    QAJ4C_key_init_n(&age_key, "age_", 3);
+
+    assert(QAJ4C_get_uint(QAJ4C_object_get_key(QAJ4C_array_get(value, 0), &id_key)) == 1);
+    assert(id_key.last_index == 0);
+    assert(QAJ4C_get_uint(QAJ4C_object_get_key(QAJ4C_array_get(value, 1), &id_key)) == 2);
+    assert(id_key.last_index == 0);
+    /* the member is located at a different index */
+    assert(QAJ4C_get_uint(QAJ4C_object_get_key(QAJ4C_array_get(value, 2), &id_key)) == 3);
+    assert(id_key.last_index == 1);
+    assert(QAJ4C_object_get_key(QAJ4C_array_get(value, 3), &id_key) == NULL);
+
+    assert(QAJ4C_get_uint(QAJ4C_object_get_key(QAJ4C_array_get(value, 0), &age_key)) == 39);
+    assert(age_key.last_index == 2);
+    assert(QAJ4C_object_get_key(QAJ4C_array_get(value, 2), &age_key) == NULL);
+    /* the cached index is out of range */
+    assert(QAJ4C_get_uint(QAJ4C_object_get_key(QAJ4C_array_get(value, 3), &age_key)) == 41);
+    assert(age_key.last_index == 0);
+
+    free((void*)value);
 }
 
-TEST(ErrorHandlingTests, NullSmallPrintBuffer) {
-    char json[] = "[null]";
-    char out[ARRAY_COUNT(json) + 1];
-    memset(out, '\n', ARRAY_COUNT(out));
 
-    size_t buff_size = QAJ4C_calculate_max_buffer_size(json);
-    char buff[buff_size];
+#ifndef QAJ4C_COMPACT_VALUES /* lookup indices are not supported */
+TEST(DomObjectAccessTests, LazyIndex) {
+    const char small_json[] = R"({"name":"foo","id":1,"age":39,"job":null,"role":"admin"})";
+    char json[4096];
+    char output[4096];
+    uint8_t buff[8192];
     const QAJ4C_Value* value = NULL;
+    create_same_length_keys_json(json, sizeof(json), QAJ4C_SORT_MIN_MEMBERS);
+    size_t required_size = QAJ4C_calculate_max_buffer_size_opt(json, strlen(json), QAJ4C_PARSE_OPTS_LAZY_INDEX);
 
-    size_t actual_size = QAJ4C_parse(json, buff, buff_size, &value);
-    assert(!QAJ4C_is_error(value));
-
-    assert(actual_size == buff_size);
+    /* small objects are scanned and get no index */
+    assert(QAJ4C_calculate_max_buffer_size_opt(small_json, ARRAY_COUNT(small_json), QAJ4C_PARSE_OPTS_LAZY_INDEX) == QAJ4C_calculate_max_buffer_size(small_json));
 
-    for (size_t i = 0, n = ARRAY_COUNT(json); i <= n; i++) {
-        assert(i == QAJ4C_sprint(value, out, i));
-        assert('\n' == out[i]); // check that nothing has been written over the bounds!
-        if (i > 0) {
-            assert(i - 1 == strlen(out));
-        }
-    }
-}
+    assert(required_size == QAJ4C_calculate_max_buffer_size(json) + QAJ4C_object_index_size(QAJ4C_OBJECT_FLAG_SORTED_INDEX, QAJ4C_SORT_MIN_MEMBERS));
+    assert(QAJ4C_parse_opt(json, strlen(json), QAJ4C_PARSE_OPTS_LAZY_INDEX, buff, required_size, &value) == required_size);
+
+    /* the members keep the input order */
+    assert(QAJ4C_get_internal_type(value) == QAJ4C_OBJECT);
+    QAJ4C_sprint(value, output, ARRAY_COUNT(output));
+    assert(strcmp(json, output) == 0);
+
+    const QAJ4C_Object* obj_ptr = (const QAJ4C_Object*)value;
+    const size_type* state = (const size_type*)(obj_ptr->top + obj_ptr->count);
+    assert(*state == QAJ4C_INDEX_STATE_PENDING);
+    assert(QAJ4C_get_uint(QAJ4C_object_get(value, "common_prefix_key_005")) == 5);
+    assert(*state == QAJ4C_INDEX_STATE_READY);
+    check_same_length_keys(value, QAJ4C_SORT_MIN_MEMBERS);
+}
+#endif
+
+TEST(DomObjectAccessTests, LazyIndexLargeObjects) {
+    static char object_json[16384];
+    static char json[65536];
+    const int opts[] = {QAJ4C_PARSE_OPTS_LAZY_INDEX, QAJ4C_PARSE_OPTS_LAZY_INDEX | QAJ4C_PARSE_OPTS_HASH_INDEX};
+    create_same_length_keys_json(object_json, sizeof(object_json), 300);
+    snprintf(json, sizeof(json), "[%s,{\"a\":[%s]}]", object_json, object_json);
+
+    for (size_t i = 0; i < ARRAY_COUNT(opts); ++i) {
+        const QAJ4C_Value* value = QAJ4C_parse_opt_dynamic(json, strlen(json), opts[i], realloc);
+        assert(QAJ4C_is_array(value));
+        check_same_length_keys(QAJ4C_array_get(value, 0), 300);
+        check_same_length_keys(QAJ4C_array_get(QAJ4C_object_get(QAJ4C_array_get(value, 1), "a"), 0), 300);
+        free((void*)value);
+    }
+}
+
+static void* lazy_index_reader( void* arg ) {
+    const QAJ4C_Value* value = (const QAJ4C_Value*)arg;
+    for (size_t i = 0; i < QAJ4C_array_size(value); ++i) {
+        check_same_length_keys(QAJ4C_array_get(value, i), 40);
+    }
+    return NULL;
+}
+
+/**
+ * Multiple threads read the same document, so the lazy indices are built while other
+ * threads perform lookups on the same objects.
+ */
+TEST(DomObjectAccessTests, LazyIndexConcurrentReaders) {
+    static char object_json[4096];
+    static char json[1024 * 1024];
+    pthread_t threads[8];
+    size_t pos = snprintf(json, sizeof(json), "[");
+    create_same_length_keys_json(object_json, sizeof(object_json), 40);
+    for (size_t i = 0; i < 200; ++i) {
+        pos += snprintf(json + pos, sizeof(json) - pos, "%s%s", i > 0 ? "," : "", object_json);
+    }
+    snprintf(json + pos, sizeof(json) - pos, "]");
+
+    for (int run = 0; run < 20; ++run) {
+        const QAJ4C_Value* value = QAJ4C_parse_opt_dynamic(json, strlen(json), QAJ4C_PARSE_OPTS_LAZY_INDEX, realloc);
+        for (size_t i = 0; i < ARRAY_COUNT(threads); ++i) {
+            assert(pthread_create(&threads[i], NULL, lazy_index_reader, (void*)value) == 0);
+        }
+        for (size_t i = 0; i < ARRAY_COUNT(threads); ++i) {
+            pthread_join(threads[i], NULL);
+        }
+        free((void*)value);
+    }
+}
+
+
+TEST(DomObjectAccessTests, KeepOrder) {
+    const char json[] = R"({"role":"admin","name":"foo","id":1,"age":39,"job":null,"nested":{"z":1,"y":2,"x":3}})";
+    char output[ARRAY_COUNT(json)];
+    const QAJ4C_Value* value = QAJ4C_parse_opt_dynamic(json, ARRAY_COUNT(json), QAJ4C_PARSE_OPTS_KEEP_ORDER, realloc);
+
+    QAJ4C_sprint(value, output, ARRAY_COUNT(output));
+    assert(strcmp(json, output) == 0);
+    assert(QAJ4C_get_internal_type(value) == QAJ4C_OBJECT);
+#ifndef QAJ4C_COMPACT_VALUES
+    /* small objects are scanned and get no index (see KeepOrderLargeObjects) */
+    assert((value->type & (QAJ4C_OBJECT_FLAG_SORTED_INDEX | QAJ4C_OBJECT_FLAG_LAZY_INDEX)) == 0);
+#endif
+
+    assert(QAJ4C_get_uint(QAJ4C_object_get(value, "id")) == 1);
+    assert(QAJ4C_get_uint(QAJ4C_object_get(value, "age")) == 39);
+    assert(QAJ4C_is_null(QAJ4C_object_get(value, "job")));
+    assert(QAJ4C_string_equals(QAJ4C_object_get(value, "name"), "foo"));
+    assert(QAJ4C_string_equals(QAJ4C_object_get(value, "role"), "admin"));
+    assert(QAJ4C_get_uint(QAJ4C_object_get(QAJ4C_object_get(value, "nested"), "x")) == 3);
+    assert(QAJ4C_object_get(value, "ids") == NULL);
+
+    free((void*)value);
+}
+
+
+TEST(DomObjectAccessTests, KeepOrderLargeObjects) {
+    static char json[65536];
+    static char output[65536];
+    const int opts[] = {QAJ4C_PARSE_OPTS_KEEP_ORDER, QAJ4C_PARSE_OPTS_KEEP_ORDER | QAJ4C_PARSE_OPTS_HASH_INDEX};
+    char* pos = json;
+
+    /* keys in descending order */
+    pos += sprintf(pos, "{");
+    for (int i = 499; i >= 0; --i) {
+        pos += sprintf(pos, "\"common_prefix_key_%03u\":%u%s", i, i, i > 0 ? "," : "");
+    }
+    sprintf(pos, "}");
+
+    for (size_t i = 0; i < ARRAY_COUNT(opts); ++i) {
+        size_t buff_size = QAJ4C_calculate_max_buffer_size_opt(json, strlen(json), opts[i]);
+        uint8_t* buff = (uint8_t*)malloc(buff_size);
+        const QAJ4C_Value* value = NULL;
+        assert(QAJ4C_parse_opt(json, strlen(json), opts[i], buff, buff_size, &value) == buff_size);
+        check_same_length_keys(value, 500);
+        QAJ4C_sprint(value, output, ARRAY_COUNT(output));
+        assert(strcmp(json, output) == 0);
+        free(buff);
+    }
+}
+
+
+static void check_get_many( const QAJ4C_Value* value ) {
+    static const size_t key_count = 70; // more than one chunk
+    char names[key_count][32];
+    const char* keys[key_count];
+    const QAJ4C_Value* result[key_count];
+
+    // existing and missing keys of different lengths in mixed order (also duplicates)
+    for (size_t i = 0; i < key_count; ++i) {
+        size_t id = (i * 37) % 120;
+        if (id % 5 == 0) {
+            snprintf(names[i], sizeof(names[i]), "missing_%u", (unsigned)id);
+        } else {
+            snprintf(names[i], sizeof(names[i]), "common_prefix_key_%03u", (unsigned)(id % 100));
+        }
+        keys[i] = names[i];
+    }
+    keys[key_count - 1] = keys[0];
+
+    QAJ4C_object_get_many(value, keys, key_count, result);
+    for (size_t i = 0; i < key_count; ++i) {
+        assert(result[i] == QAJ4C_object_get(value, keys[i]));
+    }
+}
+
+TEST(DomObjectAccessTests, GetMany) {
+    const size_t counts[] = {5, 40, 100};
+    const int opts[] = {0, QAJ4C_PARSE_OPTS_DONT_SORT_OBJECT_MEMBERS, QAJ4C_PARSE_OPTS_HASH_INDEX,
+                        QAJ4C_PARSE_OPTS_KEEP_ORDER, QAJ4C_PARSE_OPTS_LAZY_INDEX};
+    static char json[4096];
+
+    for (size_t i = 0; i < ARRAY_COUNT(counts); ++i) {
+        create_same_length_keys_json(json, sizeof(json), counts[i]);
+        for (size_t j = 0; j < ARRAY_COUNT(opts); ++j) {
+            const QAJ4C_Value* value = QAJ4C_parse_opt_dynamic(json, strlen(json), opts[j], realloc);
+            check_get_many(value);
+            free((void*)value);
+        }
+    }
+}
+
+TEST(DomObjectAccessTests, GetManyKeysOfDifferentLength) {
+    const char json[] = R"({"b":1,"a":2,"id":3,"name":4,"x":5,"role":6,"created":7,"":8})";
+    const char* keys[] = {"role", "a", "", "id", "created", "b", "foo", "x", "name", "nam"};
+    const unsigned expected[] = {6, 2, 8, 3, 7, 1, 0, 5, 4, 0};
+    const QAJ4C_Value* result[ARRAY_COUNT(keys)];
+    const QAJ4C_Value* value = QAJ4C_parse_dynamic(json, realloc);
+
+    QAJ4C_object_optimize((QAJ4C_Value*)value);
+    QAJ4C_object_get_many(value, keys, ARRAY_COUNT(keys), result);
+    for (size_t i = 0; i < ARRAY_COUNT(keys); ++i) {
+        if (expected[i] == 0) {
+            assert(result[i] == NULL);
+        } else {
+            assert(QAJ4C_get_uint(result[i]) == expected[i]);
+        }
+    }
+    free((void*)value);
+}
+
+
+#ifndef QAJ4C_COMPACT_VALUES /* learned and shared shapes are not supported */
+TEST(DomObjectAccessTests, ShareShapes) {
+    const char json[] = R"([{"id":1,"name":"first","a rather long key":[1,2]},{"id":2,"name":"second","a rather long key":{"x":[]}},{"id":3,"name":"third","a rather long key":null}])";
+    char output[ARRAY_COUNT(json)];
+    size_t buff_size = QAJ4C_calculate_max_buffer_size_opt(json, ARRAY_COUNT(json), QAJ4C_PARSE_OPTS_SHARE_SHAPES);
+    char buff[buff_size];
+    const QAJ4C_Value* value = NULL;
+
+    /* the keys of the 2nd and 3rd object are not stored (only a header in front of the values) */
+    assert(QAJ4C_calculate_max_buffer_size_opt(json, ARRAY_COUNT(json), 0) - buff_size == 2 * (2 * sizeof(QAJ4C_Value) + ARRAY_COUNT("a rather long key")));
+    assert(QAJ4C_parse_opt(json, ARRAY_COUNT(json), QAJ4C_PARSE_OPTS_SHARE_SHAPES, buff, buff_size, &value) == buff_size);
+    assert(QAJ4C_get_internal_type(QAJ4C_array_get(value, 0)) == QAJ4C_OBJECT);
+    assert(QAJ4C_get_internal_type(QAJ4C_array_get(value, 1)) == QAJ4C_OBJECT_SHAPED);
+    assert(QAJ4C_get_internal_type(QAJ4C_array_get(value, 2)) == QAJ4C_OBJECT_SHAPED);
+
+    QAJ4C_sprint(value, output, ARRAY_COUNT(output));
+    assert(strcmp(json, output) == 0);
+
+    for (size_t i = 0; i < QAJ4C_array_size(value); ++i) {
+        const QAJ4C_Value* object = QAJ4C_array_get(value, i);
+        const char* keys[] = {"name", "id", "missing"};
+        const QAJ4C_Value* result[ARRAY_COUNT(keys)];
+        QAJ4C_Key key;
+
+        assert(QAJ4C_object_size(object) == 3);
+        assert(QAJ4C_get_uint(QAJ4C_object_get(object, "id")) == i + 1);
+        assert(QAJ4C_object_get(object, "missing") == NULL);
+        assert(QAJ4C_string_equals(QAJ4C_member_get_key(QAJ4C_object_get_member(object, 2)), "a rather long key"));
+        assert(QAJ4C_member_get_value(QAJ4C_object_get_member(object, 0)) == QAJ4C_object_get(object, "id"));
+
+        QAJ4C_key_init(&key, "name");
+        assert(QAJ4C_object_get_key(object, &key) == QAJ4C_object_get(object, "name"));
+        assert(QAJ4C_object_get_key(object, &key) == QAJ4C_object_get(object, "name"));
+
+        QAJ4C_object_get_many(object, keys, ARRAY_COUNT(keys), result);
+        assert(result[0] == QAJ4C_object_get(object, "name"));
+        assert(QAJ4C_get_uint(result[1]) == i + 1);
+        assert(result[2] == NULL);
+    }
+}
+#endif
+
+#ifndef QAJ4C_COMPACT_VALUES /* learned and shared shapes are not supported */
+TEST(DomObjectAccessTests, ShareShapesCopy) {
+    const char json[] = R"([{"alpha":1,"beta":2},{"alpha":3,"beta":4},{"alpha":5,"beta":"x"}])";
+    const QAJ4C_Value* value = QAJ4C_parse_opt_dynamic(json, ARRAY_COUNT(json), QAJ4C_PARSE_OPTS_SHARE_SHAPES, realloc);
+    const QAJ4C_Value* plain = QAJ4C_parse_opt_dynamic(json, ARRAY_COUNT(json), 0, realloc);
+    QAJ4C_Builder builder;
+    QAJ4C_Value* copy;
+
+    assert(QAJ4C_get_internal_type(QAJ4C_array_get(value, 1)) == QAJ4C_OBJECT_SHAPED);
+    assert(QAJ4C_value_sizeof(value) == QAJ4C_value_sizeof(plain));
+    assert(QAJ4C_equals(value, plain));
+    assert(QAJ4C_equals(plain, value));
+
+    QAJ4C_builder_init(&builder, malloc(QAJ4C_value_sizeof(value)), QAJ4C_value_sizeof(value));
+    copy = QAJ4C_builder_get_document(&builder);
+    QAJ4C_copy(value, copy, &builder);
+    assert(builder.cur_obj_pos == builder.buffer_size);
+    assert(QAJ4C_get_internal_type(QAJ4C_array_get(copy, 1)) == QAJ4C_OBJECT);
+    assert(QAJ4C_equals(copy, value));
+    assert(QAJ4C_equals(copy, plain));
+
+    free(builder.buffer);
+    free((void*)value);
+    free((void*)plain);
+}
+#endif
+
+#ifndef QAJ4C_COMPACT_VALUES /* learned and shared shapes are not supported */
+TEST(DomObjectAccessTests, ShareShapesOnlyWithDirectPredecessor) {
+    const char json[] = R"([{"a":1,"b":2},{"b":3,"a":4},{"b":5,"a":6},7,{"b":8,"a":9},{"b":10},{"b":11,"a":12,"c":13},{"b":14,"a":15},{"b" : 16 , /* c */ "a":{"b":[17]}},[{"b":18,"a":19}]])";
+    const QAJ4C_INTERNAL_TYPE expected[] = {QAJ4C_OBJECT, QAJ4C_OBJECT, QAJ4C_OBJECT_SHAPED, QAJ4C_PRIMITIVE, QAJ4C_OBJECT, QAJ4C_OBJECT, QAJ4C_OBJECT, QAJ4C_OBJECT, QAJ4C_OBJECT_SHAPED, QAJ4C_ARRAY};
+    const QAJ4C_Value* value = QAJ4C_parse_opt_dynamic(json, ARRAY_COUNT(json), QAJ4C_PARSE_OPTS_SHARE_SHAPES, realloc);
+    const QAJ4C_Value* plain = QAJ4C_parse_opt_dynamic(json, ARRAY_COUNT(json), 0, realloc);
+
+    assert(QAJ4C_array_size(value) == ARRAY_COUNT(expected));
+    for (size_t i = 0; i < ARRAY_COUNT(expected); ++i) {
+        assert(QAJ4C_get_internal_type(QAJ4C_array_get(value, i)) == expected[i]);
+    }
+    assert(QAJ4C_get_uint(QAJ4C_array_get(QAJ4C_object_get(QAJ4C_object_get(QAJ4C_array_get(value, 8), "a"), "b"), 0)) == 17);
+    assert(QAJ4C_equals(value, plain));
+
+    free((void*)value);
+    free((void*)plain);
+}
+#endif
+
+#ifndef QAJ4C_COMPACT_VALUES /* learned and shared shapes are not supported */
+TEST(DomObjectAccessTests, ShareShapesEscapedKeys) {
+    char json[] = R"([{"a":1,"b\"":"a longer string value"},{"a":2,"b\"":"another string value"},{"a":3,"b\u0022":"x"}])";
+    char output[ARRAY_COUNT(json)];
+    size_t buff_size = QAJ4C_calculate_max_buffer_size_insitu_opt(json, ARRAY_COUNT(json), QAJ4C_PARSE_OPTS_SHARE_SHAPES);
+    char buff[buff_size];
+    const QAJ4C_Value* value = NULL;
+
+    assert(QAJ4C_parse_opt_insitu(json, ARRAY_COUNT(json), QAJ4C_PARSE_OPTS_SHARE_SHAPES, buff, buff_size, &value) == buff_size);
+    /* equal keys that are escaped differently are not shared */
+    assert(QAJ4C_get_internal_type(QAJ4C_array_get(value, 1)) == QAJ4C_OBJECT_SHAPED);
+    assert(QAJ4C_get_internal_type(QAJ4C_array_get(value, 2)) == QAJ4C_OBJECT);
+    for (size_t i = 0; i < QAJ4C_array_size(value); ++i) {
+        assert(QAJ4C_get_uint(QAJ4C_object_get(QAJ4C_array_get(value, i), "a")) == i + 1);
+    }
+    assert(QAJ4C_string_equals(QAJ4C_object_get(QAJ4C_array_get(value, 1), "b\""), "another string value"));
+
+    QAJ4C_sprint(value, output, ARRAY_COUNT(output));
+    assert(strcmp(R"([{"a":1,"b\"":"a longer string value"},{"a":2,"b\"":"another string value"},{"a":3,"b\"":"x"}])", output) == 0);
+}
+#endif
+
+#ifndef QAJ4C_COMPACT_VALUES /* packed arrays are not supported */
+TEST(DomObjectAccessTests, PackArrays) {
+    const char json[] = R"({"ints":[1, -2,3000000000 ,-5000000000,123456789012345678],"doubles":[1.5,-2e3,0.25],"mixed":[1,2.5],"big":[1234567890123456789],"strings":["a"],"empty":[],"nested":[[1,2],[3.5]]})";
+    char output[ARRAY_COUNT(json)];
+    size_t buff_size = QAJ4C_calculate_max_buffer_size_opt(json, ARRAY_COUNT(json), QAJ4C_PARSE_OPTS_PACK_ARRAYS | QAJ4C_PARSE_OPTS_DONT_SORT_OBJECT_MEMBERS);
+    char buff[buff_size];
+    const QAJ4C_Value* value = NULL;
+    const QAJ4C_Value* plain = QAJ4C_parse_opt_dynamic(json, ARRAY_COUNT(json), QAJ4C_PARSE_OPTS_DONT_SORT_OBJECT_MEMBERS, realloc);
+    const QAJ4C_Value* ints;
+    const QAJ4C_Value* doubles;
+
+    /* the 5 integers, 3 doubles and 3 nested elements only take 8 bytes each */
+    assert(QAJ4C_calculate_max_buffer_size_opt(json, ARRAY_COUNT(json), QAJ4C_PARSE_OPTS_DONT_SORT_OBJECT_MEMBERS) - buff_size == 11 * (sizeof(QAJ4C_Value) - 8));
+    assert(QAJ4C_parse_opt(json, ARRAY_COUNT(json), QAJ4C_PARSE_OPTS_PACK_ARRAYS | QAJ4C_PARSE_OPTS_DONT_SORT_OBJECT_MEMBERS, buff, buff_size, &value) == buff_size);
+    assert(QAJ4C_get_internal_type(QAJ4C_object_get(value, "mixed")) == QAJ4C_ARRAY);
+    assert(QAJ4C_get_internal_type(QAJ4C_object_get(value, "big")) == QAJ4C_ARRAY);
+    assert(QAJ4C_get_internal_type(QAJ4C_object_get(value, "strings")) == QAJ4C_ARRAY);
+    assert(QAJ4C_get_internal_type(QAJ4C_object_get(value, "empty")) == QAJ4C_ARRAY);
+    assert(QAJ4C_get_internal_type(QAJ4C_array_get(QAJ4C_object_get(value, "nested"), 0)) == QAJ4C_ARRAY_PACKED);
+    assert(QAJ4C_array_get_doubles(QAJ4C_array_get(QAJ4C_object_get(value, "nested"), 1))[0] == 3.5);
+
+    ints = QAJ4C_object_get(value, "ints");
+    assert(QAJ4C_get_internal_type(ints) == QAJ4C_ARRAY_PACKED);
+    assert(QAJ4C_array_get_doubles(ints) == NULL);
+    assert(QAJ4C_array_get_int64s(ints)[1] == -2);
+    assert(QAJ4C_array_get_int64s(ints)[4] == 123456789012345678LL);
+    assert(QAJ4C_array_size(ints) == 5);
+    assert(QAJ4C_get_type(QAJ4C_array_get(ints, 0)) == QAJ4C_TYPE_NUMBER);
+    assert(QAJ4C_get_int(QAJ4C_array_get(ints, 1)) == -2);
+    assert(!QAJ4C_is_int(QAJ4C_array_get(ints, 2)) && QAJ4C_get_uint(QAJ4C_array_get(ints, 2)) == 3000000000u);
+    assert(!QAJ4C_is_uint64(QAJ4C_array_get(ints, 3)) && QAJ4C_get_int64(QAJ4C_array_get(ints, 3)) == -5000000000LL);
+    assert(QAJ4C_get_double(QAJ4C_array_get(ints, 3)) == -5000000000.0);
+
+    doubles = QAJ4C_object_get(value, "doubles");
+    assert(QAJ4C_array_get_int64s(doubles) == NULL);
+    assert(QAJ4C_array_get_doubles(doubles)[1] == -2000.0);
+    assert(QAJ4C_is_double(QAJ4C_array_get(doubles, 2)) && !QAJ4C_is_int(QAJ4C_array_get(doubles, 2)));
+    assert(QAJ4C_get_double(QAJ4C_array_get(doubles, 2)) == 0.25);
+    assert(QAJ4C_array_get_doubles(QAJ4C_object_get(value, "mixed")) == NULL);
+
+    assert(QAJ4C_equals(value, plain));
+    assert(QAJ4C_equals(plain, value));
+    assert(QAJ4C_value_sizeof(value) == QAJ4C_value_sizeof(plain));
+
+    QAJ4C_sprint(value, output, ARRAY_COUNT(output));
+    assert(strcmp(R"({"ints":[1,-2,3000000000,-5000000000,123456789012345678],"doubles":[1.5,-2000,0.25],"mixed":[1,2.5],"big":[1234567890123456789],"strings":["a"],"empty":[],"nested":[[1,2],[3.5]]})", output) == 0);
+    free((void*)plain);
+}
+#endif
+
+TEST(DomObjectAccessTests, PackArraysCopy) {
+    const char json[] = R"([[4,5,6],[0.5,1e-3]])";
+    const QAJ4C_Value* value = QAJ4C_parse_opt_dynamic(json, ARRAY_COUNT(json), QAJ4C_PARSE_OPTS_PACK_ARRAYS, realloc);
+    QAJ4C_Builder builder;
+    QAJ4C_Value* copy;
+
+    QAJ4C_builder_init(&builder, malloc(QAJ4C_value_sizeof(value)), QAJ4C_value_sizeof(value));
+    copy = QAJ4C_builder_get_document(&builder);
+    QAJ4C_copy(value, copy, &builder);
+    assert(builder.cur_obj_pos == builder.buffer_size);
+    assert(QAJ4C_equals(copy, value));
+
+    /* the copy is not packed and can be modified */
+    assert(QAJ4C_get_internal_type(QAJ4C_array_get(copy, 0)) == QAJ4C_ARRAY);
+    QAJ4C_set_int(QAJ4C_array_get_rw(QAJ4C_array_get_rw(copy, 0), 2), 7);
+    assert(QAJ4C_get_int(QAJ4C_array_get(QAJ4C_array_get(copy, 0), 2)) == 7);
+    assert(QAJ4C_get_double(QAJ4C_array_get(QAJ4C_array_get(copy, 1), 1)) == 0.001);
+
+    free(builder.buffer);
+    free((void*)value);
+}
+
+TEST(DomObjectAccessTests, ArrayCopyNumbers) {
+    const char json[] = R"([1, -2, 3000000000, 2.5, 4, "x", 5])";
+    const QAJ4C_Value* value = QAJ4C_parse_opt_dynamic(json, ARRAY_COUNT(json), 0, realloc);
+    double doubles[8];
+    int64_t int64s[8];
+    uint64_t uint64s[8];
+
+    assert(QAJ4C_array_copy_doubles(value, doubles, 8) == 5);
+    assert(doubles[0] == 1.0 && doubles[1] == -2.0 && doubles[2] == 3000000000.0 && doubles[3] == 2.5 && doubles[4] == 4.0);
+    assert(QAJ4C_array_copy_int64s(value, int64s, 8) == 3);
+    assert(int64s[1] == -2 && int64s[2] == 3000000000LL);
+    assert(QAJ4C_array_copy_uint64s(value, uint64s, 8) == 1);
+    assert(QAJ4C_array_copy_doubles(value, doubles, 2) == 2);
+    free((void*)value);
+}
+
+TEST(DomObjectAccessTests, ArrayCopyMatrix) {
+    const char json[] = R"([[1, 2, 3], [4.5, 5, 6], [-7, 8, 9]])";
+    int opts[] = {0, QAJ4C_PARSE_OPTS_PACK_ARRAYS};
+    for (size_t i = 0; i < ARRAY_COUNT(opts); ++i) {
+        const QAJ4C_Value* value = QAJ4C_parse_opt_dynamic(json, ARRAY_COUNT(json), opts[i], realloc);
+        double matrix[9];
+        int64_t int64s[9];
+        uint64_t uint64s[9];
+
+        assert(QAJ4C_array_copy_doubles(value, matrix, 9) == 9);
+        assert(matrix[0] == 1.0 && matrix[3] == 4.5 && matrix[6] == -7.0 && matrix[8] == 9.0);
+        assert(QAJ4C_array_copy_doubles(value, matrix, 4) == 4);
+        assert(QAJ4C_array_copy_int64s(value, int64s, 9) == 3);
+        assert(QAJ4C_array_copy_int64s(QAJ4C_array_get(value, 2), int64s, 9) == 3);
+        assert(int64s[0] == -7 && int64s[2] == 9);
+        assert(QAJ4C_array_copy_uint64s(QAJ4C_array_get(value, 2), uint64s, 9) == 0);
+        free((void*)value);
+    }
+}
+
+TEST(DomObjectAccessTests, ArrayColumns) {
+    const char json[] = R"([{"id":1,"name":"a","score":0.5},{"name":"bb","id":-2},{"id":null,"name":7},3,{"id":4.5,"score":2,"name":"ccc"}])";
+    const QAJ4C_Value* value = QAJ4C_parse_opt_dynamic(json, ARRAY_COUNT(json), 0, realloc);
+    QAJ4C_Key id;
+    QAJ4C_Key name;
+    QAJ4C_Key score;
+    double doubles[5];
+    int64_t int64s[5];
+    const char* strings[5];
+    size_t lengths[5];
+    uint8_t nulls[1] = {0xFF};
+
+    QAJ4C_key_init(&id, "id");
+    QAJ4C_key_init(&name, "name");
+    QAJ4C_key_init(&score, "score");
+
+    assert(QAJ4C_array_column_doubles(value, &id, doubles, 5, nulls) == 3);
+    assert(nulls[0] == 0x0C);
+    assert(doubles[0] == 1.0 && doubles[1] == -2.0 && doubles[2] == 0.0 && doubles[3] == 0.0 && doubles[4] == 4.5);
+    assert(QAJ4C_array_column_int64s(value, &id, int64s, 5, nulls) == 2);
+    assert(nulls[0] == 0x1C);
+    assert(int64s[0] == 1 && int64s[1] == -2 && int64s[4] == 0);
+    assert(QAJ4C_array_column_doubles(value, &score, doubles, 5, NULL) == 2);
+    assert(doubles[0] == 0.5 && doubles[1] == 0.0 && doubles[4] == 2.0);
+
+    assert(QAJ4C_array_column_strings(value, &name, strings, lengths, 5, nulls) == 3);
+    assert(nulls[0] == 0x0C);
+    assert(strcmp(strings[1], "bb") == 0 && lengths[1] == 2);
+    assert(strings[2] == NULL && lengths[2] == 0);
+    assert(strcmp(strings[4], "ccc") == 0 && lengths[4] == 3);
+    assert(QAJ4C_array_column_strings(value, &name, strings, NULL, 2, nulls) == 2);
+    assert(nulls[0] == 0);
+    free((void*)value);
+}
+
+#ifndef QAJ4C_COMPACT_VALUES /* learned and shared shapes are not supported */
+TEST(DomObjectAccessTests, ArrayColumnsSharedShapes) {
+    const char json[] = R"([{"a":1,"b":"x"},{"a":2,"b":"y"},{"b":"z","c":0},{"a":4,"b":"w"},{"a":5,"b":"v"}])";
+    const QAJ4C_Value* value = QAJ4C_parse_opt_dynamic(json, ARRAY_COUNT(json), QAJ4C_PARSE_OPTS_SHARE_SHAPES, realloc);
+    QAJ4C_Key a;
+    QAJ4C_Key b;
+    int64_t int64s[5];
+    const char* strings[5];
+    uint8_t nulls[1];
+
+    QAJ4C_key_init(&a, "a");
+    QAJ4C_key_init(&b, "b");
+    assert(QAJ4C_get_internal_type(QAJ4C_array_get(value, 1)) == QAJ4C_OBJECT_SHAPED);
+
+    assert(QAJ4C_array_column_int64s(value, &a, int64s, 5, nulls) == 4);
+    assert(nulls[0] == 0x04);
+    assert(int64s[0] == 1 && int64s[1] == 2 && int64s[3] == 4 && int64s[4] == 5);
+    assert(QAJ4C_array_column_strings(value, &b, strings, NULL, 5, nulls) == 5);
+    assert(nulls[0] == 0);
+    assert(strcmp(strings[2], "z") == 0 && strcmp(strings[4], "v") == 0);
+    free((void*)value);
+}
+#endif
+
+
+TEST(ErrorHandlingTests, TooSmallDomBuffer) {
+    char json[] = "[0.123456,9,12,3,5,7,2,3]";
+    // just reduce the buffer size by one single byte
+    size_t buff_size = QAJ4C_calculate_max_buffer_size(json) - 1;
+    char buff[buff_size];
+    const QAJ4C_Value* value = NULL;
+
+    size_t actual_size = QAJ4C_parse(json, buff, buff_size, &value);
+    assert(QAJ4C_is_error(value));
+
+    assert(QAJ4C_error_get_errno(value) == QAJ4C_ERROR_STORAGE_BUFFER_TO_SMALL);
+}
+
+TEST(ErrorHandlingTests, ReallocFailsBegin) {
+    char json[] = "[0.123456,9,12,3,5,7,2,3]";
+    auto lambda = []( void *ptr, size_t size ) {return (void*)NULL;};
+    // just reduce the buffer size by one single byte
+    const QAJ4C_Value* value = QAJ4C_parse_dynamic(json, lambda);
+    assert(QAJ4C_is_not_set(value));
+    free((void*)value);
+}
+
+TEST(ErrorHandlingTests, ReallocFailsLater) {
+    char json[] = "[0.123456,9,12,3,5,7,2,3]";
+    static bool first = true;
+    auto lambda = []( void *ptr, size_t size ) {
+        if ( first ) {
+            first = false;
+            return realloc(ptr, size);
+        }
+        return (void*)NULL;
+    };
+    // just reduce the buffer size by one single byte
+    const QAJ4C_Value* value = QAJ4C_parse_dynamic(json, lambda);
+    assert(QAJ4C_is_error(value));
+
+    assert(QAJ4C_error_get_errno(value) == QAJ4C_ERROR_ALLOCATION_ERROR);
+    free((void*)value);
+}
+
+TEST(ErrorHandlingTests, DoubleSmallPrintBuffer) {
+    char json[] = "[0.123456]";
+    char out[ARRAY_COUNT(json) + 1];
+    memset(out, '\n', ARRAY_COUNT(out));
+
+    size_t buff_size = QAJ4C_calculate_max_buffer_size(json);
+    char buff[buff_size];
+    const QAJ4C_Value* value = NULL;
+
+    size_t actual_size = QAJ4C_parse(json, buff, buff_size, &value);
+    assert(!QAJ4C_is_error(value));
+
+    assert(actual_size == buff_size);
+
+    for (size_t i = 0, n = ARRAY_COUNT(json); i <= n; i++) {
+        assert(i == QAJ4C_sprint(value, out, i));
+        assert('\n' == out[i]); // check that nothing has been written over the bounds!
+        if (i > 0) {
+            assert(i - 1 == strlen(out));
+        }
+    }
+}
+
+TEST(ErrorHandlingTests, MultipleDoublesSmallPrintBuffer) {
+    char json[] = "[0.123456,6.9]";
+    char out[ARRAY_COUNT(json) + 1];
+    memset(out, '\n', ARRAY_COUNT(out));
+
+    size_t buff_size = QAJ4C_calculate_max_buffer_size(json);
+    char buff[buff_size];
+    const QAJ4C_Value* value = NULL;
+
+    size_t actual_size = QAJ4C_parse(json, buff, buff_size, &value);
+    assert(!QAJ4C_is_error(value));
+
+    assert(actual_size == buff_size);
+
+    for (size_t i = 0, n = ARRAY_COUNT(json); i <= n; i++) {
+        assert(i == QAJ4C_sprint(value, out, i));
+        assert('\n' == out[i]); // check that nothing has been written over the bounds!
+        if (i > 0) {
+            assert(i - 1 == strlen(out));
+        }
+    }
+}
+
+TEST(ErrorHandlingTests, PrintStringPartially) {
+    char json[] = R"(["so ka?","ey chummer!"])";
+    char out[ARRAY_COUNT(json) + 1];
+    memset(out, '\n', ARRAY_COUNT(out));
+
+    size_t buff_size = QAJ4C_calculate_max_buffer_size(json);
+    char buff[buff_size];
+    const QAJ4C_Value* value = NULL;
+
+    size_t actual_size = QAJ4C_parse(json, buff, buff_size, &value);
+    assert(!QAJ4C_is_error(value));
+
+    assert(actual_size == buff_size);
+
+    for (size_t i = 0, n = ARRAY_COUNT(json); i <= n; i++) {
+        assert(i == QAJ4C_sprint(value, out, i));
+        assert('\n' == out[i]); // check that nothing has been written over the bounds!
+        if (i > 0) {
+            assert(i - 1 == strlen(out));
+        }
+    }
+}
+
+TEST(ErrorHandlingTests, PrintCompositionOfObjectsAndArraysPartially) {
+    char json[] = R"({"id":5,"values":[{},[],{"key":"val","key2":"val2"},[12,34],5.4]})";
+    char out[ARRAY_COUNT(json) + 1];
+    memset(out, '\n', ARRAY_COUNT(out));
+
+    size_t buff_size = QAJ4C_calculate_max_buffer_size(json);
+    char buff[buff_size];
+    const QAJ4C_Value* value = NULL;
+
+    size_t actual_size = QAJ4C_parse(json, buff, buff_size, &value);
+    assert(!QAJ4C_is_error(value));
+
+    assert(actual_size == buff_size);
+
+    for (size_t i = 0, n = ARRAY_COUNT(json); i <= n; i++) {
+        assert(i == QAJ4C_sprint(value, out, i));
+        assert('\n' == out[i]); // check that nothing has been written over the bounds!
+        if (i > 0) {
+            assert(i - 1 == strlen(out));
+        }
+    }
+}
+
+TEST(ErrorHandlingTests, PrintConstantsPartially) {
+    char json[] = R"([null,true,false])";
+    char out[ARRAY_COUNT(json) + 1];
+    memset(out, '\n', ARRAY_COUNT(out));
+
+    size_t buff_size = QAJ4C_calculate_max_buffer_size(json);
+    char buff[buff_size];
+    const QAJ4C_Value* value = NULL;
+
+    size_t actual_size = QAJ4C_parse(json, buff, buff_size, &value);
+    assert(!QAJ4C_is_error(value));
+
+    assert(actual_size == buff_size);
+
+    for (size_t i = 0, n = ARRAY_COUNT(json); i <= n; i++) {
+        assert(i == QAJ4C_sprint(value, out, i));
+        assert('\n' == out[i]); // check that nothing has been written over the bounds!
+        if (i > 0) {
+            assert(i - 1 == strlen(out));
+        }
+    }
+}
+
+TEST(ErrorHandlingTests, NullSmallPrintBuffer) {
+    char json[] = "[null]";
+    char out[ARRAY_COUNT(json) + 1];
+    memset(out, '\n', ARRAY_COUNT(out));
+
+    size_t buff_size = QAJ4C_calculate_max_buffer_size(json);
+    char buff[buff_size];
+    const QAJ4C_Value* value = NULL;
+
+    size_t actual_size = QAJ4C_parse(json, buff, buff_size, &value);
+    assert(!QAJ4C_is_error(value));
+
+    assert(actual_size == buff_size);
+
+    for (size_t i = 0, n = ARRAY_COUNT(json); i <= n; i++) {
+        assert(i == QAJ4C_sprint(value, out, i));
+        assert('\n' == out[i]); // check that nothing has been written over the bounds!
+        if (i > 0) {
+            assert(i - 1 == strlen(out));
+        }
+    }
+}
 
 TEST(PrintTests, PrintErrorObject) {
     char json[] = "{";
@@ -2254,6 +3199,7 @@ TEST(PrintTests, PrintDoubleZero) {
    assert( strcmp("0", buffer) == 0 );
 }
 
+#ifndef QAJ4C_COMPACT_VALUES /* every bit pattern is a valid compact value */
 TEST(PrintTests, PrintCorruptValue) {
     QAJ4C_Value value;
     char buffer[64] = {'\0'};
@@ -2266,6 +3212,7 @@ TEST(PrintTests, PrintCorruptValue) {
     size_t out = QAJ4C_sprint(&value, buffer, ARRAY_COUNT(buffer));
     assert(1 == count); // expect an error
 }
+#endif
 
 
 TEST(PrintTests, PrintEmtpyObject) {
@@ -2753,30 +3700,126 @@ TEST(VariousTests, ErrorsCannotBeCopied) {
     assert(1 == count);
 }
 
-/**
- * The parser is build on some "assumptions" and this test should verify this
- * for the different platform.
- */
-TEST(VariousTests, CheckSizes) {
-    assert(sizeof(double) == 8);
-    assert(sizeof(int64_t) == 8);
-    assert(sizeof(uint64_t) == 8);
+/**
+ * The parser is build on some "assumptions" and this test should verify this
+ * for the different platform.
+ */
+TEST(VariousTests, CheckSizes) {
+    assert(sizeof(double) == 8);
+    assert(sizeof(int64_t) == 8);
+    assert(sizeof(uint64_t) == 8);
+
+    printf("Sizeof QAJ4C_Value is: " FMT_SIZE "\n", sizeof(QAJ4C_Value));
+
+#ifdef QAJ4C_COMPACT_VALUES
+    assert(sizeof(QAJ4C_Value) == sizeof(double));
+#else
+    assert(sizeof(QAJ4C_Value) == (QAJ4C_MAX(sizeof(uint32_t), sizeof(uintptr_t)) + sizeof(size_type) * 2));
+    assert(sizeof(QAJ4C_Value) == sizeof(QAJ4C_Object));
+    assert(sizeof(QAJ4C_Value) == sizeof(QAJ4C_Array));
+    assert(sizeof(QAJ4C_Value) == sizeof(QAJ4C_String));
+    assert(sizeof(QAJ4C_Value) == sizeof(QAJ4C_Short_string));
+    assert(sizeof(QAJ4C_Value) == sizeof(QAJ4C_Primitive));
+    assert(sizeof(QAJ4C_Value) == sizeof(QAJ4C_Error));
+#endif
+
+    assert(sizeof(QAJ4C_Member) == 2 * sizeof(QAJ4C_Value));
+}
+
+#ifdef QAJ4C_COMPACT_VALUES
+TEST(VariousTests, CompactBigIntegers) {
+    const char json[] = R"([140737488355327,140737488355328,-140737488355328,-140737488355329,18446744073709551615,-9223372036854775808])";
+    size_t buff_size = QAJ4C_calculate_max_buffer_size(json);
+    uint8_t buffer[buff_size];
+    uint8_t buffer2[buff_size];
+    char output[ARRAY_COUNT(json)];
+    const QAJ4C_Value* value = NULL;
+
+    assert(QAJ4C_parse(json, buffer, buff_size, &value) <= buff_size);
+    assert(QAJ4C_get_int64(QAJ4C_array_get(value, 0)) == 140737488355327LL);
+    assert(QAJ4C_get_int64(QAJ4C_array_get(value, 1)) == 140737488355328LL);
+    assert(QAJ4C_get_int64(QAJ4C_array_get(value, 2)) == -140737488355328LL);
+    assert(QAJ4C_get_int64(QAJ4C_array_get(value, 3)) == -140737488355329LL);
+    assert(QAJ4C_get_uint64(QAJ4C_array_get(value, 4)) == UINT64_MAX);
+    assert(!QAJ4C_is_int64(QAJ4C_array_get(value, 4)));
+    assert(QAJ4C_get_int64(QAJ4C_array_get(value, 5)) == INT64_MIN);
+    QAJ4C_sprint(value, output, ARRAY_COUNT(output));
+    assert(strcmp(json, output) == 0);
+
+    /* the copy stores the integers on its own builder */
+    QAJ4C_Builder builder = QAJ4C_builder_create(buffer2, buff_size);
+    QAJ4C_Value* copy = QAJ4C_builder_get_document(&builder);
+    QAJ4C_copy(value, copy, &builder);
+    assert(QAJ4C_value_sizeof(copy) == QAJ4C_value_sizeof(value));
+    memset(buffer, 0, buff_size);
+    assert(QAJ4C_get_uint64(QAJ4C_array_get(copy, 4)) == UINT64_MAX);
+    assert(QAJ4C_get_int64(QAJ4C_array_get(copy, 5)) == INT64_MIN);
+}
+
+TEST(VariousTests, CompactBigIntegersWithoutBuilder) {
+    QAJ4C_Value value;
+    static int called = 0;
+    auto lambda = [](){
+        ++called;
+    };
+    QAJ4C_register_fatal_error_function(lambda);
+
+    QAJ4C_set_int64(&value, ((int64_t)1 << 47) - 1);
+    assert(QAJ4C_get_int64(&value) == ((int64_t)1 << 47) - 1);
+    assert(0 == called);
+    QAJ4C_set_int64(&value, INT64_MIN);
+    assert(1 == called);
+    assert(QAJ4C_is_double(&value) && QAJ4C_get_double(&value) == (double)INT64_MIN);
+}
+
+TEST(VariousTests, CompactStrings) {
+    const char json[] = R"(["abcde","abcdef","a\u0000b","a longer string value"])";
+    char insitu_json[] = R"(["abcde","abcdef","a longer string value"])";
+    const char* strings[] = {"", "a\0b", "a longer string"};
+    const size_t lengths[] = {0, 3, 15};
+    uint8_t buff[512];
+    const QAJ4C_Value* value = QAJ4C_parse_opt_dynamic(json, ARRAY_COUNT(json), 0, realloc);
 
-    printf("Sizeof QAJ4C_Value is: " FMT_SIZE "\n", sizeof(QAJ4C_Value));
+    assert(QAJ4C_get_internal_type(QAJ4C_array_get(value, 0)) == QAJ4C_INLINE_STRING);
+    assert(QAJ4C_get_internal_type(QAJ4C_array_get(value, 1)) == QAJ4C_STRING);
+    assert(QAJ4C_get_string_length(QAJ4C_array_get(value, 2)) == 3);
+    assert(memcmp(QAJ4C_get_string(QAJ4C_array_get(value, 2)), "a\0b", 3) == 0);
+    assert(QAJ4C_string_equals(QAJ4C_array_get(value, 3), "a longer string value"));
+    free((void*)value);
 
-    assert(sizeof(QAJ4C_Value) == (QAJ4C_MAX(sizeof(uint32_t), sizeof(uintptr_t)) + sizeof(size_type) * 2));
-    assert(sizeof(QAJ4C_Value) == sizeof(QAJ4C_Object));
-    assert(sizeof(QAJ4C_Value) == sizeof(QAJ4C_Array));
-    assert(sizeof(QAJ4C_Value) == sizeof(QAJ4C_String));
-    assert(sizeof(QAJ4C_Value) == sizeof(QAJ4C_Short_string));
-    assert(sizeof(QAJ4C_Value) == sizeof(QAJ4C_Primitive));
-    assert(sizeof(QAJ4C_Value) == sizeof(QAJ4C_Error));
+    /* insitu strings reference the message (the \0 is written behind each string) */
+    assert(QAJ4C_parse_insitu(insitu_json, buff, ARRAY_COUNT(buff), &value) > 0);
+    assert(QAJ4C_get_internal_type(QAJ4C_array_get(value, 1)) == QAJ4C_STRING_REF);
+    assert(QAJ4C_get_string_length(QAJ4C_array_get(value, 2)) == 21);
 
-    assert(sizeof(QAJ4C_Member) == 2 * sizeof(QAJ4C_Value));
+    QAJ4C_Builder builder = QAJ4C_builder_create(buff, ARRAY_COUNT(buff));
+    QAJ4C_Value* root = QAJ4C_builder_get_document(&builder);
+    QAJ4C_set_array_from_strings(root, strings, lengths, ARRAY_COUNT(strings), &builder);
+    assert(QAJ4C_get_string_length(QAJ4C_array_get(root, 0)) == 0);
+    assert(QAJ4C_get_string_length(QAJ4C_array_get(root, 1)) == 3);
+    assert(QAJ4C_get_internal_type(QAJ4C_array_get(root, 1)) == QAJ4C_STRING);
+    assert(QAJ4C_get_string_length(QAJ4C_array_get(root, 2)) == 15);
+}
+
+TEST(VariousTests, CompactArrayFromCArrays) {
+    const int64_t int64s[] = {1, -2, 3000000000LL, -5000000000000000LL};
+    char buff[512];
+    char output[128];
+    QAJ4C_Builder builder = QAJ4C_builder_create(buff, ARRAY_COUNT(buff));
+    QAJ4C_Value* root = QAJ4C_builder_get_document(&builder);
+
+    /* packed is ignored, the elements are regular values */
+    QAJ4C_set_array_from_int64s(root, int64s, ARRAY_COUNT(int64s), true, &builder);
+    assert(QAJ4C_get_internal_type(root) == QAJ4C_ARRAY);
+    assert(QAJ4C_array_get_int64s(root) == NULL);
+    assert(QAJ4C_get_int64(QAJ4C_array_get(root, 3)) == -5000000000000000LL);
+    QAJ4C_sprint(root, output, ARRAY_COUNT(output));
+    assert(strcmp("[1,-2,3000000000,-5000000000000000]", output) == 0);
 }
+#endif
 
 TEST(VariousTests, ResetBuilder) {
-    char buff[256];
+    char buff[16 * sizeof(QAJ4C_Value)];
 
     QAJ4C_Builder builder = QAJ4C_builder_create(buff, ARRAY_COUNT(buff));
     QAJ4C_Builder builder2 = QAJ4C_builder_create(buff, ARRAY_COUNT(buff));
@@ -2958,6 +4001,48 @@ TEST(DomCreation, CreateObject) {
     assert(QAJ4C_object_get(value_ptr, key5) == nullptr);
 }
 
+TEST(DomCreation, OptimizeLargeObject) {
+    static const unsigned object_size = 600;
+    static const unsigned member_count = 580; // leave some members unset
+    char key[128];
+    uint8_t buff[64 * 1024];
+    QAJ4C_Builder builder = QAJ4C_builder_create(buff, ARRAY_COUNT(buff));
+
+    QAJ4C_Value* value_ptr = QAJ4C_builder_get_document(&builder);
+    QAJ4C_set_object(value_ptr, object_size, &builder);
+
+    // keys of varying length (also beyond 64 chars) inserted in a shuffled order
+    for (unsigned i = 0; i < member_count; i++) {
+        unsigned id = (i * 7919) % member_count;
+        int len = snprintf(key, ARRAY_COUNT(key), "%u_", id);
+        while (len < (int)(id % 100) + 1) {
+            key[len++] = 'a' + (char)((id + len) % 26);
+        }
+        QAJ4C_Value* member = QAJ4C_object_create_member_by_copy_n(value_ptr, key, len, &builder);
+        assert(member != nullptr);
+        QAJ4C_set_uint(member, id);
+    }
+
+    QAJ4C_object_optimize(value_ptr);
+    assert(QAJ4C_get_internal_type(value_ptr) == QAJ4C_OBJECT_SORTED);
+
+    for (unsigned i = 1; i < member_count; i++) {
+        const QAJ4C_Member* lower_member = QAJ4C_object_get_member(value_ptr, i - 1);
+        const QAJ4C_Member* current_member = QAJ4C_object_get_member(value_ptr, i);
+        assert(QAJ4C_compare_members(lower_member, current_member) < 0);
+    }
+    for (unsigned i = member_count; i < object_size; i++) {
+        assert(QAJ4C_is_null(QAJ4C_member_get_key(QAJ4C_object_get_member(value_ptr, i))));
+    }
+
+    for (unsigned i = 0; i < member_count; i++) {
+        const QAJ4C_Member* member = QAJ4C_object_get_member(value_ptr, i);
+        const QAJ4C_Value* key_ptr = QAJ4C_member_get_key(member);
+        const QAJ4C_Value* found = QAJ4C_object_get_n(value_ptr, QAJ4C_get_string(key_ptr), QAJ4C_get_string_length(key_ptr));
+        assert(found == QAJ4C_member_get_value(member));
+    }
+}
+
 TEST(DomCreation, OptimizeEmptyObject) {
     uint8_t buff[256];
     QAJ4C_Builder builder = QAJ4C_builder_create(buff, ARRAY_COUNT(buff));
@@ -3206,7 +4291,7 @@ TEST(CornerCaseTests, AttachedEmptyObject) {
  * that have occurred in the past.
  */
 TEST(CornerCaseTests, PrintArrayWithNullValues) {
-    uint8_t buff[256];
+    uint8_t buff[16 * sizeof(QAJ4C_Value)];
     char json[64];
 
     for (int i = 0; i < ARRAY_COUNT(buff); ++i) {
@@ -3223,3 +4308,658 @@ TEST(CornerCaseTests, PrintArrayWithNullValues) {
     QAJ4C_sprint(root_node, json, ARRAY_COUNT(json));
     assert( strcmp(R"({"a":[null,null]})", json) == 0);
 }
+
+/**
+ * The length of the message used to be truncated to 32 bits (so only "[1" was parsed here).
+ */
+TEST(CornerCaseTests, MessageLengthBeyondSizeType) {
+    if (sizeof(size_t) <= sizeof(uint32_t)) {
+        return;
+    }
+    const QAJ4C_Value* value = QAJ4C_parse_opt_dynamic("[1]", ((size_t)1 << 32) + 2, 0, realloc);
+    assert(QAJ4C_is_array(value));
+    assert(QAJ4C_array_size(value) == 1);
+    free((void*)value);
+}
+
+/**
+ * In this test the statistics of the nested array were overwritten by the DOM of the
+ * following empty arrays (the first pass stored statistics for empty arrays too).
+ */
+TEST(CornerCaseTests, NestedArrayFollowedByEmptyArrays) {
+    const char* json = R"([[[]],[],[],[],[]])";
+    char output[64];
+    const QAJ4C_Value* value = QAJ4C_parse_dynamic(json, realloc);
+
+    QAJ4C_sprint(value, output, ARRAY_COUNT(output));
+    assert(strcmp(json, output) == 0);
+    free((void*)value);
+}
+
+TEST(IncrementalParsingTests, ParseInSmallSteps) {
+    const char* json = R"({"id":1,"name":"a longer string value","list":[1,2.5,-3,[],{},[{"x":true}]],"nested":{"c":null,"b":false,"a":"x"}})";
+    uint8_t buff[1024];
+    char output[256];
+    const QAJ4C_Value* value = NULL;
+    QAJ4C_Incremental_parser parser;
+    int steps = 0;
+
+    QAJ4C_incremental_parse_init(&parser, json, SIZE_MAX, 0, buff, ARRAY_COUNT(buff));
+    while (QAJ4C_incremental_parse_step(&parser, 8, 2, &value) == QAJ4C_PARSE_STATUS_IN_PROGRESS) {
+        assert(value == NULL);
+        ++steps;
+    }
+    assert(steps > 10);
+    assert(QAJ4C_is_object(value));
+    assert(QAJ4C_get_uint(QAJ4C_object_get(value, "id")) == 1);
+    assert(QAJ4C_array_size(QAJ4C_object_get(value, "list")) == 6);
+
+    QAJ4C_sprint(value, output, ARRAY_COUNT(output));
+    assert(strcmp(json, output) == 0);
+}
+
+#ifndef QAJ4C_COMPACT_VALUES /* learned and shared shapes are not supported */
+TEST(IncrementalParsingTests, ParseSharedShapes) {
+    const char* json = R"({"rows":[{"id":1,"name":"first"},{"id":2,"name":"second"},{"id":3,"name":"third"}]})";
+    uint8_t buff[1024];
+    char output[256];
+    const QAJ4C_Value* value = NULL;
+    QAJ4C_Incremental_parser parser;
+
+    QAJ4C_incremental_parse_init(&parser, json, SIZE_MAX, QAJ4C_PARSE_OPTS_SHARE_SHAPES, buff, ARRAY_COUNT(buff));
+    while (QAJ4C_incremental_parse_step(&parser, 8, 2, &value) == QAJ4C_PARSE_STATUS_IN_PROGRESS) {
+    }
+    assert(QAJ4C_get_internal_type(QAJ4C_array_get(QAJ4C_object_get(value, "rows"), 2)) == QAJ4C_OBJECT_SHAPED);
+    assert(QAJ4C_get_uint(QAJ4C_object_get(QAJ4C_array_get(QAJ4C_object_get(value, "rows"), 2), "id")) == 3);
+
+    QAJ4C_sprint(value, output, ARRAY_COUNT(output));
+    assert(strcmp(json, output) == 0);
+}
+#endif
+
+#ifndef QAJ4C_COMPACT_VALUES /* packed arrays are not supported */
+TEST(IncrementalParsingTests, ParsePackedArrays) {
+    const char* json = R"({"x":[1,2,3,4,5,6,7,8],"y":[0.5,1.5,2.5,3.5]})";
+    uint8_t buff[512];
+    char output[128];
+    const QAJ4C_Value* value = NULL;
+    QAJ4C_Incremental_parser parser;
+    int steps = 0;
+
+    QAJ4C_incremental_parse_init(&parser, json, SIZE_MAX, QAJ4C_PARSE_OPTS_PACK_ARRAYS, buff, ARRAY_COUNT(buff));
+    while (QAJ4C_incremental_parse_step(&parser, SIZE_MAX, 3, &value) == QAJ4C_PARSE_STATUS_IN_PROGRESS) {
+        ++steps;
+    }
+    /* the elements of packed arrays count against the budget as well */
+    assert(steps > 8);
+    assert(QAJ4C_array_get_int64s(QAJ4C_object_get(value, "x"))[7] == 8);
+    assert(QAJ4C_array_get_doubles(QAJ4C_object_get(value, "y"))[3] == 3.5);
+
+    QAJ4C_sprint(value, output, ARRAY_COUNT(output));
+    assert(strcmp(json, output) == 0);
+}
+#endif
+
+TEST(IncrementalParsingTests, ParseWithZeroBudget) {
+    const char* json = R"([1,2,3])";
+    uint8_t buff[256];
+    const QAJ4C_Value* value = NULL;
+    QAJ4C_Incremental_parser parser;
+    int steps = 0;
+
+    QAJ4C_incremental_parse_init(&parser, json, SIZE_MAX, 0, buff, ARRAY_COUNT(buff));
+    while (QAJ4C_incremental_parse_step(&parser, 0, 0, &value) == QAJ4C_PARSE_STATUS_IN_PROGRESS) {
+        ++steps;
+    }
+    /* each of the 4 values is processed in both passes */
+    assert(steps == 7);
+    assert(QAJ4C_is_array(value));
+    assert(QAJ4C_array_size(value) == 3);
+}
+
+TEST(IncrementalParsingTests, ParseInsitu) {
+    char json[] = R"({"a":"some string","b":["x","y"]})";
+    uint8_t buff[256];
+    const QAJ4C_Value* value = NULL;
+    QAJ4C_Incremental_parser parser;
+
+    QAJ4C_incremental_parse_init_insitu(&parser, json, SIZE_MAX, 0, buff, ARRAY_COUNT(buff));
+    while (QAJ4C_incremental_parse_step(&parser, 4, 1, &value) == QAJ4C_PARSE_STATUS_IN_PROGRESS) {
+    }
+    assert(QAJ4C_is_object(value));
+    assert(strcmp(QAJ4C_get_string(QAJ4C_object_get(value, "a")), "some string") == 0);
+    assert(QAJ4C_get_string(QAJ4C_object_get(value, "a")) > json);
+    assert(QAJ4C_get_string(QAJ4C_object_get(value, "a")) < json + sizeof(json));
+}
+
+TEST(IncrementalParsingTests, ParseInvalidJson) {
+    const char* json = R"({"a":[1,2,3],"b":[1 2]})";
+    uint8_t buff[256];
+    const QAJ4C_Value* value = NULL;
+    QAJ4C_Incremental_parser parser;
+
+    QAJ4C_incremental_parse_init(&parser, json, SIZE_MAX, 0, buff, ARRAY_COUNT(buff));
+    while (QAJ4C_incremental_parse_step(&parser, 1, 1, &value) == QAJ4C_PARSE_STATUS_IN_PROGRESS) {
+    }
+    assert(QAJ4C_is_error(value));
+    assert(QAJ4C_error_get_errno(value) == QAJ4C_ERROR_MISSING_COMMA);
+
+    /* further steps will not change the result */
+    assert(QAJ4C_incremental_parse_step(&parser, 1, 1, &value) == QAJ4C_PARSE_STATUS_DONE);
+    assert(QAJ4C_is_error(value));
+}
+
+TEST(IncrementalParsingTests, ParseBufferTooSmall) {
+    const char* json = R"([1,2,3,4,5,6,7,8,9])";
+    uint8_t buff[64];
+    const QAJ4C_Value* value = NULL;
+    QAJ4C_Incremental_parser parser;
+
+    QAJ4C_incremental_parse_init(&parser, json, SIZE_MAX, 0, buff, ARRAY_COUNT(buff));
+    while (QAJ4C_incremental_parse_step(&parser, 4, 4, &value) == QAJ4C_PARSE_STATUS_IN_PROGRESS) {
+    }
+    assert(QAJ4C_is_error(value));
+    assert(QAJ4C_error_get_errno(value) == QAJ4C_ERROR_STORAGE_BUFFER_TO_SMALL);
+}
+
+TEST(ParseLimitsTests, NoLimitsExceeded) {
+    const char* json = R"({"a":[1,2,3],"b":"a longer string value","c":{"d":null}})";
+    uint8_t buff[512];
+    const QAJ4C_Value* value = NULL;
+    QAJ4C_Parse_limits limits = {3, 12, 64, 21, 3, ARRAY_COUNT(buff)};
+
+    QAJ4C_parse_opt_limited(json, SIZE_MAX, 0, &limits, buff, ARRAY_COUNT(buff), &value);
+    assert(QAJ4C_is_object(value));
+}
+
+TEST(ParseLimitsTests, DepthLimitExceeded) {
+    const char* json = R"({"a":[[1]]})";
+    uint8_t buff[256];
+    const QAJ4C_Value* value = NULL;
+    QAJ4C_Parse_limits limits = {};
+    limits.max_depth = 2;
+
+    QAJ4C_parse_opt_limited(json, SIZE_MAX, 0, &limits, buff, ARRAY_COUNT(buff), &value);
+    assert(QAJ4C_is_error(value));
+    assert(QAJ4C_error_get_errno(value) == QAJ4C_ERROR_DEPTH_OVERFLOW);
+}
+
+TEST(ParseLimitsTests, NodeLimitExceeded) {
+    const char* json = R"([1,2,3,4,5,6,7,8,9])";
+    uint8_t buff[256];
+    const QAJ4C_Value* value = NULL;
+    QAJ4C_Parse_limits limits = {};
+    limits.max_nodes = 9;
+
+    QAJ4C_parse_opt_limited(json, SIZE_MAX, 0, &limits, buff, ARRAY_COUNT(buff), &value);
+    assert(QAJ4C_is_error(value));
+    assert(QAJ4C_error_get_errno(value) == QAJ4C_ERROR_NODE_LIMIT_EXCEEDED);
+    assert(QAJ4C_error_get_json_pos(value) == 17);
+}
+
+TEST(ParseLimitsTests, StringBytesLimitExceeded) {
+    const char* json = R"({"abc":"def","ghi":"jkl"})";
+    uint8_t buff[256];
+    const QAJ4C_Value* value = NULL;
+    QAJ4C_Parse_limits limits = {};
+    limits.max_string_bytes = 15;
+
+    QAJ4C_parse_opt_limited(json, SIZE_MAX, 0, &limits, buff, ARRAY_COUNT(buff), &value);
+    assert(QAJ4C_is_error(value));
+    assert(QAJ4C_error_get_errno(value) == QAJ4C_ERROR_STRING_BYTES_LIMIT_EXCEEDED);
+}
+
+TEST(ParseLimitsTests, StringLengthLimitExceeded) {
+    char json[] = R"(["abc","defghijk"])";
+    uint8_t buff[256];
+    const QAJ4C_Value* value = NULL;
+    QAJ4C_Parse_limits limits = {};
+    limits.max_string_length = 7;
+
+    QAJ4C_parse_opt_insitu_limited(json, SIZE_MAX, 0, &limits, buff, ARRAY_COUNT(buff), &value);
+    assert(QAJ4C_is_error(value));
+    assert(QAJ4C_error_get_errno(value) == QAJ4C_ERROR_STRING_LENGTH_LIMIT_EXCEEDED);
+}
+
+TEST(ParseLimitsTests, ObjectMembersLimitExceeded) {
+    const char* json = R"({"a":{"a":1,"b":2},"b":{"a":1,"b":2,"c":3}})";
+    uint8_t buff[256];
+    const QAJ4C_Value* value = NULL;
+    QAJ4C_Parse_limits limits = {};
+    limits.max_object_members = 2;
+
+    QAJ4C_parse_opt_limited(json, SIZE_MAX, 0, &limits, buff, ARRAY_COUNT(buff), &value);
+    assert(QAJ4C_is_error(value));
+    assert(QAJ4C_error_get_errno(value) == QAJ4C_ERROR_OBJECT_MEMBERS_LIMIT_EXCEEDED);
+}
+
+/**
+ * The buffer size limit has to be checked before the DOM buffer is allocated.
+ */
+TEST(ParseLimitsTests, BufferSizeLimitExceededDynamic) {
+    static size_t max_size;
+    const char* json = R"(["a longer string value", "another longer string value"])";
+    QAJ4C_Parse_limits limits = {};
+    limits.max_buffer_size = 64;
+    max_size = 0;
+
+    auto realloc_tracking = [](void* ptr, size_t size) -> void* {
+        max_size = QAJ4C_MAX(max_size, size);
+        return realloc(ptr, size);
+    };
+
+    const QAJ4C_Value* value = QAJ4C_parse_opt_dynamic_limited(json, SIZE_MAX, 0, &limits, realloc_tracking);
+    assert(QAJ4C_is_error(value));
+    assert(QAJ4C_error_get_errno(value) == QAJ4C_ERROR_BUFFER_SIZE_LIMIT_EXCEEDED);
+    assert(max_size <= 64);
+    free((void*)value);
+}
+
+TEST(ParseLimitsTests, IncrementalLimitExceeded) {
+    const char* json = R"([1,2,3,4,5,6,7,8,9])";
+    uint8_t buff[256];
+    const QAJ4C_Value* value = NULL;
+    QAJ4C_Incremental_parser parser;
+    QAJ4C_Parse_limits limits = {};
+    limits.max_nodes = 5;
+
+    QAJ4C_incremental_parse_init(&parser, json, SIZE_MAX, 0, buff, ARRAY_COUNT(buff));
+    QAJ4C_incremental_parse_set_limits(&parser, &limits);
+    while (QAJ4C_incremental_parse_step(&parser, 4, 4, &value) == QAJ4C_PARSE_STATUS_IN_PROGRESS) {
+    }
+    assert(QAJ4C_is_error(value));
+    assert(QAJ4C_error_get_errno(value) == QAJ4C_ERROR_NODE_LIMIT_EXCEEDED);
+}
+
+TEST(ParserContextTests, ReuseBufferForSimilarMessages) {
+    static int realloc_calls;
+    const char* json1 = R"({"id":1,"name":"a longer string value","list":[1,2,3,[],{},[{"x":true}]]})";
+    const char* json2 = R"({"id":2,"name":"another string value!","list":[4,5,6,[],{},[{"y":false}]]})";
+    QAJ4C_Parser parser;
+    realloc_calls = 0;
+
+    auto realloc_counting = [](void* ptr, size_t size) -> void* {
+        ++realloc_calls;
+        return realloc(ptr, size);
+    };
+
+    QAJ4C_parser_init(&parser, realloc_counting, free);
+    const QAJ4C_Value* value = QAJ4C_parser_parse(&parser, json1, SIZE_MAX, 0);
+    assert(QAJ4C_is_object(value));
+    assert(realloc_calls > 1);
+    assert(parser.high_water_mark <= parser.buffer_size);
+
+    realloc_calls = 0;
+    value = QAJ4C_parser_parse(&parser, json2, SIZE_MAX, 0);
+    assert(QAJ4C_is_object(value));
+    assert(QAJ4C_get_uint(QAJ4C_object_get(value, "id")) == 2);
+    assert(strcmp(QAJ4C_get_string(QAJ4C_object_get(value, "name")), "another string value!") == 0);
+    assert(realloc_calls == 0);
+
+    /* after release the buffer is allocated at once with the high water mark */
+    QAJ4C_parser_release(&parser);
+    assert(parser.buffer == NULL);
+    value = QAJ4C_parser_parse(&parser, json1, SIZE_MAX, 0);
+    assert(QAJ4C_is_object(value));
+    assert(realloc_calls == 1);
+
+    QAJ4C_parser_release(&parser);
+}
+
+TEST(ParserContextTests, ParseErrorAndContinue) {
+    QAJ4C_Parser parser;
+    QAJ4C_parser_init(&parser, realloc, free);
+
+    const QAJ4C_Value* value = QAJ4C_parser_parse(&parser, "[1,2 3]", SIZE_MAX, 0);
+    assert(QAJ4C_is_error(value));
+    assert(QAJ4C_error_get_errno(value) == QAJ4C_ERROR_MISSING_COMMA);
+
+    value = QAJ4C_parser_parse(&parser, "[1,2]", SIZE_MAX, 0);
+    assert(QAJ4C_is_array(value));
+    assert(QAJ4C_array_size(value) == 2);
+
+    QAJ4C_parser_release(&parser);
+}
+
+TEST(ParserContextTests, ParseWithLimits) {
+    QAJ4C_Parser parser;
+    QAJ4C_Parse_limits limits = {};
+    limits.max_nodes = 3;
+    QAJ4C_parser_init(&parser, realloc, free);
+    parser.limits = &limits;
+
+    const QAJ4C_Value* value = QAJ4C_parser_parse(&parser, "[1,2,3]", SIZE_MAX, 0);
+    assert(QAJ4C_is_error(value));
+    assert(QAJ4C_error_get_errno(value) == QAJ4C_ERROR_NODE_LIMIT_EXCEEDED);
+
+    QAJ4C_parser_release(&parser);
+}
+
+static void print_wide_object( char* buffer, size_t size, int members, int first_member ) {
+    size_t pos = snprintf(buffer, size, "{");
+    for (int i = 0; i < members; ++i) {
+        int id = (first_member + i) % members;
+        pos += snprintf(buffer + pos, size - pos, "%s\"member_%d\":[%d,{\"x\":%d}]", i > 0 ? "," : "", id, id, id);
+    }
+    snprintf(buffer + pos, size - pos, "}");
+}
+
+TEST(ParserContextTests, LearnShapes) {
+    char json[4096];
+    char expected[4096];
+    char output[4096];
+    QAJ4C_Parser parser;
+    QAJ4C_parser_init(&parser, realloc, free);
+    print_wide_object(json, ARRAY_COUNT(json), 40, 0);
+
+    const QAJ4C_Value* value = QAJ4C_parse_opt_dynamic(json, SIZE_MAX, 0, realloc);
+    QAJ4C_sprint(value, expected, ARRAY_COUNT(expected));
+    free((void*)value);
+
+    for (int i = 0; i < 3; ++i) {
+        value = QAJ4C_parser_parse(&parser, json, SIZE_MAX, QAJ4C_PARSE_OPTS_LEARN_SHAPES);
+        assert(QAJ4C_get_internal_type(value) == QAJ4C_OBJECT_SORTED);
+        assert(QAJ4C_object_size(value) == 40);
+        assert(QAJ4C_get_uint(QAJ4C_array_get(QAJ4C_object_get(value, "member_17"), 0)) == 17);
+        assert(QAJ4C_get_uint(QAJ4C_object_get(QAJ4C_array_get(QAJ4C_object_get(value, "member_39"), 1), "x")) == 39);
+        QAJ4C_sprint(value, output, ARRAY_COUNT(output));
+        assert(strcmp(output, expected) == 0);
+    }
+
+    QAJ4C_parser_release(&parser);
+    assert(parser.shapes == NULL);
+}
+
+TEST(ParserContextTests, LearnShapesChangedKeyOrder) {
+    char json[4096];
+    char output[4096];
+    QAJ4C_Parser parser;
+    QAJ4C_parser_init(&parser, realloc, free);
+
+    for (int i = 0; i < 4; ++i) {
+        /* the key order differs on every second run */
+        print_wide_object(json, ARRAY_COUNT(json), 40, (i % 2) * 7);
+        const QAJ4C_Value* value = QAJ4C_parser_parse(&parser, json, SIZE_MAX, QAJ4C_PARSE_OPTS_LEARN_SHAPES);
+        assert(QAJ4C_get_internal_type(value) == QAJ4C_OBJECT_SORTED);
+        for (int j = 0; j < 40; ++j) {
+            char key[16];
+            snprintf(key, ARRAY_COUNT(key), "member_%d", j);
+            assert(QAJ4C_get_int(QAJ4C_array_get(QAJ4C_object_get(value, key), 0)) == j);
+        }
+    }
+
+    /* an object with less members and unsorted objects with a different order */
+    const char small1[] = R"({"a":1,"b":{"c":2,"d":3},"e":[{"f":1,"g":2},{"f":3,"g":4}]})";
+    const char small2[] = R"({"a":1,"b":{"d":3,"c":2},"e":[{"g":2,"f":1},{"f":3},{"f":5,"h":6}]})";
+    const QAJ4C_Value* value = QAJ4C_parser_parse(&parser, small1, SIZE_MAX, QAJ4C_PARSE_OPTS_LEARN_SHAPES);
+    QAJ4C_sprint(value, output, ARRAY_COUNT(output));
+    assert(strcmp(output, small1) == 0);
+    value = QAJ4C_parser_parse(&parser, small1, SIZE_MAX, QAJ4C_PARSE_OPTS_LEARN_SHAPES);
+    QAJ4C_sprint(value, output, ARRAY_COUNT(output));
+    assert(strcmp(output, small1) == 0);
+    value = QAJ4C_parser_parse(&parser, small2, SIZE_MAX, QAJ4C_PARSE_OPTS_LEARN_SHAPES);
+    QAJ4C_sprint(value, output, ARRAY_COUNT(output));
+    assert(strcmp(output, small2) == 0);
+    assert(QAJ4C_get_int(QAJ4C_object_get(QAJ4C_object_get(value, "b"), "c")) == 2);
+    assert(QAJ4C_get_int(QAJ4C_object_get(QAJ4C_array_get(QAJ4C_object_get(value, "e"), 2), "h")) == 6);
+
+    QAJ4C_parser_release(&parser);
+}
+
+TEST(ParserContextTests, LearnShapesInsitu) {
+    char json[4096];
+    char original[4096];
+    char expected[4096];
+    char output[4096];
+    QAJ4C_Parser parser;
+    QAJ4C_parser_init(&parser, realloc, free);
+    print_wide_object(original, ARRAY_COUNT(original), 40, 3);
+
+    const QAJ4C_Value* value = QAJ4C_parse_opt_dynamic(original, SIZE_MAX, 0, realloc);
+    QAJ4C_sprint(value, expected, ARRAY_COUNT(expected));
+    free((void*)value);
+
+    for (int i = 0; i < 2; ++i) {
+        strcpy(json, original);
+        value = QAJ4C_parser_parse_insitu(&parser, json, SIZE_MAX, QAJ4C_PARSE_OPTS_LEARN_SHAPES);
+        assert(QAJ4C_get_uint(QAJ4C_array_get(QAJ4C_object_get(value, "member_5"), 0)) == 5);
+        QAJ4C_sprint(value, output, ARRAY_COUNT(output));
+        assert(strcmp(output, expected) == 0);
+    }
+
+    QAJ4C_parser_release(&parser);
+}
+
+struct Tracking_allocator_ctx {
+    int allocations;
+    size_t allocated;
+    size_t alignment;
+};
+
+static QAJ4C_Allocator create_tracking_allocator( Tracking_allocator_ctx* ctx ) {
+    QAJ4C_Allocator allocator;
+    ctx->allocations = 0;
+    ctx->allocated = 0;
+    ctx->alignment = 0;
+
+    allocator.alloc_fn = [](void* ctx, size_t size, size_t alignment) -> void* {
+        Tracking_allocator_ctx* me = (Tracking_allocator_ctx*)ctx;
+        me->allocations += 1;
+        me->allocated = size;
+        me->alignment = alignment;
+        return malloc(size);
+    };
+    allocator.realloc_fn = [](void* ctx, void* ptr, size_t size, size_t alignment) -> void* {
+        Tracking_allocator_ctx* me = (Tracking_allocator_ctx*)ctx;
+        me->allocated = size;
+        me->alignment = alignment;
+        return realloc(ptr, size);
+    };
+    allocator.free_fn = [](void* ctx, void* ptr) {
+        Tracking_allocator_ctx* me = (Tracking_allocator_ctx*)ctx;
+        me->allocations -= 1;
+        me->allocated = 0;
+        free(ptr);
+    };
+    allocator.ctx = ctx;
+    return allocator;
+}
+
+TEST(AllocatorTests, ParseDynamicWithAllocator) {
+    const char* json = R"({"id":1,"name":"a longer string value","list":[1,2,3]})";
+    Tracking_allocator_ctx ctx;
+    QAJ4C_Allocator allocator = create_tracking_allocator(&ctx);
+
+    const QAJ4C_Value* value = QAJ4C_parse_opt_dynamic_allocator(json, SIZE_MAX, 0, NULL, &allocator);
+    assert(QAJ4C_is_object(value));
+    assert(ctx.allocations == 1);
+    assert(ctx.allocated == QAJ4C_calculate_max_buffer_size(json));
+    assert(ctx.alignment == sizeof(uintptr_t));
+
+    QAJ4C_document_free(value, &allocator);
+    assert(ctx.allocations == 0);
+}
+
+TEST(AllocatorTests, ParseDynamicWithStdAllocator) {
+    const char* json = R"([1,2,3])";
+    const QAJ4C_Value* value = QAJ4C_parse_opt_dynamic_allocator(json, SIZE_MAX, 0, NULL, QAJ4C_std_allocator());
+    assert(QAJ4C_is_array(value));
+    QAJ4C_document_free(value, QAJ4C_std_allocator());
+
+    /* documents parsed with realloc can be released with the std allocator */
+    value = QAJ4C_parse_dynamic(json, realloc);
+    assert(QAJ4C_is_array(value));
+    QAJ4C_document_free(value, QAJ4C_std_allocator());
+}
+
+TEST(AllocatorTests, ParserContextWithAllocator) {
+    const char* json = R"({"id":1,"name":"a longer string value","list":[1,2,3]})";
+    Tracking_allocator_ctx ctx;
+    QAJ4C_Allocator allocator = create_tracking_allocator(&ctx);
+    QAJ4C_Parser parser;
+
+    QAJ4C_parser_init_allocator(&parser, &allocator);
+    const QAJ4C_Value* value = QAJ4C_parser_parse(&parser, json, SIZE_MAX, 0);
+    assert(QAJ4C_is_object(value));
+    assert(ctx.allocations == 1);
+
+    QAJ4C_parser_release(&parser);
+    assert(ctx.allocations == 0);
+}
+
+TEST(AllocatorTests, GrowingBuilder) {
+    char key[32];
+    char output[128];
+    Tracking_allocator_ctx ctx;
+    QAJ4C_Allocator allocator = create_tracking_allocator(&ctx);
+    QAJ4C_Builder builder;
+
+    QAJ4C_builder_init_allocator(&builder, 64, &allocator);
+    assert(ctx.allocations == 1);
+    QAJ4C_Value* root = QAJ4C_builder_get_document(&builder);
+    QAJ4C_set_object(root, 3, &builder);
+
+    /* a fixed size array that does not fit into the first chunk */
+    QAJ4C_Value* numbers = QAJ4C_object_create_member_by_ref(root, "numbers");
+    QAJ4C_set_array(numbers, 100, &builder);
+    for (int i = 0; i < 100; ++i) {
+        QAJ4C_set_int(QAJ4C_array_get_rw(numbers, i), i);
+    }
+
+    /* growable containers and copied strings spread over further chunks */
+    QAJ4C_Value* members = QAJ4C_object_create_member_by_ref(root, "members");
+    QAJ4C_set_object_growable(members, 0, &builder);
+    for (int i = 0; i < 500; ++i) {
+        snprintf(key, sizeof(key), "member_%d", i);
+        QAJ4C_Value* member = QAJ4C_object_append_member_by_copy(members, key, &builder);
+        QAJ4C_set_string_copy(member, key, &builder);
+    }
+    QAJ4C_Value* packed = QAJ4C_object_create_member_by_ref(root, "packed");
+    int64_t values[] = {1, 2, 3};
+    QAJ4C_set_array_from_int64s(packed, values, ARRAY_COUNT(values), true, &builder);
+    QAJ4C_object_optimize(root);
+    QAJ4C_object_optimize(members);
+    assert(ctx.allocations > 2);
+
+    assert(QAJ4C_builder_get_document(&builder) == root);
+    assert(QAJ4C_get_int(QAJ4C_array_get(QAJ4C_object_get(root, "numbers"), 99)) == 99);
+    for (int i = 0; i < 500; ++i) {
+        snprintf(key, sizeof(key), "member_%d", i);
+        assert(strcmp(QAJ4C_get_string(QAJ4C_object_get(members, key)), key) == 0);
+    }
+    QAJ4C_sprint(QAJ4C_object_get(root, "packed"), output, ARRAY_COUNT(output));
+    assert(strcmp(output, "[1,2,3]") == 0);
+
+    /* reset keeps the first chunk */
+    QAJ4C_builder_reset(&builder);
+    assert(ctx.allocations == 1);
+    root = QAJ4C_builder_get_document(&builder);
+    QAJ4C_set_string_copy(root, "a string that is longer than the remaining first chunk", &builder);
+    QAJ4C_sprint(root, output, ARRAY_COUNT(output));
+    assert(strcmp(output, "\"a string that is longer than the remaining first chunk\"") == 0);
+    assert(ctx.allocations == 2);
+
+    QAJ4C_builder_release(&builder);
+    assert(ctx.allocations == 0);
+    assert(QAJ4C_builder_get_document(&builder) == NULL);
+}
+
+TEST(AllocatorTests, GrowingBuilderAllocationFailure) {
+    static int allocations;
+    QAJ4C_Allocator allocator = *QAJ4C_std_allocator();
+    QAJ4C_Builder builder;
+    allocations = 0;
+    allocator.alloc_fn = [](void* ctx, size_t size, size_t alignment) -> void* {
+        (void)ctx;
+        (void)alignment;
+        return ++allocations > 1 ? NULL : malloc(size);
+    };
+
+    static bool called = false;
+    QAJ4C_register_fatal_error_function([](){
+        called = true;
+    });
+
+    QAJ4C_builder_init_allocator(&builder, 128, &allocator);
+    QAJ4C_Value* root = QAJ4C_builder_get_document(&builder);
+    QAJ4C_set_array(root, 3, &builder);
+    assert(called == false);
+    char str[200];
+    memset(str, 'x', sizeof(str));
+    QAJ4C_set_string_copy_n(QAJ4C_array_get_rw(root, 0), str, sizeof(str), &builder);
+    assert(called == true);
+    assert(QAJ4C_array_size(root) == 3);
+    assert(QAJ4C_get_string_length(QAJ4C_array_get(root, 0)) == 0);
+
+    QAJ4C_builder_release(&builder);
+}
+
+TEST(AllocatorTests, GrowingBuilderFirstChunkFailure) {
+    static int allocations;
+    static size_t allocated;
+    QAJ4C_Allocator allocator = *QAJ4C_std_allocator();
+    QAJ4C_Builder builder;
+    QAJ4C_Value value;
+    char output[64];
+    allocations = 0;
+    allocator.alloc_fn = [](void* ctx, size_t size, size_t alignment) -> void* {
+        (void)ctx;
+        (void)alignment;
+        allocated = size;
+        return ++allocations == 1 ? NULL : malloc(size);
+    };
+
+    QAJ4C_builder_init_allocator(&builder, 256, &allocator);
+    assert(QAJ4C_builder_get_document(&builder) == NULL);
+
+    /* the reset retries the allocation with the same size (and keeps the allocator) */
+    QAJ4C_builder_reset(&builder);
+    assert(allocations == 2);
+    assert(allocated == sizeof(QAJ4C_Builder_chunk) + 256);
+    QAJ4C_Value* root = QAJ4C_builder_get_document(&builder);
+    assert(root != NULL);
+    QAJ4C_set_array(root, 2, &builder);
+    QAJ4C_set_int(QAJ4C_array_get_rw(root, 0), 1);
+    QAJ4C_set_int(QAJ4C_array_get_rw(root, 1), 2);
+    QAJ4C_sprint(root, output, ARRAY_COUNT(output));
+    assert(strcmp(output, "[1,2]") == 0);
+
+    /* a released builder allocates its first chunk on the next use, keeping the document free */
+    QAJ4C_builder_release(&builder);
+    QAJ4C_set_array(&value, 2, &builder);
+    assert(allocations == 3);
+    root = QAJ4C_builder_get_document(&builder);
+    assert(root != NULL && root != QAJ4C_array_get(&value, 0) && root != QAJ4C_array_get(&value, 1));
+    QAJ4C_set_uint(root, 7);
+    assert(QAJ4C_is_null(QAJ4C_array_get(&value, 0)));
+
+    QAJ4C_builder_release(&builder);
+}
+
+TEST(ErrorHandlingTests, ThreadFatalErrorFunction) {
+    static int thread_calls;
+    static int global_calls;
+    thread_calls = 0;
+    global_calls = 0;
+
+    QAJ4C_register_fatal_error_function([](){
+        ++global_calls;
+    });
+    QAJ4C_fatal_error_fn previous = QAJ4C_register_thread_fatal_error_function([](){
+        ++thread_calls;
+    });
+    assert(previous == NULL);
+
+    /* the mutation paths are checked in all builds (also with QAJ4C_UNCHECKED) */
+    QAJ4C_Value value;
+    QAJ4C_set_bool(&value, true);
+    assert(QAJ4C_array_get_rw(&value, 0) == NULL);
+    assert(thread_calls == 1);
+    assert(global_calls == 0);
+
+    /* removing the thread handler falls back to the global one */
+    QAJ4C_register_thread_fatal_error_function(previous);
+    assert(QAJ4C_object_create_member_by_ref(&value, "id") == NULL);
+    assert(thread_calls == 1);
+    assert(global_calls == 1);
+}
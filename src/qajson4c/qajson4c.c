@@ -43,6 +43,12 @@ void QAJ4C_register_fatal_error_function( QAJ4C_fatal_error_fn function ) {
     }
 }
 
+QAJ4C_fatal_error_fn QAJ4C_register_thread_fatal_error_function( QAJ4C_fatal_error_fn function ) {
+    QAJ4C_fatal_error_fn previous = g_qaj4c_thread_err_function;
+    g_qaj4c_thread_err_function = function;
+    return previous;
+}
+
 size_t QAJ4C_calculate_max_buffer_size_n( const char* json, size_t n ) {
     return QAJ4C_calculate_max_buffer_generic(json, n, 0);
 }
@@ -59,6 +65,14 @@ size_t QAJ4C_calculate_max_buffer_size_insitu( const char* json ) {
     return QAJ4C_calculate_max_buffer_size_insitu_n(json, QAJ4C_STRLEN(json));
 }
 
+size_t QAJ4C_calculate_max_buffer_size_opt( const char* json, size_t n, int opts ) {
+    return QAJ4C_calculate_max_buffer_generic(json, n, opts);
+}
+
+size_t QAJ4C_calculate_max_buffer_size_insitu_opt( const char* json, size_t n, int opts ) {
+    return QAJ4C_calculate_max_buffer_generic(json, n, opts | 1);
+}
+
 size_t QAJ4C_parse( const char* json, void* buffer, size_t buffer_size, const QAJ4C_Value** result_ptr ) {
     return QAJ4C_parse_opt(json, SIZE_MAX, 0, buffer, buffer_size, result_ptr);
 }
@@ -72,14 +86,32 @@ size_t QAJ4C_parse_insitu( char* json, void* buffer, size_t buffer_size, const Q
 }
 
 size_t QAJ4C_parse_opt( const char* json, size_t json_len, int opts, void* buffer, size_t buffer_size, const QAJ4C_Value** result_ptr ) {
+    return QAJ4C_parse_opt_limited(json, json_len, opts, NULL, buffer, buffer_size, result_ptr);
+}
+
+const QAJ4C_Value* QAJ4C_parse_opt_dynamic( const char* json, size_t json_len, int opts, QAJ4C_realloc_fn realloc_callback ) {
+    return QAJ4C_parse_opt_dynamic_limited(json, json_len, opts, NULL, realloc_callback);
+}
+
+size_t QAJ4C_parse_opt_insitu( char* json, size_t json_len, int opts, void* buffer, size_t buffer_size, const QAJ4C_Value** result_ptr ) {
+    return QAJ4C_parse_opt_limited(json, json_len, opts | 1, NULL, buffer, buffer_size, result_ptr);
+}
+
+size_t QAJ4C_parse_opt_limited( const char* json, size_t json_len, int opts, const QAJ4C_Parse_limits* limits, void* buffer, size_t buffer_size, const QAJ4C_Value** result_ptr ) {
     QAJ4C_Builder builder;
     QAJ4C_builder_init(&builder, buffer, buffer_size);
-    return QAJ4C_parse_generic(&builder, json, json_len, opts, result_ptr, NULL);
+    return QAJ4C_parse_generic(&builder, json, json_len, opts, limits, result_ptr, NULL);
 }
 
-const QAJ4C_Value* QAJ4C_parse_opt_dynamic( const char* json, size_t json_len, int opts, QAJ4C_realloc_fn realloc_callback ) {
+const QAJ4C_Value* QAJ4C_parse_opt_dynamic_limited( const char* json, size_t json_len, int opts, const QAJ4C_Parse_limits* limits, QAJ4C_realloc_fn realloc_callback ) {
+    QAJ4C_Realloc_adapter adapter;
+    QAJ4C_realloc_adapter_init(&adapter, realloc_callback, NULL);
+    return QAJ4C_parse_opt_dynamic_allocator(json, json_len, opts, limits, &adapter.allocator);
+}
+
+const QAJ4C_Value* QAJ4C_parse_opt_dynamic_allocator( const char* json, size_t json_len, int opts, const QAJ4C_Parse_limits* limits, const QAJ4C_Allocator* allocator ) {
     static size_type MIN_SIZE = sizeof(QAJ4C_Value) + sizeof(QAJ4C_Error_information);
-    void* buffer = realloc_callback( NULL, MIN_SIZE);
+    void* buffer = QAJ4C_allocator_realloc(allocator, NULL, MIN_SIZE);
     QAJ4C_Builder builder;
     const QAJ4C_Value* result = NULL;
     if (buffer == NULL) {
@@ -87,12 +119,80 @@ const QAJ4C_Value* QAJ4C_parse_opt_dynamic( const char* json, size_t json_len, i
     }
 
     QAJ4C_builder_init(&builder, buffer, MIN_SIZE);
-    QAJ4C_parse_generic(&builder, json, json_len, opts, &result, realloc_callback);
+    QAJ4C_parse_generic(&builder, json, json_len, opts, limits, &result, allocator);
     return result;
 }
 
-size_t QAJ4C_parse_opt_insitu( char* json, size_t json_len, int opts, void* buffer, size_t buffer_size, const QAJ4C_Value** result_ptr ) {
-    return QAJ4C_parse_opt(json, json_len, opts | 1, buffer, buffer_size, result_ptr);
+void QAJ4C_document_free( const QAJ4C_Value* document, const QAJ4C_Allocator* allocator ) {
+    if (document != NULL) {
+        allocator->free_fn(allocator->ctx, (void*)document);
+    }
+}
+
+const QAJ4C_Allocator* QAJ4C_std_allocator( void ) {
+    return QAJ4C_std_allocator_impl();
+}
+
+size_t QAJ4C_parse_opt_insitu_limited( char* json, size_t json_len, int opts, const QAJ4C_Parse_limits* limits, void* buffer, size_t buffer_size, const QAJ4C_Value** result_ptr ) {
+    return QAJ4C_parse_opt_limited(json, json_len, opts | 1, limits, buffer, buffer_size, result_ptr);
+}
+
+void QAJ4C_parser_init( QAJ4C_Parser* parser, QAJ4C_realloc_fn realloc_callback, QAJ4C_free_fn free_callback ) {
+    parser->allocator.alloc_fn = NULL;
+    parser->allocator.realloc_fn = NULL;
+    parser->allocator.free_fn = NULL;
+    parser->allocator.ctx = NULL;
+    parser->realloc_callback = realloc_callback;
+    parser->free_callback = free_callback;
+    parser->limits = NULL;
+    parser->buffer = NULL;
+    parser->buffer_size = 0;
+    parser->high_water_mark = 0;
+    parser->shapes = NULL;
+}
+
+const QAJ4C_Value* QAJ4C_parser_parse( QAJ4C_Parser* parser, const char* json, size_t json_len, int opts ) {
+    return QAJ4C_parser_parse_generic(parser, json, json_len, opts);
+}
+
+const QAJ4C_Value* QAJ4C_parser_parse_insitu( QAJ4C_Parser* parser, char* json, size_t json_len, int opts ) {
+    return QAJ4C_parser_parse_generic(parser, json, json_len, opts | 1);
+}
+
+void QAJ4C_parser_init_allocator( QAJ4C_Parser* parser, const QAJ4C_Allocator* allocator ) {
+    QAJ4C_parser_init(parser, NULL, NULL);
+    parser->allocator = *allocator;
+}
+
+void QAJ4C_parser_release( QAJ4C_Parser* parser ) {
+    QAJ4C_Realloc_adapter adapter;
+    const QAJ4C_Allocator* allocator = QAJ4C_parser_get_allocator(parser, &adapter);
+    if (parser->buffer != NULL) {
+        allocator->free_fn(allocator->ctx, parser->buffer);
+    }
+    if (parser->shapes != NULL) {
+        allocator->free_fn(allocator->ctx, parser->shapes);
+    }
+    parser->buffer = NULL;
+    parser->buffer_size = 0;
+    parser->shapes = NULL;
+}
+
+void QAJ4C_incremental_parse_init( QAJ4C_Incremental_parser* parser, const char* json, size_t json_len, int opts, void* buffer, size_t buffer_size ) {
+    QAJ4C_incremental_parse_init_generic(parser, json, json_len, opts, buffer, buffer_size);
+}
+
+void QAJ4C_incremental_parse_init_insitu( QAJ4C_Incremental_parser* parser, char* json, size_t json_len, int opts, void* buffer, size_t buffer_size ) {
+    QAJ4C_incremental_parse_init_generic(parser, json, json_len, opts | 1, buffer, buffer_size);
+}
+
+void QAJ4C_incremental_parse_set_limits( QAJ4C_Incremental_parser* parser, const QAJ4C_Parse_limits* limits ) {
+    QAJ4C_incremental_parse_set_limits_generic(parser, limits);
+}
+
+QAJ4C_PARSE_STATUS QAJ4C_incremental_parse_step( QAJ4C_Incremental_parser* parser, size_t max_bytes, size_t max_nodes, const QAJ4C_Value** result_ptr ) {
+    /* ensure each step makes progress */
+    return QAJ4C_incremental_parse_step_generic(parser, QAJ4C_MAX(max_bytes, 1), QAJ4C_MAX(max_nodes, 1), result_ptr);
 }
 
 size_t QAJ4C_sprint( const QAJ4C_Value* value_ptr, char* buffer, size_t buffer_size ) {
@@ -130,29 +230,18 @@ bool QAJ4C_is_string( const QAJ4C_Value* value_ptr ) {
 }
 
 const char* QAJ4C_get_string( const QAJ4C_Value* value_ptr ) {
-    QAJ4C_ASSERT(QAJ4C_is_string(value_ptr), {return "";});
-
-    if (QAJ4C_get_internal_type(value_ptr) == QAJ4C_INLINE_STRING) {
-        return ((QAJ4C_Short_string*) value_ptr)->s;
-    }
-    return ((QAJ4C_String*) value_ptr)->s;
+    QAJ4C_ACCESS_ASSERT(QAJ4C_is_string(value_ptr), {return "";});
+    return QAJ4C_STRING_CHARS(value_ptr);
 }
 
 size_t QAJ4C_get_string_length( const QAJ4C_Value* value_ptr ){
-    QAJ4C_ASSERT(QAJ4C_is_string(value_ptr), {return 0;});
-    if (QAJ4C_get_internal_type(value_ptr) == QAJ4C_INLINE_STRING) {
-        return ((QAJ4C_Short_string*) value_ptr)->count;
-    }
-    return ((QAJ4C_String*) value_ptr)->count;
+    QAJ4C_ACCESS_ASSERT(QAJ4C_is_string(value_ptr), {return 0;});
+    return QAJ4C_STRING_LENGTH(value_ptr);
 }
 
 int QAJ4C_string_cmp_n( const QAJ4C_Value* value_ptr, const char* str, size_t len ) {
-    QAJ4C_Value wrapper_value;
-
-    QAJ4C_ASSERT(QAJ4C_is_string(value_ptr), {return strcmp("", str);});
-
-    QAJ4C_set_string_ref_n(&wrapper_value, str, len);
-    return QAJ4C_strcmp(value_ptr, &wrapper_value);
+    QAJ4C_ACCESS_ASSERT(QAJ4C_is_string(value_ptr), {return strcmp("", str);});
+    return QAJ4C_strcmp_n(value_ptr, str, len);
 }
 
 bool QAJ4C_string_cmp( const QAJ4C_Value* value_ptr, const char* str ) {
@@ -181,8 +270,8 @@ bool QAJ4C_is_int( const QAJ4C_Value* value_ptr ) {
 }
 
 int32_t QAJ4C_get_int( const QAJ4C_Value* value_ptr ) {
-    QAJ4C_ASSERT(QAJ4C_is_int(value_ptr), {return 0;});
-    return (int32_t) ((QAJ4C_Primitive*) value_ptr)->data.i;
+    QAJ4C_ACCESS_ASSERT(QAJ4C_is_int(value_ptr), {return 0;});
+    return (int32_t) QAJ4C_PRIMITIVE_DATA(value_ptr).i;
 }
 
 bool QAJ4C_is_int64( const QAJ4C_Value* value_ptr ) {
@@ -190,8 +279,8 @@ bool QAJ4C_is_int64( const QAJ4C_Value* value_ptr ) {
 }
 
 int64_t QAJ4C_get_int64( const QAJ4C_Value* value_ptr ) {
-    QAJ4C_ASSERT(QAJ4C_is_int64(value_ptr), {return 0;});
-    return ((QAJ4C_Primitive*) value_ptr)->data.i;
+    QAJ4C_ACCESS_ASSERT(QAJ4C_is_int64(value_ptr), {return 0;});
+    return QAJ4C_PRIMITIVE_DATA(value_ptr).i;
 }
 
 bool QAJ4C_is_uint( const QAJ4C_Value* value_ptr ) {
@@ -199,8 +288,8 @@ bool QAJ4C_is_uint( const QAJ4C_Value* value_ptr ) {
 }
 
 uint32_t QAJ4C_get_uint( const QAJ4C_Value* value_ptr ) {
-    QAJ4C_ASSERT(QAJ4C_is_uint(value_ptr), {return 0;});
-    return (uint32_t) ((QAJ4C_Primitive*) value_ptr)->data.u;
+    QAJ4C_ACCESS_ASSERT(QAJ4C_is_uint(value_ptr), {return 0;});
+    return (uint32_t) QAJ4C_PRIMITIVE_DATA(value_ptr).u;
 }
 
 bool QAJ4C_is_uint64( const QAJ4C_Value* value_ptr ) {
@@ -208,8 +297,8 @@ bool QAJ4C_is_uint64( const QAJ4C_Value* value_ptr ) {
 }
 
 uint64_t QAJ4C_get_uint64( const QAJ4C_Value* value_ptr ) {
-    QAJ4C_ASSERT(QAJ4C_is_uint64(value_ptr), {return 0;});
-    return ((QAJ4C_Primitive*) value_ptr)->data.u;
+    QAJ4C_ACCESS_ASSERT(QAJ4C_is_uint64(value_ptr), {return 0;});
+    return QAJ4C_PRIMITIVE_DATA(value_ptr).u;
 }
 
 bool QAJ4C_is_double( const QAJ4C_Value* value_ptr ) {
@@ -218,17 +307,27 @@ bool QAJ4C_is_double( const QAJ4C_Value* value_ptr ) {
 }
 
 double QAJ4C_get_double( const QAJ4C_Value* value_ptr ) {
-    QAJ4C_ASSERT(QAJ4C_is_double(value_ptr), {return 0.0;});
+    QAJ4C_ACCESS_ASSERT(QAJ4C_is_double(value_ptr), {return 0.0;});
 
+#ifdef QAJ4C_COMPACT_VALUES
+    if (value_ptr->bits < QAJ4C_COMPACT_BOXED) {
+        double result;
+        QAJ4C_MEMCPY(&result, &value_ptr->bits, sizeof(double));
+        return result;
+    }
+    if (QAJ4C_COMPACT_TAG(value_ptr->bits) == QAJ4C_COMPACT_TAG_INT) {
+        return (double) QAJ4C_PRIMITIVE_DATA(value_ptr).i;
+    }
+#endif
     switch (QAJ4C_get_storage_type(value_ptr)) {
     case QAJ4C_PRIMITIVE_INT:
     case QAJ4C_PRIMITIVE_INT64:
-        return (double) ((QAJ4C_Primitive*) value_ptr)->data.i;
+        return (double) QAJ4C_PRIMITIVE_DATA(value_ptr).i;
     case QAJ4C_PRIMITIVE_UINT:
     case QAJ4C_PRIMITIVE_UINT64:
-        return (double) ((QAJ4C_Primitive*) value_ptr)->data.u;
+        return (double) QAJ4C_PRIMITIVE_DATA(value_ptr).u;
     default:
-        return ((QAJ4C_Primitive*) value_ptr)->data.d;
+        return QAJ4C_PRIMITIVE_DATA(value_ptr).d;
     }
 }
 
@@ -237,8 +336,8 @@ bool QAJ4C_is_bool( const QAJ4C_Value* value_ptr ) {
 }
 
 bool QAJ4C_get_bool( const QAJ4C_Value* value_ptr ) {
-    QAJ4C_ASSERT(QAJ4C_is_bool(value_ptr), {return false;});
-    return ((QAJ4C_Primitive*) value_ptr)->data.b;
+    QAJ4C_ACCESS_ASSERT(QAJ4C_is_bool(value_ptr), {return false;});
+    return QAJ4C_PLAIN_PRIMITIVE_DATA(value_ptr).b;
 }
 
 bool QAJ4C_is_not_set( const QAJ4C_Value* value_ptr ) {
@@ -253,7 +352,14 @@ QAJ4C_TYPE QAJ4C_get_type( const QAJ4C_Value* value_ptr ) {
     if ( value_ptr == NULL ) {
         return QAJ4C_TYPE_NULL;
     }
-    return value_ptr->type & 0xFF;
+#ifdef QAJ4C_COMPACT_VALUES
+    return QAJ4C_COMPACT_TYPE(value_ptr);
+#else
+    if (QAJ4C_IS_PACKED_ELEMENT(value_ptr)) {
+        return QAJ4C_TYPE_NUMBER;
+    }
+    return QAJ4C_TYPE_WORD(value_ptr) & 0xFF;
+#endif
 }
 
 bool QAJ4C_is_error( const QAJ4C_Value* value_ptr ) {
@@ -261,63 +367,140 @@ bool QAJ4C_is_error( const QAJ4C_Value* value_ptr ) {
 }
 
 const char* QAJ4C_error_get_json( const QAJ4C_Value* value_ptr ) {
-    QAJ4C_ASSERT(QAJ4C_is_error(value_ptr), {return "";});
-    return ((QAJ4C_Error*) value_ptr)->info->json;
+    QAJ4C_ACCESS_ASSERT(QAJ4C_is_error(value_ptr), {return "";});
+    return QAJ4C_ERROR_INFO(value_ptr)->json;
 }
 
 QAJ4C_ERROR_CODE QAJ4C_error_get_errno( const QAJ4C_Value* value_ptr ) {
-    QAJ4C_ASSERT(QAJ4C_is_error(value_ptr), {return 0;});
-    return ((QAJ4C_Error*) value_ptr)->info->err_no;
+    QAJ4C_ACCESS_ASSERT(QAJ4C_is_error(value_ptr), {return 0;});
+    return QAJ4C_ERROR_INFO(value_ptr)->err_no;
 }
 
 size_t QAJ4C_error_get_json_pos( const QAJ4C_Value* value_ptr ) {
-    QAJ4C_ASSERT(QAJ4C_is_error(value_ptr), {return 0;});
-    return ((QAJ4C_Error*) value_ptr)->info->json_pos;
+    QAJ4C_ACCESS_ASSERT(QAJ4C_is_error(value_ptr), {return 0;});
+    return QAJ4C_ERROR_INFO(value_ptr)->json_pos;
 }
 
 size_t QAJ4C_object_size( const QAJ4C_Value* value_ptr ) {
-    QAJ4C_ASSERT(QAJ4C_is_object(value_ptr), {return 0;});
-    return ((QAJ4C_Object*) value_ptr)->count;
+    QAJ4C_ACCESS_ASSERT(QAJ4C_is_object(value_ptr), {return 0;});
+    return QAJ4C_OBJECT_COUNT(value_ptr);
 }
 
 const QAJ4C_Member* QAJ4C_object_get_member( const QAJ4C_Value* value_ptr, size_t index ) {
-    QAJ4C_ASSERT(QAJ4C_is_object(value_ptr) && QAJ4C_object_size(value_ptr) > index, {return NULL;});
-    return &((QAJ4C_Object*) value_ptr)->top[index];
+    QAJ4C_ACCESS_ASSERT(QAJ4C_is_object(value_ptr) && QAJ4C_object_size(value_ptr) > index, {return NULL;});
+    if (QAJ4C_get_internal_type(value_ptr) == QAJ4C_OBJECT_SHAPED) {
+        return QAJ4C_shaped_object_get_member(value_ptr, index);
+    }
+    return &QAJ4C_OBJECT_TOP(value_ptr)[index];
 }
 
 const QAJ4C_Value* QAJ4C_member_get_key( const QAJ4C_Member* member ) {
-    QAJ4C_ASSERT(member != NULL, {return NULL;});
+    QAJ4C_ACCESS_ASSERT(member != NULL, {return NULL;});
+    if (QAJ4C_IS_SHAPED_MEMBER(member)) {
+        return QAJ4C_shaped_member_get_key(member);
+    }
     return &member->key;
 }
 
 const QAJ4C_Value* QAJ4C_member_get_value( const QAJ4C_Member* member ) {
-    QAJ4C_ASSERT(member != NULL, {return NULL;});
+    QAJ4C_ACCESS_ASSERT(member != NULL, {return NULL;});
+    if (QAJ4C_IS_SHAPED_MEMBER(member)) {
+        return QAJ4C_shaped_member_get_value(member);
+    }
     return &member->value;
 }
 
 const QAJ4C_Value* QAJ4C_object_get_n( const QAJ4C_Value* value_ptr, const char* str, size_t len ) {
-    QAJ4C_Value wrapper_value;
-    QAJ4C_ASSERT(QAJ4C_is_object(value_ptr), {return NULL;});
-
-    QAJ4C_set_string_ref_n(&wrapper_value, str, len);
-    if (QAJ4C_get_internal_type(value_ptr) == QAJ4C_OBJECT_SORTED) {
-        return QAJ4C_object_get_sorted((QAJ4C_Object*) value_ptr, &wrapper_value);
-    }
-    return QAJ4C_object_get_unsorted((QAJ4C_Object*) value_ptr, &wrapper_value);
+    QAJ4C_ACCESS_ASSERT(QAJ4C_is_object(value_ptr), {return NULL;});
+    return QAJ4C_object_get_hashed(value_ptr, str, len, QAJ4C_hash_string(str, len));
 }
 
 const QAJ4C_Value* QAJ4C_object_get( const QAJ4C_Value* value_ptr, const char* str ) {
     return QAJ4C_object_get_n( value_ptr, str, QAJ4C_STRLEN(str));
 }
 
+void QAJ4C_key_init_n( QAJ4C_Key* key, const char* str, size_t len ) {
+    key->str = str;
+    key->len = len;
+    key->hash = QAJ4C_hash_string(str, len);
+    key->last_index = 0;
+}
+
+void QAJ4C_key_init( QAJ4C_Key* key, const char* str ) {
+    QAJ4C_key_init_n(key, str, QAJ4C_STRLEN(str));
+}
+
+const QAJ4C_Value* QAJ4C_object_get_key( const QAJ4C_Value* value_ptr, QAJ4C_Key* key ) {
+    QAJ4C_ACCESS_ASSERT(QAJ4C_is_object(value_ptr), {return NULL;});
+    return QAJ4C_object_get_cached(value_ptr, key->str, key->len, key->hash, &key->last_index);
+}
+
+void QAJ4C_object_get_many( const QAJ4C_Value* value_ptr, const char* keys[], size_t count, const QAJ4C_Value* result[] ) {
+    size_t i;
+    for (i = 0; i < count; ++i) {
+        result[i] = NULL;
+    }
+    QAJ4C_ACCESS_ASSERT(QAJ4C_is_object(value_ptr), {return;});
+    QAJ4C_object_get_many_impl(value_ptr, keys, count, result);
+}
+
 size_t QAJ4C_array_size( const QAJ4C_Value* value_ptr ) {
-    QAJ4C_ASSERT(QAJ4C_is_array(value_ptr), {return 0;});
-    return ((QAJ4C_Array*) value_ptr)->count;
+    QAJ4C_ACCESS_ASSERT(QAJ4C_is_array(value_ptr), {return 0;});
+    return QAJ4C_ARRAY_COUNT(value_ptr);
 }
 
 const QAJ4C_Value* QAJ4C_array_get( const QAJ4C_Value* value_ptr, size_t index ) {
-    QAJ4C_ASSERT(QAJ4C_is_array(value_ptr) && QAJ4C_array_size(value_ptr) > index, {return NULL;});
-    return ((QAJ4C_Array*) value_ptr)->top + index;
+    QAJ4C_ACCESS_ASSERT(QAJ4C_is_array(value_ptr) && QAJ4C_array_size(value_ptr) > index, {return NULL;});
+    if (QAJ4C_get_internal_type(value_ptr) == QAJ4C_ARRAY_PACKED) {
+        return QAJ4C_packed_array_get(value_ptr, index);
+    }
+    return QAJ4C_ARRAY_TOP(value_ptr) + index;
+}
+
+const int64_t* QAJ4C_array_get_int64s( const QAJ4C_Value* value_ptr ) {
+    QAJ4C_ACCESS_ASSERT(QAJ4C_is_array(value_ptr), {return NULL;});
+    if (QAJ4C_packed_array_tag(value_ptr) != QAJ4C_PACKED_INT64_TAG) {
+        return NULL;
+    }
+    return (const int64_t*)((QAJ4C_Packed_array*) value_ptr)->top;
+}
+
+const double* QAJ4C_array_get_doubles( const QAJ4C_Value* value_ptr ) {
+    QAJ4C_ACCESS_ASSERT(QAJ4C_is_array(value_ptr), {return NULL;});
+    if (QAJ4C_packed_array_tag(value_ptr) != QAJ4C_PACKED_DOUBLE_TAG) {
+        return NULL;
+    }
+    return (const double*)((QAJ4C_Packed_array*) value_ptr)->top;
+}
+
+size_t QAJ4C_array_copy_doubles( const QAJ4C_Value* value_ptr, double* out, size_t n ) {
+    QAJ4C_ACCESS_ASSERT(QAJ4C_is_array(value_ptr), {return 0;});
+    return QAJ4C_array_copy_impl(value_ptr, out, n, QAJ4C_PRIMITIVE_DOUBLE);
+}
+
+size_t QAJ4C_array_copy_int64s( const QAJ4C_Value* value_ptr, int64_t* out, size_t n ) {
+    QAJ4C_ACCESS_ASSERT(QAJ4C_is_array(value_ptr), {return 0;});
+    return QAJ4C_array_copy_impl(value_ptr, out, n, QAJ4C_PRIMITIVE_INT64);
+}
+
+size_t QAJ4C_array_copy_uint64s( const QAJ4C_Value* value_ptr, uint64_t* out, size_t n ) {
+    QAJ4C_ACCESS_ASSERT(QAJ4C_is_array(value_ptr), {return 0;});
+    return QAJ4C_array_copy_impl(value_ptr, out, n, QAJ4C_PRIMITIVE_UINT64);
+}
+
+size_t QAJ4C_array_column_doubles( const QAJ4C_Value* value_ptr, QAJ4C_Key* key, double* out, size_t n, uint8_t* nulls ) {
+    QAJ4C_ACCESS_ASSERT(QAJ4C_is_array(value_ptr), {return 0;});
+    return QAJ4C_array_column_numbers_impl(value_ptr, key, out, QAJ4C_PRIMITIVE_DOUBLE, n, nulls);
+}
+
+size_t QAJ4C_array_column_int64s( const QAJ4C_Value* value_ptr, QAJ4C_Key* key, int64_t* out, size_t n, uint8_t* nulls ) {
+    QAJ4C_ACCESS_ASSERT(QAJ4C_is_array(value_ptr), {return 0;});
+    return QAJ4C_array_column_numbers_impl(value_ptr, key, out, QAJ4C_PRIMITIVE_INT64, n, nulls);
+}
+
+size_t QAJ4C_array_column_strings( const QAJ4C_Value* value_ptr, QAJ4C_Key* key, const char** strings, size_t* lengths, size_t n, uint8_t* nulls ) {
+    QAJ4C_ACCESS_ASSERT(QAJ4C_is_array(value_ptr), {return 0;});
+    return QAJ4C_array_column_strings_impl(value_ptr, key, strings, lengths, n, nulls);
 }
 
 QAJ4C_Builder QAJ4C_builder_create( void* buff, size_t buff_size )
@@ -335,20 +518,52 @@ void QAJ4C_builder_init( QAJ4C_Builder* me, void* buff, size_t buff_size ) {
     me->cur_obj_pos = sizeof(QAJ4C_Value);
     /* strings from end to front */
     me->cur_str_pos = buff_size;
+
+    me->allocator.alloc_fn = NULL;
+    me->allocator.realloc_fn = NULL;
+    me->allocator.free_fn = NULL;
+    me->allocator.ctx = NULL;
+    me->chunks = NULL;
+}
+
+void QAJ4C_builder_init_allocator( QAJ4C_Builder* me, size_t chunk_size, const QAJ4C_Allocator* allocator ) {
+    QAJ4C_builder_init(me, NULL, 0);
+    me->allocator = *allocator;
+    /* the size of the first chunk (kept in case the allocation fails and is retried) */
+    me->buffer_size = chunk_size;
+    QAJ4C_builder_add_chunk(me, 0);
 }
 
 void QAJ4C_builder_reset( QAJ4C_Builder* me )
 {
-   QAJ4C_builder_init( me, me->buffer, me->buffer_size );
+   if (me->chunks != NULL) {
+       QAJ4C_builder_free_chunks( me, true );
+   } else if (me->allocator.alloc_fn != NULL) {
+       /* the first chunk of the growing builder has not been allocated (or was released) */
+       QAJ4C_builder_add_chunk( me, 0 );
+   } else {
+       QAJ4C_builder_init( me, me->buffer, me->buffer_size );
+   }
+}
+
+void QAJ4C_builder_release( QAJ4C_Builder* me ) {
+    QAJ4C_builder_free_chunks(me, false);
 }
 
 QAJ4C_Value* QAJ4C_builder_get_document( QAJ4C_Builder* builder ) {
+    if (builder->chunks != NULL) {
+        return (QAJ4C_Value*)(builder->chunks + 1);
+    }
     return (QAJ4C_Value*)builder->buffer;
 }
 
 void QAJ4C_set_bool( QAJ4C_Value* value_ptr, bool value ) {
+#ifdef QAJ4C_COMPACT_VALUES
+    value_ptr->bits = QAJ4C_COMPACT_BOX(QAJ4C_COMPACT_TAG_CONST, value ? 2 : 1);
+#else
     value_ptr->type = QAJ4C_BOOL_TYPE_CONSTANT;
     ((QAJ4C_Primitive*) value_ptr)->data.b = value;
+#endif
 }
 
 void QAJ4C_set_int( QAJ4C_Value* value_ptr, int32_t value ) {
@@ -356,16 +571,7 @@ void QAJ4C_set_int( QAJ4C_Value* value_ptr, int32_t value ) {
 }
 
 void QAJ4C_set_int64( QAJ4C_Value* value_ptr, int64_t value ) {
-    if (value >= 0) {
-        QAJ4C_set_uint64(value_ptr, value);
-        return;
-    }
-    if ( value < INT32_MIN ) {
-        value_ptr->type = QAJ4C_INT64_TYPE_CONSTANT;
-    } else {
-        value_ptr->type = QAJ4C_INT32_TYPE_CONSTANT;
-    }
-    ((QAJ4C_Primitive*) value_ptr)->data.i = value;
+    QAJ4C_set_int64_impl(value_ptr, value, NULL);
 }
 
 void QAJ4C_set_uint( QAJ4C_Value* value_ptr, uint32_t value ) {
@@ -373,35 +579,40 @@ void QAJ4C_set_uint( QAJ4C_Value* value_ptr, uint32_t value ) {
 }
 
 void QAJ4C_set_uint64( QAJ4C_Value* value_ptr, uint64_t value ) {
-    if (value <= UINT32_MAX) {
-        if (value <= INT32_MAX) {
-            value_ptr->type = QAJ4C_UINT32_TYPE_INT32_COMPAT_CONSTANT;
-        } else {
-            value_ptr->type = QAJ4C_UINT32_TYPE_CONSTANT;
-        }
-    } else {
-        if (value <= INT64_MAX) {
-            value_ptr->type = QAJ4C_UINT64_TYPE_INT64_COMPAT_CONSTANT;
-        } else {
-            value_ptr->type = QAJ4C_UINT64_TYPE_CONSTANT;
-        }
-    }
-    ((QAJ4C_Primitive*) value_ptr)->data.u = value;
+    QAJ4C_set_uint64_impl(value_ptr, value, NULL);
 }
 
 void QAJ4C_set_double( QAJ4C_Value* value_ptr, double value ) {
+#ifdef QAJ4C_COMPACT_VALUES
+    if (value != value) {
+        value_ptr->bits = QAJ4C_COMPACT_CANONICAL_NAN; /* other NaNs could look like boxed values */
+    } else {
+        QAJ4C_MEMCPY(&value_ptr->bits, &value, sizeof(double));
+    }
+#else
     value_ptr->type = QAJ4C_DOUBLE_TYPE_CONSTANT;
     ((QAJ4C_Primitive*) value_ptr)->data.d = value;
+#endif
 }
 
 void QAJ4C_set_null( QAJ4C_Value* value_ptr ) {
+#ifdef QAJ4C_COMPACT_VALUES
+    value_ptr->bits = QAJ4C_COMPACT_BOX(QAJ4C_COMPACT_TAG_CONST, 0);
+#else
     value_ptr->type = QAJ4C_NULL_TYPE_CONSTANT;
+#endif
 }
 
 void QAJ4C_set_string_ref_n( QAJ4C_Value* value_ptr, const char* str, size_t len ) {
-    value_ptr->type = QAJ4C_STRING_REF_TYPE_CONSTANT;
-    ((QAJ4C_String*)value_ptr)->s = str;
-    ((QAJ4C_String*)value_ptr)->count = len;
+#ifdef QAJ4C_COMPACT_VALUES
+    /* the length of a reference is not stored, so short strings are copied into the value */
+    if (len <= QAJ4C_INLINE_STRING_SIZE && QAJ4C_MEMCHR(str, '\0', len) == NULL) {
+        QAJ4C_SET_INLINE_STRING(value_ptr, str, len);
+        return;
+    }
+    QAJ4C_ASSERT(str[len] == '\0', {});
+#endif
+    QAJ4C_SET_STRING(value_ptr, QAJ4C_STRING_REF_TYPE_CONSTANT, str, len);
 }
 
 void QAJ4C_set_string_ref( QAJ4C_Value* value_ptr, const char* str ) {
@@ -409,21 +620,22 @@ void QAJ4C_set_string_ref( QAJ4C_Value* value_ptr, const char* str ) {
 }
 
 void QAJ4C_set_string_copy_n( QAJ4C_Value* value_ptr, const char* str, size_t len, QAJ4C_Builder* builder ) {
+#ifdef QAJ4C_COMPACT_VALUES
+    /* the length of inline strings is taken from the \0, so strings containing one are stored */
+    if (len <= QAJ4C_INLINE_STRING_SIZE && QAJ4C_MEMCHR(str, '\0', len) == NULL) {
+#else
     if (len <= QAJ4C_INLINE_STRING_SIZE) {
-        value_ptr->type = QAJ4C_INLINE_STRING_TYPE_CONSTANT;
-        ((QAJ4C_Short_string*)value_ptr)->count = (uint8_t)len;
-        QAJ4C_MEMCPY(&((QAJ4C_Short_string*)value_ptr)->s, str, len);
-        ((QAJ4C_Short_string*)value_ptr)->s[len] = '\0';
+#endif
+        QAJ4C_SET_INLINE_STRING(value_ptr, str, len);
     } else {
         char* new_string;
-        value_ptr->type = QAJ4C_STRING_TYPE_CONSTANT;
-        QAJ4C_ASSERT(builder != NULL, {((QAJ4C_String*)value_ptr)->count = 0; ((QAJ4C_String*)value_ptr)->s = ""; return;});
-        new_string = QAJ4C_builder_pop_string(builder, len + 1);
-        QAJ4C_ASSERT(new_string != NULL, {((QAJ4C_String*)value_ptr)->count = 0; ((QAJ4C_String*)value_ptr)->s = ""; return;});
-        ((QAJ4C_String*)value_ptr)->count = len;
+        QAJ4C_ASSERT(builder != NULL, {QAJ4C_SET_INLINE_STRING(value_ptr, "", 0); return;});
+        new_string = QAJ4C_builder_pop_string(builder, QAJ4C_STRING_HEADER_SIZE + len + 1);
+        QAJ4C_ASSERT(new_string != NULL, {QAJ4C_SET_INLINE_STRING(value_ptr, "", 0); return;});
+        new_string += QAJ4C_STRING_HEADER_SIZE;
         QAJ4C_MEMCPY(new_string, str, len);
-        ((QAJ4C_String*)value_ptr)->s = new_string;
         new_string[len] = '\0';
+        QAJ4C_SET_STRING(value_ptr, QAJ4C_STRING_TYPE_CONSTANT, new_string, len);
     }
 }
 
@@ -432,49 +644,172 @@ void QAJ4C_set_string_copy( QAJ4C_Value* value_ptr, const char* str, QAJ4C_Build
 }
 
 void QAJ4C_set_array( QAJ4C_Value* value_ptr, size_t count, QAJ4C_Builder* builder ) {
-    value_ptr->type = QAJ4C_ARRAY_TYPE_CONSTANT;
-    ((QAJ4C_Array*)value_ptr)->top = QAJ4C_builder_pop_values(builder, count);
-    if (QAJ4C_UNLIKELY(((QAJ4C_Array*)value_ptr)->top==NULL)) {
-        ((QAJ4C_Array*)value_ptr)->count = 0;
-    } else {
-        ((QAJ4C_Array*)value_ptr)->count = count;
+    QAJ4C_Value* top = QAJ4C_builder_pop_values(builder, count);
+    QAJ4C_SET_ARRAY(value_ptr, QAJ4C_ARRAY_TYPE_CONSTANT, top, QAJ4C_UNLIKELY(top == NULL) ? 0 : count);
+}
+
+void QAJ4C_set_array_from_doubles( QAJ4C_Value* value_ptr, const double* values, size_t count, bool packed, QAJ4C_Builder* builder ) {
+    QAJ4C_Value* top;
+    size_t i;
+
+    if (packed && count > 0 && QAJ4C_TYPE_FLAGS_SUPPORTED) {
+        QAJ4C_set_packed_array(value_ptr, values, count, QAJ4C_PACKED_DOUBLE_TAG, builder);
+        return;
+    }
+    QAJ4C_set_array(value_ptr, count, builder);
+    top = QAJ4C_ARRAY_TOP(value_ptr);
+    count = QAJ4C_ARRAY_COUNT(value_ptr);
+    for (i = 0; i < count; ++i) {
+        QAJ4C_set_double(&top[i], values[i]);
     }
 }
 
+void QAJ4C_set_array_from_int64s( QAJ4C_Value* value_ptr, const int64_t* values, size_t count, bool packed, QAJ4C_Builder* builder ) {
+    QAJ4C_Value* top;
+    size_t i;
+
+    if (packed && count > 0 && QAJ4C_TYPE_FLAGS_SUPPORTED) {
+        QAJ4C_set_packed_array(value_ptr, values, count, QAJ4C_PACKED_INT64_TAG, builder);
+        return;
+    }
+    QAJ4C_set_array(value_ptr, count, builder);
+    top = QAJ4C_ARRAY_TOP(value_ptr);
+    count = QAJ4C_ARRAY_COUNT(value_ptr);
+    for (i = 0; i < count; ++i) {
+        QAJ4C_set_int64_impl(&top[i], values[i], builder);
+    }
+}
+
+void QAJ4C_set_array_from_strings( QAJ4C_Value* value_ptr, const char* const* strings, const size_t* lengths, size_t count, QAJ4C_Builder* builder ) {
+    QAJ4C_Value* top;
+    size_t i;
+
+    QAJ4C_set_array(value_ptr, count, builder);
+    top = QAJ4C_ARRAY_TOP(value_ptr);
+    count = QAJ4C_ARRAY_COUNT(value_ptr);
+    for (i = 0; i < count; ++i) {
+        QAJ4C_set_string_copy_n(&top[i], strings[i], lengths != NULL ? lengths[i] : QAJ4C_STRLEN(strings[i]), builder);
+    }
+}
+
+void QAJ4C_set_array_growable( QAJ4C_Value* value_ptr, size_t capacity, QAJ4C_Builder* builder ) {
+    QAJ4C_Value* top = QAJ4C_builder_pop_growable(builder, capacity, sizeof(QAJ4C_Value));
+    QAJ4C_SET_ARRAY(value_ptr, QAJ4C_UNLIKELY(top == NULL) ? QAJ4C_ARRAY_TYPE_CONSTANT : QAJ4C_ARRAY_TYPE_CONSTANT | QAJ4C_GROWABLE_FLAG, top, 0);
+}
+
+QAJ4C_Value* QAJ4C_array_append( QAJ4C_Value* value_ptr, QAJ4C_Builder* builder ) {
+    QAJ4C_Value* top;
+    size_type count;
+
+    QAJ4C_ASSERT(QAJ4C_get_internal_type(value_ptr) == QAJ4C_ARRAY && (QAJ4C_TYPE_WORD(value_ptr) & QAJ4C_GROWABLE_FLAG) != 0, {return NULL;});
+    top = QAJ4C_ARRAY_TOP(value_ptr);
+    count = QAJ4C_ARRAY_COUNT(value_ptr);
+    if (count == ((QAJ4C_Growable_header*)top - 1)->capacity) {
+        top = QAJ4C_builder_grow(builder, top, count, sizeof(QAJ4C_Value));
+        if (top == NULL) {
+            return NULL;
+        }
+    }
+    QAJ4C_set_null(&top[count]);
+    QAJ4C_SET_ARRAY(value_ptr, QAJ4C_ARRAY_TYPE_CONSTANT | QAJ4C_GROWABLE_FLAG, top, count + 1);
+    return &top[count];
+}
+
 QAJ4C_Value* QAJ4C_array_get_rw( QAJ4C_Value* value_ptr, size_t index ) {
-    QAJ4C_ASSERT(QAJ4C_is_array(value_ptr) && QAJ4C_array_size(value_ptr) > index, {return NULL;});
-    return ((QAJ4C_Array*) value_ptr)->top + index;
+    /* mutation path, so the checks are kept with QAJ4C_UNCHECKED (packed elements are no values) */
+    QAJ4C_ASSERT(QAJ4C_get_internal_type(value_ptr) == QAJ4C_ARRAY && QAJ4C_array_size(value_ptr) > index, {return NULL;});
+    return QAJ4C_ARRAY_TOP(value_ptr) + index;
 }
 
 void QAJ4C_set_object( QAJ4C_Value* value_ptr, size_t count, QAJ4C_Builder* builder ) {
-    value_ptr->type = QAJ4C_OBJECT_TYPE_CONSTANT;
-    ((QAJ4C_Object*)value_ptr)->top = QAJ4C_builder_pop_members(builder, count);
-    if (QAJ4C_UNLIKELY(((QAJ4C_Object*)value_ptr)->top==NULL)) {
-        ((QAJ4C_Object*)value_ptr)->count = 0;
-    } else {
-        ((QAJ4C_Object*)value_ptr)->count = count;
+    QAJ4C_Member* top = QAJ4C_builder_pop_members(builder, count);
+    QAJ4C_SET_OBJECT(value_ptr, QAJ4C_OBJECT_TYPE_CONSTANT, top, QAJ4C_UNLIKELY(top == NULL) ? 0 : count);
+}
+
+void QAJ4C_set_object_from_arrays( QAJ4C_Value* value_ptr, const char* const* keys, const size_t* lengths, const QAJ4C_Value* const* values, size_t count, bool presorted, QAJ4C_Builder* builder ) {
+    QAJ4C_Member* top;
+    bool sorted = true;
+    size_t i;
+
+    QAJ4C_set_object(value_ptr, count, builder);
+    top = QAJ4C_OBJECT_TOP(value_ptr);
+    count = QAJ4C_OBJECT_COUNT(value_ptr);
+    for (i = 0; i < count; ++i) {
+        size_t len = lengths != NULL ? lengths[i] : QAJ4C_STRLEN(keys[i]);
+        QAJ4C_set_string_ref_n(&top[i].key, keys[i], len);
+        QAJ4C_set_key_hash(&top[i].key, QAJ4C_hash_string(keys[i], len));
+        if (QAJ4C_IS_PACKED_ELEMENT(values[i])) {
+            QAJ4C_packed_element_unpack(values[i], &top[i].value);
+        } else if (values[i] != NULL) {
+            top[i].value = *values[i];
+        }
+        /* strictly ascending keys are sorted and unique */
+        if (presorted && i > 0 && sorted) {
+            size_t prev_len = QAJ4C_STRING_LENGTH(&top[i - 1].key);
+            sorted = prev_len < len || (prev_len == len && QAJ4C_MEMCMP(keys[i - 1], keys[i], len) < 0);
+        }
+    }
+    if (presorted) {
+        QAJ4C_ASSERT(sorted, {return;});
+        QAJ4C_SET_TYPE_WORD(value_ptr, QAJ4C_OBJECT_SORTED_TYPE_CONSTANT);
+    }
+}
+
+void QAJ4C_set_object_growable( QAJ4C_Value* value_ptr, size_t capacity, QAJ4C_Builder* builder ) {
+    QAJ4C_Member* top = QAJ4C_builder_pop_growable(builder, capacity, sizeof(QAJ4C_Member));
+    QAJ4C_SET_OBJECT(value_ptr, QAJ4C_UNLIKELY(top == NULL) ? QAJ4C_OBJECT_TYPE_CONSTANT : QAJ4C_OBJECT_TYPE_CONSTANT | QAJ4C_GROWABLE_FLAG, top, 0);
+}
+
+QAJ4C_Value* QAJ4C_object_append_member_by_ref_n( QAJ4C_Value* value_ptr, const char* str, size_t len, QAJ4C_Builder* builder ) {
+    QAJ4C_Member* member = QAJ4C_object_append_member(value_ptr, builder);
+    if (member == NULL) {
+        return NULL;
+    }
+    QAJ4C_set_string_ref_n(&member->key, str, len);
+    QAJ4C_set_key_hash(&member->key, QAJ4C_hash_string(str, len));
+    return &member->value;
+}
+
+QAJ4C_Value* QAJ4C_object_append_member_by_ref( QAJ4C_Value* value_ptr, const char* str, QAJ4C_Builder* builder ) {
+    return QAJ4C_object_append_member_by_ref_n(value_ptr, str, QAJ4C_STRLEN(str), builder);
+}
+
+QAJ4C_Value* QAJ4C_object_append_member_by_copy_n( QAJ4C_Value* value_ptr, const char* str, size_t len, QAJ4C_Builder* builder ) {
+    QAJ4C_Member* member = QAJ4C_object_append_member(value_ptr, builder);
+    if (member == NULL) {
+        return NULL;
     }
+    QAJ4C_set_string_copy_n(&member->key, str, len, builder);
+    QAJ4C_set_key_hash(&member->key, QAJ4C_hash_string(str, len));
+    return &member->value;
+}
+
+QAJ4C_Value* QAJ4C_object_append_member_by_copy( QAJ4C_Value* value_ptr, const char* str, QAJ4C_Builder* builder ) {
+    return QAJ4C_object_append_member_by_copy_n(value_ptr, str, QAJ4C_STRLEN(str), builder);
 }
 
 QAJ4C_Value* QAJ4C_object_create_member_by_ref_n( QAJ4C_Value* value_ptr, const char* str, size_t len ) {
+    QAJ4C_Member* top;
     size_type count;
     size_type i;
 
-    QAJ4C_ASSERT(QAJ4C_is_object(value_ptr), {return NULL;});
-    count = ((QAJ4C_Object*) value_ptr)->count;
+    QAJ4C_ASSERT(QAJ4C_is_object(value_ptr) && QAJ4C_get_internal_type(value_ptr) != QAJ4C_OBJECT_SHAPED, {return NULL;});
+    top = QAJ4C_OBJECT_TOP(value_ptr);
+    count = QAJ4C_OBJECT_COUNT(value_ptr);
 
     for (i = 0; i < count; ++i) {
-        QAJ4C_Value* key_value = &((QAJ4C_Object*) value_ptr)->top[i].key;
+        QAJ4C_Value* key_value = &top[i].key;
         if (QAJ4C_is_null(key_value)) {
-            value_ptr->type = QAJ4C_OBJECT_TYPE_CONSTANT; /* not sorted anymore */
+            QAJ4C_SET_TYPE_WORD(value_ptr, QAJ4C_OBJECT_TYPE_CONSTANT); /* not sorted anymore */
             QAJ4C_set_string_ref_n(key_value, str, len);
-            return &((QAJ4C_Object*) value_ptr)->top[i].value;
+            QAJ4C_set_key_hash(key_value, QAJ4C_hash_string(str, len));
+            return &top[i].value;
         } else if (QAJ4C_string_equals_n(key_value, str, len)) {
             /* adding the same key twice voilates the json rules! */
             break;
         }
     }
-    g_qaj4c_err_function();
+    QAJ4C_raise_fatal_error();
     return NULL;
 }
 
@@ -483,24 +818,27 @@ QAJ4C_Value* QAJ4C_object_create_member_by_ref( QAJ4C_Value* value_ptr, const ch
 }
 
 QAJ4C_Value* QAJ4C_object_create_member_by_copy_n( QAJ4C_Value* value_ptr, const char* str, size_t len, QAJ4C_Builder* builder ) {
+    QAJ4C_Member* top;
     size_type count;
     size_type i;
 
-    QAJ4C_ASSERT(QAJ4C_is_object(value_ptr), {return NULL;});
-    count = ((QAJ4C_Object*) value_ptr)->count;
+    QAJ4C_ASSERT(QAJ4C_is_object(value_ptr) && QAJ4C_get_internal_type(value_ptr) != QAJ4C_OBJECT_SHAPED, {return NULL;});
+    top = QAJ4C_OBJECT_TOP(value_ptr);
+    count = QAJ4C_OBJECT_COUNT(value_ptr);
 
     for (i = 0; i < count; ++i) {
-        QAJ4C_Value* key_value = &((QAJ4C_Object*) value_ptr)->top[i].key;
+        QAJ4C_Value* key_value = &top[i].key;
         if (QAJ4C_is_null(key_value)) {
-            value_ptr->type = QAJ4C_OBJECT_TYPE_CONSTANT; /* not sorted anymore */
+            QAJ4C_SET_TYPE_WORD(value_ptr, QAJ4C_OBJECT_TYPE_CONSTANT); /* not sorted anymore */
             QAJ4C_set_string_copy_n(key_value, str, len, builder);
-            return &((QAJ4C_Object*) value_ptr)->top[i].value;
+            QAJ4C_set_key_hash(key_value, QAJ4C_hash_string(str, len));
+            return &top[i].value;
         } else if (QAJ4C_string_equals_n(key_value, str, len)) {
             /* adding the same key twice voilates the json rules! */
             break;
         }
     }
-    g_qaj4c_err_function();
+    QAJ4C_raise_fatal_error();
     return NULL;
 }
 
@@ -511,10 +849,10 @@ QAJ4C_Value* QAJ4C_object_create_member_by_copy( QAJ4C_Value* value_ptr, const c
 void QAJ4C_object_optimize( QAJ4C_Value* value_ptr ) {
     QAJ4C_ASSERT(QAJ4C_is_object(value_ptr), {return;});
 
-    if (QAJ4C_get_internal_type(value_ptr) != QAJ4C_OBJECT_SORTED) {
-        QAJ4C_Object* obj_ptr = (QAJ4C_Object*)value_ptr;
-        QAJ4C_QSORT(obj_ptr->top, obj_ptr->count, sizeof(QAJ4C_Member), QAJ4C_compare_members);
-        value_ptr->type = QAJ4C_OBJECT_SORTED_TYPE_CONSTANT;
+    /* shaped objects keep the order of the keys they share */
+    if (QAJ4C_get_internal_type(value_ptr) == QAJ4C_OBJECT) {
+        QAJ4C_sort_members(QAJ4C_OBJECT_TOP(value_ptr), QAJ4C_OBJECT_COUNT(value_ptr));
+        QAJ4C_SET_TYPE_WORD(value_ptr, QAJ4C_OBJECT_SORTED_TYPE_CONSTANT | (QAJ4C_TYPE_WORD(value_ptr) & QAJ4C_GROWABLE_FLAG));
     }
 }
 
@@ -522,16 +860,14 @@ void QAJ4C_object_optimize( QAJ4C_Value* value_ptr ) {
 QAJ4C_Object_builder QAJ4C_object_builder_init( QAJ4C_Value* value_ptr, size_t member_count, bool deduplicate, QAJ4C_Builder* builder )
 {
     QAJ4C_Object_builder object_builder = {value_ptr, deduplicate, 0, member_count};
-    QAJ4C_Object* object_ptr = (QAJ4C_Object*)value_ptr;
     QAJ4C_set_object(value_ptr, member_count, builder);
-    object_ptr->count = 0; /* The size management is performed by the builder */
+    QAJ4C_SET_OBJECT_COUNT(value_ptr, 0); /* The size management is performed by the builder */
     return object_builder;
 }
 
 QAJ4C_Value* QAJ4C_object_builder_create_member_by_ref_n( QAJ4C_Object_builder* value_ptr, const char* str, size_t len )
 {
     QAJ4C_Value* return_value = NULL;
-    QAJ4C_Object* object_ptr = ((QAJ4C_Object*)value_ptr->object);
 
     QAJ4C_ASSERT(value_ptr != NULL && value_ptr->pos < value_ptr->count, {return return_value;});
 
@@ -540,12 +876,13 @@ QAJ4C_Value* QAJ4C_object_builder_create_member_by_ref_n( QAJ4C_Object_builder*
     }
 
     if (return_value == NULL) {
-        QAJ4C_Member* member = &object_ptr->top[value_ptr->pos];
+        QAJ4C_Member* member = &QAJ4C_OBJECT_TOP(value_ptr->object)[value_ptr->pos];
         QAJ4C_set_string_ref_n(&member->key, str, len);
+        QAJ4C_set_key_hash(&member->key, QAJ4C_hash_string(str, len));
         return_value = &member->value;
 
         value_ptr->pos += 1;
-        object_ptr->count = value_ptr->pos;
+        QAJ4C_SET_OBJECT_COUNT(value_ptr->object, value_ptr->pos);
     }
 
     return return_value;
@@ -559,7 +896,6 @@ QAJ4C_Value* QAJ4C_object_builder_create_member_by_ref( QAJ4C_Object_builder* va
 QAJ4C_Value* QAJ4C_object_builder_create_member_by_copy_n( QAJ4C_Object_builder* value_ptr, const char* str, size_t len, QAJ4C_Builder* builder )
 {
     QAJ4C_Value* return_value = NULL;
-    QAJ4C_Object* object_ptr = ((QAJ4C_Object*)value_ptr->object);
 
     QAJ4C_ASSERT(value_ptr != NULL && value_ptr->pos < value_ptr->count, {return return_value;});
 
@@ -568,12 +904,13 @@ QAJ4C_Value* QAJ4C_object_builder_create_member_by_copy_n( QAJ4C_Object_builder*
     }
 
     if (return_value == NULL) {
-        QAJ4C_Member* member = &object_ptr->top[value_ptr->pos];
+        QAJ4C_Member* member = &QAJ4C_OBJECT_TOP(value_ptr->object)[value_ptr->pos];
         QAJ4C_set_string_copy_n(&member->key, str, len, builder);
+        QAJ4C_set_key_hash(&member->key, QAJ4C_hash_string(str, len));
         return_value = &member->value;
 
         value_ptr->pos += 1;
-        object_ptr->count = value_ptr->pos;
+        QAJ4C_SET_OBJECT_COUNT(value_ptr->object, value_ptr->pos);
     }
 
     return return_value;
@@ -593,26 +930,37 @@ void QAJ4C_copy( const QAJ4C_Value* src, QAJ4C_Value* dest, QAJ4C_Builder* build
     case QAJ4C_NULL:
     case QAJ4C_STRING_REF:
     case QAJ4C_INLINE_STRING:
-    case QAJ4C_PRIMITIVE:
         *dest = *src;
         break;
+    case QAJ4C_PRIMITIVE:
+        if (QAJ4C_IS_PACKED_ELEMENT(src)) {
+            QAJ4C_packed_element_unpack(src, dest);
+        } else {
+            QAJ4C_COPY_PRIMITIVE(src, dest, builder);
+        }
+        break;
     case QAJ4C_STRING:
         QAJ4C_set_string_copy_n(dest, QAJ4C_get_string(src), QAJ4C_get_string_length(src), builder);
         break;
     case QAJ4C_OBJECT:
     case QAJ4C_OBJECT_SORTED:
+    case QAJ4C_OBJECT_SHAPED:
         n = QAJ4C_object_size(src);
         QAJ4C_set_object(dest, n, builder);
 
         for (i = 0; i < n; ++i) {
             const QAJ4C_Member* src_member = QAJ4C_object_get_member(src, i);
-            QAJ4C_Member* dest_member = &((QAJ4C_Object*)dest)->top[i];
+            QAJ4C_Member* dest_member = &QAJ4C_OBJECT_TOP(dest)[i];
 
-            QAJ4C_copy(&src_member->key, &dest_member->key, builder);
-            QAJ4C_copy(&src_member->value, &dest_member->value, builder);
+            QAJ4C_copy(QAJ4C_member_get_key(src_member), &dest_member->key, builder);
+            if (QAJ4C_is_string(&dest_member->key)) {
+                QAJ4C_set_key_hash(&dest_member->key, QAJ4C_hash_string(QAJ4C_get_string(&dest_member->key), QAJ4C_get_string_length(&dest_member->key)));
+            }
+            QAJ4C_copy(QAJ4C_member_get_value(src_member), &dest_member->value, builder);
         }
         break;
     case QAJ4C_ARRAY:
+    case QAJ4C_ARRAY_PACKED: /* the copy is not packed (so it can be modified) */
         n = QAJ4C_array_size(src);
         QAJ4C_set_array(dest, n, builder);
         for (i = 0; i < n; ++i) {
@@ -620,7 +968,7 @@ void QAJ4C_copy( const QAJ4C_Value* src, QAJ4C_Value* dest, QAJ4C_Builder* build
         }
         break;
     default:
-        g_qaj4c_err_function();
+        QAJ4C_raise_fatal_error();
         break;
     }
 }
@@ -640,9 +988,9 @@ bool QAJ4C_equals( const QAJ4C_Value* lhs, const QAJ4C_Value* rhs ) {
     case QAJ4C_TYPE_STRING:
         return QAJ4C_strcmp(lhs, rhs) == 0;
     case QAJ4C_TYPE_BOOL:
-        return ((QAJ4C_Primitive*)lhs)->data.b == ((QAJ4C_Primitive*)rhs)->data.b;
+        return QAJ4C_PLAIN_PRIMITIVE_DATA(lhs).b == QAJ4C_PLAIN_PRIMITIVE_DATA(rhs).b;
     case QAJ4C_TYPE_NUMBER:
-        return ((QAJ4C_Primitive*)lhs)->data.i == ((QAJ4C_Primitive*)rhs)->data.i;
+        return QAJ4C_PRIMITIVE_DATA(lhs).i == QAJ4C_PRIMITIVE_DATA(rhs).i;
     case QAJ4C_TYPE_OBJECT:
         n = QAJ4C_object_size(lhs);
         if (n != QAJ4C_object_size(rhs)) {
@@ -688,7 +1036,7 @@ bool QAJ4C_equals( const QAJ4C_Value* lhs, const QAJ4C_Value* rhs ) {
         }
         return true;
     default:
-        g_qaj4c_err_function();
+        QAJ4C_raise_fatal_error();
         break;
     }
     return false;
@@ -703,26 +1051,33 @@ size_t QAJ4C_value_sizeof( const QAJ4C_Value* value_ptr ) {
     switch (QAJ4C_get_internal_type(value_ptr)) {
     case QAJ4C_OBJECT_SORTED:
     case QAJ4C_OBJECT:
+    case QAJ4C_OBJECT_SHAPED: /* the size of a copy with own keys (see QAJ4C_copy) */
         n = QAJ4C_object_size(value_ptr);
+        size += n > 0 ? QAJ4C_CONTAINER_HEADER_SIZE : 0;
         for (i = 0; i < n; ++i) {
             const QAJ4C_Member* member = QAJ4C_object_get_member(value_ptr, i);
-            size += QAJ4C_value_sizeof(&member->key);
-            size += QAJ4C_value_sizeof(&member->value);
+            size += QAJ4C_value_sizeof(QAJ4C_member_get_key(member));
+            size += QAJ4C_value_sizeof(QAJ4C_member_get_value(member));
         }
         break;
     case QAJ4C_ARRAY:
+    case QAJ4C_ARRAY_PACKED: /* the size of an unpacked copy (see QAJ4C_copy) */
         n = QAJ4C_array_size(value_ptr);
+        size += n > 0 ? QAJ4C_CONTAINER_HEADER_SIZE : 0;
         for (i = 0; i < n; ++i) {
             const QAJ4C_Value* elem = QAJ4C_array_get(value_ptr, i);
             size += QAJ4C_value_sizeof(elem);
         }
         break;
     case QAJ4C_STRING:
-        size += QAJ4C_get_string_length(value_ptr) + 1;
+        size += QAJ4C_STRING_HEADER_SIZE + QAJ4C_get_string_length(value_ptr) + 1;
         break;
     case QAJ4C_ERROR_DESCRIPTION:
         size += sizeof(QAJ4C_Error_information);
         break;
+    case QAJ4C_PRIMITIVE:
+        size += QAJ4C_PRIMITIVE_STORAGE_SIZE(value_ptr);
+        break;
     default:
         QAJ4C_ASSERT(QAJ4C_get_internal_type(value_ptr) != QAJ4C_UNSPECIFIED, {});
         break;
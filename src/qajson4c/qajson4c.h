@@ -43,6 +43,11 @@ extern "C" {
 
 /**
  * Generic value opaque data type holding the JSON DOM.
+ *
+ * In case the library is compiled with QAJ4C_COMPACT_VALUES a value takes 8 bytes (instead of
+ * 16 on 64 bit). This layout has no room for lookup indices, shared or learned shapes and packed
+ * arrays (the according parse options are ignored), integers beyond +/-2^47 are stored on the
+ * builder and all pointers have to fit into 48 bits.
  */
 struct QAJ4C_Value;
 
@@ -56,12 +61,35 @@ struct QAJ4C_Member;
 
 typedef struct QAJ4C_Member QAJ4C_Member;
 
+/**
+ * Allocator interface that allows to hand over a user context (e.g. an arena, a pool or
+ * some accounting) to the allocation methods. The alignment is a hint about the alignment the
+ * library requires for the allocated memory (memory suitable for any type is always fine).
+ *
+ * The realloc method has to keep the content of the memory (just like realloc).
+ */
+struct QAJ4C_Allocator {
+    void* (*alloc_fn)( void* ctx, size_t size, size_t alignment );
+    void* (*realloc_fn)( void* ctx, void* ptr, size_t size, size_t alignment );
+    void (*free_fn)( void* ctx, void* ptr );
+    void* ctx;
+};
+typedef struct QAJ4C_Allocator QAJ4C_Allocator;
+
+/**
+ * Chunk of memory of a growing builder (see QAJ4C_builder_init_allocator).
+ */
+struct QAJ4C_Builder_chunk;
+
 struct QAJ4C_Builder {
     uint8_t* buffer;
     size_t buffer_size;
 
     size_t cur_str_pos;
     size_t cur_obj_pos;
+
+    QAJ4C_Allocator allocator; /*!< Allocator of a growing builder (alloc_fn is NULL in case of a fixed buffer) */
+    struct QAJ4C_Builder_chunk* chunks; /*!< First chunk of a growing builder (starts with the document) */
 };
 typedef struct QAJ4C_Builder QAJ4C_Builder;
 
@@ -73,6 +101,35 @@ struct QAJ4C_Object_builder {
 };
 typedef struct QAJ4C_Object_builder QAJ4C_Object_builder;
 
+/**
+ * Precompiled object key for repeated lookups (see QAJ4C_key_init). Besides the length and
+ * the hash of the name the key remembers the member index it has been found at last, so
+ * lookups on objects of the same shape do not have to search.
+ *
+ * As the key is updated on lookup, it must not be shared between threads.
+ */
+struct QAJ4C_Key {
+    const char* str;
+    size_t len;
+    uint32_t hash;
+    size_t last_index;
+};
+typedef struct QAJ4C_Key QAJ4C_Key;
+
+/**
+ * Opaque state of an incremental parse run (see QAJ4C_incremental_parse_init). The
+ * storage is large enough to hold the state of both parser passes so no heap memory
+ * is required.
+ */
+struct QAJ4C_Incremental_parser {
+#ifdef QAJ4C_LARGE_DOCUMENTS
+    uint64_t storage[384];
+#else
+    uint64_t storage[256];
+#endif
+};
+typedef struct QAJ4C_Incremental_parser QAJ4C_Incremental_parser;
+
 /**
  * This method will get called in case of a fatal error
  * (array access on not array QAJ4C_Value).
@@ -85,6 +142,12 @@ typedef void (*QAJ4C_fatal_error_fn)( void );
  */
 typedef void* (*QAJ4C_realloc_fn)( void *ptr, size_t size );
 
+/**
+ * This type defines a free like method that is used to release memory that has been allocated
+ * using the according realloc method.
+ */
+typedef void (*QAJ4C_free_fn)( void *ptr );
+
 /**
  * This type defines a callback method for the print method. This callback will be called
  * for each individual char.
@@ -118,7 +181,13 @@ typedef enum QAJ4C_ERROR_CODE {
     QAJ4C_ERROR_ALLOCATION_ERROR = 12,        /*!<  Realloc failed (parse_dynamic only). */
     QAJ4C_ERROR_TRAILING_COMMA = 13,          /*!<  Trailing comma is detected in an object/array detected (strict parsing only)*/
     QAJ4C_ERROR_INVALID_ESCAPE_SEQUENCE = 14, /*!<  String escaped character is invalid. (e.g. \x) */
-    QAJ4C_ERROR_INVALID_UNICODE_SEQUENCE = 15 /*!<  The unicode sequence cannot be translated to a valid UTF-8 character */
+    QAJ4C_ERROR_INVALID_UNICODE_SEQUENCE = 15, /*!<  The unicode sequence cannot be translated to a valid UTF-8 character */
+    QAJ4C_ERROR_NODE_LIMIT_EXCEEDED = 16,           /*!<  The amount of values exceeds the parse limits */
+    QAJ4C_ERROR_STRING_BYTES_LIMIT_EXCEEDED = 17,   /*!<  The size of all strings exceeds the parse limits */
+    QAJ4C_ERROR_STRING_LENGTH_LIMIT_EXCEEDED = 18,  /*!<  The length of a string exceeds the parse limits */
+    QAJ4C_ERROR_OBJECT_MEMBERS_LIMIT_EXCEEDED = 19, /*!<  The amount of object members exceeds the parse limits */
+    QAJ4C_ERROR_BUFFER_SIZE_LIMIT_EXCEEDED = 20,    /*!<  The required DOM buffer size exceeds the parse limits */
+    QAJ4C_ERROR_DOCUMENT_SIZE_EXCEEDED = 21         /*!<  The json message (or its values) exceed the supported size, see QAJ4C_LARGE_DOCUMENTS */
 
 } QAJ4C_ERROR_CODE;
 
@@ -137,13 +206,66 @@ typedef enum QAJ4C_TYPE {
 
 /**
  * Enumeration that holds all parsing options.
+ *
+ * Documents parsed with QAJ4C_PARSE_OPTS_LAZY_INDEX can be shared by multiple reader threads.
+ * The first lookup by key on an object builds its index, readers that access the object
+ * meanwhile scan the members.
  */
 typedef enum QAJ4C_PARSE_OPTS {
     /* enum value 1 is reserved! */
     QAJ4C_PARSE_OPTS_STRICT = 2, /*!< Enables the strict mode. */
-    QAJ4C_PARSE_OPTS_DONT_SORT_OBJECT_MEMBERS = 4 /*!< Disables sorting objects for faster value by key access. */
+    QAJ4C_PARSE_OPTS_DONT_SORT_OBJECT_MEMBERS = 4, /*!< Disables sorting objects for faster value by key access. */
+    QAJ4C_PARSE_OPTS_HASH_INDEX = 8, /*!< Adds a hash index to large objects for constant time value by key access (requires additional buffer space). */
+    QAJ4C_PARSE_OPTS_LAZY_INDEX = 16, /*!< Keeps the members in place and builds the lookup index of an object on the first access by key (requires additional buffer space). */
+    QAJ4C_PARSE_OPTS_KEEP_ORDER = 32, /*!< Keeps the members in input order and adds a sorted index for value by key access (requires additional buffer space). */
+    QAJ4C_PARSE_OPTS_SHARE_SHAPES = 64, /*!< Objects within an array that have the same keys (in the same order) as the previous element share the keys of that element and only store their values. */
+    QAJ4C_PARSE_OPTS_LEARN_SHAPES = 128, /*!< Only for parser contexts: learns the key order of the objects and expects the same order in the following messages (the members are placed directly at their sorted position). */
+    QAJ4C_PARSE_OPTS_PACK_ARRAYS = 256 /*!< Arrays that only contain integers (up to 18 digits) or only doubles store their elements as plain int64_t or double values (8 instead of 16 bytes per element, see QAJ4C_array_get_int64s). */
 } QAJ4C_PARSE_OPTS;
 
+/**
+ * Limits that can be applied to a parse run to reject abusive json messages (e.g. from untrusted
+ * sources). The limits are enforced within the first pass, so before the DOM buffer is
+ * allocated or written. A limit set to 0 is not applied.
+ */
+typedef struct QAJ4C_Parse_limits {
+    size_t max_depth;          /*!< Maximum amount of nested objects and arrays (can only lower the default of 33) */
+    size_t max_nodes;          /*!< Maximum amount of values (object keys are counted as values, too) */
+    size_t max_string_bytes;   /*!< Maximum amount of bytes of all strings including keys and the '\0' characters */
+    size_t max_string_length;  /*!< Maximum length of a single string */
+    size_t max_object_members; /*!< Maximum amount of members of a single object */
+    size_t max_buffer_size;    /*!< Maximum buffer size that is required to store the DOM */
+} QAJ4C_Parse_limits;
+
+/**
+ * Reusable parser context that owns a growable buffer. The buffer is kept between the parse
+ * runs and grows to the largest document parsed so far (high water mark), so parsing a stream of
+ * similar messages will not require any further allocation.
+ *
+ * A parser context is not thread-safe. In case of multiple threads each thread should use its
+ * own context.
+ */
+struct QAJ4C_Parser {
+    QAJ4C_Allocator allocator; /*!< Allocator used by the context (in case no realloc callback is used) */
+    QAJ4C_realloc_fn realloc_callback;
+    QAJ4C_free_fn free_callback;
+    const QAJ4C_Parse_limits* limits; /*!< Optional limits applied to each parse run (may be NULL) */
+
+    uint8_t* buffer;
+    size_t buffer_size;
+    size_t high_water_mark; /*!< Size of the largest document parsed so far */
+    struct QAJ4C_Shape_table* shapes; /*!< Key orders learned with QAJ4C_PARSE_OPTS_LEARN_SHAPES */
+};
+typedef struct QAJ4C_Parser QAJ4C_Parser;
+
+/**
+ * Result of a single incremental parse step.
+ */
+typedef enum QAJ4C_PARSE_STATUS {
+    QAJ4C_PARSE_STATUS_DONE = 0,   /*!< The parse run completed (either with a DOM or an error value). */
+    QAJ4C_PARSE_STATUS_IN_PROGRESS /*!< The budget of the step was used up, call step again to continue. */
+} QAJ4C_PARSE_STATUS;
+
 /**
  * With this method a fatal error handler can be registered to have a custom
  * way of handling invalid access behavior (like integer access on a string).
@@ -152,6 +274,24 @@ typedef enum QAJ4C_PARSE_OPTS {
  */
 void QAJ4C_register_fatal_error_function( QAJ4C_fatal_error_fn function );
 
+/**
+ * With this method a fatal error handler can be registered for the calling thread only. The
+ * thread's handler has precedence over the handler registered with
+ * QAJ4C_register_fatal_error_function. Registering NULL removes the thread's handler.
+ *
+ * @note In case the library is compiled with QAJ4C_UNCHECKED the read accessors (like
+ * QAJ4C_get_int or QAJ4C_array_get) will not check the type anymore and thus not call the
+ * handler. The builder and mutation methods (like QAJ4C_array_get_rw) are checked in all builds.
+ *
+ * @return the previously registered handler of the thread (can be used to restore it).
+ */
+QAJ4C_fatal_error_fn QAJ4C_register_thread_fatal_error_function( QAJ4C_fatal_error_fn function );
+
+/**
+ * This method returns an allocator that is using malloc, realloc and free.
+ */
+const QAJ4C_Allocator* QAJ4C_std_allocator( void );
+
 /**
  * This method will walk through the json message (with a given size) and analyze what buffer
  * size would be required to store the complete DOM.
@@ -177,6 +317,19 @@ size_t QAJ4C_calculate_max_buffer_size_insitu_n( const char* json, size_t n );
  */
 size_t QAJ4C_calculate_max_buffer_size_insitu( const char* json );
 
+/**
+ * This method will walk through the json message (with a given size) and analyze what buffer
+ * size would be required to store the complete DOM in case it is parsed with the given options
+ * (e.g. QAJ4C_PARSE_OPTS_HASH_INDEX requires additional space).
+ */
+size_t QAJ4C_calculate_max_buffer_size_opt( const char* json, size_t n, int opts );
+
+/**
+ * Same as QAJ4C_calculate_max_buffer_size_opt but for the insitu parse methods (strings do not
+ * have to be copied into the buffer).
+ */
+size_t QAJ4C_calculate_max_buffer_size_insitu_opt( const char* json, size_t n, int opts );
+
 /**
  * This method will parse the json message and will use the handed over buffer to store the DOM
  * and the strings.
@@ -244,6 +397,123 @@ const QAJ4C_Value* QAJ4C_parse_opt_dynamic( const char* json, size_t json_len, i
  */
 size_t QAJ4C_parse_opt_insitu( char* json, size_t json_len, int opts, void* buffer, size_t buffer_size, const QAJ4C_Value** result_ptr );
 
+/**
+ * Same as QAJ4C_parse_opt but the parse run will fail with the according error code in case
+ * the json message exceeds one of the handed over limits.
+ *
+ * @return the amount of data written to the buffer
+ */
+size_t QAJ4C_parse_opt_limited( const char* json, size_t json_len, int opts, const QAJ4C_Parse_limits* limits, void* buffer, size_t buffer_size, const QAJ4C_Value** result_ptr );
+
+/**
+ * Same as QAJ4C_parse_opt_dynamic but the parse run will fail with the according error code in
+ * case the json message exceeds one of the handed over limits. As the limits are checked before
+ * the DOM buffer is allocated, the realloc callback will not be called with a size exceeding
+ * max_buffer_size.
+ */
+const QAJ4C_Value* QAJ4C_parse_opt_dynamic_limited( const char* json, size_t json_len, int opts, const QAJ4C_Parse_limits* limits, QAJ4C_realloc_fn realloc_callback );
+
+/**
+ * This method will parse the json message without a handed over buffer but with an allocator.
+ * The buffer will be grown using the allocator's realloc method each time it is insufficient.
+ * The limits are optional (may be NULL).
+ *
+ * @note The document has to be released using QAJ4C_document_free with the same allocator.
+ *
+ * @returns NULL, in case no memory could ever get allocated at all. In all other cases
+ * a valid instance (that may contain an error instead of parsed content).
+ */
+const QAJ4C_Value* QAJ4C_parse_opt_dynamic_allocator( const char* json, size_t json_len, int opts, const QAJ4C_Parse_limits* limits, const QAJ4C_Allocator* allocator );
+
+/**
+ * This method releases a document that has been parsed using the according allocator.
+ * Documents that have been parsed with a realloc callback can be released with
+ * QAJ4C_std_allocator in case realloc has been used.
+ */
+void QAJ4C_document_free( const QAJ4C_Value* document, const QAJ4C_Allocator* allocator );
+
+/**
+ * Same as QAJ4C_parse_opt_insitu but the parse run will fail with the according error code in
+ * case the json message exceeds one of the handed over limits.
+ *
+ * @return the amount of data written to the buffer
+ */
+size_t QAJ4C_parse_opt_insitu_limited( char* json, size_t json_len, int opts, const QAJ4C_Parse_limits* limits, void* buffer, size_t buffer_size, const QAJ4C_Value** result_ptr );
+
+/**
+ * This method initializes the parser context. No memory will be allocated until the first
+ * parse run.
+ */
+void QAJ4C_parser_init( QAJ4C_Parser* parser, QAJ4C_realloc_fn realloc_callback, QAJ4C_free_fn free_callback );
+
+/**
+ * Same as QAJ4C_parser_init but the buffer will be managed using the allocator (the allocator
+ * will be copied to the context).
+ */
+void QAJ4C_parser_init_allocator( QAJ4C_Parser* parser, const QAJ4C_Allocator* allocator );
+
+/**
+ * This method will parse the json message into the buffer of the parser context. The buffer is
+ * grown in case it is insufficient. The returned document is valid until the next parse run or
+ * until the buffer of the context is released.
+ *
+ * @note In case the json string is null terminated, json_len can also be set to SIZE_MAX (or -1).
+ *
+ * @returns NULL, in case no memory could ever get allocated at all. In all other cases
+ * a valid instance (that may contain an error instead of parsed content).
+ */
+const QAJ4C_Value* QAJ4C_parser_parse( QAJ4C_Parser* parser, const char* json, size_t json_len, int opts );
+
+/**
+ * Same as QAJ4C_parser_parse but the strings will not be copied within the buffer and will be
+ * referenced to the json message. Just like strtok, the json message will be adjusted in place.
+ */
+const QAJ4C_Value* QAJ4C_parser_parse_insitu( QAJ4C_Parser* parser, char* json, size_t json_len, int opts );
+
+/**
+ * This method frees the buffer of the parser context (the last parsed document is no longer valid).
+ * The high water mark is kept, so the next parse run will directly allocate a sufficient buffer.
+ * Learned key orders are dropped.
+ */
+void QAJ4C_parser_release( QAJ4C_Parser* parser );
+
+/**
+ * This method prepares an incremental parse run of the json message that will use the handed over
+ * buffer to store the DOM and the strings. The actual parsing is done by calling
+ * QAJ4C_incremental_parse_step until it reports QAJ4C_PARSE_STATUS_DONE. This way a large message
+ * can be parsed in small slices (e.g. within a cooperative main loop).
+ *
+ * @note The parser instance must not be moved or copied while the parse run is in progress. Also
+ * the json message and the buffer have to stay valid until the parse run completed.
+ * @note In case the json string is null terminated, json_len can also be set to SIZE_MAX (or -1).
+ */
+void QAJ4C_incremental_parse_init( QAJ4C_Incremental_parser* parser, const char* json, size_t json_len, int opts, void* buffer, size_t buffer_size );
+
+/**
+ * Same as QAJ4C_incremental_parse_init but the strings will not be copied within the buffer and
+ * will be referenced to the json message. Just like strtok, the json message will be adjusted in place.
+ */
+void QAJ4C_incremental_parse_init_insitu( QAJ4C_Incremental_parser* parser, char* json, size_t json_len, int opts, void* buffer, size_t buffer_size );
+
+/**
+ * Applies the handed over limits to the incremental parse run. This method has to be called
+ * before the first parse step.
+ */
+void QAJ4C_incremental_parse_set_limits( QAJ4C_Incremental_parser* parser, const QAJ4C_Parse_limits* limits );
+
+/**
+ * This method continues the incremental parse run until either the parse run completed or the budget
+ * is used up. The budget is defined by the amount of json bytes (max_bytes) and the amount of
+ * json values (max_nodes) that are processed during this step. A budget of 0 is handled like 1 so
+ * each step makes progress. A single value (e.g. a long string) is always processed as a whole.
+ *
+ * In case the parse run completed the document will be stored in result_ptr. Just like with
+ * QAJ4C_parse the document's root value may contain an error value.
+ *
+ * @return QAJ4C_PARSE_STATUS_DONE in case the parse run completed, else QAJ4C_PARSE_STATUS_IN_PROGRESS.
+ */
+QAJ4C_PARSE_STATUS QAJ4C_incremental_parse_step( QAJ4C_Incremental_parser* parser, size_t max_bytes, size_t max_nodes, const QAJ4C_Value** result_ptr );
+
 /**
  * This method prints the DOM as JSON in the handed over buffer.
  *
@@ -508,6 +778,33 @@ const QAJ4C_Value* QAJ4C_object_get_n( const QAJ4C_Value* value_ptr, const char*
  */
 const QAJ4C_Value* QAJ4C_object_get( const QAJ4C_Value* value_ptr, const char* str );
 
+/**
+ * Initializes the key handle with the given name and size. The name is referenced and has to
+ * outlive the key.
+ */
+void QAJ4C_key_init_n( QAJ4C_Key* key, const char* str, size_t len );
+
+/**
+ * Initializes the key handle with the given name (using strlen to determine the size). The
+ * name is referenced and has to outlive the key.
+ */
+void QAJ4C_key_init( QAJ4C_Key* key, const char* str );
+
+/**
+ * In case the value is an object this method will retrieve a member by the precompiled key
+ * and return the value of the member. The member index the key has been found at is cached
+ * within the key and validated on the next lookup.
+ */
+const QAJ4C_Value* QAJ4C_object_get_key( const QAJ4C_Value* value_ptr, QAJ4C_Key* key );
+
+/**
+ * In case the value is an object this method will retrieve the members of all given keys
+ * (zero terminated) at once and store the values (or NULL in case the member does not exist)
+ * at the same position within the result array. For sorted objects the keys are sorted and
+ * merged with the members in one pass instead of searching each key on its own.
+ */
+void QAJ4C_object_get_many( const QAJ4C_Value* value_ptr, const char* keys[], size_t count, const QAJ4C_Value* result[] );
+
 /**
  * In case the value is an array, this method will return the array size.
  */
@@ -522,6 +819,70 @@ size_t QAJ4C_array_size( const QAJ4C_Value* value_ptr );
  */
 const QAJ4C_Value* QAJ4C_array_get( const QAJ4C_Value* value_ptr, size_t index );
 
+/**
+ * In case the value is an array that has been packed while parsing (see
+ * QAJ4C_PARSE_OPTS_PACK_ARRAYS) and only contains integers, this method will return its
+ * elements as contiguous c-array (else NULL).
+ *
+ * @note the elements of packed arrays can also be accessed with QAJ4C_array_get, the
+ * returned values are read only (and cannot be passed to QAJ4C_array_get_rw).
+ */
+const int64_t* QAJ4C_array_get_int64s( const QAJ4C_Value* value_ptr );
+
+/**
+ * In case the value is an array that has been packed while parsing (see
+ * QAJ4C_PARSE_OPTS_PACK_ARRAYS) and only contains doubles, this method will return its
+ * elements as contiguous c-array (else NULL).
+ */
+const double* QAJ4C_array_get_doubles( const QAJ4C_Value* value_ptr );
+
+/**
+ * In case the value is an array, this method copies its elements as doubles into out (at most n
+ * elements). Elements that are arrays themselves are copied row by row, so an array of arrays
+ * ends up as row-major matrix. The copy stops at the first element that is not a number.
+ *
+ * @return the number of elements written to out.
+ */
+size_t QAJ4C_array_copy_doubles( const QAJ4C_Value* value_ptr, double* out, size_t n );
+
+/**
+ * Like QAJ4C_array_copy_doubles, but the copy stops at the first element that is not
+ * compatible to int64_t (see QAJ4C_is_int64).
+ */
+size_t QAJ4C_array_copy_int64s( const QAJ4C_Value* value_ptr, int64_t* out, size_t n );
+
+/**
+ * Like QAJ4C_array_copy_doubles, but the copy stops at the first element that is not
+ * compatible to uint64_t (see QAJ4C_is_uint64).
+ */
+size_t QAJ4C_array_copy_uint64s( const QAJ4C_Value* value_ptr, uint64_t* out, size_t n );
+
+/**
+ * In case the value is an array of objects (records), this method extracts the member of the
+ * given key from each of the first n records as double into out. Records that do not have the
+ * member as number (or that are no objects) get 0.0 and their bit within the null bitmap is set
+ * (bit i % 8 of nulls[i / 8], the bitmap is optional and may be NULL).
+ *
+ * The key handle caches the member index, so records that share their layout are looked up
+ * without searching (and records with shared keys, see QAJ4C_PARSE_OPTS_SHARE_SHAPES, without
+ * comparing the key).
+ *
+ * @return the number of records that had a value.
+ */
+size_t QAJ4C_array_column_doubles( const QAJ4C_Value* value_ptr, QAJ4C_Key* key, double* out, size_t n, uint8_t* nulls );
+
+/**
+ * Like QAJ4C_array_column_doubles, but only members that are compatible to int64_t (see
+ * QAJ4C_is_int64) are extracted.
+ */
+size_t QAJ4C_array_column_int64s( const QAJ4C_Value* value_ptr, QAJ4C_Key* key, int64_t* out, size_t n, uint8_t* nulls );
+
+/**
+ * Like QAJ4C_array_column_doubles, but extracts string members as pointer and length (lengths
+ * is optional and may be NULL). Records without a string member get NULL and length 0.
+ */
+size_t QAJ4C_array_column_strings( const QAJ4C_Value* value_ptr, QAJ4C_Key* key, const char** strings, size_t* lengths, size_t n, uint8_t* nulls );
+
 /**
  * Creates the builder with the given buffer.
  */
@@ -533,13 +894,34 @@ QAJ4C_Builder QAJ4C_builder_create( void* buff, size_t buff_size );
 void QAJ4C_builder_init( QAJ4C_Builder* me, void* buff, size_t buff_size );
 
 /**
- * Creates the builder with the given buffer.
+ * Initializes a growing builder that does not require a worst case buffer size. The memory is
+ * allocated in chunks using the handed over allocator: the first chunk has the size chunk_size
+ * (and holds the document), each further chunk is allocated as soon as the current one is
+ * exhausted and is twice as large as its predecessor (or as large as the requested values or
+ * string). Values and strings are never moved, so all pointers stay valid until the builder
+ * is reset or released.
+ *
+ * @note The chunks have to be released using QAJ4C_builder_release.
+ */
+void QAJ4C_builder_init_allocator( QAJ4C_Builder* me, size_t chunk_size, const QAJ4C_Allocator* allocator );
+
+/**
+ * Resets the builder, so a new document can be built in the same buffer. A growing builder
+ * releases all chunks but the first one (or allocates the first chunk again in case it could
+ * not be allocated or the builder has been released).
  */
 void QAJ4C_builder_reset( QAJ4C_Builder* me );
 
+/**
+ * Releases the chunks of a growing builder (the document is no longer valid). This method does
+ * nothing in case the builder uses a fixed buffer.
+ */
+void QAJ4C_builder_release( QAJ4C_Builder* me );
+
 /**
  * This method will retrieve the document from the builder.
- * Returns NULL in case the buffer has insufficient size.
+ * Returns NULL in case the buffer has insufficient size (or the first chunk of a growing
+ * builder could not be allocated).
  */
 QAJ4C_Value* QAJ4C_builder_get_document( QAJ4C_Builder* builder );
 
@@ -555,6 +937,10 @@ void QAJ4C_set_int( QAJ4C_Value* value_ptr, int32_t value );
 
 /**
  * This method will set the value to a int64_t with the handed over value.
+ *
+ * @note With QAJ4C_COMPACT_VALUES values beyond +/-2^47 require storage on a builder (as
+ * provided while parsing, by QAJ4C_set_array_from_int64s or QAJ4C_copy), this method calls the
+ * fatal error handler for them and stores the nearest double instead.
  */
 void QAJ4C_set_int64( QAJ4C_Value* value_ptr, int64_t value );
 
@@ -565,6 +951,8 @@ void QAJ4C_set_uint( QAJ4C_Value* value_ptr, uint32_t value );
 
 /**
  * This method will set the value to a uint64_t with the handed over value.
+ *
+ * @note See QAJ4C_set_int64 for the values that QAJ4C_COMPACT_VALUES cannot store this way.
  */
 void QAJ4C_set_uint64( QAJ4C_Value* value_ptr, uint64_t value );
 
@@ -584,6 +972,9 @@ void QAJ4C_set_null( QAJ4C_Value* value_ptr );
  *
  * @note As the string is a reference, the lifetime of the string must at least
  * be as long as the lifetime of the DOM object.
+ *
+ * @note With QAJ4C_COMPACT_VALUES the length of a reference is not stored, so strings longer
+ * than 5 chars have to be \0 terminated at len.
  */
 void QAJ4C_set_string_ref_n( QAJ4C_Value* value_ptr, const char* str, size_t len );
 
@@ -617,11 +1008,50 @@ void QAJ4C_set_string_copy( QAJ4C_Value* value_ptr, const char* str, QAJ4C_Build
  */
 void QAJ4C_set_array( QAJ4C_Value* value_ptr, size_t count, QAJ4C_Builder* builder );
 
+/**
+ * This method will set the values type to array and fill it with the given doubles in one
+ * go. In case packed is set, the elements are stored as plain doubles (8 bytes each instead
+ * of sizeof(QAJ4C_Value), see QAJ4C_array_get_doubles). Packed is ignored with
+ * QAJ4C_COMPACT_VALUES.
+ *
+ * @note packed arrays cannot be modified using QAJ4C_array_get_rw.
+ */
+void QAJ4C_set_array_from_doubles( QAJ4C_Value* value_ptr, const double* values, size_t count, bool packed, QAJ4C_Builder* builder );
+
+/**
+ * Like QAJ4C_set_array_from_doubles, but for int64_t values (see QAJ4C_array_get_int64s).
+ */
+void QAJ4C_set_array_from_int64s( QAJ4C_Value* value_ptr, const int64_t* values, size_t count, bool packed, QAJ4C_Builder* builder );
+
+/**
+ * This method will set the values type to array and fill it with copies of the given strings
+ * (the allocation is performed on the builder). In case lengths is NULL the string sizes are
+ * determined by using strlen.
+ */
+void QAJ4C_set_array_from_strings( QAJ4C_Value* value_ptr, const char* const* strings, const size_t* lengths, size_t count, QAJ4C_Builder* builder );
+
+/**
+ * This method will set the values type to an empty array that grows on QAJ4C_array_append, for
+ * the case the final size is not known upfront. The memory allocation (with room for capacity
+ * elements) will be performed on the builder.
+ */
+void QAJ4C_set_array_growable( QAJ4C_Value* value_ptr, size_t capacity, QAJ4C_Builder* builder );
+
+/**
+ * Appends a (null) element to an array created by QAJ4C_set_array_growable and returns it. In
+ * case the capacity is used up, the elements are extended in place as long as they have been the
+ * last allocation on the builder, else they are moved with twice the capacity.
+ *
+ * @note as the elements may move, pointers to them (also the ones retrieved by
+ * QAJ4C_array_get_rw) are only valid until the next append to the same array.
+ */
+QAJ4C_Value* QAJ4C_array_append( QAJ4C_Value* value_ptr, QAJ4C_Builder* builder );
+
 /**
  * Will retrieve the entry of the array at the given index.
  *
  * @note a QAJ4C_array is organized as a c-array internally, thus random access
- * is possible with low cost.
+ * is possible with low cost. Packed arrays cannot be modified (copy them first).
  */
 QAJ4C_Value* QAJ4C_array_get_rw( QAJ4C_Value* value_ptr, size_t index );
 
@@ -634,6 +1064,54 @@ QAJ4C_Value* QAJ4C_array_get_rw( QAJ4C_Value* value_ptr, size_t index );
  */
 void QAJ4C_set_object( QAJ4C_Value* value_ptr, size_t count, QAJ4C_Builder* builder );
 
+/**
+ * This method will set the values type to object and create its members from the parallel
+ * arrays keys (referenced like QAJ4C_object_create_member_by_ref, lengths may be NULL to use
+ * strlen) and values. The values are copied over shallow (strings, arrays and objects they hold
+ * are referenced), NULL entries result in null members. The keys are not checked for duplicates.
+ *
+ * In case presorted is set, the keys have to be ordered like QAJ4C_object_optimize orders them
+ * (by length first, then by bytes). This is verified in one pass (also ruling out duplicates) and
+ * the object is then marked as optimized without sorting it. In case the verification fails, the
+ * fatal error function is called and the object stays unoptimized.
+ */
+void QAJ4C_set_object_from_arrays( QAJ4C_Value* value_ptr, const char* const* keys, const size_t* lengths, const QAJ4C_Value* const* values, size_t count, bool presorted, QAJ4C_Builder* builder );
+
+/**
+ * This method will set the values type to an empty object that grows on
+ * QAJ4C_object_append_member_by_ref and QAJ4C_object_append_member_by_copy (see
+ * QAJ4C_set_array_growable).
+ */
+void QAJ4C_set_object_growable( QAJ4C_Value* value_ptr, size_t capacity, QAJ4C_Builder* builder );
+
+/**
+ * Appends a member to an object created by QAJ4C_set_object_growable, referencing the handed over
+ * string as key, and returns its (null) value. The key is not checked for duplicates and the
+ * object is not optimized anymore.
+ *
+ * @note as the members may move, pointers to their values are only valid until the next append
+ * to the same object.
+ */
+QAJ4C_Value* QAJ4C_object_append_member_by_ref_n( QAJ4C_Value* value_ptr, const char* str, size_t len, QAJ4C_Builder* builder );
+
+/**
+ * Shortcut version of QAJ4C_object_append_member_by_ref_n, using strlen to calculate the string
+ * length.
+ */
+QAJ4C_Value* QAJ4C_object_append_member_by_ref( QAJ4C_Value* value_ptr, const char* str, QAJ4C_Builder* builder );
+
+/**
+ * Like QAJ4C_object_append_member_by_ref_n, but the key string is copied (the allocation will be
+ * performed on the handed over builder).
+ */
+QAJ4C_Value* QAJ4C_object_append_member_by_copy_n( QAJ4C_Value* value_ptr, const char* str, size_t len, QAJ4C_Builder* builder );
+
+/**
+ * Shortcut version of QAJ4C_object_append_member_by_copy_n, using strlen to calculate the string
+ * length.
+ */
+QAJ4C_Value* QAJ4C_object_append_member_by_copy( QAJ4C_Value* value_ptr, const char* str, QAJ4C_Builder* builder );
+
 /**
  * This method will optimize the current content on of the object (for faster DOM access).
  * Adding new members will require to call optimize again.
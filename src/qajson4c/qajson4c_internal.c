@@ -36,35 +36,151 @@ typedef struct QAJ4C_Json_message {
     size_type json_pos;
 } QAJ4C_Json_message;
 
+/*
+ * Key of a learned shape. The key is stored within the pool of the table (it contains no escape
+ * sequences, so it equals its json text).
+ */
+typedef struct QAJ4C_Learned_key {
+    size_type offset; /* position of the key within the pool */
+    size_type length;
+    size_type slot; /* position of the member after sorting (the input position if not sorted) */
+    uint16_t hash;
+} QAJ4C_Learned_key;
+
+typedef struct QAJ4C_Learned_shape {
+    uint32_t path; /* hash over the keys (and array nestings) that lead to the object */
+    size_type count;
+    uint16_t first_key; /* index of the first key within the table */
+    bool sorted;
+    bool used;
+} QAJ4C_Learned_shape;
+
+/*
+ * Key orders of the objects of the previous messages of a parser context. Keys and pool are only
+ * appended during a parse run (open objects refer to their keys), a full table is cleared before
+ * the next run.
+ */
+struct QAJ4C_Shape_table {
+    size_type key_count;
+    size_type pool_size;
+    bool full;
+    QAJ4C_Learned_shape shapes[QAJ4C_SHAPE_TABLE_SLOTS];
+    QAJ4C_Learned_key keys[QAJ4C_SHAPE_TABLE_KEYS];
+    char pool[QAJ4C_SHAPE_TABLE_POOL];
+};
+
+typedef struct QAJ4C_First_pass_frame {
+    size_type member_count;
+    size_type storage_pos;
+    /*
+     * Shape sharing: objects keep the position of their next key within the previous element
+     * (0 in case the keys differ), arrays the position of the previous element in case it is an
+     * object that can share its keys (0 otherwise).
+     */
+    size_type shape_pos;
+    size_type json_start; /* objects: position behind the { */
+    size_type key_string_length; /* objects: string storage required by the keys */
+    bool is_object;
+    uint8_t pack_kind; /* arrays: the kinds of the elements so far (see QAJ4C_PACK_INT64) */
+} QAJ4C_First_pass_frame;
+
 typedef struct QAJ4C_First_pass_parser {
     QAJ4C_Json_message* msg;
 
     QAJ4C_Builder* builder; /* Storage about object sizes */
-    QAJ4C_realloc_fn realloc_callback;
+    const QAJ4C_Allocator* allocator;
+    size_t buffer_capacity; /* allocated size of the builder's buffer */
+    bool grow_buffer; /* grow the buffer geometrically while storing statistics */
+    QAJ4C_Shape_table* shapes; /* learned shapes (only for parser contexts with QAJ4C_PARSE_OPTS_LEARN_SHAPES) */
 
     bool strict_parsing;
     bool insitu_parsing;
     bool optimize_object;
+    bool share_shapes;
+    bool pack_arrays;
+    int index_opts; /* options that decide about the lookup index of objects */
 
     int max_depth;
     size_type amount_nodes;
     size_type complete_string_length;
     size_type storage_counter;
+    size_t index_storage; /* bytes required by the lookup indices of the objects */
+    size_t shared_storage; /* bytes saved by objects that share their keys and by packed arrays */
+    size_t compact_storage; /* compact values: bytes of the container headers and large integers */
+    bool string_nul; /* the current string contains an escaped \0 */
+
+    QAJ4C_Parse_limits limits; /* all limits are set (unlimited is SIZE_MAX) */
+    size_t string_bytes;
 
     QAJ4C_ERROR_CODE err_code;
 
+    /* explicit stack of the currently open objects and arrays (allows to suspend the pass) */
+    bool expect_value;
+    int depth;
+    QAJ4C_First_pass_frame stack[QAJ4C_MAX_DEPTH + 1];
 } QAJ4C_First_pass_parser;
 
+typedef struct QAJ4C_Second_pass_frame {
+    QAJ4C_Value* value_ptr;
+    size_type index;
+    size_type elements;
+    uint32_t path; /* see QAJ4C_Learned_shape */
+    uint16_t first_key; /* keys of the learned shape the members are expected in (or QAJ4C_NO_SHAPE) */
+    bool predicted; /* all keys so far matched the learned shape */
+    bool is_object;
+} QAJ4C_Second_pass_frame;
+
 typedef struct QAJ4C_Second_pass_parser {
     const char* json_char;
+    const char* json_end;
     QAJ4C_Builder* builder;
-    QAJ4C_realloc_fn realloc_callback;
     bool insitu_parsing;
     bool optimize_object;
+    int index_opts;
+    QAJ4C_Shape_table* shapes;
+
+    size_t curr_buffer_pos;
 
-    size_type curr_buffer_pos;
+    /* the value that will be parsed next (NULL in case the open container has to continue) */
+    QAJ4C_Value* pending_value;
+    uint32_t pending_path;
+    int depth;
+    QAJ4C_Second_pass_frame stack[QAJ4C_MAX_DEPTH + 1];
 } QAJ4C_Second_pass_parser;
 
+typedef enum QAJ4C_PARSE_PHASE {
+    QAJ4C_PHASE_FIRST_PASS = 0,
+    QAJ4C_PHASE_SECOND_PASS,
+    QAJ4C_PHASE_DONE
+} QAJ4C_PARSE_PHASE;
+
+/*
+ * Complete state of a parse run. As both passes keep their position within the json message
+ * and the nesting in explicit stacks the parse can be suspended after any node and resumed later.
+ */
+typedef struct QAJ4C_Parser_state {
+    QAJ4C_Json_message msg;
+    QAJ4C_First_pass_parser first_pass;
+    QAJ4C_Second_pass_parser second_pass;
+    QAJ4C_PARSE_PHASE phase;
+    const QAJ4C_Value* result;
+    size_t result_size;
+} QAJ4C_Parser_state;
+
+typedef struct QAJ4C_Parse_budget {
+    size_t max_bytes;
+    size_t max_nodes;
+    size_t nodes;
+} QAJ4C_Parse_budget;
+
+typedef struct QAJ4C_Incremental_parser_impl {
+    QAJ4C_Builder builder;
+    QAJ4C_Parser_state state;
+} QAJ4C_Incremental_parser_impl;
+
+/* Compile time check that the public storage is large enough to hold the incremental parser */
+typedef char QAJ4C_incremental_parser_size_check[(sizeof(QAJ4C_Incremental_parser_impl) <= sizeof(QAJ4C_Incremental_parser)) ? 1 : -1];
+
 typedef struct QAJ4C_Buffer_printer {
     char* buffer;
     size_type index;
@@ -81,14 +197,103 @@ void QAJ4C_std_err_function( void ) {
 }
 
 QAJ4C_fatal_error_fn g_qaj4c_err_function = &QAJ4C_std_err_function;
+QAJ4C_THREAD_LOCAL QAJ4C_fatal_error_fn g_qaj4c_thread_err_function = NULL;
+
+void QAJ4C_raise_fatal_error( void ) {
+    if (g_qaj4c_thread_err_function != NULL) {
+        g_qaj4c_thread_err_function();
+    } else {
+        g_qaj4c_err_function();
+    }
+}
+
+static void* QAJ4C_std_alloc( void* ctx, size_t size, size_t alignment ) {
+    (void)ctx;
+    (void)alignment; /* malloc memory is suitably aligned for any type */
+    return QAJ4C_MALLOC(size);
+}
+
+static void* QAJ4C_std_realloc( void* ctx, void* ptr, size_t size, size_t alignment ) {
+    (void)ctx;
+    (void)alignment;
+    return QAJ4C_REALLOC(ptr, size);
+}
+
+static void QAJ4C_std_free( void* ctx, void* ptr ) {
+    (void)ctx;
+    QAJ4C_FREE(ptr);
+}
+
+static const QAJ4C_Allocator QAJ4C_STD_ALLOCATOR = {&QAJ4C_std_alloc, &QAJ4C_std_realloc, &QAJ4C_std_free, NULL};
+
+const QAJ4C_Allocator* QAJ4C_std_allocator_impl( void ) {
+    return &QAJ4C_STD_ALLOCATOR;
+}
+
+static void* QAJ4C_realloc_adapter_alloc( void* ctx, size_t size, size_t alignment ) {
+    QAJ4C_Realloc_adapter* me = (QAJ4C_Realloc_adapter*)ctx;
+    (void)alignment; /* realloc like methods have to return memory that is suitably aligned for any type */
+    return me->realloc_callback(NULL, size);
+}
+
+static void* QAJ4C_realloc_adapter_realloc( void* ctx, void* ptr, size_t size, size_t alignment ) {
+    QAJ4C_Realloc_adapter* me = (QAJ4C_Realloc_adapter*)ctx;
+    (void)alignment;
+    return me->realloc_callback(ptr, size);
+}
+
+static void QAJ4C_realloc_adapter_free( void* ctx, void* ptr ) {
+    QAJ4C_Realloc_adapter* me = (QAJ4C_Realloc_adapter*)ctx;
+    if (me->free_callback != NULL) {
+        me->free_callback(ptr);
+    }
+}
+
+void QAJ4C_realloc_adapter_init( QAJ4C_Realloc_adapter* me, QAJ4C_realloc_fn realloc_callback, QAJ4C_free_fn free_callback ) {
+    me->allocator.alloc_fn = &QAJ4C_realloc_adapter_alloc;
+    me->allocator.realloc_fn = &QAJ4C_realloc_adapter_realloc;
+    me->allocator.free_fn = &QAJ4C_realloc_adapter_free;
+    me->allocator.ctx = me;
+    me->realloc_callback = realloc_callback;
+    me->free_callback = free_callback;
+}
 
-static void QAJ4C_first_pass_parser_init( QAJ4C_First_pass_parser* parser, QAJ4C_Builder* builder, QAJ4C_Json_message* msg, int opts, QAJ4C_realloc_fn realloc_callback );
+void* QAJ4C_allocator_realloc( const QAJ4C_Allocator* allocator, void* ptr, size_t size ) {
+    if (ptr == NULL) {
+        return allocator->alloc_fn(allocator->ctx, size, QAJ4C_ALLOC_ALIGNMENT);
+    }
+    return allocator->realloc_fn(allocator->ctx, ptr, size, QAJ4C_ALLOC_ALIGNMENT);
+}
+
+const QAJ4C_Allocator* QAJ4C_parser_get_allocator( QAJ4C_Parser* me, QAJ4C_Realloc_adapter* adapter ) {
+    if (me->allocator.alloc_fn != NULL) {
+        return &me->allocator;
+    }
+    QAJ4C_realloc_adapter_init(adapter, me->realloc_callback, me->free_callback);
+    return &adapter->allocator;
+}
+
+static void QAJ4C_parser_state_init( QAJ4C_Parser_state* me, QAJ4C_Builder* builder, const char* json, size_t json_len, int opts, const QAJ4C_Parse_limits* limits, const QAJ4C_Allocator* allocator );
+static bool QAJ4C_parser_state_run( QAJ4C_Parser_state* me, QAJ4C_Parse_budget* budget );
+static bool QAJ4C_parse_budget_exhausted( const QAJ4C_Parse_budget* budget, size_t bytes );
+
+static void QAJ4C_first_pass_parser_init( QAJ4C_First_pass_parser* parser, QAJ4C_Builder* builder, QAJ4C_Json_message* msg, int opts, const QAJ4C_Parse_limits* limits, const QAJ4C_Allocator* allocator );
+static void QAJ4C_first_pass_parser_set_limits( QAJ4C_First_pass_parser* parser, const QAJ4C_Parse_limits* limits );
+static void QAJ4C_first_pass_count_node( QAJ4C_First_pass_parser* parser );
+static void QAJ4C_first_pass_check_buffer_limit( QAJ4C_First_pass_parser* parser );
 static void QAJ4C_first_pass_parser_set_error( QAJ4C_First_pass_parser* parser, QAJ4C_ERROR_CODE error );
-static void QAJ4C_first_pass_process( QAJ4C_First_pass_parser* parser, int depth );
-static void QAJ4C_first_pass_object( QAJ4C_First_pass_parser* parser, int depth );
-static void QAJ4C_first_pass_array( QAJ4C_First_pass_parser* parser, int depth );
+static bool QAJ4C_first_pass_run( QAJ4C_First_pass_parser* parser, QAJ4C_Parse_budget* budget );
+static void QAJ4C_first_pass_process( QAJ4C_First_pass_parser* parser );
+static void QAJ4C_first_pass_object( QAJ4C_First_pass_parser* parser );
+static void QAJ4C_first_pass_object_members( QAJ4C_First_pass_parser* parser, char json_char );
+static void QAJ4C_first_pass_object_continue( QAJ4C_First_pass_parser* parser );
+static void QAJ4C_first_pass_array( QAJ4C_First_pass_parser* parser );
+static void QAJ4C_first_pass_array_continue( QAJ4C_First_pass_parser* parser );
+static QAJ4C_First_pass_frame* QAJ4C_first_pass_push( QAJ4C_First_pass_parser* parser, bool is_object, bool is_empty );
+static void QAJ4C_first_pass_pop( QAJ4C_First_pass_parser* parser );
+static void QAJ4C_first_pass_match_shape( QAJ4C_First_pass_parser* parser, QAJ4C_First_pass_frame* frame, size_type key_start );
 static void QAJ4C_first_pass_string( QAJ4C_First_pass_parser* parser );
-static void QAJ4C_first_pass_numeric_value( QAJ4C_First_pass_parser* parser );
+static uint8_t QAJ4C_first_pass_numeric_value( QAJ4C_First_pass_parser* parser );
 static void QAJ4C_first_pass_constant( QAJ4C_First_pass_parser* parser, const char* str, size_t len );
 static uint32_t QAJ4C_first_pass_4digits( QAJ4C_First_pass_parser* parser );
 static int QAJ4C_first_pass_utf16( QAJ4C_First_pass_parser* parser );
@@ -98,22 +303,73 @@ static void QAJ4C_first_pass_skip_comment( QAJ4C_First_pass_parser* parser );
 static size_type* QAJ4C_first_pass_fetch_stats_buffer( QAJ4C_First_pass_parser* parser, size_type storage_pos );
 static QAJ4C_Value* QAJ4C_create_error_description( QAJ4C_First_pass_parser* me );
 
+static size_type QAJ4C_value_type( const QAJ4C_Value* value_ptr );
+static bool QAJ4C_array_copy_elements( const QAJ4C_Value* value_ptr, void* out, size_t n, uint8_t primitive_type, size_t* copied );
+static bool QAJ4C_packed_array_copy_elements( const QAJ4C_Value* value_ptr, void* out, size_t n, uint8_t primitive_type, size_t* copied );
+static void QAJ4C_primitives_copy( const QAJ4C_Value* src, size_t count, uint8_t storage_type, void* out, uint8_t primitive_type, size_t offset );
+static uint16_t QAJ4C_fold_hash( uint32_t hash );
+static size_type QAJ4C_key_length( const QAJ4C_Value* value_ptr );
+static const char* QAJ4C_key_string( const QAJ4C_Value* value_ptr );
+static bool QAJ4C_key_matches( const QAJ4C_Value* key, const char* str, size_type len, uint16_t hash );
+static unsigned QAJ4C_key_candidate( const QAJ4C_Value* key, size_type expected );
+static int QAJ4C_key_compare_string( const QAJ4C_Value* key, const char* str, size_type len );
+static size_type QAJ4C_object_gallop( const QAJ4C_Object* obj_ptr, const size_type* perm, const char* str, size_type len, size_type first );
+static uint64_t QAJ4C_string_prefix( const char* str, size_type len );
+static bool QAJ4C_request_less( const char* keys[], const size_type* lengths, const uint64_t* prefixes, size_type lhs, size_type rhs );
+static void QAJ4C_object_get_many_sorted( const QAJ4C_Object* obj_ptr, const size_type* perm, const char* keys[], const size_type* lengths, size_type count, const QAJ4C_Value* result[] );
+static void QAJ4C_object_get_many_unsorted( const QAJ4C_Object* obj_ptr, const char* keys[], const size_type* lengths, size_type count, const QAJ4C_Value* result[] );
+static void QAJ4C_object_get_many_chunk( const QAJ4C_Value* value_ptr, const char* keys[], size_type count, const QAJ4C_Value* result[] );
+static const QAJ4C_Value* QAJ4C_column_lookup( const QAJ4C_Value* array_ptr, size_type index, QAJ4C_Key* key, const QAJ4C_Member** shape_keys );
+static size_type QAJ4C_column_init( const QAJ4C_Value* array_ptr, size_t n, uint8_t* nulls );
+static int QAJ4C_key_compare( const QAJ4C_Value* lhs, const QAJ4C_Value* rhs );
+static size_type* QAJ4C_object_index_state( const QAJ4C_Object* obj_ptr );
+static size_type* QAJ4C_object_index_entries( const QAJ4C_Object* obj_ptr );
+static void QAJ4C_object_build_index( const QAJ4C_Object* obj_ptr, size_type flags );
+static void QAJ4C_swap_members( QAJ4C_Member* lhs, QAJ4C_Member* rhs );
+static void QAJ4C_insertion_sort_members( QAJ4C_Member* top, size_type count );
+static void QAJ4C_sift_down_members( QAJ4C_Member* top, size_type root, size_type count );
+static void QAJ4C_heap_sort_members( QAJ4C_Member* top, size_type count );
+static void QAJ4C_intro_sort_members( QAJ4C_Member* top, size_type count, int depth_limit );
+static size_type QAJ4C_member_bucket( const QAJ4C_Member* member );
+static bool QAJ4C_object_index_ready( const QAJ4C_Value* value_ptr );
+
 size_t QAJ4C_calculate_max_buffer_parser( QAJ4C_First_pass_parser* parser );
+static size_t QAJ4C_first_pass_object_storage( QAJ4C_First_pass_parser* parser );
 
 static void QAJ4C_second_pass_parser_init( QAJ4C_Second_pass_parser* me, QAJ4C_First_pass_parser* parser );
+static bool QAJ4C_second_pass_run( QAJ4C_Second_pass_parser* me, QAJ4C_Parse_budget* budget );
 static void QAJ4C_second_pass_process( QAJ4C_Second_pass_parser* me, QAJ4C_Value* result_ptr );
 static void QAJ4C_second_pass_object( QAJ4C_Second_pass_parser* me, QAJ4C_Value* result_ptr );
+static void QAJ4C_second_pass_shaped_object( QAJ4C_Second_pass_parser* me, QAJ4C_Value* result_ptr, size_type elements );
 static void QAJ4C_second_pass_array( QAJ4C_Second_pass_parser* me, QAJ4C_Value* result_ptr );
+static void QAJ4C_second_pass_packed_array( QAJ4C_Second_pass_parser* me, QAJ4C_Value* result_ptr, size_type elements );
+static bool QAJ4C_second_pass_packed_elements( QAJ4C_Second_pass_parser* me, QAJ4C_Second_pass_frame* frame, QAJ4C_Parse_budget* budget, const char* start_char );
+static bool QAJ4C_second_pass_array_elements( QAJ4C_Second_pass_parser* me, QAJ4C_Second_pass_frame* frame, QAJ4C_Parse_budget* budget, const char* start_char );
+static void QAJ4C_second_pass_continue( QAJ4C_Second_pass_parser* me );
+static void QAJ4C_second_pass_push( QAJ4C_Second_pass_parser* me, QAJ4C_Value* value_ptr, size_type elements, bool is_object );
 static void QAJ4C_second_pass_string( QAJ4C_Second_pass_parser* me, QAJ4C_Value* result_ptr );
 static char* QAJ4C_second_pass_string_escape_sequence( QAJ4C_Second_pass_parser* me, char* put_str );
 static char* QAJ4C_second_pass_unicode_sequence( QAJ4C_Second_pass_parser* me, char* put_str );
 static void QAJ4C_second_pass_numeric_value( QAJ4C_Second_pass_parser* me, QAJ4C_Value* result_ptr );
+static const char* QAJ4C_fast_numeric_value( const char* json_char, QAJ4C_Value* result_ptr, QAJ4C_Builder* builder );
 static uint32_t QAJ4C_second_pass_utf16( QAJ4C_Second_pass_parser* me );
 
 static size_type QAJ4C_second_pass_fetch_stats_data( QAJ4C_Second_pass_parser* me );
+static void QAJ4C_second_pass_predict_shape( QAJ4C_Second_pass_parser* me, QAJ4C_Second_pass_frame* frame );
+static QAJ4C_Member* QAJ4C_second_pass_shape_member( QAJ4C_Second_pass_parser* me, QAJ4C_Second_pass_frame* frame );
+static void QAJ4C_second_pass_known_key( QAJ4C_Second_pass_parser* me, QAJ4C_Value* result_ptr, size_type len );
+static void QAJ4C_second_pass_close_object( QAJ4C_Second_pass_parser* me, QAJ4C_Second_pass_frame* frame );
+static uint32_t QAJ4C_shape_path( uint32_t path, uint16_t key_hash );
+static QAJ4C_Shape_table* QAJ4C_parser_shapes( QAJ4C_Parser* me, const QAJ4C_Allocator* allocator );
+static QAJ4C_Learned_shape* QAJ4C_shape_table_find( QAJ4C_Shape_table* table, uint32_t path, bool insert );
+static uint16_t QAJ4C_shape_table_learn_keys( QAJ4C_Shape_table* table, const QAJ4C_Second_pass_frame* frame );
+static void QAJ4C_shape_table_learn_slots( QAJ4C_Shape_table* table, const QAJ4C_Second_pass_frame* frame, uint16_t first_key, bool sorted );
 
 static const char* QAJ4C_skip_whitespaces_and_comments_second_pass( const char* json );
+static const char* QAJ4C_skip_string( const char* json );
+static const char* QAJ4C_skip_value( const char* json );
 
+static void QAJ4C_json_message_init( QAJ4C_Json_message* msg, const char* json, size_t json_len );
 static char QAJ4C_json_message_peek( QAJ4C_Json_message* msg );
 static char QAJ4C_json_message_read( QAJ4C_Json_message* msg );
 static void QAJ4C_json_message_forward( QAJ4C_Json_message* msg );
@@ -125,12 +381,14 @@ bool QAJ4C_std_print_callback_function( void *ptr, const char* buffer, size_t si
 static char* QAJ4C_do_print_uint64( uint64_t value, char* buffer, size_t size );
 
 bool QAJ4C_print_callback_object( const QAJ4C_Object* value_ptr, QAJ4C_print_buffer_callback_fn callback, void *ptr );
+bool QAJ4C_print_callback_shaped_object( const QAJ4C_Shaped_object* value_ptr, QAJ4C_print_buffer_callback_fn callback, void *ptr );
 bool QAJ4C_print_callback_array( const QAJ4C_Array* value_ptr, QAJ4C_print_buffer_callback_fn callback, void *ptr );
+bool QAJ4C_print_callback_packed_array( const QAJ4C_Value* value_ptr, QAJ4C_print_buffer_callback_fn callback, void *ptr );
 bool QAJ4C_print_callback_primitive( const QAJ4C_Value* value_ptr, QAJ4C_print_buffer_callback_fn callback, void *ptr );
 bool QAJ4C_print_callback_double( double d, QAJ4C_print_buffer_callback_fn callback, void *ptr );
 bool QAJ4C_print_callback_uint64( uint64_t value, QAJ4C_print_buffer_callback_fn callback, void *ptr );
 bool QAJ4C_print_callback_int64( int64_t value, QAJ4C_print_buffer_callback_fn callback, void *ptr );
-bool QAJ4C_print_callback_error( const QAJ4C_Error* value_ptr, QAJ4C_print_buffer_callback_fn callback, void *ptr );
+bool QAJ4C_print_callback_error( const QAJ4C_Value* value_ptr, QAJ4C_print_buffer_callback_fn callback, void *ptr );
 bool QAJ4C_print_callback_constant( const char *string, size_t size, QAJ4C_print_buffer_callback_fn callback, void *ptr );
 bool QAJ4C_print_callback_string( const char *string, QAJ4C_print_buffer_callback_fn callback, void *ptr );
 
@@ -156,101 +414,273 @@ static bool QAJ4C_is_double_separation_char( char c ) {
     return c == '.' || c == 'e' || c == 'E';
 }
 
-size_t QAJ4C_parse_generic( QAJ4C_Builder* builder, const char* json, size_t json_len, int opts, const QAJ4C_Value** result_ptr, QAJ4C_realloc_fn realloc_callback ) {
-    QAJ4C_First_pass_parser parser;
-    QAJ4C_Second_pass_parser second_parser;
-    QAJ4C_Json_message msg;
-    size_type required_size;
-    msg.json = json;
-    msg.json_len = json_len;
-    msg.json_pos = 0;
+size_t QAJ4C_parse_generic( QAJ4C_Builder* builder, const char* json, size_t json_len, int opts, const QAJ4C_Parse_limits* limits, const QAJ4C_Value** result_ptr, const QAJ4C_Allocator* allocator ) {
+    QAJ4C_Parser_state state;
+    QAJ4C_Parse_budget budget = {SIZE_MAX, SIZE_MAX, 0};
+
+    QAJ4C_parser_state_init(&state, builder, json, json_len, opts, limits, allocator);
+    QAJ4C_parser_state_run(&state, &budget);
+
+    *result_ptr = state.result;
+    return state.result_size;
+}
+
+void QAJ4C_incremental_parse_init_generic( QAJ4C_Incremental_parser* parser, const char* json, size_t json_len, int opts, void* buffer, size_t buffer_size ) {
+    QAJ4C_Incremental_parser_impl* me = (QAJ4C_Incremental_parser_impl*)parser->storage;
+    QAJ4C_builder_init(&me->builder, buffer, buffer_size);
+    QAJ4C_parser_state_init(&me->state, &me->builder, json, json_len, opts, NULL, NULL);
+}
 
-    QAJ4C_first_pass_parser_init(&parser, builder, &msg, opts, realloc_callback);
+void QAJ4C_incremental_parse_set_limits_generic( QAJ4C_Incremental_parser* parser, const QAJ4C_Parse_limits* limits ) {
+    QAJ4C_Incremental_parser_impl* me = (QAJ4C_Incremental_parser_impl*)parser->storage;
+    QAJ4C_first_pass_parser_set_limits(&me->state.first_pass, limits);
+}
+
+QAJ4C_PARSE_STATUS QAJ4C_incremental_parse_step_generic( QAJ4C_Incremental_parser* parser, size_t max_bytes, size_t max_nodes, const QAJ4C_Value** result_ptr ) {
+    QAJ4C_Incremental_parser_impl* me = (QAJ4C_Incremental_parser_impl*)parser->storage;
+    QAJ4C_Parse_budget budget = {max_bytes, max_nodes, 0};
 
-    QAJ4C_first_pass_process(&parser, 0);
+    if (me->state.phase != QAJ4C_PHASE_DONE && !QAJ4C_parser_state_run(&me->state, &budget)) {
+        return QAJ4C_PARSE_STATUS_IN_PROGRESS;
+    }
+    *result_ptr = me->state.result;
+    return QAJ4C_PARSE_STATUS_DONE;
+}
 
-    if (parser.strict_parsing && parser.msg->json[parser.msg->json_pos] != '\0') {
-        /* skip whitespaces and comments after the json, even though we are graceful */
-        QAJ4C_first_pass_skip_whitespaces_and_comments(&parser);
-        if (parser.msg->json[parser.msg->json_pos] != '\0') {
-            QAJ4C_first_pass_parser_set_error(&parser, QAJ4C_ERROR_UNEXPECTED_JSON_APPENDIX);
+const QAJ4C_Value* QAJ4C_parser_parse_generic( QAJ4C_Parser* me, const char* json, size_t json_len, int opts ) {
+    static const size_t MIN_SIZE = sizeof(QAJ4C_Value) + sizeof(QAJ4C_Error_information);
+    QAJ4C_Parser_state state;
+    QAJ4C_Builder builder;
+    QAJ4C_Parse_budget budget = {SIZE_MAX, SIZE_MAX, 0};
+    QAJ4C_Realloc_adapter adapter;
+    const QAJ4C_Allocator* allocator = QAJ4C_parser_get_allocator(me, &adapter);
+
+    if (me->buffer == NULL) {
+        /* start with the size of the largest document so far (avoids realloc calls during the parse run) */
+        size_t size = QAJ4C_MAX(me->high_water_mark, MIN_SIZE);
+        me->buffer = QAJ4C_allocator_realloc(allocator, NULL, size);
+        if (me->buffer == NULL) {
+            return NULL;
         }
+        me->buffer_size = size;
     }
 
-    if ( parser.err_code != QAJ4C_ERROR_NO_ERROR ) {
-        *result_ptr = QAJ4C_create_error_description(&parser);
-        return builder->cur_obj_pos;
+    QAJ4C_builder_init(&builder, me->buffer, me->buffer_size);
+    QAJ4C_parser_state_init(&state, &builder, json, json_len, opts, me->limits, allocator);
+    state.first_pass.grow_buffer = true;
+    if ((opts & QAJ4C_PARSE_OPTS_LEARN_SHAPES) != 0 && QAJ4C_TYPE_FLAGS_SUPPORTED) {
+        state.first_pass.shapes = QAJ4C_parser_shapes(me, allocator);
     }
+    QAJ4C_parser_state_run(&state, &budget);
 
-    required_size = QAJ4C_calculate_max_buffer_parser(&parser);
-    if (required_size > builder->buffer_size) {
-        if (parser.realloc_callback != NULL) {
-            void* tmp = parser.realloc_callback(builder->buffer, required_size);
-            if (tmp == NULL) {
-                QAJ4C_first_pass_parser_set_error(&parser, QAJ4C_ERROR_ALLOCATION_ERROR);
-            } else {
-                QAJ4C_builder_init(builder, tmp, required_size);
-            }
-        } else {
-            QAJ4C_first_pass_parser_set_error(&parser, QAJ4C_ERROR_STORAGE_BUFFER_TO_SMALL);
+    me->buffer = builder.buffer;
+    me->buffer_size = state.first_pass.buffer_capacity;
+    me->high_water_mark = QAJ4C_MAX(me->high_water_mark, state.result_size);
+    return state.result;
+}
+
+/*
+ * The shape table of the context (allocated on first use, NULL in case the allocation failed).
+ * A table that ran full is cleared, so the shapes of the following messages are learned again.
+ */
+static QAJ4C_Shape_table* QAJ4C_parser_shapes( QAJ4C_Parser* me, const QAJ4C_Allocator* allocator ) {
+    if (me->shapes == NULL) {
+        me->shapes = (QAJ4C_Shape_table*)QAJ4C_allocator_realloc(allocator, NULL, sizeof(QAJ4C_Shape_table));
+        if (me->shapes == NULL) {
+            return NULL;
         }
+        me->shapes->full = true;
     }
-    else
-    {
-        QAJ4C_builder_init(builder, builder->buffer, required_size);
+    if (me->shapes->full) {
+        QAJ4C_MEMSET(me->shapes, 0, sizeof(QAJ4C_Shape_table));
     }
+    return me->shapes;
+}
+
+static void QAJ4C_parser_state_init( QAJ4C_Parser_state* me, QAJ4C_Builder* builder, const char* json, size_t json_len, int opts, const QAJ4C_Parse_limits* limits, const QAJ4C_Allocator* allocator ) {
+    QAJ4C_json_message_init(&me->msg, json, json_len);
+    me->phase = QAJ4C_PHASE_FIRST_PASS;
+    me->result = NULL;
+    me->result_size = 0;
+
+    QAJ4C_first_pass_parser_init(&me->first_pass, builder, &me->msg, opts, limits, allocator);
+}
+
+/*
+ * Continues the parse run until it is either complete (returns true) or the budget
+ * has been used up (returns false).
+ */
+static bool QAJ4C_parser_state_run( QAJ4C_Parser_state* me, QAJ4C_Parse_budget* budget ) {
+    QAJ4C_First_pass_parser* parser = &me->first_pass;
+    QAJ4C_Builder* builder = parser->builder;
+    size_type required_size;
 
-    if ( parser.err_code != QAJ4C_ERROR_NO_ERROR ) {
-        *result_ptr = QAJ4C_create_error_description(&parser);
-        return builder->cur_obj_pos;
+    if (me->phase == QAJ4C_PHASE_FIRST_PASS) {
+        if (!QAJ4C_first_pass_run(parser, budget)) {
+            return false;
+        }
+
+        if (parser->strict_parsing && parser->msg->json[parser->msg->json_pos] != '\0') {
+            /* skip whitespaces and comments after the json, even though we are graceful */
+            QAJ4C_first_pass_skip_whitespaces_and_comments(parser);
+            if (parser->msg->json[parser->msg->json_pos] != '\0') {
+                QAJ4C_first_pass_parser_set_error(parser, QAJ4C_ERROR_UNEXPECTED_JSON_APPENDIX);
+            }
+        }
+
+        if (parser->err_code == QAJ4C_ERROR_NO_ERROR) {
+            required_size = QAJ4C_calculate_max_buffer_parser(parser);
+            if (required_size > builder->buffer_size) {
+                if (parser->allocator != NULL) {
+                    void* tmp = QAJ4C_allocator_realloc(parser->allocator, builder->buffer, required_size);
+                    if (tmp == NULL) {
+                        QAJ4C_first_pass_parser_set_error(parser, QAJ4C_ERROR_ALLOCATION_ERROR);
+                    } else {
+                        QAJ4C_builder_init(builder, tmp, required_size);
+                        parser->buffer_capacity = required_size;
+                    }
+                } else {
+                    QAJ4C_first_pass_parser_set_error(parser, QAJ4C_ERROR_STORAGE_BUFFER_TO_SMALL);
+                }
+            } else {
+                QAJ4C_builder_init(builder, builder->buffer, required_size);
+            }
+        }
+
+        if (parser->err_code != QAJ4C_ERROR_NO_ERROR) {
+            me->result = QAJ4C_create_error_description(parser);
+            me->result_size = builder->cur_obj_pos;
+            me->phase = QAJ4C_PHASE_DONE;
+            return true;
+        }
+
+        QAJ4C_second_pass_parser_init(&me->second_pass, parser);
+        me->result = QAJ4C_builder_get_document(builder);
+        me->second_pass.pending_value = (QAJ4C_Value*)me->result;
+        me->phase = QAJ4C_PHASE_SECOND_PASS;
     }
 
-    QAJ4C_second_pass_parser_init(&second_parser, &parser);
-    *result_ptr = QAJ4C_builder_get_document(builder);
-    QAJ4C_second_pass_process(&second_parser, (QAJ4C_Value*)*result_ptr);
+    if (me->phase == QAJ4C_PHASE_SECOND_PASS) {
+        if (!QAJ4C_second_pass_run(&me->second_pass, budget)) {
+            return false;
+        }
+        me->result_size = builder->buffer_size;
+        me->phase = QAJ4C_PHASE_DONE;
+    }
+    return true;
+}
 
-    return builder->buffer_size;
+static bool QAJ4C_parse_budget_exhausted( const QAJ4C_Parse_budget* budget, size_t bytes ) {
+    return budget->nodes >= budget->max_nodes || bytes >= budget->max_bytes;
 }
 
 size_t QAJ4C_calculate_max_buffer_parser( QAJ4C_First_pass_parser* parser ) {
     if (QAJ4C_UNLIKELY(parser->err_code != QAJ4C_ERROR_NO_ERROR)) {
         return sizeof(QAJ4C_Value) + sizeof(QAJ4C_Error_information);
     }
-    return parser->amount_nodes * sizeof(QAJ4C_Value) + parser->complete_string_length;
+    return QAJ4C_first_pass_object_storage(parser) + parser->complete_string_length;
+}
+
+static size_t QAJ4C_first_pass_object_storage( QAJ4C_First_pass_parser* parser ) {
+    return (size_t)parser->amount_nodes * sizeof(QAJ4C_Value) + parser->index_storage - parser->shared_storage + parser->compact_storage;
 }
 
 size_t QAJ4C_calculate_max_buffer_generic( const char* json, size_t json_len, int opts ) {
     QAJ4C_First_pass_parser parser;
     QAJ4C_Json_message msg;
-    msg.json = json;
-    msg.json_len = json_len;
-    msg.json_pos = 0;
+    QAJ4C_Parse_budget budget = {SIZE_MAX, SIZE_MAX, 0};
+    QAJ4C_json_message_init(&msg, json, json_len);
 
-    QAJ4C_first_pass_parser_init(&parser, NULL, &msg, opts, NULL);
-    QAJ4C_first_pass_process(&parser, 0);
+    QAJ4C_first_pass_parser_init(&parser, NULL, &msg, opts, NULL, NULL);
+    QAJ4C_first_pass_run(&parser, &budget);
 
     return QAJ4C_calculate_max_buffer_parser(&parser);
 }
 
-static void QAJ4C_first_pass_parser_init( QAJ4C_First_pass_parser* parser, QAJ4C_Builder* builder, QAJ4C_Json_message* msg, int opts, QAJ4C_realloc_fn realloc_callback ) {
+static void QAJ4C_first_pass_parser_init( QAJ4C_First_pass_parser* parser, QAJ4C_Builder* builder, QAJ4C_Json_message* msg, int opts, const QAJ4C_Parse_limits* limits, const QAJ4C_Allocator* allocator ) {
     parser->msg = msg;
 
     parser->builder = builder;
-    parser->realloc_callback = realloc_callback;
+    parser->allocator = allocator;
+    parser->buffer_capacity = builder != NULL ? builder->buffer_size : 0;
+    parser->shapes = NULL;
+    parser->grow_buffer = false;
 
     parser->strict_parsing = (opts & QAJ4C_PARSE_OPTS_STRICT) != 0;
-    parser->optimize_object = (opts & QAJ4C_PARSE_OPTS_DONT_SORT_OBJECT_MEMBERS) == 0;
+    /*
+     * The members are not sorted in place in case the input order should be kept or a lazy index
+     * is used (as the document might be shared between threads).
+     */
+    parser->optimize_object = (opts & (QAJ4C_PARSE_OPTS_DONT_SORT_OBJECT_MEMBERS | QAJ4C_PARSE_OPTS_LAZY_INDEX | QAJ4C_PARSE_OPTS_KEEP_ORDER)) == 0;
     parser->insitu_parsing = (opts & 1) != 0;
+#ifdef QAJ4C_COMPACT_VALUES
+    /* the compact values have no room for the index flags, shared keys and packed elements */
+    parser->index_opts = 0;
+    parser->share_shapes = false;
+    parser->pack_arrays = false;
+#else
+    parser->index_opts = opts & (QAJ4C_PARSE_OPTS_HASH_INDEX | QAJ4C_PARSE_OPTS_LAZY_INDEX | QAJ4C_PARSE_OPTS_KEEP_ORDER);
+    parser->share_shapes = (opts & QAJ4C_PARSE_OPTS_SHARE_SHAPES) != 0;
+    parser->pack_arrays = (opts & QAJ4C_PARSE_OPTS_PACK_ARRAYS) != 0;
+#endif
 
-    parser->max_depth = 32;
     parser->amount_nodes = 0;
+    parser->index_storage = 0;
+    parser->shared_storage = 0;
+    parser->compact_storage = 0;
+    parser->string_nul = false;
     parser->complete_string_length = 0;
     parser->storage_counter = 0;
     parser->err_code = QAJ4C_ERROR_NO_ERROR;
+    parser->string_bytes = 0;
+
+    parser->expect_value = true;
+    parser->depth = 0;
+
+    QAJ4C_first_pass_parser_set_limits(parser, limits);
+}
+
+static void QAJ4C_first_pass_parser_set_limits( QAJ4C_First_pass_parser* parser, const QAJ4C_Parse_limits* limits ) {
+    static const QAJ4C_Parse_limits NO_LIMITS = {0, 0, 0, 0, 0, 0};
+    if (limits == NULL) {
+        limits = &NO_LIMITS;
+    }
+
+    parser->max_depth = QAJ4C_MAX_DEPTH;
+    if (limits->max_depth > 0 && limits->max_depth <= QAJ4C_MAX_DEPTH) {
+        parser->max_depth = (int)limits->max_depth - 1;
+    }
+    parser->limits.max_depth = limits->max_depth;
+    parser->limits.max_nodes = limits->max_nodes > 0 ? limits->max_nodes : SIZE_MAX;
+    parser->limits.max_string_bytes = limits->max_string_bytes > 0 ? limits->max_string_bytes : SIZE_MAX;
+    parser->limits.max_string_length = limits->max_string_length > 0 ? limits->max_string_length : SIZE_MAX;
+    parser->limits.max_object_members = limits->max_object_members > 0 ? limits->max_object_members : SIZE_MAX;
+    parser->limits.max_buffer_size = limits->max_buffer_size > 0 ? limits->max_buffer_size : SIZE_MAX;
+}
+
+static void QAJ4C_first_pass_count_node( QAJ4C_First_pass_parser* parser ) {
+    parser->amount_nodes++;
+    if (QAJ4C_UNLIKELY(parser->amount_nodes > parser->limits.max_nodes)) {
+        QAJ4C_first_pass_parser_set_error(parser, QAJ4C_ERROR_NODE_LIMIT_EXCEEDED);
+    } else if (QAJ4C_UNLIKELY(parser->amount_nodes > QAJ4C_MAX_NODES)) {
+        QAJ4C_first_pass_parser_set_error(parser, QAJ4C_ERROR_DOCUMENT_SIZE_EXCEEDED);
+    }
+    QAJ4C_first_pass_check_buffer_limit(parser);
+}
+
+static void QAJ4C_first_pass_check_buffer_limit( QAJ4C_First_pass_parser* parser ) {
+    size_t required_size = QAJ4C_first_pass_object_storage(parser) + parser->complete_string_length;
+    if (QAJ4C_UNLIKELY(required_size > parser->limits.max_buffer_size)) {
+        QAJ4C_first_pass_parser_set_error(parser, QAJ4C_ERROR_BUFFER_SIZE_LIMIT_EXCEEDED);
+    }
 }
 
 static void QAJ4C_first_pass_parser_set_error( QAJ4C_First_pass_parser* parser, QAJ4C_ERROR_CODE error ) {
     if( parser->err_code == QAJ4C_ERROR_NO_ERROR) {
+        /* the message has been cut at the end of the size_type range (see QAJ4C_json_message_init) */
+        if (QAJ4C_UNLIKELY(parser->msg->json_pos >= QAJ4C_SIZE_TYPE_MAX - 1)) {
+            error = QAJ4C_ERROR_DOCUMENT_SIZE_EXCEEDED;
+        }
         parser->err_code = error;
         /* set the length of the json message to the current position to avoid the parser will continue parsing */
         if (parser->msg->json_len > parser->msg->json_pos) {
@@ -259,17 +689,53 @@ static void QAJ4C_first_pass_parser_set_error( QAJ4C_First_pass_parser* parser,
     }
 }
 
-static void QAJ4C_first_pass_process( QAJ4C_First_pass_parser* parser, int depth ) {
+/*
+ * Runs the first pass until the complete json message has been processed (returns true) or
+ * the budget has been used up (returns false). Instead of recursion the currently open objects and
+ * arrays are kept on the parser's stack so the pass can be resumed at any value.
+ */
+static bool QAJ4C_first_pass_run( QAJ4C_First_pass_parser* parser, QAJ4C_Parse_budget* budget ) {
+    size_type start_pos = parser->msg->json_pos;
+
+    while (parser->err_code == QAJ4C_ERROR_NO_ERROR) {
+        if (parser->expect_value) {
+            if (QAJ4C_parse_budget_exhausted(budget, parser->msg->json_pos - start_pos)) {
+                return false;
+            }
+            parser->expect_value = false;
+            budget->nodes += 1;
+            QAJ4C_first_pass_process(parser);
+        } else if (parser->depth == 0) {
+            break;
+        } else if (parser->stack[parser->depth - 1].is_object) {
+            QAJ4C_first_pass_object_continue(parser);
+        } else {
+            QAJ4C_first_pass_array_continue(parser);
+        }
+    }
+    return true;
+}
+
+static void QAJ4C_first_pass_process( QAJ4C_First_pass_parser* parser ) {
+    uint8_t* pack_kind = NULL;
+    uint8_t kind = QAJ4C_PACK_OTHER;
+
     QAJ4C_first_pass_skip_whitespaces_and_comments(parser);
-    parser->amount_nodes++;
+    QAJ4C_first_pass_count_node(parser);
+    if (parser->share_shapes && parser->depth > 0 && !parser->stack[parser->depth - 1].is_object && QAJ4C_json_message_peek(parser->msg) != '{') {
+        parser->stack[parser->depth - 1].shape_pos = 0; /* only a direct predecessor can share its keys */
+    }
+    if (parser->pack_arrays && parser->depth > 0 && !parser->stack[parser->depth - 1].is_object) {
+        pack_kind = &parser->stack[parser->depth - 1].pack_kind;
+    }
     switch (QAJ4C_json_message_peek(parser->msg)) {
     case '{':
         QAJ4C_json_message_forward(parser->msg);
-        QAJ4C_first_pass_object(parser, depth);
+        QAJ4C_first_pass_object(parser);
         break;
     case '[':
         QAJ4C_json_message_forward(parser->msg);
-        QAJ4C_first_pass_array(parser, depth);
+        QAJ4C_first_pass_array(parser);
         break;
     case '"':
         QAJ4C_json_message_forward(parser->msg);
@@ -299,21 +765,23 @@ static void QAJ4C_first_pass_process( QAJ4C_First_pass_parser* parser, int depth
     case '7':
     case '8':
     case '9':
-        QAJ4C_first_pass_numeric_value(parser);
+        kind = QAJ4C_first_pass_numeric_value(parser);
         break;
     default:
         QAJ4C_first_pass_parser_set_error(parser, QAJ4C_ERROR_UNEXPECTED_CHAR);
         break;
     }
+    if (pack_kind != NULL) {
+        *pack_kind |= kind;
+    }
 }
 
-static void QAJ4C_first_pass_object( QAJ4C_First_pass_parser* parser, int depth ) {
+static void QAJ4C_first_pass_object( QAJ4C_First_pass_parser* parser ) {
+    size_type json_start = parser->msg->json_pos;
+    QAJ4C_First_pass_frame* frame;
     char json_char;
-    size_type member_count = 0;
-    size_type storage_pos = parser->storage_counter;
-    parser->storage_counter++;
 
-    if (parser->max_depth < depth) {
+    if (parser->max_depth < parser->depth) {
         QAJ4C_first_pass_parser_set_error(parser, QAJ4C_ERROR_DEPTH_OVERFLOW);
         return;
     }
@@ -321,8 +789,23 @@ static void QAJ4C_first_pass_object( QAJ4C_First_pass_parser* parser, int depth
     QAJ4C_first_pass_skip_whitespaces_and_comments(parser);
     json_char = QAJ4C_json_message_read(parser->msg);
 
+    frame = QAJ4C_first_pass_push(parser, true, json_char == '}');
+    frame->json_start = json_start;
+    if (parser->share_shapes && parser->depth > 1 && !parser->stack[parser->depth - 2].is_object) {
+        frame->shape_pos = parser->stack[parser->depth - 2].shape_pos;
+    }
+    QAJ4C_first_pass_object_members(parser, json_char);
+}
+
+/*
+ * Processes the object until the next member value is reached (expect_value will be set)
+ * or until the object is closed.
+ */
+static void QAJ4C_first_pass_object_members( QAJ4C_First_pass_parser* parser, char json_char ) {
+    QAJ4C_First_pass_frame* frame = &parser->stack[parser->depth - 1];
+
     while (json_char != '\0' && json_char != '}') {
-        if (member_count > 0) {
+        if (frame->member_count > 0) {
             if (json_char != ',') {
                 QAJ4C_first_pass_parser_set_error(parser, QAJ4C_ERROR_MISSING_COMMA);
             }
@@ -330,16 +813,27 @@ static void QAJ4C_first_pass_object( QAJ4C_First_pass_parser* parser, int depth
             json_char = QAJ4C_json_message_read(parser->msg);
         }
         if (json_char == '"') {
-            parser->amount_nodes++; /* count the string as node */
-            QAJ4C_first_pass_string(parser);
+            if (QAJ4C_UNLIKELY(frame->member_count >= parser->limits.max_object_members)) {
+                QAJ4C_first_pass_parser_set_error(parser, QAJ4C_ERROR_OBJECT_MEMBERS_LIMIT_EXCEEDED);
+            }
+            QAJ4C_first_pass_count_node(parser); /* count the string as node */
+            if (frame->shape_pos != 0) {
+                size_type key_start = parser->msg->json_pos;
+                size_type string_length = parser->complete_string_length;
+                QAJ4C_first_pass_string(parser);
+                frame->key_string_length += parser->complete_string_length - string_length;
+                QAJ4C_first_pass_match_shape(parser, frame, key_start);
+            } else {
+                QAJ4C_first_pass_string(parser);
+            }
             QAJ4C_first_pass_skip_whitespaces_and_comments(parser);
             json_char = QAJ4C_json_message_read(parser->msg);
             if (json_char != ':') {
                 QAJ4C_first_pass_parser_set_error(parser, QAJ4C_ERROR_MISSING_COLON);
             }
             QAJ4C_first_pass_skip_whitespaces_and_comments(parser);
-            QAJ4C_first_pass_process(parser, depth + 1);
-            ++member_count;
+            parser->expect_value = true;
+            return;
         } else if (json_char == '}') {
             if (parser->strict_parsing) {
                 QAJ4C_first_pass_parser_set_error(parser, QAJ4C_ERROR_TRAILING_COMMA);
@@ -357,64 +851,161 @@ static void QAJ4C_first_pass_object( QAJ4C_First_pass_parser* parser, int depth
         QAJ4C_first_pass_parser_set_error(parser, QAJ4C_ERROR_JSON_MESSAGE_TRUNCATED);
     }
 
-    if (parser->builder != NULL && parser->err_code == QAJ4C_ERROR_NO_ERROR) {
-        size_type* obj_data = QAJ4C_first_pass_fetch_stats_buffer(parser, storage_pos);
-        if (obj_data != NULL) {
-            *obj_data = member_count;
-        }
-    }
+    QAJ4C_first_pass_pop(parser);
+}
+
+static void QAJ4C_first_pass_object_continue( QAJ4C_First_pass_parser* parser ) {
+    parser->stack[parser->depth - 1].member_count++;
+    QAJ4C_first_pass_skip_whitespaces_and_comments(parser);
+    QAJ4C_first_pass_object_members(parser, QAJ4C_json_message_read(parser->msg));
 }
 
-static void QAJ4C_first_pass_array( QAJ4C_First_pass_parser* parser, int depth ) {
+static void QAJ4C_first_pass_array( QAJ4C_First_pass_parser* parser ) {
     char json_char;
-    size_type member_count = 0;
-    size_type storage_pos = parser->storage_counter;
-    parser->storage_counter++;
+    QAJ4C_First_pass_frame* frame;
 
-    if (parser->max_depth < depth) {
+    if (parser->max_depth < parser->depth) {
         QAJ4C_first_pass_parser_set_error(parser, QAJ4C_ERROR_DEPTH_OVERFLOW);
         return;
     }
 
     QAJ4C_first_pass_skip_whitespaces_and_comments(parser);
     json_char = QAJ4C_json_message_peek(parser->msg);
+
+    frame = QAJ4C_first_pass_push(parser, false, json_char == ']');
     if (json_char != ']') {
-        QAJ4C_first_pass_process(parser, depth + 1);
+        frame->member_count = 1;
+        parser->expect_value = true;
+    } else {
+        QAJ4C_json_message_forward(parser->msg);
+        QAJ4C_first_pass_pop(parser);
+    }
+}
+
+/*
+ * Processes the array after an element has been parsed until the next element is reached
+ * (expect_value will be set) or until the array is closed.
+ */
+static void QAJ4C_first_pass_array_continue( QAJ4C_First_pass_parser* parser ) {
+    QAJ4C_First_pass_frame* frame = &parser->stack[parser->depth - 1];
+    char json_char;
+
+    QAJ4C_first_pass_skip_whitespaces_and_comments(parser);
+    json_char = QAJ4C_json_message_peek(parser->msg);
+    while (json_char == ',') {
+        QAJ4C_json_message_forward(parser->msg);
         QAJ4C_first_pass_skip_whitespaces_and_comments(parser);
         json_char = QAJ4C_json_message_peek(parser->msg);
-        member_count = 1;
-        while (json_char == ',') {
-            QAJ4C_json_message_forward(parser->msg);
-            QAJ4C_first_pass_skip_whitespaces_and_comments(parser);
-            json_char = QAJ4C_json_message_peek(parser->msg);
-            if (json_char != ']') {
-                member_count += 1;
-                QAJ4C_first_pass_process(parser, depth + 1);
-                QAJ4C_first_pass_skip_whitespaces_and_comments(parser);
-                json_char = QAJ4C_json_message_peek(parser->msg);
-            } else if (parser->strict_parsing) {
-                QAJ4C_first_pass_parser_set_error(parser, QAJ4C_ERROR_TRAILING_COMMA);
-            }
-        }
         if (json_char != ']') {
-            QAJ4C_first_pass_parser_set_error(parser, QAJ4C_ERROR_MISSING_COMMA);
+            frame->member_count += 1;
+            parser->expect_value = true;
+            return;
+        } else if (parser->strict_parsing) {
+            QAJ4C_first_pass_parser_set_error(parser, QAJ4C_ERROR_TRAILING_COMMA);
         }
     }
+    if (json_char != ']') {
+        QAJ4C_first_pass_parser_set_error(parser, QAJ4C_ERROR_MISSING_COMMA);
+    }
 
     QAJ4C_json_message_forward(parser->msg);
+    QAJ4C_first_pass_pop(parser);
+}
+
+/*
+ * Only non-empty objects and arrays reserve a statistics slot. The second pass detects
+ * empty ones on its own, this keeps the statistics from being overwritten by the DOM.
+ */
+static QAJ4C_First_pass_frame* QAJ4C_first_pass_push( QAJ4C_First_pass_parser* parser, bool is_object, bool is_empty ) {
+    QAJ4C_First_pass_frame* frame = &parser->stack[parser->depth];
+    parser->depth++;
+
+    frame->is_object = is_object;
+    frame->member_count = 0;
+    frame->storage_pos = 0;
+    frame->shape_pos = 0;
+    frame->json_start = 0;
+    frame->key_string_length = 0;
+    frame->pack_kind = 0;
+    if (!is_empty) {
+        frame->storage_pos = parser->storage_counter;
+        parser->storage_counter++;
+        parser->compact_storage += QAJ4C_CONTAINER_HEADER_SIZE;
+    }
+    return frame;
+}
+
+static void QAJ4C_first_pass_pop( QAJ4C_First_pass_parser* parser ) {
+    QAJ4C_First_pass_frame* frame = &parser->stack[parser->depth - 1];
+    size_type stats_flag = 0;
+    size_type index_flags = 0;
+    parser->depth--;
+
+    /* arrays of only integers or only doubles store 8 bytes per element instead of a value */
+    if (!frame->is_object && (frame->pack_kind == QAJ4C_PACK_INT64 || frame->pack_kind == QAJ4C_PACK_DOUBLE)) {
+        parser->shared_storage += (size_t)frame->member_count * (sizeof(QAJ4C_Value) - sizeof(int64_t));
+        stats_flag = QAJ4C_PACKED_ARRAY_FLAG;
+    }
+
+    if (frame->is_object && parser->index_opts != 0) {
+        index_flags = QAJ4C_object_index_flags(parser->index_opts, frame->member_count);
+        if (index_flags != 0) {
+            parser->index_storage += QAJ4C_object_index_size(index_flags, frame->member_count);
+            QAJ4C_first_pass_check_buffer_limit(parser);
+        }
+    }
+
+    /*
+     * Small objects (these are neither sorted nor indexed) within arrays can share their keys with
+     * the next element, or use the keys of the previous element in case all keys are equal.
+     */
+    if (frame->is_object && parser->share_shapes && parser->depth > 0 && !parser->stack[parser->depth - 1].is_object) {
+        bool shareable = frame->member_count > 0 && frame->member_count < QAJ4C_SORT_MIN_MEMBERS && index_flags == 0;
+        if (shareable && frame->shape_pos != 0 && *QAJ4C_skip_whitespaces_and_comments_second_pass(parser->msg->json + frame->shape_pos) == '}') {
+            /* the keys are not stored, the values are preceded by a header */
+            parser->shared_storage += (frame->member_count - 1) * sizeof(QAJ4C_Value);
+            parser->complete_string_length -= frame->key_string_length;
+            stats_flag = QAJ4C_SHAPED_OBJECT_FLAG;
+        }
+        parser->stack[parser->depth - 1].shape_pos = shareable ? frame->json_start : 0;
+    }
 
-    if (parser->builder != NULL && parser->err_code == QAJ4C_ERROR_NO_ERROR) {
-        size_type* obj_data = QAJ4C_first_pass_fetch_stats_buffer( parser, storage_pos );
-        if ( obj_data != NULL ) {
-            *obj_data = member_count;
+    if (frame->member_count > 0 && parser->builder != NULL && parser->err_code == QAJ4C_ERROR_NO_ERROR) {
+        size_type* obj_data = QAJ4C_first_pass_fetch_stats_buffer(parser, frame->storage_pos);
+        if (obj_data != NULL) {
+            *obj_data = frame->member_count | stats_flag;
         }
     }
 }
 
+/*
+ * Compares the key that has just been read with the next key of the previous element (on the
+ * raw json text, so equal keys that are escaped differently do not match). In case they are
+ * equal the position moves behind the member of the previous element, else the match is dropped.
+ */
+static void QAJ4C_first_pass_match_shape( QAJ4C_First_pass_parser* parser, QAJ4C_First_pass_frame* frame, size_type key_start ) {
+    const char* json = parser->msg->json;
+    size_type key_size = parser->msg->json_pos - key_start; /* including the closing " */
+    const char* shape_key = QAJ4C_skip_whitespaces_and_comments_second_pass(json + frame->shape_pos);
+
+    if (parser->err_code != QAJ4C_ERROR_NO_ERROR || *shape_key != '"' || QAJ4C_MEMCMP(shape_key + 1, json + key_start, key_size) != 0) {
+        frame->shape_pos = 0;
+        return;
+    }
+    shape_key = QAJ4C_skip_whitespaces_and_comments_second_pass(shape_key + 1 + key_size);
+    shape_key = QAJ4C_skip_value(shape_key + 1); /* skip the : and the value */
+    shape_key = QAJ4C_skip_whitespaces_and_comments_second_pass(shape_key);
+    if (*shape_key == ',') {
+        ++shape_key;
+    }
+    frame->shape_pos = shape_key - json;
+}
+
 static void QAJ4C_first_pass_string( QAJ4C_First_pass_parser* parser ) {
     char json_char;
     size_type chars = 0;
 
+    parser->string_nul = false;
     json_char = QAJ4C_json_message_read(parser->msg);
     while (json_char != '\0' && json_char != '"') {
         if (json_char == '\\') {
@@ -449,7 +1040,19 @@ static void QAJ4C_first_pass_string( QAJ4C_First_pass_parser* parser ) {
     }
 
     if (!parser->insitu_parsing && chars > QAJ4C_INLINE_STRING_SIZE) {
-        parser->complete_string_length += chars + 1; /* count the \0 to the complete string length! */
+        parser->complete_string_length += QAJ4C_STRING_HEADER_SIZE + chars + 1; /* count the \0 to the complete string length! */
+        QAJ4C_first_pass_check_buffer_limit(parser);
+    } else if (QAJ4C_STRING_HEADER_SIZE > 0 && parser->string_nul) {
+        /* compact values: strings with an embedded \0 are neither inlined nor referenced */
+        parser->complete_string_length += QAJ4C_STRING_HEADER_SIZE + chars + 1;
+        QAJ4C_first_pass_check_buffer_limit(parser);
+    }
+
+    parser->string_bytes += chars + 1;
+    if (QAJ4C_UNLIKELY(chars > parser->limits.max_string_length)) {
+        QAJ4C_first_pass_parser_set_error(parser, QAJ4C_ERROR_STRING_LENGTH_LIMIT_EXCEEDED);
+    } else if (QAJ4C_UNLIKELY(parser->string_bytes > parser->limits.max_string_bytes)) {
+        QAJ4C_first_pass_parser_set_error(parser, QAJ4C_ERROR_STRING_BYTES_LIMIT_EXCEEDED);
     }
 }
 
@@ -476,6 +1079,7 @@ static int QAJ4C_first_pass_utf16( QAJ4C_First_pass_parser* parser ) {
 
     if ( value < 0x80 ) { /* [0, 0x80) */
         amount_utf8_chars = 1;
+        parser->string_nul |= value == 0;
     } else if ( value < 0x800 ) { /* [0x80, 0x800) */
         amount_utf8_chars = 2;
     } else if (value < 0xd800 || value > 0xdfff) { /* [0x800, 0xd800) or (0xdfff, 0xffff] */
@@ -500,8 +1104,14 @@ static int QAJ4C_first_pass_utf16( QAJ4C_First_pass_parser* parser ) {
     return amount_utf8_chars;
 }
 
-static void QAJ4C_first_pass_numeric_value( QAJ4C_First_pass_parser* parser ) {
+/*
+ * Validates the number and returns its kind: integers with up to QAJ4C_PACK_MAX_DIGITS digits
+ * are QAJ4C_PACK_INT64, numbers with a fraction or exponent QAJ4C_PACK_DOUBLE.
+ */
+static uint8_t QAJ4C_first_pass_numeric_value( QAJ4C_First_pass_parser* parser ) {
     char json_char = QAJ4C_json_message_peek(parser->msg);
+    size_type digits_start;
+    uint8_t kind;
 
     if ( json_char == '-' ) {
         json_char = QAJ4C_json_message_forward_and_peek(parser->msg);
@@ -513,6 +1123,7 @@ static void QAJ4C_first_pass_numeric_value( QAJ4C_First_pass_parser* parser ) {
         }
     }
 
+    digits_start = parser->msg->json_pos;
 	if (!QAJ4C_is_digit(json_char)) {
 		QAJ4C_first_pass_parser_set_error(parser, QAJ4C_ERROR_INVALID_NUMBER_FORMAT);
 	} else if (json_char == '0' && parser->strict_parsing) {
@@ -526,8 +1137,16 @@ static void QAJ4C_first_pass_numeric_value( QAJ4C_First_pass_parser* parser ) {
     while (QAJ4C_is_digit(json_char)) {
         json_char = QAJ4C_json_message_forward_and_peek(parser->msg);
     }
+    kind = parser->msg->json_pos - digits_start <= QAJ4C_PACK_MAX_DIGITS ? QAJ4C_PACK_INT64 : QAJ4C_PACK_OTHER;
+#ifdef QAJ4C_COMPACT_VALUES
+    /* integers with 15 or more digits might not fit into the boxed integer */
+    if (!QAJ4C_is_double_separation_char(json_char) && parser->msg->json_pos - digits_start > 14) {
+        parser->compact_storage += sizeof(uint64_t);
+    }
+#endif
 
     if (QAJ4C_is_double_separation_char(json_char)) {
+        kind = QAJ4C_PACK_DOUBLE;
         /* check the format! */
         if (json_char == '.') {
             json_char = QAJ4C_json_message_forward_and_peek(parser->msg);
@@ -555,6 +1174,7 @@ static void QAJ4C_first_pass_numeric_value( QAJ4C_First_pass_parser* parser ) {
             }
         }
     }
+    return kind;
 }
 
 static void QAJ4C_first_pass_constant( QAJ4C_First_pass_parser* parser, const char* str, size_t len ) {
@@ -569,23 +1189,66 @@ static void QAJ4C_first_pass_constant( QAJ4C_First_pass_parser* parser, const ch
 
 static void QAJ4C_second_pass_parser_init( QAJ4C_Second_pass_parser* me, QAJ4C_First_pass_parser* parser ) {
     QAJ4C_Builder* builder = parser->builder;
-    size_type required_object_storage = parser->amount_nodes * sizeof(QAJ4C_Value);
-    size_type required_tempoary_storage = parser->storage_counter *  sizeof(size_type);
-    size_type copy_to_index = required_object_storage - required_tempoary_storage;
+    size_t required_object_storage = QAJ4C_first_pass_object_storage(parser);
+    size_t required_tempoary_storage = parser->storage_counter *  sizeof(size_type);
+    size_t copy_to_index = required_object_storage - required_tempoary_storage;
 
     memmove(builder->buffer + copy_to_index, builder->buffer, required_tempoary_storage);
     me->json_char = parser->msg->json;
+    me->json_end = parser->msg->json + parser->msg->json_pos;
     me->builder = parser->builder;
-    me->realloc_callback = parser->realloc_callback;
     me->insitu_parsing = parser->insitu_parsing;
     me->optimize_object = parser->optimize_object;
+    me->index_opts = parser->index_opts;
+    me->shapes = parser->shapes;
     me->curr_buffer_pos = copy_to_index;
+    me->pending_value = NULL;
+    me->pending_path = 0;
+    me->depth = 0;
 
     /* reset the builder to its original state! */
     QAJ4C_builder_init(builder, builder->buffer, builder->buffer_size);
     builder->cur_str_pos = required_object_storage;
 }
 
+/*
+ * Runs the second pass until the DOM is complete (returns true) or the budget has been
+ * used up (returns false).
+ */
+static bool QAJ4C_second_pass_run( QAJ4C_Second_pass_parser* me, QAJ4C_Parse_budget* budget ) {
+    const char* start_char = me->json_char;
+
+    while (true) {
+        if (me->pending_value != NULL) {
+            QAJ4C_Value* result_ptr = me->pending_value;
+            if (QAJ4C_parse_budget_exhausted(budget, me->json_char - start_char)) {
+                return false;
+            }
+            me->pending_value = NULL;
+            budget->nodes += 1;
+            QAJ4C_second_pass_process(me, result_ptr);
+        } else if (me->depth == 0) {
+            break;
+        } else {
+            QAJ4C_Second_pass_frame* frame = &me->stack[me->depth - 1];
+            if (frame->is_object) {
+                QAJ4C_second_pass_continue(me);
+            } else if (QAJ4C_get_internal_type(frame->value_ptr) == QAJ4C_ARRAY_PACKED) {
+                if (!QAJ4C_second_pass_packed_elements(me, frame, budget, start_char)) {
+                    return false;
+                }
+                QAJ4C_second_pass_continue(me);
+            } else {
+                if (!QAJ4C_second_pass_array_elements(me, frame, budget, start_char)) {
+                    return false;
+                }
+                QAJ4C_second_pass_continue(me);
+            }
+        }
+    }
+    return true;
+}
+
 static void QAJ4C_second_pass_process( QAJ4C_Second_pass_parser* me, QAJ4C_Value* result_ptr ) {
     /* skip those stupid whitespaces! */
     me->json_char = QAJ4C_skip_whitespaces_and_comments_second_pass(me->json_char);
@@ -621,132 +1284,387 @@ static void QAJ4C_second_pass_process( QAJ4C_Second_pass_parser* me, QAJ4C_Value
 }
 
 static void QAJ4C_second_pass_object( QAJ4C_Second_pass_parser* me, QAJ4C_Value* result_ptr  ) {
-    size_type elements = QAJ4C_second_pass_fetch_stats_data(me);
-    size_type index;
-    QAJ4C_Member* top;
+    size_type elements = 0;
+
+    me->json_char = QAJ4C_skip_whitespaces_and_comments_second_pass(me->json_char);
+    if (*me->json_char != '}') {
+        elements = QAJ4C_second_pass_fetch_stats_data(me);
+        if (elements & QAJ4C_SHAPED_OBJECT_FLAG) {
+            QAJ4C_second_pass_shaped_object(me, result_ptr, elements & ~QAJ4C_SHAPED_OBJECT_FLAG);
+            return;
+        }
+    }
 
     /*
      * Do not use set_object as it would initialize memory and thus corrupt the buffer
      * that stores string sizes and integer types
      */
-    result_ptr->type = QAJ4C_OBJECT_TYPE_CONSTANT;
-    ((QAJ4C_Object*)result_ptr)->count = elements;
-    ((QAJ4C_Object*)result_ptr)->top = (QAJ4C_Member*)(&me->builder->buffer[me->builder->cur_obj_pos]);
+    QAJ4C_SET_OBJECT(result_ptr, QAJ4C_OBJECT_TYPE_CONSTANT, (QAJ4C_Member*)(&me->builder->buffer[me->builder->cur_obj_pos + QAJ4C_CONTAINER_HEADER_SIZE]), elements);
+    if (elements > 0) {
+        me->builder->cur_obj_pos += QAJ4C_CONTAINER_HEADER_SIZE;
+    }
     me->builder->cur_obj_pos += sizeof(QAJ4C_Member) * elements;
-    top = ((QAJ4C_Object*)result_ptr)->top;
-
-    me->json_char = QAJ4C_skip_whitespaces_and_comments_second_pass(me->json_char);
-    for (index = 0; index < elements; ++index) {
-        if (*me->json_char == ',') {
-            ++me->json_char;
-            me->json_char = QAJ4C_skip_whitespaces_and_comments_second_pass(me->json_char);
+    if (me->index_opts != 0) {
+        size_type index_flags = QAJ4C_object_index_flags(me->index_opts, elements);
+        if (index_flags != 0) {
+            me->builder->cur_obj_pos += QAJ4C_object_index_size(index_flags, elements);
         }
-        ++me->json_char; /* skip the first " */
-        QAJ4C_second_pass_string(me, &top[index].key);
-        me->json_char = QAJ4C_skip_whitespaces_and_comments_second_pass(me->json_char);
-        ++me->json_char; /* skip the : */
-        me->json_char = QAJ4C_skip_whitespaces_and_comments_second_pass(me->json_char);
-
-        QAJ4C_second_pass_process(me, &top[index].value);
-        me->json_char = QAJ4C_skip_whitespaces_and_comments_second_pass(me->json_char);
     }
 
-    while( *me->json_char != '}') {
-        me->json_char += 1;
-        me->json_char = QAJ4C_skip_whitespaces_and_comments_second_pass(me->json_char);
+    QAJ4C_second_pass_push(me, result_ptr, elements, true);
+    if (me->shapes != NULL && elements > 0) {
+        QAJ4C_second_pass_predict_shape(me, &me->stack[me->depth - 1]);
     }
+}
 
-    if (me->optimize_object && elements > 2) {
-        QAJ4C_object_optimize(result_ptr);
-    }
-    ++me->json_char; /* walk over the } */
+/*
+ * The object uses the keys of the previous array element. Its values are stored behind a header
+ * that refers to these keys.
+ */
+static void QAJ4C_second_pass_shaped_object( QAJ4C_Second_pass_parser* me, QAJ4C_Value* result_ptr, size_type elements ) {
+    QAJ4C_Second_pass_frame* parent = &me->stack[me->depth - 1];
+    QAJ4C_Value* reference = &QAJ4C_ARRAY_TOP(parent->value_ptr)[parent->index - 2];
+    QAJ4C_Value* header = (QAJ4C_Value*)(&me->builder->buffer[me->builder->cur_obj_pos]);
+
+    QAJ4C_SET_TYPE_WORD(header, QAJ4C_SHAPE_HEADER_TYPE_CONSTANT);
+    ((QAJ4C_Shape_header*)header)->keys = QAJ4C_object_shape_keys(reference);
+
+    QAJ4C_SET_TYPE_WORD(result_ptr, QAJ4C_OBJECT_SHAPED_TYPE_CONSTANT);
+    ((QAJ4C_Shaped_object*)result_ptr)->count = elements;
+    ((QAJ4C_Shaped_object*)result_ptr)->top = header;
+    me->builder->cur_obj_pos += sizeof(QAJ4C_Value) * (elements + 1);
+
+    QAJ4C_second_pass_push(me, result_ptr, elements, true);
 }
 
 static void QAJ4C_second_pass_array( QAJ4C_Second_pass_parser* me, QAJ4C_Value* result_ptr ) {
-    size_type elements = QAJ4C_second_pass_fetch_stats_data(me);
-    size_type index;
-    QAJ4C_Value* top;
+    size_type elements = 0;
+
+    me->json_char = QAJ4C_skip_whitespaces_and_comments_second_pass(me->json_char);
+    if (*me->json_char != ']') {
+        elements = QAJ4C_second_pass_fetch_stats_data(me);
+        if (elements & QAJ4C_PACKED_ARRAY_FLAG) {
+            QAJ4C_second_pass_packed_array(me, result_ptr, elements & ~QAJ4C_PACKED_ARRAY_FLAG);
+            return;
+        }
+    }
 
     /*
      * Do not use set_array as it would initialize memory and thus corrupt the buffer
      * that stores string sizes and integer types
      */
-    result_ptr->type = QAJ4C_ARRAY_TYPE_CONSTANT;
-    ((QAJ4C_Array*)result_ptr)->count = elements;
-    ((QAJ4C_Array*)result_ptr)->top = (QAJ4C_Value*)(&me->builder->buffer[me->builder->cur_obj_pos]);
-    me->builder->cur_obj_pos += sizeof(QAJ4C_Value) * elements;
-    top = ((QAJ4C_Array*)result_ptr)->top;
-
-    me->json_char = QAJ4C_skip_whitespaces_and_comments_second_pass(me->json_char);
-    for (index = 0; index < elements; index++) {
-        if (*me->json_char == ',') {
-            ++me->json_char;
-            me->json_char = QAJ4C_skip_whitespaces_and_comments_second_pass(
-                    me->json_char);
-        }
-        QAJ4C_second_pass_process(me, &top[index]);
-        me->json_char = QAJ4C_skip_whitespaces_and_comments_second_pass(me->json_char);
+    QAJ4C_SET_ARRAY(result_ptr, QAJ4C_ARRAY_TYPE_CONSTANT, (QAJ4C_Value*)(&me->builder->buffer[me->builder->cur_obj_pos + QAJ4C_CONTAINER_HEADER_SIZE]), elements);
+    if (elements > 0) {
+        me->builder->cur_obj_pos += QAJ4C_CONTAINER_HEADER_SIZE;
     }
+    me->builder->cur_obj_pos += sizeof(QAJ4C_Value) * elements;
 
-    while (*me->json_char != ']') {
-        me->json_char += 1;
-        me->json_char = QAJ4C_skip_whitespaces_and_comments_second_pass(me->json_char);
-    }
-    ++me->json_char; /* walk over the ] */
+    QAJ4C_second_pass_push(me, result_ptr, elements, false);
 }
 
-static void QAJ4C_second_pass_string( QAJ4C_Second_pass_parser* me, QAJ4C_Value* result_ptr  ) {
-    char* base_put_str = NULL;
-    char* put_str = NULL;
-    uintptr_t chars;
-
-    bool check_size = true;
+/*
+ * The array only contains integers or only doubles (the first element tells which). Its elements
+ * are parsed by QAJ4C_second_pass_packed_elements.
+ */
+static void QAJ4C_second_pass_packed_array( QAJ4C_Second_pass_parser* me, QAJ4C_Value* result_ptr, size_type elements ) {
+    uintptr_t tag = QAJ4C_PACKED_INT64_TAG;
+    const char* c = me->json_char;
+
+    while (*c == '-' || *c == '+' || QAJ4C_is_digit(*c)) {
+        ++c;
+    }
+    if (QAJ4C_is_double_separation_char(*c)) {
+        tag = QAJ4C_PACKED_DOUBLE_TAG;
+    }
+
+    QAJ4C_SET_TYPE_WORD(result_ptr, QAJ4C_ARRAY_PACKED_TYPE_CONSTANT | (size_type)(tag << QAJ4C_PACKED_TAG_SHIFT));
+    ((QAJ4C_Packed_array*)result_ptr)->count = elements;
+    ((QAJ4C_Packed_array*)result_ptr)->top = &me->builder->buffer[me->builder->cur_obj_pos];
+    me->builder->cur_obj_pos += sizeof(int64_t) * elements;
+
+    QAJ4C_second_pass_push(me, result_ptr, elements, false);
+}
+
+/*
+ * Parses the remaining elements of a packed array back to back (as long as the budget allows,
+ * returns false in case it has been used up).
+ */
+static bool QAJ4C_second_pass_packed_elements( QAJ4C_Second_pass_parser* me, QAJ4C_Second_pass_frame* frame, QAJ4C_Parse_budget* budget, const char* start_char ) {
+    QAJ4C_Packed_array* array_ptr = (QAJ4C_Packed_array*)frame->value_ptr;
+    bool doubles = QAJ4C_packed_array_tag(frame->value_ptr) == QAJ4C_PACKED_DOUBLE_TAG;
+    QAJ4C_Value number;
+    char* c;
+
+    while (frame->index < frame->elements) {
+        if (QAJ4C_parse_budget_exhausted(budget, me->json_char - start_char)) {
+            return false;
+        }
+        budget->nodes += 1;
+        me->json_char = QAJ4C_skip_whitespaces_and_comments_second_pass(me->json_char);
+        if (*me->json_char == ',') {
+            me->json_char = QAJ4C_skip_whitespaces_and_comments_second_pass(me->json_char + 1);
+        }
+        /* the first pass verified the format (and that the integers fit) */
+        c = (char*)QAJ4C_fast_numeric_value(me->json_char, &number, NULL);
+        if (c != NULL) {
+            ((int64_t*)array_ptr->top)[frame->index] = QAJ4C_PLAIN_PRIMITIVE_DATA(&number).i;
+        } else if (doubles) {
+            ((double*)array_ptr->top)[frame->index] = QAJ4C_STRTOD(me->json_char, &c);
+        } else {
+            ((int64_t*)array_ptr->top)[frame->index] = QAJ4C_STRTOL(me->json_char, &c, 10);
+        }
+        me->json_char = c;
+        frame->index += 1;
+    }
+    return true;
+}
+
+/*
+ * Parses the numbers and strings of the array back to back, without walking through the pending
+ * value and the type dispatch for each of them. Stops at the first other element (it is left to
+ * QAJ4C_second_pass_continue) or in case the budget has been used up (returns false).
+ */
+static bool QAJ4C_second_pass_array_elements( QAJ4C_Second_pass_parser* me, QAJ4C_Second_pass_frame* frame, QAJ4C_Parse_budget* budget, const char* start_char ) {
+    QAJ4C_Value* top = QAJ4C_ARRAY_TOP(frame->value_ptr);
+
+    while (frame->index < frame->elements) {
+        const char* json_char = QAJ4C_skip_whitespaces_and_comments_second_pass(me->json_char);
+        if (*json_char == ',') {
+            json_char = QAJ4C_skip_whitespaces_and_comments_second_pass(json_char + 1);
+        }
+        me->json_char = json_char;
+        if (*json_char != '"' && *json_char != '-' && !QAJ4C_is_digit(*json_char)) {
+            break;
+        }
+        if (QAJ4C_parse_budget_exhausted(budget, json_char - start_char)) {
+            return false;
+        }
+        budget->nodes += 1;
+        if (*json_char == '"') {
+            me->json_char += 1;
+            QAJ4C_second_pass_string(me, &top[frame->index]);
+        } else {
+            QAJ4C_second_pass_numeric_value(me, &top[frame->index]);
+        }
+        frame->index += 1;
+    }
+    return true;
+}
+
+static void QAJ4C_second_pass_push( QAJ4C_Second_pass_parser* me, QAJ4C_Value* value_ptr, size_type elements, bool is_object ) {
+    QAJ4C_Second_pass_frame* frame = &me->stack[me->depth];
+    me->depth++;
+
+    frame->value_ptr = value_ptr;
+    frame->index = 0;
+    frame->elements = elements;
+    frame->path = me->pending_path;
+    frame->first_key = QAJ4C_NO_SHAPE;
+    frame->predicted = false;
+    frame->is_object = is_object;
+}
+
+/*
+ * Walks to the next element of the innermost open object or array (and sets it as pending
+ * value) or closes the object or array in case all elements have been processed.
+ */
+static void QAJ4C_second_pass_continue( QAJ4C_Second_pass_parser* me ) {
+    QAJ4C_Second_pass_frame* frame = &me->stack[me->depth - 1];
+
+    me->json_char = QAJ4C_skip_whitespaces_and_comments_second_pass(me->json_char);
+    if (frame->index < frame->elements) {
+        if (*me->json_char == ',') {
+            ++me->json_char;
+            me->json_char = QAJ4C_skip_whitespaces_and_comments_second_pass(me->json_char);
+        }
+        if (frame->is_object && QAJ4C_get_internal_type(frame->value_ptr) == QAJ4C_OBJECT_SHAPED) {
+            /* the key is known already */
+            me->json_char = QAJ4C_skip_string(me->json_char + 1);
+            me->json_char = QAJ4C_skip_whitespaces_and_comments_second_pass(me->json_char);
+            ++me->json_char; /* skip the : */
+            me->json_char = QAJ4C_skip_whitespaces_and_comments_second_pass(me->json_char);
+            me->pending_value = &((QAJ4C_Shaped_object*)frame->value_ptr)->top[frame->index + 1];
+        } else if (frame->is_object) {
+            QAJ4C_Member* member;
+            ++me->json_char; /* skip the first " */
+            if (frame->first_key != QAJ4C_NO_SHAPE) {
+                member = QAJ4C_second_pass_shape_member(me, frame);
+            } else {
+                member = &QAJ4C_OBJECT_TOP(frame->value_ptr)[frame->index];
+                QAJ4C_second_pass_string(me, &member->key);
+                if (QAJ4C_TYPE_FLAGS_SUPPORTED) {
+                    QAJ4C_set_key_hash(&member->key, QAJ4C_hash_string(QAJ4C_key_string(&member->key), QAJ4C_key_length(&member->key)));
+                }
+            }
+            me->json_char = QAJ4C_skip_whitespaces_and_comments_second_pass(me->json_char);
+            ++me->json_char; /* skip the : */
+            me->json_char = QAJ4C_skip_whitespaces_and_comments_second_pass(me->json_char);
+            me->pending_value = &member->value;
+            if (me->shapes != NULL) {
+                me->pending_path = QAJ4C_shape_path(frame->path, QAJ4C_get_key_hash(&member->key));
+            }
+        } else {
+            me->pending_value = &QAJ4C_ARRAY_TOP(frame->value_ptr)[frame->index];
+            if (me->shapes != NULL) {
+                me->pending_path = QAJ4C_shape_path(frame->path, 0);
+            }
+        }
+        frame->index += 1;
+        return;
+    }
+
+    if (frame->is_object) {
+        while (*me->json_char != '}') {
+            me->json_char += 1;
+            me->json_char = QAJ4C_skip_whitespaces_and_comments_second_pass(me->json_char);
+        }
+        QAJ4C_second_pass_close_object(me, frame);
+        if (me->index_opts != 0) {
+            size_type index_flags = QAJ4C_object_index_flags(me->index_opts, frame->elements);
+            if (index_flags != 0) {
+                QAJ4C_object_index_init(frame->value_ptr, index_flags);
+            }
+        }
+    } else {
+        while (*me->json_char != ']') {
+            me->json_char += 1;
+            me->json_char = QAJ4C_skip_whitespaces_and_comments_second_pass(me->json_char);
+        }
+    }
+    ++me->json_char; /* walk over the } or ] */
+    me->depth--;
+}
+
+/*
+ * Sorts the object (if required) and learns the order of its keys in case it did not match the
+ * learned shape.
+ */
+static void QAJ4C_second_pass_close_object( QAJ4C_Second_pass_parser* me, QAJ4C_Second_pass_frame* frame ) {
+    bool sorted = me->optimize_object && frame->elements >= QAJ4C_SORT_MIN_MEMBERS;
+    uint16_t first_key = QAJ4C_NO_SHAPE;
+
+    if (me->shapes != NULL && frame->elements > 0 && !frame->predicted && QAJ4C_get_internal_type(frame->value_ptr) == QAJ4C_OBJECT) {
+        /* the keys are learned in input order (so before sorting) */
+        first_key = QAJ4C_shape_table_learn_keys(me->shapes, frame);
+    }
+    if (sorted && frame->predicted) {
+        /* all members have been placed at their sorted position already */
+        QAJ4C_SET_TYPE_WORD(frame->value_ptr, QAJ4C_OBJECT_SORTED_TYPE_CONSTANT);
+    } else if (sorted) {
+        QAJ4C_object_optimize(frame->value_ptr);
+    }
+    if (first_key != QAJ4C_NO_SHAPE) {
+        QAJ4C_shape_table_learn_slots(me->shapes, frame, first_key, sorted);
+    }
+}
+
+/*
+ * Expects the keys of the object in the order of the shape learned for its path, in case the
+ * shape has the same amount of members and the object is sorted the same way.
+ */
+static void QAJ4C_second_pass_predict_shape( QAJ4C_Second_pass_parser* me, QAJ4C_Second_pass_frame* frame ) {
+    QAJ4C_Learned_shape* shape = QAJ4C_shape_table_find(me->shapes, frame->path, false);
+    bool sorted = me->optimize_object && frame->elements >= QAJ4C_SORT_MIN_MEMBERS;
+
+    if (shape != NULL && shape->count == frame->elements && shape->sorted == sorted) {
+        frame->first_key = shape->first_key;
+        frame->predicted = true;
+    }
+}
+
+/*
+ * Parses the next key of an object with a learned shape. The member is placed at the slot of the
+ * expected key, also in case the key does not match (the remaining slots are still free and the
+ * object will be sorted when it is closed).
+ */
+static QAJ4C_Member* QAJ4C_second_pass_shape_member( QAJ4C_Second_pass_parser* me, QAJ4C_Second_pass_frame* frame ) {
+    const QAJ4C_Learned_key* key = &me->shapes->keys[frame->first_key + frame->index];
+    QAJ4C_Member* member = &QAJ4C_OBJECT_TOP(frame->value_ptr)[key->slot];
+
+    if (frame->predicted && me->json_char + key->length < me->json_end
+            && QAJ4C_MEMCMP(me->json_char, &me->shapes->pool[key->offset], key->length) == 0
+            && me->json_char[key->length] == '"') {
+        QAJ4C_second_pass_known_key(me, &member->key, key->length);
+        QAJ4C_SET_TYPE_WORD(&member->key, QAJ4C_TYPE_WORD(&member->key) | (size_type)key->hash << QAJ4C_KEY_HASH_SHIFT);
+    } else {
+        frame->predicted = false;
+        QAJ4C_second_pass_string(me, &member->key);
+        QAJ4C_set_key_hash(&member->key, QAJ4C_hash_string(QAJ4C_key_string(&member->key), QAJ4C_key_length(&member->key)));
+    }
+    return member;
+}
+
+/*
+ * Stores the key that matched a learned key. It contains no escape sequences, so the json text
+ * is the content of the string.
+ */
+static void QAJ4C_second_pass_known_key( QAJ4C_Second_pass_parser* me, QAJ4C_Value* result_ptr, size_type len ) {
+    char* put_str;
 
     if (me->insitu_parsing) {
-        result_ptr->type = QAJ4C_STRING_REF_TYPE_CONSTANT;
-        ((QAJ4C_String*)result_ptr)->s = me->json_char;
         put_str = (char*)me->json_char;
-        check_size = false;
+        put_str[len] = '\0';
+        QAJ4C_SET_STRING(result_ptr, QAJ4C_STRING_REF_TYPE_CONSTANT, put_str, len);
+    } else if (len <= QAJ4C_INLINE_STRING_SIZE) {
+        QAJ4C_SET_INLINE_STRING(result_ptr, me->json_char, len);
     } else {
-        result_ptr->type = QAJ4C_INLINE_STRING_TYPE_CONSTANT;
-        put_str = ((QAJ4C_Short_string*)result_ptr)->s;
+        put_str = (char*)&me->builder->buffer[me->builder->cur_str_pos + QAJ4C_STRING_HEADER_SIZE];
+        QAJ4C_MEMCPY(put_str, me->json_char, len);
+        put_str[len] = '\0';
+        QAJ4C_SET_STRING(result_ptr, QAJ4C_STRING_TYPE_CONSTANT, put_str, len);
+        me->builder->cur_str_pos += QAJ4C_STRING_HEADER_SIZE + len + 1;
     }
+    me->json_char += len + 1; /* also skip the closing " */
+}
 
-    base_put_str = put_str;
+/*
+ * Short strings are collected on the stack first and inlined into the value, the others are
+ * moved to the string storage once they exceed the inline size (in situ parsing references the
+ * json instead). Compact values can neither inline nor reference strings with an escaped \0.
+ */
+static void QAJ4C_second_pass_string( QAJ4C_Second_pass_parser* me, QAJ4C_Value* result_ptr  ) {
+    char short_str[QAJ4C_INLINE_STRING_SIZE + 4]; /* an escape sequence writes up to 4 chars */
+    char* storage;
+    char* base_put_str = me->insitu_parsing ? (char*)me->json_char : short_str;
+    char* put_str = base_put_str;
+    bool embedded_nul = false;
+    size_type chars;
 
     while (*me->json_char != '"') {
         if (*me->json_char == '\\') {
             put_str = QAJ4C_second_pass_string_escape_sequence(me, put_str);
+            embedded_nul |= *put_str == '\0';
         } else {
             *put_str = *me->json_char;
         }
         put_str += 1;
         me->json_char += 1;
 
-        if (check_size) {
-            chars = put_str - base_put_str;
-            if (chars > QAJ4C_INLINE_STRING_SIZE) {
-                put_str = (char*)&me->builder->buffer[me->builder->cur_str_pos];
-                /* copy over to normal string */
-                QAJ4C_MEMCPY(put_str, base_put_str, chars * sizeof(char));
-                result_ptr->type = QAJ4C_STRING_TYPE_CONSTANT;
-                ((QAJ4C_String*)result_ptr)->s = put_str;
-                base_put_str = put_str;
-                put_str += chars;
-                check_size = false; /* now the copy has been performed, stop checking the length! */
-            }
+        if (base_put_str == short_str && (size_t)(put_str - short_str) > QAJ4C_INLINE_STRING_SIZE) {
+            /* copy over to normal string */
+            storage = (char*)&me->builder->buffer[me->builder->cur_str_pos + QAJ4C_STRING_HEADER_SIZE];
+            chars = put_str - short_str;
+            QAJ4C_MEMCPY(storage, short_str, chars * sizeof(char));
+            base_put_str = storage;
+            put_str = storage + chars;
         }
     }
     *put_str = '\0';
     me->json_char += 1;
     chars = put_str - base_put_str;
-    if (QAJ4C_get_internal_type(result_ptr) == QAJ4C_INLINE_STRING) {
-        ((QAJ4C_Short_string*)result_ptr)->count = chars;
+    embedded_nul = embedded_nul && QAJ4C_STRING_HEADER_SIZE > 0;
+
+    if (base_put_str == short_str && !embedded_nul) {
+        QAJ4C_SET_INLINE_STRING(result_ptr, short_str, chars);
+    } else if (me->insitu_parsing && !embedded_nul) {
+        QAJ4C_SET_STRING(result_ptr, QAJ4C_STRING_REF_TYPE_CONSTANT, base_put_str, chars);
     } else {
-        ((QAJ4C_String*)result_ptr)->count = chars;
-        if (!me->insitu_parsing) {
-            me->builder->cur_str_pos += chars + 1;
+        storage = (char*)&me->builder->buffer[me->builder->cur_str_pos + QAJ4C_STRING_HEADER_SIZE];
+        if (base_put_str != storage) {
+            QAJ4C_MEMCPY(storage, base_put_str, (chars + 1) * sizeof(char));
         }
+        QAJ4C_SET_STRING(result_ptr, QAJ4C_STRING_TYPE_CONSTANT, storage, chars);
+        me->builder->cur_str_pos += QAJ4C_STRING_HEADER_SIZE + chars + 1;
     }
 }
 
@@ -841,21 +1759,25 @@ static uint32_t QAJ4C_second_pass_utf16( QAJ4C_Second_pass_parser* me ) {
 }
 
 static void QAJ4C_second_pass_numeric_value( QAJ4C_Second_pass_parser* me, QAJ4C_Value* result_ptr ) {
-    char* c = (char*)me->json_char;
+    char* c = (char*)QAJ4C_fast_numeric_value(me->json_char, result_ptr, me->builder);
     bool double_value = false;
+    if (c != NULL) {
+        me->json_char = c;
+        return;
+    }
     if (*me->json_char == '-') {
         int64_t i = QAJ4C_STRTOL(me->json_char, &c, 10);
         if (QAJ4C_is_double_separation_char(*c) || ((i == INT64_MAX || i == INT64_MIN) && errno == ERANGE)) {
             double_value = true;
         } else {
-            QAJ4C_set_int64(result_ptr, i);
+            QAJ4C_set_int64_impl(result_ptr, i, me->builder);
         }
     } else {
         uint64_t i = QAJ4C_STRTOUL(me->json_char, &c, 10);
         if (QAJ4C_is_double_separation_char(*c) || (i == UINT64_MAX && errno == ERANGE)) {
             double_value = true;
         } else {
-            QAJ4C_set_uint64(result_ptr, i);
+            QAJ4C_set_uint64_impl(result_ptr, i, me->builder);
         }
 
     }
@@ -865,19 +1787,99 @@ static void QAJ4C_second_pass_numeric_value( QAJ4C_Second_pass_parser* me, QAJ4C
     me->json_char = c;
 }
 
-static size_type QAJ4C_second_pass_fetch_stats_data( QAJ4C_Second_pass_parser* me ) {
-    if (QAJ4C_UNLIKELY(me->curr_buffer_pos <= me->builder->cur_obj_pos - sizeof(size_type))) {
-        /*
-         * Corner case that the last entry is empty. In some cases this causes that
-         * the statistics are already overwritten (see Corner-case tests)
-         */
-        return 0;
+/*
+ * Converts numbers with up to 18 digits without the C library. Integers are exact anyway, doubles
+ * are only converted in case mantissa and power of ten are exact doubles (so the single
+ * multiplication or division rounds correctly). Returns NULL in all other cases. The builder
+ * stores the large integers of compact values.
+ */
+static const char* QAJ4C_fast_numeric_value( const char* json_char, QAJ4C_Value* result_ptr, QAJ4C_Builder* builder ) {
+    static const double powers_of_ten[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    const char* c = json_char;
+    bool negative = *c == '-';
+    bool double_value = false;
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    double d;
+
+    if (negative || *c == '+') {
+        ++c;
+    }
+    for (; QAJ4C_is_digit(*c); ++c, ++digits) {
+        mantissa = mantissa * 10 + (uint64_t)(*c - '0');
+    }
+    if (*c == '.') {
+        double_value = true;
+        for (++c; QAJ4C_is_digit(*c); ++c, ++digits, --exponent) {
+            mantissa = mantissa * 10 + (uint64_t)(*c - '0');
+        }
+    }
+    if (*c == 'e' || *c == 'E') {
+        bool negative_exponent;
+        int exponent_value = 0;
+        double_value = true;
+        ++c;
+        negative_exponent = *c == '-';
+        if (negative_exponent || *c == '+') {
+            ++c;
+        }
+        for (; QAJ4C_is_digit(*c); ++c) {
+            if (exponent_value < 1000) {
+                exponent_value = exponent_value * 10 + (*c - '0');
+            }
+        }
+        exponent += negative_exponent ? -exponent_value : exponent_value;
+    }
+
+    if (digits > QAJ4C_PACK_MAX_DIGITS) {
+        return NULL;
+    }
+    if (!double_value) {
+        if (negative) {
+            QAJ4C_set_int64_impl(result_ptr, -(int64_t)mantissa, builder);
+        } else {
+            QAJ4C_set_uint64_impl(result_ptr, mantissa, builder);
+        }
+        return c;
+    }
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+    if (mantissa > ((uint64_t)1 << DBL_MANT_DIG) || exponent < -22 || exponent > 22) {
+        return NULL;
     }
+    d = (double)mantissa;
+    d = exponent < 0 ? d / powers_of_ten[-exponent] : d * powers_of_ten[exponent];
+    QAJ4C_set_double(result_ptr, negative ? -d : d);
+    return c;
+#else
+    /* excess precision would round twice */
+    (void)powers_of_ten;
+    (void)d;
+    return NULL;
+#endif
+}
+
+static size_type QAJ4C_second_pass_fetch_stats_data( QAJ4C_Second_pass_parser* me ) {
     size_type data = *((size_type*)(me->builder->buffer + me->curr_buffer_pos));
     me->curr_buffer_pos += sizeof(size_type);
     return data;
 }
 
+/*
+ * Messages beyond the size_type range are cut, parsing them fails with
+ * QAJ4C_ERROR_DOCUMENT_SIZE_EXCEEDED once the end of the range is reached (a length of SIZE_MAX
+ * for null terminated messages is cut as well but stops at the \0).
+ */
+static void QAJ4C_json_message_init( QAJ4C_Json_message* msg, const char* json, size_t json_len ) {
+    msg->json = json;
+    /* one position is kept free, as reading the end of the message still moves the position */
+    msg->json_len = json_len < QAJ4C_SIZE_TYPE_MAX - 1 ? (size_type)json_len : QAJ4C_SIZE_TYPE_MAX - 1;
+    msg->json_pos = 0;
+}
+
 static char QAJ4C_json_message_peek( QAJ4C_Json_message* msg ) {
     /* Also very unlikely to happen (only in case json is invalid) */
     return QAJ4C_UNLIKELY(msg->json_pos >= msg->json_len) ? '\0' : msg->json[msg->json_pos];
@@ -964,6 +1966,54 @@ static const char* QAJ4C_skip_whitespaces_and_comments_second_pass( const char*
     return c_ptr;
 }
 
+/* Skips the (already validated) string that starts behind the opening " */
+static const char* QAJ4C_skip_string( const char* json ) {
+    while (*json != '"') {
+        if (*json == '\\') {
+            ++json;
+        }
+        ++json;
+    }
+    return json + 1;
+}
+
+/* Skips the (already validated) value that follows at the given position */
+static const char* QAJ4C_skip_value( const char* json ) {
+    size_type depth = 0;
+    json = QAJ4C_skip_whitespaces_and_comments_second_pass(json);
+    do {
+        switch (*json) {
+        case '"':
+            json = QAJ4C_skip_string(json + 1);
+            break;
+        case '{':
+        case '[':
+            ++depth;
+            ++json;
+            break;
+        case '}':
+        case ']':
+            --depth;
+            ++json;
+            break;
+        case '/':
+            json = QAJ4C_skip_whitespaces_and_comments_second_pass(json);
+            break;
+        default:
+            if (depth == 0) {
+                /* primitive value on top level */
+                while (*json > 0x20 && *json != ',' && *json != '}' && *json != ']' && *json != '/') {
+                    ++json;
+                }
+            } else {
+                ++json;
+            }
+            break;
+        }
+    } while (depth > 0);
+    return json;
+}
+
 static QAJ4C_Value* QAJ4C_create_error_description( QAJ4C_First_pass_parser* parser ) {
     QAJ4C_Value* document;
     QAJ4C_Error_information* err_info;
@@ -974,7 +2024,6 @@ static QAJ4C_Value* QAJ4C_create_error_description( QAJ4C_First_pass_parser* par
 
     QAJ4C_builder_init(parser->builder, parser->builder->buffer, parser->builder->buffer_size);
     document = QAJ4C_builder_get_document(parser->builder);
-    document->type = QAJ4C_ERROR_DESCRIPTION_TYPE_CONSTANT;
 
     err_info = (QAJ4C_Error_information*)(parser->builder->buffer + sizeof(QAJ4C_Value));
     err_info->err_no = parser->err_code;
@@ -982,7 +2031,7 @@ static QAJ4C_Value* QAJ4C_create_error_description( QAJ4C_First_pass_parser* par
     err_info->json_pos = parser->msg->json_len;
 
     parser->builder->cur_obj_pos = sizeof(QAJ4C_Value) + sizeof(QAJ4C_Error_information);
-    ((QAJ4C_Error*)document)->info = err_info;
+    QAJ4C_SET_ERROR(document, err_info);
 
     return document;
 }
@@ -993,25 +2042,124 @@ static size_type* QAJ4C_first_pass_fetch_stats_buffer( QAJ4C_First_pass_parser*
     if (in_buffer_pos + sizeof(size_type) > builder->buffer_size) {
         void *tmp;
         size_t required_size = QAJ4C_calculate_max_buffer_parser(parser);
-        if (parser->realloc_callback == NULL) {
+        if (parser->grow_buffer) {
+            required_size = QAJ4C_MAX(required_size, builder->buffer_size * 2);
+        }
+        if (parser->allocator == NULL) {
             QAJ4C_first_pass_parser_set_error(parser,
                                               QAJ4C_ERROR_STORAGE_BUFFER_TO_SMALL);
             return NULL;
         }
 
-        tmp = parser->realloc_callback(builder->buffer, required_size);
+        tmp = QAJ4C_allocator_realloc(parser->allocator, builder->buffer, required_size);
         if (tmp == NULL) {
             QAJ4C_first_pass_parser_set_error(parser, QAJ4C_ERROR_ALLOCATION_ERROR);
             return NULL;
         }
         builder->buffer = tmp;
         builder->buffer_size = required_size;
+        parser->buffer_capacity = required_size;
     }
     return (size_type*)&builder->buffer[in_buffer_pos];
 }
 
 static bool QAJ4C_builder_validate_buffer( QAJ4C_Builder* builder ) {
-    return builder->cur_obj_pos - 1 <= builder->cur_str_pos;
+    return builder->cur_obj_pos <= builder->cur_str_pos + 1;
+}
+
+/*
+ * Continues a growing builder in a new chunk that has room for at least size bytes (the rest
+ * of the current chunk is wasted). The first chunk starts with the document and has the size
+ * that is held by buffer_size until it is allocated. Returns false in case the builder has a
+ * fixed buffer or the allocation failed.
+ */
+bool QAJ4C_builder_add_chunk( QAJ4C_Builder* builder, size_t size ) {
+    QAJ4C_Builder_chunk* chunk;
+    size_t reserved = builder->chunks == NULL ? sizeof(QAJ4C_Value) : 0;
+    if (builder->allocator.alloc_fn == NULL) {
+        return false;
+    }
+    if (builder->chunks == NULL) {
+        size = QAJ4C_MAX(builder->buffer_size, size + reserved);
+    } else {
+        size = QAJ4C_MAX(builder->buffer_size * 2, size);
+    }
+    chunk = builder->allocator.alloc_fn(builder->allocator.ctx, sizeof(QAJ4C_Builder_chunk) + size, QAJ4C_ALLOC_ALIGNMENT);
+    if (chunk == NULL) {
+        return false;
+    }
+    chunk->next = NULL;
+    chunk->size = size;
+    if (builder->chunks == NULL) {
+        builder->chunks = chunk;
+    } else {
+        ((QAJ4C_Builder_chunk*)builder->buffer - 1)->next = chunk;
+    }
+    builder->buffer = (uint8_t*)(chunk + 1);
+    builder->buffer_size = size;
+    builder->cur_obj_pos = reserved;
+    builder->cur_str_pos = size;
+    return true;
+}
+
+/*
+ * Releases the chunks of a growing builder. In case the first chunk is kept, the builder
+ * starts over with it.
+ */
+void QAJ4C_builder_free_chunks( QAJ4C_Builder* builder, bool keep_first ) {
+    QAJ4C_Builder_chunk* chunk = builder->chunks;
+    QAJ4C_Builder_chunk* next;
+    if (chunk == NULL) {
+        return;
+    }
+    next = chunk->next;
+    if (keep_first) {
+        chunk->next = NULL;
+        builder->buffer = (uint8_t*)(chunk + 1);
+        builder->buffer_size = chunk->size;
+        builder->cur_str_pos = chunk->size;
+    } else {
+        /* a reset will allocate the first chunk with the same size again */
+        builder->buffer_size = chunk->size;
+        builder->allocator.free_fn(builder->allocator.ctx, chunk);
+        builder->chunks = NULL;
+        builder->buffer = NULL;
+        builder->cur_str_pos = 0;
+    }
+    builder->cur_obj_pos = sizeof(QAJ4C_Value);
+    while (next != NULL) {
+        chunk = next;
+        next = chunk->next;
+        builder->allocator.free_fn(builder->allocator.ctx, chunk);
+    }
+}
+
+/*
+ * Takes size bytes from the object end of the buffer (a growing builder continues in a new
+ * chunk in case the current one is exhausted). Returns NULL in case there is no room left.
+ */
+static uint8_t* QAJ4C_builder_pop_objects( QAJ4C_Builder* builder, size_t size ) {
+    uint8_t* result = &builder->buffer[builder->cur_obj_pos];
+    builder->cur_obj_pos += size;
+    if (QAJ4C_UNLIKELY(!QAJ4C_builder_validate_buffer(builder))) {
+        builder->cur_obj_pos -= size;
+        QAJ4C_ASSERT(QAJ4C_builder_add_chunk(builder, size), {return NULL;});
+        result = &builder->buffer[builder->cur_obj_pos];
+        builder->cur_obj_pos += size;
+    }
+    return result;
+}
+
+/*
+ * Takes the elements of an array or object (behind the header of compact values, which is
+ * filled in by QAJ4C_SET_ARRAY and QAJ4C_SET_OBJECT).
+ */
+static void* QAJ4C_builder_pop_elements( QAJ4C_Builder* builder, size_type count, size_t element_size ) {
+    uint8_t* elements = QAJ4C_builder_pop_objects(builder, QAJ4C_CONTAINER_HEADER_SIZE + count * element_size);
+    if (elements == NULL) {
+        return NULL;
+    }
+    return elements + QAJ4C_CONTAINER_HEADER_SIZE;
 }
 
 QAJ4C_Value* QAJ4C_builder_pop_values( QAJ4C_Builder* builder, size_type count ) {
@@ -1020,21 +2168,109 @@ QAJ4C_Value* QAJ4C_builder_pop_values( QAJ4C_Builder* builder, size_type count )
     if (count == 0) {
         return NULL;
     }
-    new_pointer = (QAJ4C_Value*)(&builder->buffer[builder->cur_obj_pos]);
-    builder->cur_obj_pos += count * sizeof(QAJ4C_Value);
-
-    QAJ4C_ASSERT(QAJ4C_builder_validate_buffer(builder), {return NULL;});
+    new_pointer = (QAJ4C_Value*)QAJ4C_builder_pop_elements(builder, count, sizeof(QAJ4C_Value));
+    if (new_pointer == NULL) {
+        return NULL;
+    }
 
     for (i = 0; i < count; i++) {
-        (new_pointer + i)->type = QAJ4C_NULL_TYPE_CONSTANT;
+        QAJ4C_set_null(new_pointer + i);
     }
     return new_pointer;
 }
 
+/*
+ * Creates a packed array on the builder (the elements are 8 bytes each, so both kinds of values
+ * are copied as they are).
+ */
+void QAJ4C_set_packed_array( QAJ4C_Value* value_ptr, const void* values, size_type count, uintptr_t tag, QAJ4C_Builder* builder ) {
+    QAJ4C_Packed_array* array_ptr = (QAJ4C_Packed_array*)value_ptr;
+    void* top = QAJ4C_builder_pop_objects(builder, count * sizeof(int64_t));
+
+    if (top == NULL) {
+        QAJ4C_set_array(value_ptr, 0, builder);
+        return;
+    }
+    QAJ4C_MEMCPY(top, values, count * sizeof(int64_t));
+    QAJ4C_SET_TYPE_WORD(value_ptr, QAJ4C_ARRAY_PACKED_TYPE_CONSTANT | (size_type)(tag << QAJ4C_PACKED_TAG_SHIFT));
+    array_ptr->top = top;
+    array_ptr->count = count;
+}
+
+/*
+ * Allocates the elements of a growable array or object behind a header that stores the
+ * capacity. Returns the first element (or NULL in case the buffer is too small).
+ */
+void* QAJ4C_builder_pop_growable( QAJ4C_Builder* builder, size_type capacity, size_t element_size ) {
+    QAJ4C_Growable_header* header;
+
+#ifdef QAJ4C_COMPACT_VALUES
+    /* a capacity of 0 marks the compact arrays and objects that are not growable */
+    capacity = QAJ4C_MAX(capacity, 1);
+#endif
+    header = (QAJ4C_Growable_header*)QAJ4C_builder_pop_objects(builder, sizeof(QAJ4C_Growable_header) + capacity * element_size);
+    if (header == NULL) {
+        return NULL;
+    }
+    header->capacity = capacity;
+    return header + 1;
+}
+
+/*
+ * Makes room for at least one more element (count has reached the capacity). The elements are
+ * extended in place in case they have been the last allocation on the builder and there is
+ * room left, else they are moved behind the last allocation (the old memory is wasted).
+ * Returns the elements or NULL in case the buffer is too small.
+ */
+void* QAJ4C_builder_grow( QAJ4C_Builder* builder, void* top, size_type count, size_t element_size ) {
+    QAJ4C_Growable_header* header = (QAJ4C_Growable_header*)top - 1;
+    size_type capacity = QAJ4C_MAX(header->capacity * 2, QAJ4C_GROWABLE_MIN_CAPACITY);
+    uint8_t* end = (uint8_t*)top + header->capacity * element_size;
+    void* result;
+
+    if (end == &builder->buffer[builder->cur_obj_pos]) {
+        size_t size = (capacity - header->capacity) * element_size;
+        builder->cur_obj_pos += size;
+        if (QAJ4C_builder_validate_buffer(builder)) {
+            header->capacity = capacity;
+            return top;
+        }
+        builder->cur_obj_pos -= size;
+    }
+    result = QAJ4C_builder_pop_growable(builder, capacity, element_size);
+    if (result != NULL) {
+        QAJ4C_MEMCPY(result, top, count * element_size);
+    }
+    return result;
+}
+
+/*
+ * Appends a member (key and value are null) to the growable object, which is not sorted anymore.
+ */
+QAJ4C_Member* QAJ4C_object_append_member( QAJ4C_Value* value_ptr, QAJ4C_Builder* builder ) {
+    QAJ4C_Member* top;
+    size_type count;
+
+    QAJ4C_ASSERT(QAJ4C_is_object(value_ptr) && (QAJ4C_TYPE_WORD(value_ptr) & QAJ4C_GROWABLE_FLAG) != 0, {return NULL;});
+    top = QAJ4C_OBJECT_TOP(value_ptr);
+    count = QAJ4C_OBJECT_COUNT(value_ptr);
+    if (count == ((QAJ4C_Growable_header*)top - 1)->capacity) {
+        top = QAJ4C_builder_grow(builder, top, count, sizeof(QAJ4C_Member));
+        if (top == NULL) {
+            return NULL;
+        }
+    }
+    QAJ4C_set_null(&top[count].key);
+    QAJ4C_set_null(&top[count].value);
+    QAJ4C_SET_OBJECT(value_ptr, QAJ4C_OBJECT_TYPE_CONSTANT | QAJ4C_GROWABLE_FLAG, top, count + 1);
+    return &top[count];
+}
+
 char* QAJ4C_builder_pop_string( QAJ4C_Builder* builder, size_type length ) {
-    QAJ4C_ASSERT(builder->cur_str_pos >= length * sizeof(char), {return NULL;});
+    if (QAJ4C_UNLIKELY(builder->cur_str_pos < length * sizeof(char) || builder->cur_str_pos - length * sizeof(char) + 1 < builder->cur_obj_pos)) {
+        QAJ4C_ASSERT(QAJ4C_builder_add_chunk(builder, length * sizeof(char)), {return NULL;});
+    }
     builder->cur_str_pos -= length * sizeof(char);
-    QAJ4C_ASSERT(QAJ4C_builder_validate_buffer(builder), {return NULL;});
     return (char*)(&builder->buffer[builder->cur_str_pos]);
 }
 
@@ -1044,72 +2280,1418 @@ QAJ4C_Member* QAJ4C_builder_pop_members( QAJ4C_Builder* builder, size_type count
     if (count == 0) {
         return NULL;
     }
-    new_pointer = (QAJ4C_Member*)(&builder->buffer[builder->cur_obj_pos]);
-    builder->cur_obj_pos += count * sizeof(QAJ4C_Member);
-    QAJ4C_ASSERT(QAJ4C_builder_validate_buffer(builder), {return NULL;});
+    new_pointer = (QAJ4C_Member*)QAJ4C_builder_pop_elements(builder, count, sizeof(QAJ4C_Member));
+    if (new_pointer == NULL) {
+        return NULL;
+    }
 
     for (i = 0; i < count; i++) {
-        new_pointer[i].key.type = QAJ4C_NULL_TYPE_CONSTANT;
-        new_pointer[i].value.type = QAJ4C_NULL_TYPE_CONSTANT;
+        QAJ4C_set_null(&new_pointer[i].key);
+        QAJ4C_set_null(&new_pointer[i].value);
     }
 
     return new_pointer;
 }
 
-QAJ4C_INTERNAL_TYPE QAJ4C_get_internal_type( const QAJ4C_Value* value_ptr ) {
-    if (value_ptr == NULL) {
-        return QAJ4C_NULL;
+#ifdef QAJ4C_COMPACT_VALUES
+/*
+ * Integers that do not fit into the payload are stored on the builder (without a builder, e.g.
+ * QAJ4C_set_int64, the value falls back to the nearest double).
+ */
+static void QAJ4C_compact_set_big_int( QAJ4C_Value* value_ptr, uint64_t value, bool is_unsigned, QAJ4C_Builder* builder ) {
+    double fallback = is_unsigned ? (double)value : (double)(int64_t)value;
+    uint8_t* storage;
+
+    QAJ4C_ASSERT(builder != NULL, {QAJ4C_set_double(value_ptr, fallback); return;});
+    storage = QAJ4C_builder_pop_objects(builder, sizeof(uint64_t));
+    if (storage == NULL) {
+        QAJ4C_set_double(value_ptr, fallback);
+        return;
     }
-    return (value_ptr->type >> 8) & 0xFF;
+    QAJ4C_MEMCPY(storage, &value, sizeof(uint64_t));
+    value_ptr->bits = QAJ4C_COMPACT_BOX(QAJ4C_COMPACT_TAG_BIG_INT, (uintptr_t)storage | (is_unsigned ? 1 : 0));
 }
+#endif
 
-uint8_t QAJ4C_get_compatibility_types( const QAJ4C_Value* value_ptr ) {
-    return (value_ptr->type >> 16) & 0xFF;
+void QAJ4C_set_int64_impl( QAJ4C_Value* value_ptr, int64_t value, QAJ4C_Builder* builder ) {
+#ifdef QAJ4C_COMPACT_VALUES
+    if (value >= QAJ4C_COMPACT_INT_MIN && value <= QAJ4C_COMPACT_INT_MAX) {
+        value_ptr->bits = QAJ4C_COMPACT_BOX(QAJ4C_COMPACT_TAG_INT, (uint64_t)value & QAJ4C_COMPACT_PAYLOAD_MASK);
+    } else {
+        QAJ4C_compact_set_big_int(value_ptr, (uint64_t)value, false, builder);
+    }
+#else
+    (void)builder;
+    value_ptr->type = QAJ4C_int64_type_constant(value);
+    ((QAJ4C_Primitive*) value_ptr)->data.i = value;
+#endif
 }
 
-uint8_t QAJ4C_get_storage_type( const QAJ4C_Value* value_ptr ) {
-    return (value_ptr->type >> 24) & 0xFF;
+void QAJ4C_set_uint64_impl( QAJ4C_Value* value_ptr, uint64_t value, QAJ4C_Builder* builder ) {
+#ifdef QAJ4C_COMPACT_VALUES
+    if (value <= (uint64_t)QAJ4C_COMPACT_INT_MAX) {
+        value_ptr->bits = QAJ4C_COMPACT_BOX(QAJ4C_COMPACT_TAG_INT, value);
+    } else {
+        QAJ4C_compact_set_big_int(value_ptr, value, true, builder);
+    }
+#else
+    (void)builder;
+    value_ptr->type = QAJ4C_uint64_type_constant(value);
+    ((QAJ4C_Primitive*) value_ptr)->data.u = value;
+#endif
 }
 
-const QAJ4C_Value* QAJ4C_object_get_unsorted( QAJ4C_Object* obj_ptr, QAJ4C_Value* str_ptr ) {
-    QAJ4C_Member* entry;
-    size_type i;
-    for (i = 0; i < obj_ptr->count; ++i) {
-        entry = obj_ptr->top + i;
-        if (!QAJ4C_is_null(&entry->key) && QAJ4C_strcmp(str_ptr, &entry->key) == 0) {
-            return &entry->value;
-        }
+#ifdef QAJ4C_COMPACT_VALUES
+/*
+ * Empty arrays and objects that are not growable share this header (it is never written, as the
+ * count of an empty array or object only changes once it is growable).
+ */
+static const QAJ4C_Growable_header QAJ4C_COMPACT_EMPTY_HEADER = {0, 0};
+
+#define QAJ4C_COMPACT_PAYLOAD(value_ptr) ((value_ptr)->bits & QAJ4C_COMPACT_PAYLOAD_MASK)
+
+static uint64_t QAJ4C_compact_kind( size_type type_word ) {
+    switch ((type_word >> 8) & 0xFF) {
+    case QAJ4C_ARRAY:
+        return QAJ4C_COMPACT_KIND_ARRAY;
+    case QAJ4C_OBJECT:
+        return QAJ4C_COMPACT_KIND_OBJECT;
+    case QAJ4C_OBJECT_SORTED:
+        return QAJ4C_COMPACT_KIND_OBJECT_SORTED;
+    default:
+        return QAJ4C_COMPACT_KIND_ERROR;
     }
-    return NULL;
 }
 
-const QAJ4C_Value* QAJ4C_object_get_sorted( QAJ4C_Object* obj_ptr, QAJ4C_Value* str_ptr ) {
-    QAJ4C_Member* result;
-    QAJ4C_Member member;
-    member.key = *str_ptr;
-    result = QAJ4C_BSEARCH(&member, obj_ptr->top, obj_ptr->count, sizeof(QAJ4C_Member), QAJ4C_compare_members);
-    if (result != NULL) {
-        return &result->value;
+#define QAJ4C_COMPACT_TYPES_OF_TAG(a, b, c, d) a, b, c, d
+
+/* Indexed by QAJ4C_COMPACT_TYPE_INDEX (tag 0 is no boxed value) */
+const uint8_t QAJ4C_compact_types[32] = {
+    QAJ4C_COMPACT_TYPES_OF_TAG(QAJ4C_TYPE_NUMBER, QAJ4C_TYPE_NUMBER, QAJ4C_TYPE_NUMBER, QAJ4C_TYPE_NUMBER),
+    QAJ4C_COMPACT_TYPES_OF_TAG(QAJ4C_TYPE_NULL, QAJ4C_TYPE_BOOL, QAJ4C_TYPE_BOOL, QAJ4C_TYPE_NULL),
+    QAJ4C_COMPACT_TYPES_OF_TAG(QAJ4C_TYPE_NUMBER, QAJ4C_TYPE_NUMBER, QAJ4C_TYPE_NUMBER, QAJ4C_TYPE_NUMBER),
+    QAJ4C_COMPACT_TYPES_OF_TAG(QAJ4C_TYPE_NUMBER, QAJ4C_TYPE_NUMBER, QAJ4C_TYPE_NUMBER, QAJ4C_TYPE_NUMBER),
+    QAJ4C_COMPACT_TYPES_OF_TAG(QAJ4C_TYPE_STRING, QAJ4C_TYPE_STRING, QAJ4C_TYPE_STRING, QAJ4C_TYPE_STRING),
+    QAJ4C_COMPACT_TYPES_OF_TAG(QAJ4C_TYPE_STRING, QAJ4C_TYPE_STRING, QAJ4C_TYPE_STRING, QAJ4C_TYPE_STRING),
+    QAJ4C_COMPACT_TYPES_OF_TAG(QAJ4C_TYPE_STRING, QAJ4C_TYPE_STRING, QAJ4C_TYPE_STRING, QAJ4C_TYPE_STRING),
+    QAJ4C_COMPACT_TYPES_OF_TAG(QAJ4C_TYPE_ARRAY, QAJ4C_TYPE_OBJECT, QAJ4C_TYPE_OBJECT, QAJ4C_TYPE_INVALID)
+};
+
+const uint8_t QAJ4C_compact_internal_types[32] = {
+    QAJ4C_COMPACT_TYPES_OF_TAG(QAJ4C_PRIMITIVE, QAJ4C_PRIMITIVE, QAJ4C_PRIMITIVE, QAJ4C_PRIMITIVE),
+    QAJ4C_COMPACT_TYPES_OF_TAG(QAJ4C_NULL, QAJ4C_PRIMITIVE, QAJ4C_PRIMITIVE, QAJ4C_NULL),
+    QAJ4C_COMPACT_TYPES_OF_TAG(QAJ4C_PRIMITIVE, QAJ4C_PRIMITIVE, QAJ4C_PRIMITIVE, QAJ4C_PRIMITIVE),
+    QAJ4C_COMPACT_TYPES_OF_TAG(QAJ4C_PRIMITIVE, QAJ4C_PRIMITIVE, QAJ4C_PRIMITIVE, QAJ4C_PRIMITIVE),
+    QAJ4C_COMPACT_TYPES_OF_TAG(QAJ4C_STRING, QAJ4C_STRING, QAJ4C_STRING, QAJ4C_STRING),
+    QAJ4C_COMPACT_TYPES_OF_TAG(QAJ4C_STRING_REF, QAJ4C_STRING_REF, QAJ4C_STRING_REF, QAJ4C_STRING_REF),
+    QAJ4C_COMPACT_TYPES_OF_TAG(QAJ4C_INLINE_STRING, QAJ4C_INLINE_STRING, QAJ4C_INLINE_STRING, QAJ4C_INLINE_STRING),
+    QAJ4C_COMPACT_TYPES_OF_TAG(QAJ4C_ARRAY, QAJ4C_OBJECT, QAJ4C_OBJECT_SORTED, QAJ4C_ERROR_DESCRIPTION)
+};
+
+size_type QAJ4C_compact_type_word( const QAJ4C_Value* value_ptr ) {
+    static const size_type container_types[] = {QAJ4C_ARRAY_TYPE_CONSTANT, QAJ4C_OBJECT_TYPE_CONSTANT, QAJ4C_OBJECT_SORTED_TYPE_CONSTANT, QAJ4C_ERROR_DESCRIPTION_TYPE_CONSTANT};
+    uint64_t kind;
+
+    if (value_ptr->bits < QAJ4C_COMPACT_BOXED) {
+        return QAJ4C_DOUBLE_TYPE_CONSTANT;
+    }
+    switch (QAJ4C_COMPACT_TAG(value_ptr->bits)) {
+    case QAJ4C_COMPACT_TAG_CONST:
+        return QAJ4C_COMPACT_PAYLOAD(value_ptr) == 0 ? QAJ4C_NULL_TYPE_CONSTANT : QAJ4C_BOOL_TYPE_CONSTANT;
+    case QAJ4C_COMPACT_TAG_INT:
+        return QAJ4C_int64_type_constant(QAJ4C_compact_primitive_data(value_ptr).i);
+    case QAJ4C_COMPACT_TAG_BIG_INT:
+        if ((QAJ4C_COMPACT_PAYLOAD(value_ptr) & 1) != 0) {
+            return QAJ4C_uint64_type_constant(QAJ4C_compact_primitive_data(value_ptr).u);
+        }
+        return QAJ4C_int64_type_constant(QAJ4C_compact_primitive_data(value_ptr).i);
+    case QAJ4C_COMPACT_TAG_STRING:
+        return QAJ4C_STRING_TYPE_CONSTANT;
+    case QAJ4C_COMPACT_TAG_STRING_REF:
+        return QAJ4C_STRING_REF_TYPE_CONSTANT;
+    case QAJ4C_COMPACT_TAG_INLINE_STRING:
+        return QAJ4C_INLINE_STRING_TYPE_CONSTANT;
+    default:
+        kind = QAJ4C_COMPACT_PAYLOAD(value_ptr) & QAJ4C_COMPACT_KIND_MASK;
+        if (kind != QAJ4C_COMPACT_KIND_ERROR && QAJ4C_COMPACT_HEADER(value_ptr)->capacity > 0) {
+            return container_types[kind] | QAJ4C_GROWABLE_FLAG;
+        }
+        return container_types[kind];
     }
-    return NULL;
 }
 
-
 /*
- * The comparison will first check on the string size and then on the content as we
- * only require this for matching purposes. The string length is also stored within
- * the objects, so check is not expensive!
+ * Changes the type of a value that keeps its data (e.g. an object that gets sorted). Only the
+ * types that exist in the compact layout are supported, the flags beside the growable flag (like
+ * key hashes) are dropped.
  */
-int QAJ4C_strcmp( const QAJ4C_Value* lhs, const QAJ4C_Value* rhs ) {
-    size_type lhs_size = QAJ4C_get_string_length(lhs);
-    size_type rhs_size = QAJ4C_get_string_length(rhs);
-    const char* lhs_string = QAJ4C_get_string(lhs);
-    const char* rhs_string = QAJ4C_get_string(rhs);
+void QAJ4C_compact_set_type_word( QAJ4C_Value* value_ptr, size_type type_word ) {
+    QAJ4C_Growable_header* header;
 
-    if (lhs_size != rhs_size) {
-        return lhs_size - rhs_size;
+    switch ((type_word >> 8) & 0xFF) {
+    case QAJ4C_NULL:
+        QAJ4C_set_null(value_ptr);
+        break;
+    case QAJ4C_ARRAY:
+    case QAJ4C_OBJECT:
+    case QAJ4C_OBJECT_SORTED:
+        header = QAJ4C_COMPACT_HEADER(value_ptr);
+        if ((type_word & QAJ4C_GROWABLE_FLAG) == 0 && header->capacity != 0) {
+            header->capacity = 0;
+        }
+        value_ptr->bits = QAJ4C_COMPACT_BOX(QAJ4C_COMPACT_TAG_CONTAINER, (uintptr_t)(header + 1) | QAJ4C_compact_kind(type_word));
+        break;
+    case QAJ4C_STRING:
+    case QAJ4C_STRING_REF:
+    case QAJ4C_INLINE_STRING:
+        break;
+    default:
+        QAJ4C_raise_fatal_error();
+        break;
+    }
+}
+
+void QAJ4C_compact_set_count( QAJ4C_Value* value_ptr, size_type count ) {
+    QAJ4C_Growable_header* header = QAJ4C_COMPACT_HEADER(value_ptr);
+    if (header->count != count) {
+        header->count = count;
+    }
+}
+
+void QAJ4C_compact_set_container( QAJ4C_Value* value_ptr, size_type type_word, void* elements, size_type count ) {
+    uint64_t kind = QAJ4C_compact_kind(type_word);
+    QAJ4C_Growable_header* header;
+
+    if (kind == QAJ4C_COMPACT_KIND_ERROR) {
+        value_ptr->bits = QAJ4C_COMPACT_BOX(QAJ4C_COMPACT_TAG_CONTAINER, (uintptr_t)elements | kind);
+        return;
+    }
+    if (elements == NULL || (count == 0 && (type_word & QAJ4C_GROWABLE_FLAG) == 0)) {
+        header = (QAJ4C_Growable_header*)&QAJ4C_COMPACT_EMPTY_HEADER;
+    } else {
+        header = (QAJ4C_Growable_header*)elements - 1;
+        header->count = count;
+        if ((type_word & QAJ4C_GROWABLE_FLAG) == 0) {
+            header->capacity = 0;
+        }
+    }
+    value_ptr->bits = QAJ4C_COMPACT_BOX(QAJ4C_COMPACT_TAG_CONTAINER, (uintptr_t)(header + 1) | kind);
+}
+
+QAJ4C_Array* QAJ4C_compact_array_view( const QAJ4C_Value* value_ptr, QAJ4C_Array* view ) {
+    view->top = QAJ4C_ARRAY_TOP(value_ptr);
+    view->count = QAJ4C_ARRAY_COUNT(value_ptr);
+    return view;
+}
+
+QAJ4C_Object* QAJ4C_compact_object_view( const QAJ4C_Value* value_ptr, QAJ4C_Object* view ) {
+    view->top = QAJ4C_OBJECT_TOP(value_ptr);
+    view->count = QAJ4C_OBJECT_COUNT(value_ptr);
+    return view;
+}
+
+size_type QAJ4C_compact_string_length( const QAJ4C_Value* value_ptr ) {
+    const char* str = QAJ4C_STRING_CHARS(value_ptr);
+    size_type len;
+
+    if (QAJ4C_COMPACT_TAG(value_ptr->bits) != QAJ4C_COMPACT_TAG_STRING) {
+        return (size_type)QAJ4C_STRLEN(str);
+    }
+    QAJ4C_MEMCPY(&len, str - QAJ4C_STRING_HEADER_SIZE, sizeof(size_type));
+    return len;
+}
+
+/*
+ * Stores the string with the given type. Inline strings are copied into the payload, copied
+ * strings (QAJ4C_STRING) need QAJ4C_STRING_HEADER_SIZE bytes in front of the chars for the length.
+ */
+void QAJ4C_compact_set_string( QAJ4C_Value* value_ptr, size_type type_word, const char* str, size_type len ) {
+    switch ((type_word >> 8) & 0xFF) {
+    case QAJ4C_INLINE_STRING:
+        value_ptr->bits = QAJ4C_COMPACT_BOX(QAJ4C_COMPACT_TAG_INLINE_STRING, 0);
+        QAJ4C_MEMCPY((char*)&value_ptr->bits + QAJ4C_COMPACT_INLINE_OFFSET, str, len);
+        break;
+    case QAJ4C_STRING:
+        QAJ4C_MEMCPY((char*)str - QAJ4C_STRING_HEADER_SIZE, &len, sizeof(size_type));
+        value_ptr->bits = QAJ4C_COMPACT_BOX(QAJ4C_COMPACT_TAG_STRING, (uintptr_t)str);
+        break;
+    default:
+        value_ptr->bits = QAJ4C_COMPACT_BOX(QAJ4C_COMPACT_TAG_STRING_REF, (uintptr_t)str);
+        break;
+    }
+}
+
+union primitive QAJ4C_compact_primitive_data( const QAJ4C_Value* value_ptr ) {
+    union primitive data;
+    uint64_t payload = QAJ4C_COMPACT_PAYLOAD(value_ptr);
+
+    data.u = 0;
+    if (value_ptr->bits < QAJ4C_COMPACT_BOXED) {
+        QAJ4C_MEMCPY(&data.d, &value_ptr->bits, sizeof(double));
+        return data;
+    }
+    switch (QAJ4C_COMPACT_TAG(value_ptr->bits)) {
+    case QAJ4C_COMPACT_TAG_CONST:
+        data.b = payload == 2;
+        break;
+    case QAJ4C_COMPACT_TAG_INT:
+        /* sign extension of the 48 bit payload */
+        data.i = (payload & ((uint64_t)1 << 47)) != 0 ? (int64_t)payload - ((int64_t)1 << 48) : (int64_t)payload;
+        break;
+    case QAJ4C_COMPACT_TAG_BIG_INT:
+        QAJ4C_MEMCPY(&data.u, (const void*)(uintptr_t)(payload & ~(uint64_t)1), sizeof(uint64_t));
+        break;
+    default:
+        break;
+    }
+    return data;
+}
+
+void QAJ4C_compact_copy_primitive( const QAJ4C_Value* src, QAJ4C_Value* dest, QAJ4C_Builder* builder ) {
+    if (src->bits >= QAJ4C_COMPACT_BOXED && QAJ4C_COMPACT_TAG(src->bits) == QAJ4C_COMPACT_TAG_BIG_INT) {
+        if ((QAJ4C_COMPACT_PAYLOAD(src) & 1) != 0) {
+            QAJ4C_set_uint64_impl(dest, QAJ4C_compact_primitive_data(src).u, builder);
+        } else {
+            QAJ4C_set_int64_impl(dest, QAJ4C_compact_primitive_data(src).i, builder);
+        }
+        return;
+    }
+    *dest = *src;
+}
+#endif
+
+QAJ4C_INTERNAL_TYPE QAJ4C_get_internal_type( const QAJ4C_Value* value_ptr ) {
+    if (value_ptr == NULL) {
+        return QAJ4C_NULL;
+    }
+#ifdef QAJ4C_COMPACT_VALUES
+    return QAJ4C_COMPACT_INTERNAL_TYPE(value_ptr);
+#else
+    if (QAJ4C_IS_PACKED_ELEMENT(value_ptr)) {
+        return QAJ4C_PRIMITIVE;
+    }
+    return (QAJ4C_TYPE_WORD(value_ptr) >> 8) & 0xFF;
+#endif
+}
+
+uint8_t QAJ4C_get_compatibility_types( const QAJ4C_Value* value_ptr ) {
+    return (QAJ4C_value_type(value_ptr) >> 16) & 0xFF;
+}
+
+uint8_t QAJ4C_get_storage_type( const QAJ4C_Value* value_ptr ) {
+    return (QAJ4C_value_type(value_ptr) >> 24) & 0xFF;
+}
+
+/*
+ * The type word of the value. Elements of packed arrays get the type word a primitive with
+ * the same value would have.
+ */
+static size_type QAJ4C_value_type( const QAJ4C_Value* value_ptr ) {
+    if (QAJ4C_UNLIKELY(QAJ4C_IS_PACKED_ELEMENT(value_ptr))) {
+        if (((uintptr_t)value_ptr & QAJ4C_PACKED_TAG_MASK) == QAJ4C_PACKED_DOUBLE_TAG) {
+            return QAJ4C_DOUBLE_TYPE_CONSTANT;
+        }
+        return QAJ4C_int64_type_constant(QAJ4C_PRIMITIVE_DATA(value_ptr).i);
+    }
+    return QAJ4C_TYPE_WORD(value_ptr);
+}
+
+size_type QAJ4C_int64_type_constant( int64_t value ) {
+    if (value >= 0) {
+        return QAJ4C_uint64_type_constant(value);
+    }
+    return value < INT32_MIN ? QAJ4C_INT64_TYPE_CONSTANT : QAJ4C_INT32_TYPE_CONSTANT;
+}
+
+size_type QAJ4C_uint64_type_constant( uint64_t value ) {
+    if (value <= UINT32_MAX) {
+        return value <= INT32_MAX ? QAJ4C_UINT32_TYPE_INT32_COMPAT_CONSTANT : QAJ4C_UINT32_TYPE_CONSTANT;
+    }
+    return value <= INT64_MAX ? QAJ4C_UINT64_TYPE_INT64_COMPAT_CONSTANT : QAJ4C_UINT64_TYPE_CONSTANT;
+}
+
+/* The kind of the elements of a packed array (0 in case the array is not packed) */
+uintptr_t QAJ4C_packed_array_tag( const QAJ4C_Value* value_ptr ) {
+    if (QAJ4C_get_internal_type(value_ptr) != QAJ4C_ARRAY_PACKED) {
+        return 0;
+    }
+    return (QAJ4C_TYPE_WORD(value_ptr) >> QAJ4C_PACKED_TAG_SHIFT) & QAJ4C_PACKED_TAG_MASK;
+}
+
+const QAJ4C_Value* QAJ4C_packed_array_get( const QAJ4C_Value* value_ptr, size_type index ) {
+    const QAJ4C_Packed_array* array_ptr = (const QAJ4C_Packed_array*)value_ptr;
+    /* both kinds of elements have a size of 8 bytes */
+    return (const QAJ4C_Value*)((uintptr_t)((const int64_t*)array_ptr->top + index) | QAJ4C_packed_array_tag(value_ptr));
+}
+
+void QAJ4C_packed_element_unpack( const QAJ4C_Value* element_ptr, QAJ4C_Value* dest ) {
+    if (((uintptr_t)element_ptr & QAJ4C_PACKED_TAG_MASK) == QAJ4C_PACKED_DOUBLE_TAG) {
+        QAJ4C_set_double(dest, QAJ4C_PRIMITIVE_DATA(element_ptr).d);
+    } else {
+        QAJ4C_set_int64(dest, QAJ4C_PRIMITIVE_DATA(element_ptr).i);
+    }
+}
+
+size_t QAJ4C_array_copy_impl( const QAJ4C_Value* value_ptr, void* out, size_t n, uint8_t primitive_type ) {
+    size_t copied = 0;
+    QAJ4C_array_copy_elements(value_ptr, out, n, primitive_type, &copied);
+    return copied;
+}
+
+/*
+ * Copies the numbers of the array (elements that are arrays are copied row by row) as long as they
+ * are compatible to the primitive type and out is not full. Elements sharing the same type word are
+ * converted in one loop. Returns false in case the copy stopped before the end of the array.
+ */
+static bool QAJ4C_array_copy_elements( const QAJ4C_Value* value_ptr, void* out, size_t n, uint8_t primitive_type, size_t* copied ) {
+    const QAJ4C_Value* top;
+    size_type count;
+    size_type i = 0;
+
+    if (QAJ4C_get_internal_type(value_ptr) == QAJ4C_ARRAY_PACKED) {
+        return QAJ4C_packed_array_copy_elements(value_ptr, out, n, primitive_type, copied);
+    }
+    top = QAJ4C_ARRAY_TOP(value_ptr);
+    count = QAJ4C_ARRAY_COUNT(value_ptr);
+    while (i < count) {
+        size_type type = QAJ4C_TYPE_WORD(&top[i]);
+        size_type end = i + 1;
+
+        if ((type & 0xFF) == QAJ4C_TYPE_ARRAY) {
+            if (!QAJ4C_array_copy_elements(&top[i], out, n, primitive_type, copied)) {
+                return false;
+            }
+            i += 1;
+            continue;
+        }
+        if ((type & 0xFF) != QAJ4C_TYPE_NUMBER || ((type >> 16) & primitive_type) == 0 || *copied == n) {
+            return false;
+        }
+        while (end < count && QAJ4C_TYPE_WORD(&top[end]) == type && end - i < n - *copied) {
+            end += 1;
+        }
+        QAJ4C_primitives_copy(&top[i], end - i, (type >> 24) & 0xFF, out, primitive_type, *copied);
+        *copied += end - i;
+        i = end;
+    }
+    return true;
+}
+
+static bool QAJ4C_packed_array_copy_elements( const QAJ4C_Value* value_ptr, void* out, size_t n, uint8_t primitive_type, size_t* copied ) {
+    const QAJ4C_Packed_array* array_ptr = (const QAJ4C_Packed_array*)value_ptr;
+    size_t count = n - *copied < array_ptr->count ? n - *copied : array_ptr->count;
+    size_t i;
+
+    if (QAJ4C_packed_array_tag(value_ptr) == QAJ4C_PACKED_DOUBLE_TAG) {
+        if (primitive_type != QAJ4C_PRIMITIVE_DOUBLE) {
+            return false;
+        }
+        QAJ4C_MEMCPY((double*)out + *copied, array_ptr->top, count * sizeof(double));
+    } else if (primitive_type == QAJ4C_PRIMITIVE_DOUBLE) {
+        const int64_t* src = (const int64_t*)array_ptr->top;
+        double* dest = (double*)out + *copied;
+        for (i = 0; i < count; ++i) {
+            dest[i] = (double)src[i];
+        }
+    } else if (primitive_type == QAJ4C_PRIMITIVE_INT64) {
+        QAJ4C_MEMCPY((int64_t*)out + *copied, array_ptr->top, count * sizeof(int64_t));
+    } else {
+        const int64_t* src = (const int64_t*)array_ptr->top;
+        uint64_t* dest = (uint64_t*)out + *copied;
+        for (i = 0; i < count && src[i] >= 0; ++i) {
+            dest[i] = (uint64_t)src[i];
+        }
+        count = i;
+    }
+    *copied += count;
+    return count == array_ptr->count;
+}
+
+/*
+ * Converts count primitives of the same storage type into out (starting at index offset). Integer
+ * targets only get compatible values, so the bits can be taken as they are.
+ */
+static void QAJ4C_primitives_copy( const QAJ4C_Value* src, size_t count, uint8_t storage_type, void* out, uint8_t primitive_type, size_t offset ) {
+    size_t i;
+    if (primitive_type == QAJ4C_PRIMITIVE_DOUBLE) {
+        double* dest = (double*)out + offset;
+        if (storage_type == QAJ4C_PRIMITIVE_DOUBLE) {
+            for (i = 0; i < count; ++i) {
+                dest[i] = QAJ4C_PLAIN_PRIMITIVE_DATA(&src[i]).d;
+            }
+        } else if (storage_type == QAJ4C_PRIMITIVE_UINT || storage_type == QAJ4C_PRIMITIVE_UINT64) {
+            for (i = 0; i < count; ++i) {
+                dest[i] = (double)QAJ4C_PLAIN_PRIMITIVE_DATA(&src[i]).u;
+            }
+        } else {
+            for (i = 0; i < count; ++i) {
+                dest[i] = (double)QAJ4C_PLAIN_PRIMITIVE_DATA(&src[i]).i;
+            }
+        }
+    } else if (primitive_type == QAJ4C_PRIMITIVE_INT64) {
+        int64_t* dest = (int64_t*)out + offset;
+        for (i = 0; i < count; ++i) {
+            dest[i] = QAJ4C_PLAIN_PRIMITIVE_DATA(&src[i]).i;
+        }
+    } else {
+        uint64_t* dest = (uint64_t*)out + offset;
+        for (i = 0; i < count; ++i) {
+            dest[i] = QAJ4C_PLAIN_PRIMITIVE_DATA(&src[i]).u;
+        }
+    }
+}
+
+/*
+ * FNV-1a hash of the string. Keys store it folded to 16 bits, there the value 0 is reserved
+ * for "no hash available" (e.g. strings that have not been created as object keys).
+ */
+uint32_t QAJ4C_hash_string( const char* str, size_type len ) {
+    uint32_t hash = 2166136261u;
+    size_type i;
+    for (i = 0; i < len; ++i) {
+        hash ^= (uint8_t)str[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static uint16_t QAJ4C_fold_hash( uint32_t hash ) {
+    uint16_t key_hash = (uint16_t)((hash >> 16) ^ (hash & 0xFFFF));
+    return key_hash != 0 ? key_hash : 1;
+}
+
+/* Compact values have no room for the hash (it stays 0) */
+void QAJ4C_set_key_hash( QAJ4C_Value* value_ptr, uint32_t hash ) {
+    QAJ4C_SET_TYPE_WORD(value_ptr, (QAJ4C_TYPE_WORD(value_ptr) & 0xFFFF) | ((size_type)QAJ4C_fold_hash(hash) << QAJ4C_KEY_HASH_SHIFT));
+}
+
+uint16_t QAJ4C_get_key_hash( const QAJ4C_Value* value_ptr ) {
+    return (uint16_t)(QAJ4C_TYPE_WORD(value_ptr) >> QAJ4C_KEY_HASH_SHIFT);
+}
+
+/*
+ * Direct accessors for the keys within the lookup methods (the caller ensures the value is
+ * a string), these avoid the type checks of the public accessors.
+ */
+static size_type QAJ4C_key_length( const QAJ4C_Value* value_ptr ) {
+    return QAJ4C_STRING_LENGTH(value_ptr);
+}
+
+static const char* QAJ4C_key_string( const QAJ4C_Value* value_ptr ) {
+    return QAJ4C_STRING_CHARS(value_ptr);
+}
+
+/*
+ * Checks if the key matches the given string. In case both hashes are known and differ the
+ * strings cannot be equal and the content does not need to be touched.
+ */
+static bool QAJ4C_key_matches( const QAJ4C_Value* key, const char* str, size_type len, uint16_t hash ) {
+    uint16_t key_hash = QAJ4C_get_key_hash(key);
+    if ((QAJ4C_TYPE_WORD(key) & 0xFF) != QAJ4C_TYPE_STRING || QAJ4C_key_length(key) != len) {
+        return false;
+    }
+    if (key_hash != 0 && key_hash != hash) {
+        return false;
+    }
+    return QAJ4C_MEMCMP(QAJ4C_key_string(key), str, len) == 0;
+}
+
+static size_type QAJ4C_hash_index_capacity( size_type count ) {
+    size_type capacity = 16;
+    while (capacity < count * 2) {
+        capacity *= 2;
+    }
+    return capacity;
+}
+
+/*
+ * Returns the flags of the lookup index an object with the given amount of members gets
+ * when parsed with the given options (0 in case the object gets no index).
+ */
+size_type QAJ4C_object_index_flags( int opts, size_type count ) {
+    size_type flags;
+    if ((opts & QAJ4C_PARSE_OPTS_HASH_INDEX) != 0 && count >= QAJ4C_HASH_INDEX_THRESHOLD) {
+        flags = QAJ4C_OBJECT_FLAG_HASH_INDEX;
+    } else if ((opts & (QAJ4C_PARSE_OPTS_LAZY_INDEX | QAJ4C_PARSE_OPTS_KEEP_ORDER)) != 0 && count >= QAJ4C_SORT_MIN_MEMBERS) {
+        flags = QAJ4C_OBJECT_FLAG_SORTED_INDEX;
+    } else {
+        return 0;
+    }
+    if ((opts & QAJ4C_PARSE_OPTS_LAZY_INDEX) != 0) {
+        flags |= QAJ4C_OBJECT_FLAG_LAZY_INDEX;
+    }
+    return flags;
+}
+
+/*
+ * The index is located right behind the members. It starts with the state word (used for
+ * lazy indices) followed by the entries, the size is padded to keep the values aligned.
+ */
+size_t QAJ4C_object_index_size( size_type flags, size_type count ) {
+    size_t entries = (flags & QAJ4C_OBJECT_FLAG_HASH_INDEX) != 0 ? QAJ4C_hash_index_capacity(count) : count;
+    size_t size = (entries + 1) * sizeof(size_type);
+    return (size + sizeof(QAJ4C_Value) - 1) / sizeof(QAJ4C_Value) * sizeof(QAJ4C_Value);
+}
+
+static size_type* QAJ4C_object_index_state( const QAJ4C_Object* obj_ptr ) {
+    return (size_type*)(obj_ptr->top + obj_ptr->count);
+}
+
+static size_type* QAJ4C_object_index_entries( const QAJ4C_Object* obj_ptr ) {
+    return QAJ4C_object_index_state(obj_ptr) + 1;
+}
+
+static int QAJ4C_key_compare( const QAJ4C_Value* lhs, const QAJ4C_Value* rhs ) {
+    size_type lhs_size = QAJ4C_key_length(lhs);
+    size_type rhs_size = QAJ4C_key_length(rhs);
+    if (lhs_size != rhs_size) {
+        return lhs_size < rhs_size ? -1 : 1;
+    }
+    return QAJ4C_MEMCMP(QAJ4C_key_string(lhs), QAJ4C_key_string(rhs), lhs_size);
+}
+
+static void QAJ4C_permutation_sift_down( const QAJ4C_Member* top, size_type* perm, size_type root, size_type count ) {
+    size_type value = perm[root];
+    while (root * 2 + 1 < count) {
+        size_type child = root * 2 + 1;
+        if (child + 1 < count && QAJ4C_key_compare(&top[perm[child]].key, &top[perm[child + 1]].key) < 0) {
+            child++;
+        }
+        if (QAJ4C_key_compare(&top[value].key, &top[perm[child]].key) >= 0) {
+            break;
+        }
+        perm[root] = perm[child];
+        root = child;
+    }
+    perm[root] = value;
+}
+
+/*
+ * Sorts the member indices by key (heapsort, as it does not require additional memory).
+ */
+static void QAJ4C_sort_permutation( const QAJ4C_Member* top, size_type* perm, size_type count ) {
+    size_type i;
+    for (i = count / 2; i > 0; --i) {
+        QAJ4C_permutation_sift_down(top, perm, i - 1, count);
+    }
+    for (i = count; i > 1; --i) {
+        size_type tmp = perm[0];
+        perm[0] = perm[i - 1];
+        perm[i - 1] = tmp;
+        QAJ4C_permutation_sift_down(top, perm, 0, i - 1);
+    }
+}
+
+static void QAJ4C_object_build_index( const QAJ4C_Object* obj_ptr, size_type flags ) {
+    size_type* index = QAJ4C_object_index_entries(obj_ptr);
+    size_type i;
+
+    if ((flags & QAJ4C_OBJECT_FLAG_HASH_INDEX) != 0) {
+        /* open addressing (linear probing), a slot stores the member index + 1 (0 is empty) */
+        size_type mask = QAJ4C_hash_index_capacity(obj_ptr->count) - 1;
+        QAJ4C_MEMSET(index, 0, (mask + 1) * sizeof(size_type));
+        for (i = 0; i < obj_ptr->count; ++i) {
+            const QAJ4C_Value* key = &obj_ptr->top[i].key;
+            size_type slot = QAJ4C_hash_string(QAJ4C_key_string(key), QAJ4C_key_length(key)) & mask;
+            while (index[slot] != 0) {
+                slot = (slot + 1) & mask;
+            }
+            index[slot] = i + 1;
+        }
+    } else {
+        for (i = 0; i < obj_ptr->count; ++i) {
+            index[i] = i;
+        }
+        QAJ4C_sort_permutation(obj_ptr->top, index, obj_ptr->count);
+    }
+}
+
+/*
+ * Attaches the index to a parsed object (the space has been reserved behind the members). A
+ * lazy index is only built on the first lookup.
+ */
+void QAJ4C_object_index_init( QAJ4C_Value* value_ptr, size_type flags ) {
+    QAJ4C_Object* obj_ptr = QAJ4C_OBJECT_VIEW(value_ptr);
+    if ((flags & QAJ4C_OBJECT_FLAG_LAZY_INDEX) != 0) {
+        *QAJ4C_object_index_state(obj_ptr) = QAJ4C_INDEX_STATE_PENDING;
+    } else {
+        QAJ4C_object_build_index(obj_ptr, flags);
+        *QAJ4C_object_index_state(obj_ptr) = QAJ4C_INDEX_STATE_READY;
+    }
+    QAJ4C_SET_TYPE_WORD(value_ptr, QAJ4C_TYPE_WORD(value_ptr) | flags);
+}
+
+/*
+ * Returns true in case the index of the object can be used. The first reader of a lazy index
+ * builds it; all readers that meanwhile access the object fall back to the linear scan (the
+ * members are never modified, so this is safe). The state word is only accessed atomically,
+ * the release store publishes the completed index to the other threads.
+ */
+static bool QAJ4C_object_index_ready( const QAJ4C_Value* value_ptr ) {
+    const QAJ4C_Object* obj_ptr = QAJ4C_OBJECT_VIEW(value_ptr);
+    size_type* state;
+
+    if ((QAJ4C_TYPE_WORD(value_ptr) & QAJ4C_OBJECT_FLAG_LAZY_INDEX) == 0) {
+        return true;
+    }
+    state = QAJ4C_object_index_state(obj_ptr);
+    if (QAJ4C_ATOMIC_LOAD_ACQUIRE(state) == QAJ4C_INDEX_STATE_READY) {
+        return true;
+    }
+    if (!QAJ4C_ATOMIC_CAS(state, QAJ4C_INDEX_STATE_PENDING, QAJ4C_INDEX_STATE_BUILDING)) {
+        return false;
+    }
+    QAJ4C_object_build_index(obj_ptr, QAJ4C_TYPE_WORD(value_ptr) & QAJ4C_OBJECT_INDEX_FLAGS);
+    QAJ4C_ATOMIC_STORE_RELEASE(state, QAJ4C_INDEX_STATE_READY);
+    return true;
+}
+
+const QAJ4C_Value* QAJ4C_object_get_hashed( const QAJ4C_Value* value_ptr, const char* str, size_type len, uint32_t hash ) {
+    QAJ4C_Object* obj_ptr = QAJ4C_OBJECT_VIEW(value_ptr);
+    if (QAJ4C_get_internal_type(value_ptr) == QAJ4C_OBJECT_SHAPED) {
+        return QAJ4C_object_get_shaped(value_ptr, str, len, QAJ4C_fold_hash(hash));
+    }
+    if ((QAJ4C_TYPE_WORD(value_ptr) & (QAJ4C_OBJECT_FLAG_HASH_INDEX | QAJ4C_OBJECT_FLAG_SORTED_INDEX)) != 0 && QAJ4C_object_index_ready(value_ptr)) {
+        if ((QAJ4C_TYPE_WORD(value_ptr) & QAJ4C_OBJECT_FLAG_HASH_INDEX) != 0) {
+            return QAJ4C_object_get_indexed(obj_ptr, str, len, hash);
+        }
+        return QAJ4C_object_search_sorted(obj_ptr, QAJ4C_object_index_entries(obj_ptr), str, len, QAJ4C_fold_hash(hash));
+    }
+    if (QAJ4C_get_internal_type(value_ptr) == QAJ4C_OBJECT_SORTED) {
+        return QAJ4C_object_search_sorted(obj_ptr, NULL, str, len, QAJ4C_fold_hash(hash));
+    }
+    return QAJ4C_object_get_unsorted(obj_ptr, str, len, QAJ4C_fold_hash(hash));
+}
+
+/*
+ * Checks the member at the cached index first (objects of the same shape have the member at
+ * the same position) and updates the cached index on a miss.
+ */
+const QAJ4C_Value* QAJ4C_object_get_cached( const QAJ4C_Value* value_ptr, const char* str, size_type len, uint32_t hash, size_t* last_index ) {
+    QAJ4C_Object* obj_ptr = QAJ4C_OBJECT_VIEW(value_ptr);
+    const QAJ4C_Value* result;
+
+    if (QAJ4C_get_internal_type(value_ptr) == QAJ4C_OBJECT_SHAPED) {
+        const QAJ4C_Shaped_object* shaped_ptr = (const QAJ4C_Shaped_object*)value_ptr;
+        const QAJ4C_Member* keys = QAJ4C_object_shape_keys(value_ptr);
+        if (*last_index < shaped_ptr->count && QAJ4C_key_matches(&keys[*last_index].key, str, len, QAJ4C_fold_hash(hash))) {
+            return &shaped_ptr->top[*last_index + 1];
+        }
+        result = QAJ4C_object_get_shaped(value_ptr, str, len, QAJ4C_fold_hash(hash));
+        if (result != NULL) {
+            *last_index = result - shaped_ptr->top - 1;
+        }
+        return result;
+    }
+
+    if (*last_index < obj_ptr->count && QAJ4C_key_matches(&obj_ptr->top[*last_index].key, str, len, QAJ4C_fold_hash(hash))) {
+        return &obj_ptr->top[*last_index].value;
+    }
+
+    result = QAJ4C_object_get_hashed(value_ptr, str, len, hash);
+    if (result != NULL) {
+        *last_index = (const QAJ4C_Member*)((const char*)result - offsetof(QAJ4C_Member, value)) - obj_ptr->top;
+    }
+    return result;
+}
+
+/*
+ * Checks only the type word of the key (type and key hash), so it returns false for string keys
+ * that are known to differ without looking at the string. Keys without a hash are candidates.
+ */
+static unsigned QAJ4C_key_candidate( const QAJ4C_Value* key, size_type expected ) {
+    size_type type = QAJ4C_TYPE_WORD(key) & QAJ4C_KEY_TYPE_MASK;
+    return (unsigned)(type == expected) | (unsigned)(type == QAJ4C_TYPE_STRING);
+}
+
+/*
+ * Filters four members at once by their type words (without branches) and only compares the
+ * keys of the candidates, so for keys with a hash the string is only touched on a match.
+ */
+const QAJ4C_Value* QAJ4C_object_get_unsorted( QAJ4C_Object* obj_ptr, const char* str, size_type len, uint16_t hash ) {
+    const QAJ4C_Member* top = obj_ptr->top;
+    size_type expected = QAJ4C_TYPE_STRING | ((size_type)hash << QAJ4C_KEY_HASH_SHIFT);
+    size_type count = obj_ptr->count;
+    size_type i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        unsigned candidates = QAJ4C_key_candidate(&top[i].key, expected)
+                | QAJ4C_key_candidate(&top[i + 1].key, expected) << 1
+                | QAJ4C_key_candidate(&top[i + 2].key, expected) << 2
+                | QAJ4C_key_candidate(&top[i + 3].key, expected) << 3;
+        size_type j = i;
+        for (; candidates != 0; candidates >>= 1, ++j) {
+            if ((candidates & 1) != 0 && QAJ4C_key_matches(&top[j].key, str, len, hash)) {
+                return &top[j].value;
+            }
+        }
+    }
+    for (; i < count; ++i) {
+        if (QAJ4C_key_candidate(&top[i].key, expected) && QAJ4C_key_matches(&top[i].key, str, len, hash)) {
+            return &top[i].value;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Searches the shared keys and returns the value at the position of the matching key.
+ */
+const QAJ4C_Value* QAJ4C_object_get_shaped( const QAJ4C_Value* value_ptr, const char* str, size_type len, uint16_t hash ) {
+    const QAJ4C_Shaped_object* shaped_ptr = (const QAJ4C_Shaped_object*)value_ptr;
+    const QAJ4C_Value* key_value;
+    QAJ4C_Object keys;
+
+    keys.top = (QAJ4C_Member*)QAJ4C_object_shape_keys(value_ptr);
+    keys.count = shaped_ptr->count;
+    key_value = QAJ4C_object_get_unsorted(&keys, str, len, hash);
+    if (key_value == NULL) {
+        return NULL;
+    }
+    return &shaped_ptr->top[(const QAJ4C_Member*)((const char*)key_value - offsetof(QAJ4C_Member, value)) - keys.top + 1];
+}
+
+/* The keys of the object (for shaped objects the keys it shares) */
+const QAJ4C_Member* QAJ4C_object_shape_keys( const QAJ4C_Value* value_ptr ) {
+    if (QAJ4C_get_internal_type(value_ptr) == QAJ4C_OBJECT_SHAPED) {
+        return ((const QAJ4C_Shape_header*)((const QAJ4C_Shaped_object*)value_ptr)->top)->keys;
+    }
+    return QAJ4C_OBJECT_TOP(value_ptr);
+}
+
+/*
+ * Members of shaped objects do not exist, the handle is the (tagged) address of the value.
+ */
+const QAJ4C_Member* QAJ4C_shaped_object_get_member( const QAJ4C_Value* value_ptr, size_type index ) {
+    const QAJ4C_Value* member_value = &((const QAJ4C_Shaped_object*)value_ptr)->top[index + 1];
+    return (const QAJ4C_Member*)((uintptr_t)member_value | QAJ4C_SHAPED_MEMBER_TAG);
+}
+
+const QAJ4C_Value* QAJ4C_shaped_member_get_value( const QAJ4C_Member* member ) {
+    return (const QAJ4C_Value*)((uintptr_t)member & ~QAJ4C_SHAPED_MEMBER_TAG);
+}
+
+/*
+ * Walks back from the value to the header of the object (objects that share keys are small, so
+ * this takes only a few steps).
+ */
+const QAJ4C_Value* QAJ4C_shaped_member_get_key( const QAJ4C_Member* member ) {
+    const QAJ4C_Value* member_value = QAJ4C_shaped_member_get_value(member);
+    const QAJ4C_Value* header = member_value - 1;
+    while (QAJ4C_get_internal_type(header) != QAJ4C_SHAPE_HEADER) {
+        --header;
+    }
+    return &((const QAJ4C_Shape_header*)header)->keys[member_value - header - 1].key;
+}
+
+/* The member at the given position of the sort order (either sorted in place or by permutation) */
+#define QAJ4C_SORTED_MEMBER(obj_ptr, perm, pos) (&(obj_ptr)->top[(perm) != NULL ? (perm)[pos] : (pos)])
+
+/*
+ * Returns the position of the first member with a key length >= len (null keys are located at
+ * the end and count as longer than any string).
+ */
+static size_type QAJ4C_object_lower_bound_length( const QAJ4C_Object* obj_ptr, const size_type* perm, size_type len, size_type first, size_type last ) {
+    while (first < last) {
+        size_type mid = first + (last - first) / 2;
+        const QAJ4C_Value* key = &QAJ4C_SORTED_MEMBER(obj_ptr, perm, mid)->key;
+        if ((QAJ4C_TYPE_WORD(key) & 0xFF) == QAJ4C_TYPE_STRING && QAJ4C_key_length(key) < len) {
+            first = mid + 1;
+        } else {
+            last = mid;
+        }
+    }
+    return first;
+}
+
+/*
+ * Lookup within the members sorted by (length, content). The range of keys with the requested
+ * length is located first, short ranges are scanned (the hash skips most compares) and long
+ * ranges are searched binary.
+ */
+const QAJ4C_Value* QAJ4C_object_search_sorted( const QAJ4C_Object* obj_ptr, const size_type* perm, const char* str, size_type len, uint16_t hash ) {
+    size_type first = QAJ4C_object_lower_bound_length(obj_ptr, perm, len, 0, obj_ptr->count);
+    size_type last = QAJ4C_object_lower_bound_length(obj_ptr, perm, len + 1, first, obj_ptr->count);
+
+    if (last - first <= QAJ4C_KEY_SCAN_LIMIT) {
+        for (; first < last; ++first) {
+            QAJ4C_Member* member = QAJ4C_SORTED_MEMBER(obj_ptr, perm, first);
+            if (QAJ4C_key_matches(&member->key, str, len, hash)) {
+                return &member->value;
+            }
+        }
+        return NULL;
+    }
+
+    while (first < last) {
+        size_type mid = first + (last - first) / 2;
+        QAJ4C_Member* member = QAJ4C_SORTED_MEMBER(obj_ptr, perm, mid);
+        int cmp = QAJ4C_MEMCMP(QAJ4C_key_string(&member->key), str, len);
+        if (cmp == 0) {
+            return &member->value;
+        } else if (cmp < 0) {
+            first = mid + 1;
+        } else {
+            last = mid;
+        }
+    }
+    return NULL;
+}
+
+/* Compares a key of the object with the given string (null keys are greater than any string) */
+static int QAJ4C_key_compare_string( const QAJ4C_Value* key, const char* str, size_type len ) {
+    size_type key_len;
+    if ((QAJ4C_TYPE_WORD(key) & 0xFF) != QAJ4C_TYPE_STRING) {
+        return 1;
+    }
+    key_len = QAJ4C_key_length(key);
+    if (key_len != len) {
+        return key_len < len ? -1 : 1;
+    }
+    return QAJ4C_MEMCMP(QAJ4C_key_string(key), str, len);
+}
+
+/*
+ * Returns the position of the first member (in sort order) that is not less than the string,
+ * starting at first. The range is widened exponentially first, so keys close to the previous
+ * position are found without searching the whole object.
+ */
+static size_type QAJ4C_object_gallop( const QAJ4C_Object* obj_ptr, const size_type* perm, const char* str, size_type len, size_type first ) {
+    size_type last = first;
+    size_type step = 1;
+
+    while (last < obj_ptr->count && QAJ4C_key_compare_string(&QAJ4C_SORTED_MEMBER(obj_ptr, perm, last)->key, str, len) < 0) {
+        first = last + 1;
+        last += step;
+        step *= 2;
+    }
+    if (last > obj_ptr->count) {
+        last = obj_ptr->count;
+    }
+
+    while (first < last) {
+        size_type mid = first + (last - first) / 2;
+        if (QAJ4C_key_compare_string(&QAJ4C_SORTED_MEMBER(obj_ptr, perm, mid)->key, str, len) < 0) {
+            first = mid + 1;
+        } else {
+            last = mid;
+        }
+    }
+    return first;
+}
+
+/* The first (up to) 8 bytes of the string in big endian order (compares like memcmp) */
+static uint64_t QAJ4C_string_prefix( const char* str, size_type len ) {
+    uint64_t prefix = 0;
+    size_type i;
+    for (i = 0; i < 8; ++i) {
+        prefix = (prefix << 8) | (i < len ? (uint8_t)str[i] : 0);
+    }
+    return prefix;
+}
+
+static bool QAJ4C_request_less( const char* keys[], const size_type* lengths, const uint64_t* prefixes, size_type lhs, size_type rhs ) {
+    if (lengths[lhs] != lengths[rhs]) {
+        return lengths[lhs] < lengths[rhs];
+    }
+    if (prefixes[lhs] != prefixes[rhs]) {
+        return prefixes[lhs] < prefixes[rhs];
+    }
+    return lengths[lhs] > 8 && QAJ4C_MEMCMP(keys[lhs] + 8, keys[rhs] + 8, lengths[lhs] - 8) < 0;
+}
+
+/*
+ * Sorts the requested keys the same way the members are sorted and walks both in a single
+ * merge pass.
+ */
+static void QAJ4C_object_get_many_sorted( const QAJ4C_Object* obj_ptr, const size_type* perm, const char* keys[], const size_type* lengths, size_type count, const QAJ4C_Value* result[] ) {
+    size_type order[QAJ4C_GET_MANY_CHUNK];
+    uint64_t prefixes[QAJ4C_GET_MANY_CHUNK];
+    size_type pos = 0;
+    size_type i;
+
+    for (i = 0; i < count; ++i) {
+        size_type j = i;
+        prefixes[i] = QAJ4C_string_prefix(keys[i], lengths[i]);
+        while (j > 0 && QAJ4C_request_less(keys, lengths, prefixes, i, order[j - 1])) {
+            order[j] = order[j - 1];
+            --j;
+        }
+        order[j] = i;
+    }
+
+    for (i = 0; i < count; ++i) {
+        size_type k = order[i];
+        pos = QAJ4C_object_gallop(obj_ptr, perm, keys[k], lengths[k], pos);
+        if (pos < obj_ptr->count) {
+            QAJ4C_Member* member = QAJ4C_SORTED_MEMBER(obj_ptr, perm, pos);
+            if (QAJ4C_key_compare_string(&member->key, keys[k], lengths[k]) == 0) {
+                result[k] = &member->value;
+            }
+        }
+    }
+}
+
+/*
+ * Searches each key starting behind the member the previous key has been found at, so keys
+ * requested in the order of the members are found in a single pass over the object.
+ */
+static void QAJ4C_object_get_many_unsorted( const QAJ4C_Object* obj_ptr, const char* keys[], const size_type* lengths, size_type count, const QAJ4C_Value* result[] ) {
+    size_type pos = 0;
+    size_type j;
+
+    for (j = 0; j < count && obj_ptr->count > 0; ++j) {
+        uint16_t hash = QAJ4C_fold_hash(QAJ4C_hash_string(keys[j], lengths[j]));
+        size_type expected = QAJ4C_TYPE_STRING | ((size_type)hash << QAJ4C_KEY_HASH_SHIFT);
+        size_type i = pos;
+        do {
+            const QAJ4C_Value* key = &obj_ptr->top[i].key;
+            if (QAJ4C_key_candidate(key, expected) && QAJ4C_key_matches(key, keys[j], lengths[j], hash)) {
+                result[j] = &obj_ptr->top[i].value;
+                pos = i + 1 < obj_ptr->count ? i + 1 : 0;
+                break;
+            }
+            i = i + 1 < obj_ptr->count ? i + 1 : 0;
+        } while (i != pos);
+    }
+}
+
+/*
+ * Looks up up to QAJ4C_GET_MANY_CHUNK keys (the results have to be initialized to NULL).
+ */
+static void QAJ4C_object_get_many_chunk( const QAJ4C_Value* value_ptr, const char* keys[], size_type count, const QAJ4C_Value* result[] ) {
+    QAJ4C_Object* obj_ptr = QAJ4C_OBJECT_VIEW(value_ptr);
+    size_type lengths[QAJ4C_GET_MANY_CHUNK];
+    size_type i;
+
+    for (i = 0; i < count; ++i) {
+        lengths[i] = QAJ4C_STRLEN(keys[i]);
+    }
+
+    if (QAJ4C_get_internal_type(value_ptr) == QAJ4C_OBJECT_SHAPED) {
+        for (i = 0; i < count; ++i) {
+            result[i] = QAJ4C_object_get_shaped(value_ptr, keys[i], lengths[i], QAJ4C_fold_hash(QAJ4C_hash_string(keys[i], lengths[i])));
+        }
+    } else if ((QAJ4C_TYPE_WORD(value_ptr) & (QAJ4C_OBJECT_FLAG_HASH_INDEX | QAJ4C_OBJECT_FLAG_SORTED_INDEX)) != 0 && QAJ4C_object_index_ready(value_ptr)) {
+        if ((QAJ4C_TYPE_WORD(value_ptr) & QAJ4C_OBJECT_FLAG_HASH_INDEX) != 0) {
+            for (i = 0; i < count; ++i) {
+                result[i] = QAJ4C_object_get_indexed(obj_ptr, keys[i], lengths[i], QAJ4C_hash_string(keys[i], lengths[i]));
+            }
+        } else {
+            QAJ4C_object_get_many_sorted(obj_ptr, QAJ4C_object_index_entries(obj_ptr), keys, lengths, count, result);
+        }
+    } else if (QAJ4C_get_internal_type(value_ptr) == QAJ4C_OBJECT_SORTED) {
+        QAJ4C_object_get_many_sorted(obj_ptr, NULL, keys, lengths, count, result);
+    } else {
+        QAJ4C_object_get_many_unsorted(obj_ptr, keys, lengths, count, result);
+    }
+}
+
+void QAJ4C_object_get_many_impl( const QAJ4C_Value* value_ptr, const char* keys[], size_t count, const QAJ4C_Value* result[] ) {
+    size_t first;
+    for (first = 0; first < count; first += QAJ4C_GET_MANY_CHUNK) {
+        size_t chunk = count - first < QAJ4C_GET_MANY_CHUNK ? count - first : QAJ4C_GET_MANY_CHUNK;
+        QAJ4C_object_get_many_chunk(value_ptr, keys + first, (size_type)chunk, result + first);
+    }
+}
+
+size_t QAJ4C_array_column_numbers_impl( const QAJ4C_Value* array_ptr, QAJ4C_Key* key, void* out, uint8_t primitive_type, size_t n, uint8_t* nulls ) {
+    size_type count = QAJ4C_column_init(array_ptr, n, nulls);
+    const QAJ4C_Member* shape_keys = NULL;
+    size_t result = 0;
+    size_type i;
+
+    for (i = 0; i < count; ++i) {
+        const QAJ4C_Value* value = QAJ4C_column_lookup(array_ptr, i, key, &shape_keys);
+        bool valid = value != NULL && QAJ4C_get_type(value) == QAJ4C_TYPE_NUMBER && (QAJ4C_get_compatibility_types(value) & primitive_type) != 0;
+        if (primitive_type == QAJ4C_PRIMITIVE_DOUBLE) {
+            ((double*)out)[i] = valid ? QAJ4C_get_double(value) : 0.0;
+        } else {
+            ((int64_t*)out)[i] = valid ? QAJ4C_PRIMITIVE_DATA(value).i : 0;
+        }
+        if (valid) {
+            result += 1;
+        } else if (nulls != NULL) {
+            nulls[i >> 3] |= (uint8_t)(1 << (i & 7));
+        }
+    }
+    return result;
+}
+
+size_t QAJ4C_array_column_strings_impl( const QAJ4C_Value* array_ptr, QAJ4C_Key* key, const char** strings, size_t* lengths, size_t n, uint8_t* nulls ) {
+    size_type count = QAJ4C_column_init(array_ptr, n, nulls);
+    const QAJ4C_Member* shape_keys = NULL;
+    size_t result = 0;
+    size_type i;
+
+    for (i = 0; i < count; ++i) {
+        const QAJ4C_Value* value = QAJ4C_column_lookup(array_ptr, i, key, &shape_keys);
+        if (value != NULL && QAJ4C_get_type(value) == QAJ4C_TYPE_STRING) {
+            strings[i] = QAJ4C_get_string(value);
+            if (lengths != NULL) {
+                lengths[i] = QAJ4C_get_string_length(value);
+            }
+            result += 1;
+        } else {
+            strings[i] = NULL;
+            if (lengths != NULL) {
+                lengths[i] = 0;
+            }
+            if (nulls != NULL) {
+                nulls[i >> 3] |= (uint8_t)(1 << (i & 7));
+            }
+        }
+    }
+    return result;
+}
+
+/* The number of records to extract, the bitmap starts with all records being not null */
+static size_type QAJ4C_column_init( const QAJ4C_Value* array_ptr, size_t n, uint8_t* nulls ) {
+    size_type count = QAJ4C_ARRAY_COUNT(array_ptr);
+    if (n < count) {
+        count = (size_type)n;
+    }
+    if (nulls != NULL) {
+        QAJ4C_MEMSET(nulls, 0, (count + 7) / 8);
+    }
+    return count;
+}
+
+/*
+ * Looks the key up within the record at the index (NULL in case it is not an object or does not
+ * have the member). The key caches the member index, and as long as the records share their
+ * keys (shaped objects) the value is taken from that index without comparing the key at all.
+ */
+static const QAJ4C_Value* QAJ4C_column_lookup( const QAJ4C_Value* array_ptr, size_type index, QAJ4C_Key* key, const QAJ4C_Member** shape_keys ) {
+    const QAJ4C_Value* record;
+    const QAJ4C_Value* result;
+
+    if (QAJ4C_get_internal_type(array_ptr) == QAJ4C_ARRAY_PACKED) {
+        return NULL;
+    }
+    record = &QAJ4C_ARRAY_TOP(array_ptr)[index];
+    if (QAJ4C_get_type(record) != QAJ4C_TYPE_OBJECT) {
+        return NULL;
+    }
+    if (QAJ4C_get_internal_type(record) != QAJ4C_OBJECT_SHAPED) {
+        *shape_keys = NULL;
+        return QAJ4C_object_get_cached(record, key->str, key->len, key->hash, &key->last_index);
+    }
+    if (QAJ4C_object_shape_keys(record) == *shape_keys) {
+        return &((const QAJ4C_Shaped_object*)record)->top[key->last_index + 1];
+    }
+    result = QAJ4C_object_get_cached(record, key->str, key->len, key->hash, &key->last_index);
+    *shape_keys = result != NULL ? QAJ4C_object_shape_keys(record) : NULL;
+    return result;
+}
+
+const QAJ4C_Value* QAJ4C_object_get_indexed( QAJ4C_Object* obj_ptr, const char* str, size_type len, uint32_t hash ) {
+    size_type* index = QAJ4C_object_index_entries(obj_ptr);
+    size_type mask = QAJ4C_hash_index_capacity(obj_ptr->count) - 1;
+    uint16_t key_hash = QAJ4C_fold_hash(hash);
+    size_type slot = hash & mask;
+
+    while (index[slot] != 0) {
+        QAJ4C_Member* entry = obj_ptr->top + index[slot] - 1;
+        if (QAJ4C_key_matches(&entry->key, str, len, key_hash)) {
+            return &entry->value;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return NULL;
+}
+
+
+static uint32_t QAJ4C_shape_path( uint32_t path, uint16_t key_hash ) {
+    return (path ^ key_hash) * 0x9E3779B1u + 0x7F4A7C15u;
+}
+
+/*
+ * Looks up the shape of the path (with insert a free slot is returned for unknown paths). Returns
+ * NULL in case the path is unknown or the table is full.
+ */
+static QAJ4C_Learned_shape* QAJ4C_shape_table_find( QAJ4C_Shape_table* table, uint32_t path, bool insert ) {
+    size_type mask = QAJ4C_SHAPE_TABLE_SLOTS - 1;
+    size_type slot = path & mask;
+    size_type i;
+
+    for (i = 0; i < QAJ4C_SHAPE_TABLE_SLOTS; ++i) {
+        QAJ4C_Learned_shape* shape = &table->shapes[slot];
+        if (!shape->used) {
+            return insert ? shape : NULL;
+        }
+        if (shape->path == path) {
+            return shape;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return NULL;
+}
+
+/*
+ * Appends the keys of the object in input order (in case the prediction failed the members are
+ * located at the slots of the previous shape). Keys with a \ or " are not learned as their json
+ * text differs from the content.
+ */
+static uint16_t QAJ4C_shape_table_learn_keys( QAJ4C_Shape_table* table, const QAJ4C_Second_pass_frame* frame ) {
+    const QAJ4C_Member* top = QAJ4C_OBJECT_TOP(frame->value_ptr);
+    size_type first_key = table->key_count;
+    size_type pool_size = table->pool_size;
+    size_type i;
+    size_type j;
+
+    if (table->full || frame->elements > QAJ4C_SHAPE_TABLE_KEYS - first_key) {
+        table->full = true;
+        return QAJ4C_NO_SHAPE;
+    }
+    for (i = 0; i < frame->elements; ++i) {
+        const QAJ4C_Value* key_value = frame->first_key != QAJ4C_NO_SHAPE ? &top[table->keys[frame->first_key + i].slot].key : &top[i].key;
+        const char* str = QAJ4C_key_string(key_value);
+        size_type len = QAJ4C_key_length(key_value);
+        QAJ4C_Learned_key* key = &table->keys[first_key + i];
+
+        if (len > QAJ4C_SHAPE_TABLE_POOL - pool_size) {
+            table->full = true;
+            return QAJ4C_NO_SHAPE;
+        }
+        for (j = 0; j < len; ++j) {
+            if (str[j] == '\\' || str[j] == '"') {
+                return QAJ4C_NO_SHAPE;
+            }
+        }
+        QAJ4C_MEMCPY(&table->pool[pool_size], str, len);
+        key->offset = pool_size;
+        key->length = len;
+        key->hash = QAJ4C_get_key_hash(key_value);
+        pool_size += len;
+    }
+    table->key_count += frame->elements;
+    table->pool_size = pool_size;
+    return (uint16_t)first_key;
+}
+
+/*
+ * Stores the position of each learned key after sorting and registers the shape for the path
+ * (objects with duplicate keys are not learned).
+ */
+static void QAJ4C_shape_table_learn_slots( QAJ4C_Shape_table* table, const QAJ4C_Second_pass_frame* frame, uint16_t first_key, bool sorted ) {
+    const QAJ4C_Object* obj_ptr = QAJ4C_OBJECT_VIEW(frame->value_ptr);
+    QAJ4C_Learned_shape* shape;
+    size_type i;
+
+    for (i = 0; i < frame->elements; ++i) {
+        QAJ4C_Learned_key* key = &table->keys[first_key + i];
+        if (sorted) {
+            const QAJ4C_Value* value_ptr;
+            if (i > 0 && QAJ4C_compare_members(&obj_ptr->top[i - 1], &obj_ptr->top[i]) == 0) {
+                return;
+            }
+            value_ptr = QAJ4C_object_search_sorted(obj_ptr, NULL, &table->pool[key->offset], key->length, key->hash);
+            key->slot = (const QAJ4C_Member*)((const char*)value_ptr - offsetof(QAJ4C_Member, value)) - obj_ptr->top;
+        } else {
+            key->slot = i;
+        }
+    }
+
+    shape = QAJ4C_shape_table_find(table, frame->path, true);
+    if (shape == NULL) {
+        table->full = true;
+        return;
+    }
+    shape->path = frame->path;
+    shape->count = frame->elements;
+    shape->first_key = first_key;
+    shape->sorted = sorted;
+    shape->used = true;
+}
+
+/*
+ * The comparison will first check on the string size and then on the content as we
+ * only require this for matching purposes. The string length is also stored within
+ * the objects, so check is not expensive!
+ */
+int QAJ4C_strcmp( const QAJ4C_Value* lhs, const QAJ4C_Value* rhs ) {
+    return QAJ4C_strcmp_n(lhs, QAJ4C_get_string(rhs), QAJ4C_get_string_length(rhs));
+}
+
+int QAJ4C_strcmp_n( const QAJ4C_Value* lhs, const char* str, size_type len ) {
+    size_type lhs_size = QAJ4C_get_string_length(lhs);
+    const char* lhs_string = QAJ4C_get_string(lhs);
+
+    if (lhs_size != len) {
+        return lhs_size - len;
+    }
+    return QAJ4C_MEMCMP(lhs_string, str, lhs_size);
+}
+
+static void QAJ4C_swap_members( QAJ4C_Member* lhs, QAJ4C_Member* rhs ) {
+    QAJ4C_Member tmp = *lhs;
+    *lhs = *rhs;
+    *rhs = tmp;
+}
+
+static void QAJ4C_insertion_sort_members( QAJ4C_Member* top, size_type count ) {
+    size_type i;
+    for (i = 1; i < count; ++i) {
+        QAJ4C_Member member = top[i];
+        size_type j = i;
+        while (j > 0 && QAJ4C_key_compare(&member.key, &top[j - 1].key) < 0) {
+            top[j] = top[j - 1];
+            --j;
+        }
+        top[j] = member;
+    }
+}
+
+static void QAJ4C_sift_down_members( QAJ4C_Member* top, size_type root, size_type count ) {
+    while (root * 2 + 1 < count) {
+        size_type child = root * 2 + 1;
+        if (child + 1 < count && QAJ4C_key_compare(&top[child].key, &top[child + 1].key) < 0) {
+            child++;
+        }
+        if (QAJ4C_key_compare(&top[root].key, &top[child].key) >= 0) {
+            return;
+        }
+        QAJ4C_swap_members(&top[root], &top[child]);
+        root = child;
+    }
+}
+
+static void QAJ4C_heap_sort_members( QAJ4C_Member* top, size_type count ) {
+    size_type i;
+    for (i = count / 2; i > 0; --i) {
+        QAJ4C_sift_down_members(top, i - 1, count);
+    }
+    for (i = count; i > 1; --i) {
+        QAJ4C_swap_members(&top[0], &top[i - 1]);
+        QAJ4C_sift_down_members(top, 0, i - 1);
+    }
+}
+
+/*
+ * Quicksort (median of three, the smaller partition is sorted recursively) that falls back to
+ * heapsort in case the depth limit is reached and to insertion sort for small ranges.
+ */
+static void QAJ4C_intro_sort_members( QAJ4C_Member* top, size_type count, int depth_limit ) {
+    while (count > QAJ4C_INSERTION_SORT_LIMIT) {
+        size_type mid = count / 2;
+        size_type i = 0;
+        size_type j = count - 1;
+        QAJ4C_Member pivot;
+
+        if (depth_limit-- == 0) {
+            QAJ4C_heap_sort_members(top, count);
+            return;
+        }
+
+        /* afterwards top[0] <= top[mid] <= top[count - 1], these act as sentinels */
+        if (QAJ4C_key_compare(&top[mid].key, &top[0].key) < 0) {
+            QAJ4C_swap_members(&top[mid], &top[0]);
+        }
+        if (QAJ4C_key_compare(&top[count - 1].key, &top[0].key) < 0) {
+            QAJ4C_swap_members(&top[count - 1], &top[0]);
+        }
+        if (QAJ4C_key_compare(&top[count - 1].key, &top[mid].key) < 0) {
+            QAJ4C_swap_members(&top[count - 1], &top[mid]);
+        }
+        pivot = top[mid];
+
+        while (true) {
+            while (QAJ4C_key_compare(&top[i].key, &pivot.key) < 0) {
+                ++i;
+            }
+            while (QAJ4C_key_compare(&pivot.key, &top[j].key) < 0) {
+                --j;
+            }
+            if (i >= j) {
+                break;
+            }
+            QAJ4C_swap_members(&top[i], &top[j]);
+            ++i;
+            --j;
+        }
+
+        /* [0, i) <= pivot <= [i, count), both partitions are not empty */
+        if (i < count - i) {
+            QAJ4C_intro_sort_members(top, i, depth_limit);
+            top += i;
+            count -= i;
+        } else {
+            QAJ4C_intro_sort_members(top + i, count - i, depth_limit);
+            count = i;
+        }
+    }
+    QAJ4C_insertion_sort_members(top, count);
+}
+
+static size_type QAJ4C_member_bucket( const QAJ4C_Member* member ) {
+    size_type length;
+    if ((QAJ4C_TYPE_WORD(&member->key) & 0xFF) != QAJ4C_TYPE_STRING) {
+        return QAJ4C_SORT_LENGTH_BUCKETS + 1;
+    }
+    length = QAJ4C_key_length(&member->key);
+    return length < QAJ4C_SORT_LENGTH_BUCKETS ? length : QAJ4C_SORT_LENGTH_BUCKETS;
+}
+
+/*
+ * Sorts the members by key (length first, then content) and moves members with a null key
+ * to the end. The members are distributed to buckets by key length first (in place, like an
+ * american flag sort), so the buckets only have to be sorted by content. Keys that exceed
+ * the bucket lengths share the last bucket, null keys are placed behind.
+ */
+void QAJ4C_sort_members( QAJ4C_Member* top, size_type count ) {
+    size_type bucket_end[QAJ4C_SORT_LENGTH_BUCKETS + 2];
+    size_type bucket_next[QAJ4C_SORT_LENGTH_BUCKETS + 2];
+    size_type pos = 0;
+    size_type i;
+    size_type b;
+
+    if (count <= QAJ4C_INSERTION_SORT_LIMIT) {
+        size_type strings = count;
+        for (i = 0; i < strings;) {
+            if ((QAJ4C_TYPE_WORD(&top[i].key) & 0xFF) != QAJ4C_TYPE_STRING) {
+                QAJ4C_swap_members(&top[i], &top[--strings]);
+            } else {
+                ++i;
+            }
+        }
+        QAJ4C_insertion_sort_members(top, strings);
+        return;
+    }
+
+    QAJ4C_MEMSET(bucket_end, 0, sizeof(bucket_end));
+    for (i = 0; i < count; ++i) {
+        bucket_end[QAJ4C_member_bucket(&top[i])]++;
+    }
+    for (b = 0; b < QAJ4C_SORT_LENGTH_BUCKETS + 2; ++b) {
+        bucket_next[b] = pos;
+        pos += bucket_end[b];
+        bucket_end[b] = pos;
+    }
+
+    for (b = 0; b < QAJ4C_SORT_LENGTH_BUCKETS + 2; ++b) {
+        while (bucket_next[b] < bucket_end[b]) {
+            size_type target = QAJ4C_member_bucket(&top[bucket_next[b]]);
+            if (target == b) {
+                bucket_next[b]++;
+            } else {
+                QAJ4C_swap_members(&top[bucket_next[b]], &top[bucket_next[target]++]);
+            }
+        }
+    }
+
+    pos = 0;
+    for (b = 0; b <= QAJ4C_SORT_LENGTH_BUCKETS; ++b) {
+        size_type size = bucket_end[b] - pos;
+        if (size > 1) {
+            int depth_limit = 0;
+            for (i = size; i > 0; i >>= 1) {
+                depth_limit += 2;
+            }
+            QAJ4C_intro_sort_members(top + pos, size, depth_limit);
+        }
+        pos = bucket_end[b];
     }
-    return QAJ4C_MEMCMP(lhs_string, rhs_string, lhs_size);
 }
 
 /*
@@ -1141,10 +3723,16 @@ bool QAJ4C_print_buffer_callback_impl( const QAJ4C_Value* value_ptr, QAJ4C_print
     switch (QAJ4C_get_internal_type(value_ptr)) {
     case QAJ4C_OBJECT_SORTED:
     case QAJ4C_OBJECT:
-        result = QAJ4C_print_callback_object((const QAJ4C_Object*)value_ptr, callback, ptr);
+        result = QAJ4C_print_callback_object(QAJ4C_OBJECT_VIEW(value_ptr), callback, ptr);
+        break;
+    case QAJ4C_OBJECT_SHAPED:
+        result = QAJ4C_print_callback_shaped_object((const QAJ4C_Shaped_object*)value_ptr, callback, ptr);
         break;
     case QAJ4C_ARRAY:
-        result = QAJ4C_print_callback_array((const QAJ4C_Array*)value_ptr, callback, ptr);
+        result = QAJ4C_print_callback_array(QAJ4C_ARRAY_VIEW(value_ptr), callback, ptr);
+        break;
+    case QAJ4C_ARRAY_PACKED:
+        result = QAJ4C_print_callback_packed_array(value_ptr, callback, ptr);
         break;
     case QAJ4C_PRIMITIVE:
         result = QAJ4C_print_callback_primitive(value_ptr, callback, ptr);
@@ -1158,10 +3746,10 @@ bool QAJ4C_print_buffer_callback_impl( const QAJ4C_Value* value_ptr, QAJ4C_print
         result = QAJ4C_print_callback_string(QAJ4C_get_string(value_ptr), callback, ptr);
         break;
     case QAJ4C_ERROR_DESCRIPTION:
-        result = QAJ4C_print_callback_error((const QAJ4C_Error*)value_ptr, callback, ptr);
+        result = QAJ4C_print_callback_error(value_ptr, callback, ptr);
         break;
     default:
-        g_qaj4c_err_function();
+        QAJ4C_raise_fatal_error();
     }
     return result;
 }
@@ -1169,7 +3757,7 @@ bool QAJ4C_print_buffer_callback_impl( const QAJ4C_Value* value_ptr, QAJ4C_print
 bool QAJ4C_print_callback_object( const QAJ4C_Object* value_ptr, QAJ4C_print_buffer_callback_fn callback, void *ptr ) {
     QAJ4C_Member* top = value_ptr->top;
     size_type i;
-    size_type n = ((QAJ4C_Object*)value_ptr)->count;
+    size_type n = value_ptr->count;
     bool result = true;
 
     result = callback(ptr, "{", 1);
@@ -1187,12 +3775,30 @@ bool QAJ4C_print_callback_object( const QAJ4C_Object* value_ptr, QAJ4C_print_buf
     return result && callback(ptr, "}", 1);
 }
 
+bool QAJ4C_print_callback_shaped_object( const QAJ4C_Shaped_object* value_ptr, QAJ4C_print_buffer_callback_fn callback, void *ptr ) {
+    const QAJ4C_Member* keys = ((const QAJ4C_Shape_header*)value_ptr->top)->keys;
+    size_type i;
+    size_type n = value_ptr->count;
+    bool result = true;
+
+    result = callback(ptr, "{", 1);
+    for (i = 0; i < n; ++i) {
+        if (i > 0) {
+            result = result && callback(ptr, ",", 1);
+        }
+        result = result && QAJ4C_print_buffer_callback(&keys[i].key, callback, ptr)
+                && callback(ptr, ":", 1)
+                && QAJ4C_print_buffer_callback(&value_ptr->top[i + 1], callback, ptr);
+    }
+    return result && callback(ptr, "}", 1);
+}
+
 bool QAJ4C_print_callback_array( const QAJ4C_Array* value_ptr, QAJ4C_print_buffer_callback_fn callback, void *ptr )
 {
     QAJ4C_Value* top = value_ptr->top;
     bool result = true;
     size_type i;
-    size_type n = ((QAJ4C_Array*)value_ptr)->count;
+    size_type n = value_ptr->count;
 
     result = callback(ptr, "[", 1);
     for (i = 0; i < n; ++i) {
@@ -1204,12 +3810,28 @@ bool QAJ4C_print_callback_array( const QAJ4C_Array* value_ptr, QAJ4C_print_buffe
     return result && callback(ptr, "]", 1);
 }
 
+bool QAJ4C_print_callback_packed_array( const QAJ4C_Value* value_ptr, QAJ4C_print_buffer_callback_fn callback, void *ptr )
+{
+    bool result = true;
+    size_type i;
+    size_type n = ((const QAJ4C_Packed_array*)value_ptr)->count;
+
+    result = callback(ptr, "[", 1);
+    for (i = 0; i < n; ++i) {
+        if (i > 0) {
+            result = result && callback(ptr, ",", 1);
+        }
+        result = result && QAJ4C_print_callback_primitive(QAJ4C_packed_array_get(value_ptr, i), callback, ptr);
+    }
+    return result && callback(ptr, "]", 1);
+}
+
 bool QAJ4C_print_callback_primitive( const QAJ4C_Value* value_ptr, QAJ4C_print_buffer_callback_fn callback, void *ptr )
 {
     bool result = true;
     switch (QAJ4C_get_storage_type(value_ptr)) {
     case QAJ4C_PRIMITIVE_BOOL:
-        if (((QAJ4C_Primitive*)value_ptr)->data.b) {
+        if (QAJ4C_PLAIN_PRIMITIVE_DATA(value_ptr).b) {
             result = QAJ4C_print_callback_constant( QAJ4C_TRUE_STR, QAJ4C_TRUE_STR_LEN, callback, ptr );
         } else {
             result = QAJ4C_print_callback_constant( QAJ4C_FALSE_STR, QAJ4C_FALSE_STR_LEN, callback, ptr );
@@ -1217,14 +3839,14 @@ bool QAJ4C_print_callback_primitive( const QAJ4C_Value* value_ptr, QAJ4C_print_b
         break;
     case QAJ4C_PRIMITIVE_INT:
     case QAJ4C_PRIMITIVE_INT64:
-        result = QAJ4C_print_callback_int64(((QAJ4C_Primitive*)value_ptr)->data.i, callback, ptr);
+        result = QAJ4C_print_callback_int64(QAJ4C_PRIMITIVE_DATA(value_ptr).i, callback, ptr);
         break;
     case QAJ4C_PRIMITIVE_UINT:
     case QAJ4C_PRIMITIVE_UINT64:
-        result = QAJ4C_print_callback_uint64(((QAJ4C_Primitive*)value_ptr)->data.u, callback, ptr);
+        result = QAJ4C_print_callback_uint64(QAJ4C_PRIMITIVE_DATA(value_ptr).u, callback, ptr);
         break;
     default: /* it has to be double */
-        result = QAJ4C_print_callback_double(((QAJ4C_Primitive*)value_ptr)->data.d, callback, ptr);
+        result = QAJ4C_print_callback_double(QAJ4C_PRIMITIVE_DATA(value_ptr).d, callback, ptr);
         break;
     }
     return result;
@@ -1281,7 +3903,7 @@ bool QAJ4C_print_callback_int64( int64_t value, QAJ4C_print_buffer_callback_fn c
     char buffer[BUFFER_SIZE];
 
 	/* this callback is only called with a negative number as it otherwise has been classified uint64 */
-    char* pos_ptr = QAJ4C_do_print_uint64(-value, buffer + 1, BUFFER_SIZE - 1);
+    char* pos_ptr = QAJ4C_do_print_uint64(0 - (uint64_t)value, buffer + 1, BUFFER_SIZE - 1);
 
 	pos_ptr -= 1;
 	*pos_ptr = '-';
@@ -1328,7 +3950,7 @@ bool QAJ4C_print_callback_string( const char *string, QAJ4C_print_buffer_callbac
     return result && callback(ptr, "\"", 1);
 }
 
-bool QAJ4C_print_callback_error( const QAJ4C_Error* value_ptr, QAJ4C_print_buffer_callback_fn callback, void *ptr )
+bool QAJ4C_print_callback_error( const QAJ4C_Value* value_ptr, QAJ4C_print_buffer_callback_fn callback, void *ptr )
 {
     static const char ERR_MSG[] = "{\"error\":\"Unable to parse json message. Error (";
     static const size_t ERR_MSG_LEN = ARRAY_COUNT(ERR_MSG);
@@ -1338,9 +3960,9 @@ bool QAJ4C_print_callback_error( const QAJ4C_Error* value_ptr, QAJ4C_print_buffe
     static const size_t ERR_MSG_3_LEN = ARRAY_COUNT(ERR_MSG_3);
 
     return QAJ4C_print_callback_constant(ERR_MSG, ERR_MSG_LEN, callback, ptr)
-            && QAJ4C_print_callback_uint64(value_ptr->info->err_no, callback, ptr)
+            && QAJ4C_print_callback_uint64(QAJ4C_ERROR_INFO(value_ptr)->err_no, callback, ptr)
             && QAJ4C_print_callback_constant(ERR_MSG_2, ERR_MSG_2_LEN, callback, ptr)
-            && QAJ4C_print_callback_uint64(value_ptr->info->json_pos, callback, ptr)
+            && QAJ4C_print_callback_uint64(QAJ4C_ERROR_INFO(value_ptr)->json_pos, callback, ptr)
             && QAJ4C_print_callback_constant(ERR_MSG_3, ERR_MSG_3_LEN, callback, ptr);
 }
 
@@ -40,12 +40,125 @@
 #define QAJ4C_UNLIKELY(expr) expr
 #endif
 
-#define QAJ4C_ASSERT(arg, alt) if (QAJ4C_UNLIKELY(!(arg))) do { g_qaj4c_err_function(); alt } while(0)
+#define QAJ4C_ASSERT(arg, alt) if (QAJ4C_UNLIKELY(!(arg))) do { QAJ4C_raise_fatal_error(); alt } while(0)
+
+/**
+ * Assert for the (hot) read accessors. In case QAJ4C_UNCHECKED is defined, the accessors
+ * will not verify the type of the value anymore (invalid access is undefined behavior then).
+ */
+#ifdef QAJ4C_UNCHECKED
+#define QAJ4C_ACCESS_ASSERT(arg, alt) do { } while(0)
+#else
+#define QAJ4C_ACCESS_ASSERT(arg, alt) QAJ4C_ASSERT(arg, alt)
+#endif
 
 #define QAJ4C_MIN(lhs, rhs) ((lhs<=rhs)?(lhs):(rhs))
 #define QAJ4C_MAX(lhs, rhs) ((lhs>=rhs)?(lhs):(rhs))
 
+#define QAJ4C_MAX_DEPTH 32
+
+/* The alignment of the buffers requested from an allocator (matches QAJ4C_ALIGN) */
+#define QAJ4C_ALLOC_ALIGNMENT (sizeof(uintptr_t))
+
+/*
+ * Strings only use the lower 16 bits of the type word. Object keys store a 16 bit hash in the
+ * upper bits to skip most string compares on lookup (0 means no hash available).
+ */
+#define QAJ4C_KEY_HASH_SHIFT 16
+
+/* The bits of a key type word that have to be equal for equal keys (type and key hash) */
+#define QAJ4C_KEY_TYPE_MASK 0xFFFF00FF
+
+/* Up to this many keys of the same length are scanned linearly in sorted objects */
+#define QAJ4C_KEY_SCAN_LIMIT 8
+
+/*
+ * Parsed objects with fewer members are not sorted (and get no sorted index), scanning them is
+ * faster than the binary search (see the small-objects benchmark).
+ */
+#define QAJ4C_SORT_MIN_MEMBERS 32
+
+/* QAJ4C_object_get_many sorts (and merges) the requested keys in chunks of this size */
+#define QAJ4C_GET_MANY_CHUNK 32
+
+/* Member sort: keys up to this length are bucketed by length, small ranges use insertion sort */
+#define QAJ4C_SORT_LENGTH_BUCKETS 64
+#define QAJ4C_INSERTION_SORT_LIMIT 16
+
+/*
+ * Shape sharing (QAJ4C_PARSE_OPTS_SHARE_SHAPES): the statistics of a shaped object carry this
+ * flag besides the member count. Member handles of shaped objects point to the value and are
+ * tagged with the lowest bit (values are aligned, so the bit is always free).
+ */
+#define QAJ4C_SHAPED_OBJECT_FLAG ((size_type)1 << (sizeof(size_type) * 8 - 1))
+#define QAJ4C_SHAPED_MEMBER_TAG ((uintptr_t)1)
+#define QAJ4C_IS_SHAPED_MEMBER(member) (((uintptr_t)(member) & QAJ4C_SHAPED_MEMBER_TAG) != 0)
+
+/*
+ * Packed arrays (QAJ4C_PARSE_OPTS_PACK_ARRAYS): the statistics of a packed array carry this flag
+ * besides the element count (arrays are never shaped). QAJ4C_array_get refers to an element of a
+ * packed array by its address tagged with the kind of the array (the elements are aligned, so the
+ * lower two bits are always free), the type word of a packed array carries the same tag.
+ */
+#define QAJ4C_PACKED_ARRAY_FLAG ((size_type)1 << (sizeof(size_type) * 8 - 1))
+#define QAJ4C_PACKED_INT64_TAG ((uintptr_t)1)
+#define QAJ4C_PACKED_DOUBLE_TAG ((uintptr_t)2)
+#define QAJ4C_PACKED_TAG_MASK ((uintptr_t)3)
+#define QAJ4C_PACKED_TAG_SHIFT 16
+#define QAJ4C_IS_PACKED_ELEMENT(value_ptr) (((uintptr_t)(value_ptr) & QAJ4C_PACKED_TAG_MASK) != 0)
+#define QAJ4C_PACK_MAX_DIGITS 18 /* integers with more digits might not fit into an int64_t */
+
+/* Kinds of the elements of an array (combined per array while parsing) */
+#define QAJ4C_PACK_INT64 1
+#define QAJ4C_PACK_DOUBLE 2
+#define QAJ4C_PACK_OTHER 4
+
+/* The data of a primitive value (also in case it is an element of a packed array) */
+#ifndef QAJ4C_COMPACT_VALUES
+#define QAJ4C_PRIMITIVE_DATA(value_ptr) (*(const union primitive*)((uintptr_t)(value_ptr) & ~QAJ4C_PACKED_TAG_MASK))
+#endif
+
+/*
+ * Learned shapes (QAJ4C_PARSE_OPTS_LEARN_SHAPES): capacity of the table of a parser context (the
+ * amount of slots has to be a power of two).
+ */
+#define QAJ4C_SHAPE_TABLE_SLOTS 64
+#define QAJ4C_SHAPE_TABLE_KEYS 1024
+#define QAJ4C_SHAPE_TABLE_POOL 16384
+#define QAJ4C_NO_SHAPE 0xFFFF
+
+/*
+ * Objects with at least this many members get a hash index in case QAJ4C_PARSE_OPTS_HASH_INDEX
+ * is set.
+ */
+#define QAJ4C_HASH_INDEX_THRESHOLD 64
+
+/*
+ * Lookup indices of parsed objects are stored right behind the members, the flags in the upper
+ * bits of the object's type word mark the kind of index.
+ */
+#define QAJ4C_OBJECT_FLAG_HASH_INDEX (1u << 16)
+#define QAJ4C_OBJECT_FLAG_SORTED_INDEX (1u << 17) /* permutation of the members sorted by key */
+#define QAJ4C_OBJECT_FLAG_LAZY_INDEX (1u << 18) /* index is built on the first lookup */
+#define QAJ4C_OBJECT_INDEX_FLAGS (QAJ4C_OBJECT_FLAG_HASH_INDEX | QAJ4C_OBJECT_FLAG_SORTED_INDEX | QAJ4C_OBJECT_FLAG_LAZY_INDEX)
+
+/*
+ * Arrays and objects created growable (see QAJ4C_set_array_growable) store their capacity in a
+ * header right in front of the elements, the flag in the type word marks them.
+ */
+#define QAJ4C_GROWABLE_FLAG (1u << 19)
+#define QAJ4C_GROWABLE_MIN_CAPACITY 4
+
+/* States of a lazy index */
+#define QAJ4C_INDEX_STATE_PENDING 0
+#define QAJ4C_INDEX_STATE_BUILDING 1
+#define QAJ4C_INDEX_STATE_READY 2
+
+#ifdef QAJ4C_COMPACT_VALUES
+#define QAJ4C_INLINE_STRING_SIZE 5 /* the 6 payload bytes of a boxed value (including the \0) */
+#else
 #define QAJ4C_INLINE_STRING_SIZE (sizeof(uintptr_t) + sizeof(size_type) - sizeof(uint8_t) * 2)
+#endif
 
 #define QAJ4C_NULL_TYPE_CONSTANT   ((QAJ4C_NULL << 8) | QAJ4C_TYPE_NULL)
 #define QAJ4C_OBJECT_TYPE_CONSTANT ((QAJ4C_OBJECT << 8) |  QAJ4C_TYPE_OBJECT)
@@ -55,6 +168,9 @@
 #define QAJ4C_STRING_REF_TYPE_CONSTANT ((QAJ4C_STRING_REF << 8) | QAJ4C_TYPE_STRING)
 #define QAJ4C_INLINE_STRING_TYPE_CONSTANT ((QAJ4C_INLINE_STRING << 8) | QAJ4C_TYPE_STRING)
 #define QAJ4C_ERROR_DESCRIPTION_TYPE_CONSTANT ((QAJ4C_ERROR_DESCRIPTION << 8) | QAJ4C_TYPE_INVALID)
+#define QAJ4C_OBJECT_SHAPED_TYPE_CONSTANT ((QAJ4C_OBJECT_SHAPED << 8) | QAJ4C_TYPE_OBJECT)
+#define QAJ4C_SHAPE_HEADER_TYPE_CONSTANT ((QAJ4C_SHAPE_HEADER << 8) | QAJ4C_TYPE_INVALID)
+#define QAJ4C_ARRAY_PACKED_TYPE_CONSTANT ((QAJ4C_ARRAY_PACKED << 8) | QAJ4C_TYPE_ARRAY)
 
 #define QAJ4C_NUMBER_TYPE_CONSTANT ((QAJ4C_PRIMITIVE << 8) | QAJ4C_TYPE_NUMBER)
 
@@ -71,7 +187,25 @@
 extern "C" {
 #endif
 
+/*
+ * Type of the lengths, counts and positions within a document (and of the type word of a value).
+ * With QAJ4C_LARGE_DOCUMENTS the json message and its values may exceed 4 GB, each value takes
+ * 24 bytes then (16 bytes otherwise on 64 bit, 8 bytes with QAJ4C_COMPACT_VALUES).
+ */
+#if defined(QAJ4C_LARGE_DOCUMENTS) && defined(QAJ4C_COMPACT_VALUES)
+#error "QAJ4C_COMPACT_VALUES does not support QAJ4C_LARGE_DOCUMENTS"
+#endif
+
+#ifdef QAJ4C_LARGE_DOCUMENTS
+typedef uint64_t size_type;
+#else
 typedef uint32_t size_type;
+#endif
+
+#define QAJ4C_SIZE_TYPE_MAX ((size_type)-1)
+
+/* More values do not fit into the address space (together with the indices and strings) */
+#define QAJ4C_MAX_NODES (SIZE_MAX / (sizeof(QAJ4C_Value) * 4))
 
 typedef enum QAJ4C_INTERNAL_TYPE {
     QAJ4C_NULL = 0,
@@ -83,7 +217,10 @@ typedef enum QAJ4C_INTERNAL_TYPE {
     QAJ4C_STRING_REF,
     QAJ4C_INLINE_STRING,
     QAJ4C_PRIMITIVE,
-    QAJ4C_ERROR_DESCRIPTION
+    QAJ4C_ERROR_DESCRIPTION,
+    QAJ4C_OBJECT_SHAPED,
+    QAJ4C_SHAPE_HEADER,
+    QAJ4C_ARRAY_PACKED
 } QAJ4C_INTERNAL_TYPE;
 
 typedef enum QAJ4C_Primitive_type {
@@ -101,12 +238,39 @@ typedef struct QAJ4C_Object {
     char padding[sizeof(size_type)];
 } QAJ4C_ALIGN QAJ4C_Object;
 
+/*
+ * Object that shares its keys with a previous object of the same shape. Only the values are
+ * stored (in the order of the shared keys) behind a header that references the keys.
+ */
+typedef struct QAJ4C_Shaped_object {
+    QAJ4C_Value* top; /* the header, followed by the values */
+    size_type count;
+    char padding[sizeof(size_type)];
+} QAJ4C_ALIGN QAJ4C_Shaped_object;
+
+typedef struct QAJ4C_Shape_header {
+    const QAJ4C_Member* keys; /* the members of the object the keys belong to */
+    char padding[sizeof(size_type) * 2];
+} QAJ4C_ALIGN QAJ4C_Shape_header;
+
+typedef struct QAJ4C_Shape_table QAJ4C_Shape_table;
+
 typedef struct QAJ4C_Array {
     QAJ4C_Value* top;
     size_type count;
     char padding[sizeof(size_type)];
 } QAJ4C_ALIGN QAJ4C_Array;
 
+/*
+ * Array that stores its elements as plain int64_t or double values (the kind is tagged in the
+ * type word, see QAJ4C_PACKED_INT64_TAG).
+ */
+typedef struct QAJ4C_Packed_array {
+    void* top;
+    size_type count;
+    char padding[sizeof(size_type)];
+} QAJ4C_ALIGN QAJ4C_Packed_array;
+
 typedef struct QAJ4C_String {
     const char* s;
     size_type count;
@@ -149,35 +313,252 @@ typedef struct QAJ4C_Primitive {
 
 } QAJ4C_ALIGN QAJ4C_Primitive;
 
+#ifdef QAJ4C_COMPACT_VALUES
+/*
+ * Compact layout (QAJ4C_COMPACT_VALUES): a value is a NaN-boxed double. All bit patterns below
+ * QAJ4C_COMPACT_BOXED are plain doubles (NaNs are stored as the one canonical NaN), the patterns
+ * above carry a tag (see QAJ4C_COMPACT_TAG_CONST) and a 48 bit payload. The structs above only
+ * describe the default layout then, the values are accessed by the macros below.
+ */
+struct QAJ4C_Value {
+    uint64_t bits;
+} QAJ4C_ALIGN;
+#else
 struct QAJ4C_Value {
 	char padding[QAJ4C_MAX(sizeof(uint32_t), sizeof(uintptr_t)) + sizeof(size_type)];
     size_type type;
 } QAJ4C_ALIGN; /* minimal 3 * 4 Byte = 12, at 64 Bit 16 Byte */
+#endif
 
 struct QAJ4C_Member {
     QAJ4C_Value key;
     QAJ4C_Value value;
 };
 
+/*
+ * Header in front of the elements of growable arrays and objects. With QAJ4C_COMPACT_VALUES all
+ * non-empty arrays and objects have it, as the value only holds the pointer to the elements (the
+ * capacity is 0 for arrays and objects that are not growable).
+ */
+typedef struct QAJ4C_Growable_header {
+    size_type capacity; /* in elements (values of an array or members of an object) */
+#ifdef QAJ4C_COMPACT_VALUES
+    size_type count;
+#else
+    char padding[sizeof(QAJ4C_Value) - sizeof(size_type)];
+#endif
+} QAJ4C_ALIGN QAJ4C_Growable_header;
+
+#ifdef QAJ4C_COMPACT_VALUES
+
+#define QAJ4C_COMPACT_BOXED ((uint64_t)0xFFF9 << 48)
+#define QAJ4C_COMPACT_PAYLOAD_MASK (((uint64_t)1 << 48) - 1)
+#define QAJ4C_COMPACT_CANONICAL_NAN ((uint64_t)0x7FF8 << 48)
+#define QAJ4C_COMPACT_BOX(tag, payload) (((uint64_t)(0xFFF8 + (tag)) << 48) | (uint64_t)(payload))
+#define QAJ4C_COMPACT_TAG(bits) ((unsigned)((bits) >> 48) - 0xFFF8)
+
+#define QAJ4C_COMPACT_TAG_CONST 1 /* payload 0 is null, 1 false and 2 true */
+#define QAJ4C_COMPACT_TAG_INT 2 /* integer within [-2^47, 2^47) */
+#define QAJ4C_COMPACT_TAG_BIG_INT 3 /* pointer to the 8 bytes of the integer, the lowest bit marks uint64 */
+#define QAJ4C_COMPACT_TAG_STRING 4 /* pointer to the chars, the length (size_type) precedes them */
+#define QAJ4C_COMPACT_TAG_STRING_REF 5 /* pointer to the (\0 terminated) chars */
+#define QAJ4C_COMPACT_TAG_INLINE_STRING 6 /* up to 5 chars and the \0 within the payload */
+#define QAJ4C_COMPACT_TAG_CONTAINER 7 /* pointer to the elements, the lower 2 bits tell the kind */
+
+#define QAJ4C_COMPACT_KIND_ARRAY 0
+#define QAJ4C_COMPACT_KIND_OBJECT 1
+#define QAJ4C_COMPACT_KIND_OBJECT_SORTED 2
+#define QAJ4C_COMPACT_KIND_ERROR 3
+#define QAJ4C_COMPACT_KIND_MASK ((uint64_t)3)
+
+/* Values beyond this range require 8 bytes of storage on the builder */
+#define QAJ4C_COMPACT_INT_MIN (-((int64_t)1 << 47))
+#define QAJ4C_COMPACT_INT_MAX (((int64_t)1 << 47) - 1)
+
+/* The position of the inline chars within the payload */
+#if defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define QAJ4C_COMPACT_INLINE_OFFSET 2
+#else
+#define QAJ4C_COMPACT_INLINE_OFFSET 0
+#endif
+
+#define QAJ4C_CONTAINER_HEADER_SIZE sizeof(QAJ4C_Growable_header)
+#define QAJ4C_STRING_HEADER_SIZE sizeof(size_type)
+#define QAJ4C_TYPE_FLAGS_SUPPORTED 0 /* no key hashes, lookup indices, packed arrays or learned shapes */
+
+/*
+ * The (public and internal) type is looked up by the tag and the lowest two bits of the payload
+ * (the kind of a container, the constant), the hot accessors do not need the whole type word.
+ */
+#define QAJ4C_COMPACT_TYPE_INDEX(value_ptr) (QAJ4C_COMPACT_TAG((value_ptr)->bits) * 4 + (unsigned)((value_ptr)->bits & 3))
+#define QAJ4C_COMPACT_TYPE(value_ptr) ((value_ptr)->bits < QAJ4C_COMPACT_BOXED ? QAJ4C_TYPE_NUMBER : (QAJ4C_TYPE)QAJ4C_compact_types[QAJ4C_COMPACT_TYPE_INDEX(value_ptr)])
+#define QAJ4C_COMPACT_INTERNAL_TYPE(value_ptr) ((value_ptr)->bits < QAJ4C_COMPACT_BOXED ? QAJ4C_PRIMITIVE : (QAJ4C_INTERNAL_TYPE)QAJ4C_compact_internal_types[QAJ4C_COMPACT_TYPE_INDEX(value_ptr)])
+#define QAJ4C_COMPACT_ELEMENTS(value_ptr) ((void*)(uintptr_t)((value_ptr)->bits & QAJ4C_COMPACT_PAYLOAD_MASK & ~QAJ4C_COMPACT_KIND_MASK))
+#define QAJ4C_COMPACT_HEADER(value_ptr) ((QAJ4C_Growable_header*)QAJ4C_COMPACT_ELEMENTS(value_ptr) - 1)
+
+#define QAJ4C_TYPE_WORD(value_ptr) QAJ4C_compact_type_word(value_ptr)
+#define QAJ4C_SET_TYPE_WORD(value_ptr, type_word) QAJ4C_compact_set_type_word(value_ptr, type_word)
+#define QAJ4C_ARRAY_TOP(value_ptr) ((QAJ4C_Value*)QAJ4C_COMPACT_ELEMENTS(value_ptr))
+#define QAJ4C_OBJECT_TOP(value_ptr) ((QAJ4C_Member*)QAJ4C_COMPACT_ELEMENTS(value_ptr))
+#define QAJ4C_ARRAY_COUNT(value_ptr) (QAJ4C_COMPACT_HEADER(value_ptr)->count)
+#define QAJ4C_OBJECT_COUNT(value_ptr) (QAJ4C_COMPACT_HEADER(value_ptr)->count)
+#define QAJ4C_SET_ARRAY_COUNT(value_ptr, n) QAJ4C_compact_set_count(value_ptr, n)
+#define QAJ4C_SET_OBJECT_COUNT(value_ptr, n) QAJ4C_compact_set_count(value_ptr, n)
+#define QAJ4C_SET_ARRAY(value_ptr, type_word, elements, n) QAJ4C_compact_set_container(value_ptr, type_word, elements, n)
+#define QAJ4C_SET_OBJECT(value_ptr, type_word, elements, n) QAJ4C_compact_set_container(value_ptr, type_word, elements, n)
+#define QAJ4C_ARRAY_VIEW(value_ptr) QAJ4C_compact_array_view(value_ptr, &(QAJ4C_Array){NULL, 0, {0}})
+#define QAJ4C_OBJECT_VIEW(value_ptr) QAJ4C_compact_object_view(value_ptr, &(QAJ4C_Object){NULL, 0, {0}})
+#define QAJ4C_STRING_CHARS(value_ptr) (QAJ4C_COMPACT_TAG((value_ptr)->bits) == QAJ4C_COMPACT_TAG_INLINE_STRING ? (const char*)&(value_ptr)->bits + QAJ4C_COMPACT_INLINE_OFFSET : (const char*)(uintptr_t)((value_ptr)->bits & QAJ4C_COMPACT_PAYLOAD_MASK))
+#define QAJ4C_STRING_LENGTH(value_ptr) QAJ4C_compact_string_length(value_ptr)
+#define QAJ4C_SET_STRING(value_ptr, type_word, str, n) QAJ4C_compact_set_string(value_ptr, type_word, str, n)
+#define QAJ4C_SET_INLINE_STRING(value_ptr, str, n) QAJ4C_compact_set_string(value_ptr, QAJ4C_INLINE_STRING_TYPE_CONSTANT, str, n)
+#define QAJ4C_PLAIN_PRIMITIVE_DATA(value_ptr) QAJ4C_compact_primitive_data(value_ptr)
+#define QAJ4C_PRIMITIVE_DATA(value_ptr) QAJ4C_compact_primitive_data(value_ptr)
+#define QAJ4C_PRIMITIVE_STORAGE_SIZE(value_ptr) (QAJ4C_COMPACT_TAG((value_ptr)->bits) == QAJ4C_COMPACT_TAG_BIG_INT ? sizeof(uint64_t) : 0)
+#define QAJ4C_COPY_PRIMITIVE(src, dest, builder) QAJ4C_compact_copy_primitive(src, dest, builder)
+#define QAJ4C_ERROR_INFO(value_ptr) ((QAJ4C_Error_information*)QAJ4C_COMPACT_ELEMENTS(value_ptr))
+#define QAJ4C_SET_ERROR(value_ptr, info) QAJ4C_compact_set_container(value_ptr, QAJ4C_ERROR_DESCRIPTION_TYPE_CONSTANT, info, 0)
+
+#else
+
+#define QAJ4C_CONTAINER_HEADER_SIZE 0
+#define QAJ4C_STRING_HEADER_SIZE 0
+/*
+ * The type word can carry flags and tags besides the type (key hashes, lookup indices, packed
+ * arrays and learned shapes). The compact values have no room for them.
+ */
+#define QAJ4C_TYPE_FLAGS_SUPPORTED 1
+
+/*
+ * Accessors of the fields of the values (the compact layout decodes and encodes the fields
+ * instead, see QAJ4C_COMPACT_VALUES).
+ */
+#define QAJ4C_TYPE_WORD(value_ptr) ((value_ptr)->type)
+#define QAJ4C_SET_TYPE_WORD(value_ptr, type_word) ((value_ptr)->type = (type_word))
+#define QAJ4C_ARRAY_TOP(value_ptr) (((const QAJ4C_Array*)(value_ptr))->top)
+#define QAJ4C_OBJECT_TOP(value_ptr) (((const QAJ4C_Object*)(value_ptr))->top)
+#define QAJ4C_ARRAY_COUNT(value_ptr) (((const QAJ4C_Array*)(value_ptr))->count)
+#define QAJ4C_OBJECT_COUNT(value_ptr) (((const QAJ4C_Object*)(value_ptr))->count)
+#define QAJ4C_SET_ARRAY_COUNT(value_ptr, n) (((QAJ4C_Array*)(value_ptr))->count = (n))
+#define QAJ4C_SET_OBJECT_COUNT(value_ptr, n) (((QAJ4C_Object*)(value_ptr))->count = (n))
+#define QAJ4C_SET_ARRAY(value_ptr, type_word, elements, n) ((value_ptr)->type = (type_word), ((QAJ4C_Array*)(value_ptr))->top = (elements), ((QAJ4C_Array*)(value_ptr))->count = (n))
+#define QAJ4C_SET_OBJECT(value_ptr, type_word, elements, n) ((value_ptr)->type = (type_word), ((QAJ4C_Object*)(value_ptr))->top = (elements), ((QAJ4C_Object*)(value_ptr))->count = (n))
+#define QAJ4C_ARRAY_VIEW(value_ptr) ((QAJ4C_Array*)(value_ptr))
+#define QAJ4C_OBJECT_VIEW(value_ptr) ((QAJ4C_Object*)(value_ptr))
+#define QAJ4C_STRING_CHARS(value_ptr) (((QAJ4C_TYPE_WORD(value_ptr) >> 8) & 0xFF) == QAJ4C_INLINE_STRING ? ((const QAJ4C_Short_string*)(value_ptr))->s : ((const QAJ4C_String*)(value_ptr))->s)
+#define QAJ4C_STRING_LENGTH(value_ptr) (((QAJ4C_TYPE_WORD(value_ptr) >> 8) & 0xFF) == QAJ4C_INLINE_STRING ? (size_type)((const QAJ4C_Short_string*)(value_ptr))->count : ((const QAJ4C_String*)(value_ptr))->count)
+#define QAJ4C_SET_STRING(value_ptr, type_word, str, n) ((value_ptr)->type = (type_word), ((QAJ4C_String*)(value_ptr))->s = (str), ((QAJ4C_String*)(value_ptr))->count = (n))
+#define QAJ4C_SET_INLINE_STRING(value_ptr, str, n) ((value_ptr)->type = QAJ4C_INLINE_STRING_TYPE_CONSTANT, ((QAJ4C_Short_string*)(value_ptr))->count = (uint8_t)(n), QAJ4C_MEMCPY(((QAJ4C_Short_string*)(value_ptr))->s, (str), (n)), ((QAJ4C_Short_string*)(value_ptr))->s[n] = '\0')
+#define QAJ4C_PLAIN_PRIMITIVE_DATA(value_ptr) (((const QAJ4C_Primitive*)(value_ptr))->data)
+#define QAJ4C_PRIMITIVE_STORAGE_SIZE(value_ptr) 0
+#define QAJ4C_COPY_PRIMITIVE(src, dest, builder) (*(dest) = *(src))
+#define QAJ4C_ERROR_INFO(value_ptr) (((const QAJ4C_Error*)(value_ptr))->info)
+#define QAJ4C_SET_ERROR(value_ptr, err_info) ((value_ptr)->type = QAJ4C_ERROR_DESCRIPTION_TYPE_CONSTANT, ((QAJ4C_Error*)(value_ptr))->info = (err_info))
+
+#endif
+
+/*
+ * Header of a chunk of a growing builder, the values and strings of the chunk follow the header.
+ */
+struct QAJ4C_Builder_chunk {
+    struct QAJ4C_Builder_chunk* next; /* chunks are linked in allocation order */
+    size_t size;
+} QAJ4C_ALIGN;
+typedef struct QAJ4C_Builder_chunk QAJ4C_Builder_chunk;
+
+/**
+ * Allocator that forwards to a realloc (and free) method. Used to support the realloc based API.
+ */
+typedef struct QAJ4C_Realloc_adapter {
+    QAJ4C_Allocator allocator;
+    QAJ4C_realloc_fn realloc_callback;
+    QAJ4C_free_fn free_callback;
+} QAJ4C_Realloc_adapter;
+
 extern QAJ4C_fatal_error_fn g_qaj4c_err_function;
+extern QAJ4C_THREAD_LOCAL QAJ4C_fatal_error_fn g_qaj4c_thread_err_function;
+
+void QAJ4C_raise_fatal_error( void );
 
 void QAJ4C_std_err_function( void );
-size_t QAJ4C_parse_generic( QAJ4C_Builder* builder, const char* json, size_t json_len, int opts, const QAJ4C_Value** result_ptr, QAJ4C_realloc_fn realloc_callback );
+const QAJ4C_Allocator* QAJ4C_std_allocator_impl( void );
+void QAJ4C_realloc_adapter_init( QAJ4C_Realloc_adapter* me, QAJ4C_realloc_fn realloc_callback, QAJ4C_free_fn free_callback );
+void* QAJ4C_allocator_realloc( const QAJ4C_Allocator* allocator, void* ptr, size_t size );
+const QAJ4C_Allocator* QAJ4C_parser_get_allocator( QAJ4C_Parser* me, QAJ4C_Realloc_adapter* adapter );
+
+size_t QAJ4C_parse_generic( QAJ4C_Builder* builder, const char* json, size_t json_len, int opts, const QAJ4C_Parse_limits* limits, const QAJ4C_Value** result_ptr, const QAJ4C_Allocator* allocator );
 size_t QAJ4C_calculate_max_buffer_generic( const char* json, size_t json_len, int opts );
+const QAJ4C_Value* QAJ4C_parser_parse_generic( QAJ4C_Parser* me, const char* json, size_t json_len, int opts );
+void QAJ4C_incremental_parse_init_generic( QAJ4C_Incremental_parser* parser, const char* json, size_t json_len, int opts, void* buffer, size_t buffer_size );
+void QAJ4C_incremental_parse_set_limits_generic( QAJ4C_Incremental_parser* parser, const QAJ4C_Parse_limits* limits );
+QAJ4C_PARSE_STATUS QAJ4C_incremental_parse_step_generic( QAJ4C_Incremental_parser* parser, size_t max_bytes, size_t max_nodes, const QAJ4C_Value** result_ptr );
 
+bool QAJ4C_builder_add_chunk( QAJ4C_Builder* builder, size_t size );
+void QAJ4C_builder_free_chunks( QAJ4C_Builder* builder, bool keep_first );
 QAJ4C_Value* QAJ4C_builder_pop_values( QAJ4C_Builder* builder, size_type count );
 char* QAJ4C_builder_pop_string( QAJ4C_Builder* builder, size_type length );
 QAJ4C_Member* QAJ4C_builder_pop_members( QAJ4C_Builder* builder, size_type count );
+void QAJ4C_set_packed_array( QAJ4C_Value* value_ptr, const void* values, size_type count, uintptr_t tag, QAJ4C_Builder* builder );
+void* QAJ4C_builder_pop_growable( QAJ4C_Builder* builder, size_type capacity, size_t element_size );
+void* QAJ4C_builder_grow( QAJ4C_Builder* builder, void* top, size_type count, size_t element_size );
+QAJ4C_Member* QAJ4C_object_append_member( QAJ4C_Value* value_ptr, QAJ4C_Builder* builder );
+
+void QAJ4C_set_int64_impl( QAJ4C_Value* value_ptr, int64_t value, QAJ4C_Builder* builder );
+void QAJ4C_set_uint64_impl( QAJ4C_Value* value_ptr, uint64_t value, QAJ4C_Builder* builder );
+
+#ifdef QAJ4C_COMPACT_VALUES
+extern const uint8_t QAJ4C_compact_types[32];
+extern const uint8_t QAJ4C_compact_internal_types[32];
+
+size_type QAJ4C_compact_type_word( const QAJ4C_Value* value_ptr );
+void QAJ4C_compact_set_type_word( QAJ4C_Value* value_ptr, size_type type_word );
+void QAJ4C_compact_set_count( QAJ4C_Value* value_ptr, size_type count );
+void QAJ4C_compact_set_container( QAJ4C_Value* value_ptr, size_type type_word, void* elements, size_type count );
+QAJ4C_Array* QAJ4C_compact_array_view( const QAJ4C_Value* value_ptr, QAJ4C_Array* view );
+QAJ4C_Object* QAJ4C_compact_object_view( const QAJ4C_Value* value_ptr, QAJ4C_Object* view );
+size_type QAJ4C_compact_string_length( const QAJ4C_Value* value_ptr );
+void QAJ4C_compact_set_string( QAJ4C_Value* value_ptr, size_type type_word, const char* str, size_type len );
+union primitive QAJ4C_compact_primitive_data( const QAJ4C_Value* value_ptr );
+void QAJ4C_compact_copy_primitive( const QAJ4C_Value* src, QAJ4C_Value* dest, QAJ4C_Builder* builder );
+#endif
 
 uint8_t QAJ4C_get_storage_type( const QAJ4C_Value* value_ptr );
 uint8_t QAJ4C_get_compatibility_types( const QAJ4C_Value* value_ptr );
 QAJ4C_INTERNAL_TYPE QAJ4C_get_internal_type( const QAJ4C_Value* value_ptr );
-
-const QAJ4C_Value* QAJ4C_object_get_unsorted( QAJ4C_Object* obj_ptr, QAJ4C_Value* str_ptr );
-const QAJ4C_Value* QAJ4C_object_get_sorted( QAJ4C_Object* obj_ptr, QAJ4C_Value* str_ptr );
+size_type QAJ4C_int64_type_constant( int64_t value );
+size_type QAJ4C_uint64_type_constant( uint64_t value );
+
+uintptr_t QAJ4C_packed_array_tag( const QAJ4C_Value* value_ptr );
+const QAJ4C_Value* QAJ4C_packed_array_get( const QAJ4C_Value* value_ptr, size_type index );
+void QAJ4C_packed_element_unpack( const QAJ4C_Value* element_ptr, QAJ4C_Value* dest );
+size_t QAJ4C_array_copy_impl( const QAJ4C_Value* value_ptr, void* out, size_t n, uint8_t primitive_type );
+
+uint32_t QAJ4C_hash_string( const char* str, size_type len );
+void QAJ4C_set_key_hash( QAJ4C_Value* value_ptr, uint32_t hash );
+uint16_t QAJ4C_get_key_hash( const QAJ4C_Value* value_ptr );
+
+size_type QAJ4C_object_index_flags( int opts, size_type count );
+size_t QAJ4C_object_index_size( size_type flags, size_type count );
+void QAJ4C_object_index_init( QAJ4C_Value* value_ptr, size_type flags );
+
+const QAJ4C_Value* QAJ4C_object_get_hashed( const QAJ4C_Value* value_ptr, const char* str, size_type len, uint32_t hash );
+const QAJ4C_Value* QAJ4C_object_get_shaped( const QAJ4C_Value* value_ptr, const char* str, size_type len, uint16_t hash );
+const QAJ4C_Member* QAJ4C_object_shape_keys( const QAJ4C_Value* value_ptr );
+const QAJ4C_Member* QAJ4C_shaped_object_get_member( const QAJ4C_Value* value_ptr, size_type index );
+const QAJ4C_Value* QAJ4C_shaped_member_get_key( const QAJ4C_Member* member );
+const QAJ4C_Value* QAJ4C_shaped_member_get_value( const QAJ4C_Member* member );
+const QAJ4C_Value* QAJ4C_object_get_cached( const QAJ4C_Value* value_ptr, const char* str, size_type len, uint32_t hash, size_t* last_index );
+const QAJ4C_Value* QAJ4C_object_get_unsorted( QAJ4C_Object* obj_ptr, const char* str, size_type len, uint16_t hash );
+void QAJ4C_object_get_many_impl( const QAJ4C_Value* value_ptr, const char* keys[], size_t count, const QAJ4C_Value* result[] );
+size_t QAJ4C_array_column_numbers_impl( const QAJ4C_Value* array_ptr, QAJ4C_Key* key, void* out, uint8_t primitive_type, size_t n, uint8_t* nulls );
+size_t QAJ4C_array_column_strings_impl( const QAJ4C_Value* array_ptr, QAJ4C_Key* key, const char** strings, size_t* lengths, size_t n, uint8_t* nulls );
+const QAJ4C_Value* QAJ4C_object_search_sorted( const QAJ4C_Object* obj_ptr, const size_type* perm, const char* str, size_type len, uint16_t hash );
+const QAJ4C_Value* QAJ4C_object_get_indexed( QAJ4C_Object* obj_ptr, const char* str, size_type len, uint32_t hash );
 
 int QAJ4C_strcmp( const QAJ4C_Value* lhs, const QAJ4C_Value* rhs );
+int QAJ4C_strcmp_n( const QAJ4C_Value* lhs, const char* str, size_type len );
 int QAJ4C_compare_members( const void* lhs, const void * rhs );
+void QAJ4C_sort_members( QAJ4C_Member* top, size_type count );
 
 size_t QAJ4C_sprint_impl( const QAJ4C_Value* value_ptr, char* buffer, size_t buffer_size, size_t index );
 bool QAJ4C_print_buffer_callback_impl( const QAJ4C_Value* value_ptr, QAJ4C_print_buffer_callback_fn callback, void* ptr );
@@ -72,7 +72,12 @@
 #define QAJ4C_STRLEN strlen
 #define QAJ4C_MEMCMP memcmp
 #define QAJ4C_MEMMOVE memmove
+#define QAJ4C_MEMCHR memchr
 #define QAJ4C_MEMCPY memcpy
+#define QAJ4C_MEMSET memset
+#define QAJ4C_MALLOC malloc
+#define QAJ4C_REALLOC realloc
+#define QAJ4C_FREE free
 
 #ifndef _WIN32
 #define QAJ4C_SNPRINTF snprintf
@@ -88,9 +93,31 @@
 #error "Invalid word size detected!"
 #endif
 
+/* Thread local storage (the fatal error function can be registered per thread) */
+#ifndef QAJ4C_THREAD_LOCAL
+#if defined(__STDC_VERSION__) && (__STDC_VERSION__ >= 201112L) && !defined(__STDC_NO_THREADS__)
+#define QAJ4C_THREAD_LOCAL _Thread_local
+#elif defined(__GNUC__)
+#define QAJ4C_THREAD_LOCAL __thread
+#elif defined(_MSC_VER)
+#define QAJ4C_THREAD_LOCAL __declspec(thread)
+#else
+#error "No thread local storage available, please define QAJ4C_THREAD_LOCAL"
+#endif
+#endif
+
+/* Atomic operations on 32 bit values (used to publish lazily built object indices) */
+#ifndef QAJ4C_ATOMIC_LOAD_ACQUIRE
+#if defined(__GNUC__)
+#define QAJ4C_ATOMIC_LOAD_ACQUIRE(ptr) __atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+#define QAJ4C_ATOMIC_STORE_RELEASE(ptr, value) __atomic_store_n(ptr, value, __ATOMIC_RELEASE)
+#define QAJ4C_ATOMIC_CAS(ptr, expected, desired) __sync_bool_compare_and_swap(ptr, expected, desired)
+#else
+#error "No atomic operations available, please define QAJ4C_ATOMIC_LOAD_ACQUIRE, QAJ4C_ATOMIC_STORE_RELEASE and QAJ4C_ATOMIC_CAS"
+#endif
+#endif
+
 #define QAJ4C_STRTOD strtod
-#define QAJ4C_QSORT qsort
-#define QAJ4C_BSEARCH bsearch
 #define QAJ4C_RAISE raise
 
 #endif